@@ -39,7 +39,7 @@ Item {
             onClicked: {
                 cliButtons.fileDialogType = "loadState"
                 loadDialog.title = "Load Turtle State"
-                loadDialog.nameFilters = ["Text Files (*.txt)", "All Files (*)"]
+                loadDialog.nameFilters = ["Turtle States (*.tgs)", "Text Files (*.txt)", "All Files (*)"]
                 loadDialog.open()
             }
         }
@@ -6,24 +6,17 @@ import ParserModule
 import CLIModule 1.0
 import SaveLoadManagerModule
 import CanvasModule as CanvasControl
+import ProfilingModule
 
 Window {
     id: mainWindow
     minimumWidth: 900
     minimumHeight: 1000
-    maximumHeight: minimumHeight
-    maximumWidth: minimumWidth
     visible: true
     title: qsTr("Turtle Graphics")
 
-    onWidthChanged: {
-        canvas.should_clear_canvas = true;
-        canvas.requestPaint();
-    }
-    onHeightChanged: {
-        canvas.should_clear_canvas = true;
-        canvas.requestPaint();
-    }
+    onWidthChanged: obstacleCanvas.requestPaint()
+    onHeightChanged: obstacleCanvas.requestPaint()
 
     TurtleControl {
         id: turtleControl
@@ -33,21 +26,18 @@ Window {
         id: canvasControl
         width: canvas.width
         height: canvas.height - 10 // -10 so that the turtle can't go completely under the UI
-        onObstacles_changed: canvas.requestPaint()
+        bounded: false // the view can be panned and zoomed, obstacles still stop the turtle
+        onObstacles_changed: obstacleCanvas.requestPaint()
+        onObstacles_moved: obstacleCanvas.requestPaint()
     }
 
-    Canvas {
+    Item {
         id: canvas
         width: parent.width
         height: parent.height - topControlPanel.height - outputRect.height- controlPanel.height
         anchors.top: topControlPanel.bottom
         z: 0
-
-        // JavaScript is used here for convenience, as QML integrates it directly for UI updates,
-        // allowing dynamic rendering logic to remain close to the visual layer.
-
-        property int last_line_count: 0
-        property bool should_clear_canvas: false
+        clip: true
 
         Image {
             source: "resources/images/grid_background.png"
@@ -61,58 +51,131 @@ Window {
             z: -1
         }
 
-        onPaint: {
-            const ctx = canvas.getContext("2d");
+        // Lines drawn by the turtle, rasterized into cached tiles at the level of detail of the zoom
+        LineLayer {
+            id: lineLayer
+            anchors.fill: parent
+            turtle_control: turtleControl
+            onView_changed: obstacleCanvas.requestPaint()
+        }
+
+        // Obstacles are few, so they are redrawn as a whole when they or the view change
+        Canvas {
+            id: obstacleCanvas
+            anchors.fill: parent
+
+            // JavaScript is used here for convenience, as QML integrates it directly for UI updates,
+            // allowing dynamic rendering logic to remain close to the visual layer.
 
-            // Checks if a canvas reset is necessary
-            if (should_clear_canvas) {
+            onPaint: {
+                const ctx = obstacleCanvas.getContext("2d");
+                ctx.resetTransform();
                 ctx.clearRect(0, 0, width, height);
-                last_line_count = 0;
-                should_clear_canvas = false;
+                ctx.setTransform(lineLayer.zoom, 0, 0, lineLayer.zoom, lineLayer.pan.x, lineLayer.pan.y);
+
+                for (let i = 0; i < canvasControl.obstacle_count; i++) {
+                    const points = canvasControl.get_obstacle_points(i);
+                    const color = canvasControl.get_obstacle_color(i);
+
+                    if (points && points.length >= 6) {  // Need at least 3 points (6 coordinates)
+                        ctx.fillStyle = color;
+                        ctx.beginPath();
+                        ctx.moveTo(points[0], points[1]);
+                        for (let j = 2; j < points.length; j += 2) {
+                            ctx.lineTo(points[j], points[j + 1]);
+                        }
+                        ctx.closePath();
+                        ctx.fill();
+                    }
+                }
             }
+        }
 
-            // Draw the new lines since the last repaint
-            for (let i = last_line_count; i < turtleControl.line_count; i++) {
-                const line = turtleControl.get_line(i);
-                ctx.beginPath();
-                ctx.moveTo(line.start.x, line.start.y);
-                ctx.lineTo(line.end.x, line.end.y);
-                ctx.strokeStyle = line.color.toString();
-                ctx.lineWidth = line.width;
-                ctx.stroke();
+        // Drag to pan, scroll to zoom around the mouse and double-click to reset the view.
+        // Click a line to inspect it, shift-drag to erase the lines in a rectangle.
+        DragHandler {
+            target: null
+            acceptedModifiers: Qt.NoModifier
+            property point last_translation: Qt.point(0, 0)
+            onActiveChanged: last_translation = Qt.point(0, 0)
+            onTranslationChanged: {
+                lineLayer.pan_by(Qt.point(translation.x - last_translation.x, translation.y - last_translation.y));
+                last_translation = Qt.point(translation.x, translation.y);
             }
+        }
 
-            // Draw the obstacles
-            for (let i = 0; i < canvasControl.obstacle_count; i++) {
-                const points = canvasControl.get_obstacle_points(i);
-                const color = canvasControl.get_obstacle_color(i);
-
-                if (points && points.length >= 6) {  // Need at least 3 points (6 coordinates)
-                    ctx.fillStyle = color;
-                    ctx.beginPath();
-                    ctx.moveTo(points[0], points[1]);
-                    for (let j = 2; j < points.length; j += 2) {
-                        ctx.lineTo(points[j], points[j + 1]);
-                    }
-                    ctx.closePath();
-                    ctx.fill();
+        WheelHandler {
+            target: null
+            onWheel: (event) => lineLayer.zoom_at(Qt.point(event.x, event.y), Math.pow(2, event.angleDelta.y / 480))
+        }
+
+        TapHandler {
+            onDoubleTapped: lineLayer.reset_view()
+            onTapped: (eventPoint) => {
+                canvas.selected_line = turtleControl.line_at(lineLayer.map_to_drawing(eventPoint.position),
+                                                             4 / lineLayer.zoom)
+            }
+        }
+
+        Rectangle {
+            id: eraseBand
+            visible: eraseHandler.active
+            color: "#304080ff"
+            border.color: "#4080ff"
+        }
+
+        DragHandler {
+            id: eraseHandler
+            target: null
+            acceptedModifiers: Qt.ShiftModifier
+            onCentroidChanged: {
+                if (!active)
+                    return;
+                const start = centroid.pressPosition;
+                const end = centroid.position;
+                eraseBand.x = Math.min(start.x, end.x);
+                eraseBand.y = Math.min(start.y, end.y);
+                eraseBand.width = Math.abs(end.x - start.x);
+                eraseBand.height = Math.abs(end.y - start.y);
+            }
+            onActiveChanged: {
+                if (active) {
+                    eraseBand.width = 0;
+                    eraseBand.height = 0;
+                    return;
                 }
+                const topLeft = lineLayer.map_to_drawing(Qt.point(eraseBand.x, eraseBand.y));
+                turtleControl.erase_lines(Qt.rect(topLeft.x, topLeft.y,
+                                                  eraseBand.width / lineLayer.zoom, eraseBand.height / lineLayer.zoom));
+            }
+        }
+
+        property int selected_line: -1
+
+        Text {
+            id: selectedLineText
+            anchors.left: parent.left
+            anchors.bottom: parent.bottom
+            anchors.margins: 6
+            visible: canvas.selected_line >= 0 && canvas.selected_line < turtleControl.line_count
+            text: {
+                if (!visible)
+                    return "";
+                const line = turtleControl.get_line(canvas.selected_line);
+                return "Line " + canvas.selected_line + ": (" + Math.round(line.start.x) + ", " + Math.round(line.start.y)
+                       + ") - (" + Math.round(line.end.x) + ", " + Math.round(line.end.y) + "), color " + line.color
+                       + ", width " + line.width;
             }
-            last_line_count = turtleControl.line_count;
+            font.pixelSize: 12
         }
 
         Turtle {
             id: turtle
-            x: turtleControl.position.x - width / 2
-            y: turtleControl.position.y - height / 2
+            x: turtleControl.position.x * lineLayer.zoom + lineLayer.pan.x - width / 2
+            y: turtleControl.position.y * lineLayer.zoom + lineLayer.pan.y - height / 2
             rotation: turtleControl.rotation
         }
 
-        Connections {
-            target: turtleControl
-            function onLines_changed() { canvas.requestPaint() }
-        }
-
         Connections {
             target: turtle
             function onClicked() { turtleControl.on_clicked() }
@@ -137,34 +200,48 @@ Window {
 
     Component.onCompleted: {
         // Setting values after initialization
+        parser.set_motion_batching(true);
         cli.setParser(parser);
+        cli.setTurtleControl(turtleControl);
+        cli.setCanvas(canvasControl);
+        cli.enableScriptCache();
         turtleControl.set_canvas(canvasControl);
         stateManager.setTurtleControl(turtleControl); // Set TurtleControl after initialization
         stateManager.setMainWindow(mainWindow); // Set MainWindow after initialization
         stateManager.setCLI(cli); // Set CLI after initialization
+        if (commandServerName !== "")
+            cli.startServer(commandServerName);
     }
 
     property string savePromptTitle: ""
 
+    Connections { // Connection from Turtle to Parser to report conclusion of animation
+        target: turtleControl
+        function onOn_movement_completed(movement_result) {parser.animation_done()}
+    }
 
-    property int commandCount: 0
-
-    Connections {
+    Connections { // Undo steps of the CLI
         target: cli
-        function onOutputChanged() {
-            commandCount += 1;
-            if (commandCount >= 5) {
-                commandCount = 0;
-                cli.clearOutput()// Clear the output area
-            } else {
-                outputArea.text = cli.getOutput();  // Display the output
-            }
-        }
+        function onCheckpointRequested() { turtleControl.mark_checkpoint() }
+        function onUndoRequested() { turtleControl.undo() }
+        function onRedoRequested() { turtleControl.redo() }
     }
 
-    Connections { // Connection from Turtle to Parser to report conclusion of animation
-        target: turtleControl
-        function onOn_movement_completed(movement_result) {parser.animation_done()}
+    Shortcut {
+        sequence: StandardKey.Undo
+        enabled: turtleControl.can_undo
+        onActivated: turtleControl.undo()
+    }
+
+    Shortcut {
+        sequence: StandardKey.Redo
+        enabled: turtleControl.can_redo
+        onActivated: turtleControl.redo()
+    }
+
+    Shortcut {
+        sequence: "F5"
+        onActivated: cli.rerunScript()
     }
 
     Connections { // Connections from Parser to Turtle
@@ -181,6 +258,9 @@ Window {
 
         function onUp() { turtleControl.set_pen_down(false) }
         function onDown() { turtleControl.set_pen_down(true) }
+        function onPush_state() { turtleControl.push_state() }
+        function onPop_state() { turtleControl.pop_state() }
+        function onMotion_batch(batch) { turtleControl.run_motion_batch(batch) }
     }
 
     // Bottom control panel
@@ -189,11 +269,7 @@ Window {
         turtleControl: turtleControl
         cli: cli
         anchors.bottom: parent.bottom
-        onResetCanvas: {
-            canvas.should_clear_canvas = true
-            canvasControl.clear_obstacles()
-            canvas.requestPaint()
-        }
+        onResetCanvas: canvasControl.clear_obstacles() // the line layer follows the turtle's lines
     }
 
     // Top control panel
@@ -227,11 +303,22 @@ Window {
         font.pixelSize: 12
     }
 
+    Text {
+        id: statsText
+        anchors.left: parent.left
+        anchors.top: infoText.bottom
+        leftPadding: 6
+        topPadding: 4
+        z: 2
+        text: PerfStats.summary
+        color: "#606060"
+        font.pixelSize: 10
+    }
+
     ObstacleControls {
         id: obstacleControls
         canvasControl: canvasControl
         turtleControl: turtleControl
-        canvas: canvas
         anchors.left: infoText.right
         z: 2
     }
@@ -243,9 +330,6 @@ Window {
         z: 2
         cli: cli
         stateManager: stateManager
-        onResetCanvas: {
-            canvas.should_clear_canvas = true
-        }
     }
 
     // Output box
@@ -259,14 +343,21 @@ Window {
         border.color: "gray"
         border.width: 1
 
-        Text {
+        // Only the rows added to the output log are created, older rows scroll out of view
+        ListView {
             id: outputArea
             anchors.fill: parent
-            wrapMode: Text.Wrap
-            text: cli.getOutput()  // Bind text to CLI output
-            color: "blue"
-            font.pixelSize: 14
             anchors.margins: 10
+            clip: true
+            model: cli.outputModel
+            delegate: Text {
+                width: ListView.view.width
+                wrapMode: Text.Wrap
+                text: model.message
+                color: "blue"
+                font.pixelSize: 14
+            }
+            onCountChanged: positionViewAtEnd()
         }
     }
 }
@@ -1,5 +1,6 @@
 import QtQuick
 import QtQuick.Controls
+import QtQuick.Dialogs
 
 Row {
     id: obstacleControls
@@ -10,7 +11,6 @@ Row {
 
     property var canvasControl
     property var turtleControl
-    property var canvas
 
     Button {
         text: "Generate Obstacles"
@@ -21,13 +21,39 @@ Row {
         }
     }
 
+    Button {
+        text: "Load Obstacles"
+        width: 110
+        height: 40
+        onClicked: obstacleMapDialog.open()
+    }
+
     Button {
         text: "Clear Obstacles"
         width: 100
         height: 40
         onClicked: {
             obstacleControls.canvasControl.clear_obstacles()
-            obstacleControls.canvas.should_clear_canvas = true
         }
     }
+
+    CheckBox {
+        text: "Moving"
+        height: 40
+        onToggled: obstacleControls.canvasControl.randomize_motion(checked ? 80 : 0, checked ? 45 : 0)
+    }
+
+    CheckBox {
+        text: "Self-collision"
+        height: 40
+        checked: obstacleControls.turtleControl.self_collision
+        onToggled: obstacleControls.turtleControl.self_collision = checked
+    }
+
+    FileDialog {
+        id: obstacleMapDialog
+        title: "Load Obstacle Map"
+        nameFilters: ["Obstacle Maps (*.txt *.json *.svg)", "All Files (*)"]
+        onAccepted: obstacleControls.canvasControl.load_obstacles(selectedFile)
+    }
 }
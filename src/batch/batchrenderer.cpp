@@ -0,0 +1,144 @@
+#include "batchrenderer.hpp"
+#include <QAtomicInt>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QThreadPool>
+#include "canvas.hpp"
+#include "linepainter.h"
+#include "parser.hpp"
+#include "SaveLoadManager.hpp"
+#include "turtlecontrol.h"
+
+// Stack size of the rendering threads, deep recursion in scripts needs more than some platforms' defaults
+constexpr uint RENDER_THREAD_STACK_SIZE = 8 * 1024 * 1024;
+
+BatchRenderer::BatchRenderer(const BatchOptions &options)
+    : options_(options) {}
+
+bool BatchRenderer::renderScript(const QString &scriptPath, QString &message) const {
+    QFile script(scriptPath);
+    if (!script.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        message = "Failed to open file: " + scriptPath;
+        return false;
+    }
+
+    Canvas canvas;
+    canvas.set_width(options_.canvasSize.width());
+    canvas.set_height(options_.canvasSize.height());
+
+    TurtleControl turtleControl;
+    turtleControl.set_realtime(false); // movements complete as soon as they are issued
+    turtleControl.set_canvas(&canvas);
+
+    // Connections from Parser to Turtle, as in Main.qml
+    Parser parser;
+    QObject::connect(&parser, &Parser::setspeed, &turtleControl, &TurtleControl::set_speed);
+    QObject::connect(&parser, &Parser::setsize, &turtleControl, &TurtleControl::set_pen_radius);
+    QObject::connect(&parser, &Parser::setcolor, &turtleControl, &TurtleControl::set_pen_color);
+    QObject::connect(&parser, &Parser::forward, &turtleControl, &TurtleControl::forward);
+    QObject::connect(&parser, &Parser::turn, &turtleControl, &TurtleControl::turn);
+    QObject::connect(&parser, &Parser::arc, &turtleControl, &TurtleControl::arc);
+    QObject::connect(&parser, &Parser::setpos, &turtleControl, &TurtleControl::set_position);
+    QObject::connect(&parser, &Parser::setrot, &turtleControl, &TurtleControl::set_rotation);
+    QObject::connect(&parser, &Parser::up, &turtleControl, [&turtleControl]() { turtleControl.set_pen_down(false); });
+    QObject::connect(&parser, &Parser::down, &turtleControl, [&turtleControl]() { turtleControl.set_pen_down(true); });
+    QObject::connect(&parser, &Parser::push_state, &turtleControl, &TurtleControl::push_state);
+    QObject::connect(&parser, &Parser::pop_state, &turtleControl, &TurtleControl::pop_state);
+    QObject::connect(&parser, &Parser::motion_batch, &turtleControl, &TurtleControl::run_motion_batch);
+    parser.set_motion_batching(true); // runs of movements are expanded at once
+
+    // Connection from Turtle to Parser to report the conclusion of a movement
+    QObject::connect(&turtleControl, &TurtleControl::on_movement_completed, &parser, &Parser::animation_done);
+
+    try {
+        if (parser.parse_script(script, [](const script::ExecutedCommand &) {}) == 0) {
+            message = "File is empty: " + scriptPath;
+            return false;
+        }
+    } catch (const std::exception &e) {
+        message = QString("Error in script %1: %2").arg(scriptPath, e.what());
+        return false;
+    }
+
+    const QDir outputDir(options_.outputFolder);
+    const QString baseName = QFileInfo(scriptPath).completeBaseName();
+    const QVector<Line> lines = turtleControl.get_lines();
+    QStringList written;
+
+    if (options_.b_png) {
+        const QString filePath = outputDir.filePath(baseName + ".png");
+        if (!render_lines(lines, options_.canvasSize).save(filePath)) {
+            message = "Failed to save image: " + filePath;
+            return false;
+        }
+        written.append(filePath);
+    }
+
+    if (options_.b_svg) {
+        const QString filePath = outputDir.filePath(baseName + ".svg");
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)
+            || file.write(lines_to_svg(lines, options_.canvasSize).toUtf8()) < 0) {
+            message = "Failed to save drawing: " + filePath;
+            return false;
+        }
+        written.append(filePath);
+    }
+
+    if (options_.b_state) {
+        // SaveLoadManager appends the ".tgs" extension
+        SaveLoadManager stateManager;
+        stateManager.setBuildFolder(options_.outputFolder);
+        stateManager.setTurtleControl(&turtleControl);
+        stateManager.saveState(baseName + ".state");
+        written.append(outputDir.filePath(baseName + ".state.tgs"));
+    }
+
+    message = QString("%1: %2 lines -> %3").arg(scriptPath).arg(lines.size()).arg(written.join(", "));
+    return true;
+}
+
+int BatchRenderer::renderAll(const QStringList &paths, int threadCount) const {
+    // Expand directories to the scripts they contain
+    QStringList scripts;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (!info.isDir()) {
+            scripts.append(path);
+            continue;
+        }
+        const QFileInfoList entries = QDir(path).entryInfoList({"*.txt"}, QDir::Files, QDir::Name);
+        for (const QFileInfo &entry : entries) {
+            scripts.append(entry.filePath());
+        }
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(threadCount);
+    pool.setStackSize(RENDER_THREAD_STACK_SIZE);
+    QAtomicInt failures = 0;
+    QMutex outputMutex; // keeps the messages of concurrent jobs from interleaving
+
+    for (const QString &script : scripts) {
+        pool.start([this, script, &failures, &outputMutex]() {
+            QString message;
+            const bool b_success = renderScript(script, message);
+            if (!b_success) {
+                failures.fetchAndAddRelaxed(1);
+            }
+
+            QMutexLocker locker(&outputMutex);
+            if (b_success) {
+                qInfo().noquote() << message;
+            } else {
+                qWarning().noquote() << message;
+            }
+        });
+    }
+    pool.waitForDone();
+
+    return failures.loadRelaxed();
+}
@@ -0,0 +1,64 @@
+#ifndef BATCHRENDERER_HPP
+#define BATCHRENDERER_HPP
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Outputs and canvas settings of a batch run.
+ */
+struct BatchOptions
+{
+    QString outputFolder = ".";   ///< Folder the output files are written to.
+    QSize canvasSize{900, 900};   ///< Size of the canvas and of the rendered images.
+    bool b_png = true;            ///< Write a PNG image of the drawing.
+    bool b_svg = false;           ///< Write an SVG drawing.
+    bool b_state = false;         ///< Write a state file that can be loaded by the application.
+};
+
+/**
+ * @class BatchRenderer
+ * @brief Runs turtle scripts without a user interface and writes the resulting drawings.
+ *
+ * Each script is executed by its own Parser, TurtleControl and Canvas, connected the same
+ * way Main.qml connects them, with the turtle in instant (non-realtime) mode. A renderer
+ * only holds its options, so scripts can be rendered from several threads at the same time.
+ */
+class BatchRenderer
+{
+public:
+    /**
+     * @brief Constructs a renderer.
+     * @param options The outputs and canvas settings.
+     */
+    explicit BatchRenderer(const BatchOptions &options);
+
+    /**
+     * @brief Executes a script and writes the selected outputs.
+     *
+     * Output files are named after the script: "<name>.png", "<name>.svg" and
+     * "<name>.state.txt".
+     *
+     * @param scriptPath The path of the script.
+     * @param message Receives a description of the result or of the error.
+     * @return True if the script was run and all outputs were written.
+     */
+    bool renderScript(const QString &scriptPath, QString &message) const;
+
+    /**
+     * @brief Renders scripts in parallel on a thread pool.
+     *
+     * Directories are expanded to the scripts (*.txt) they contain.
+     *
+     * @param paths Paths of scripts and directories of scripts.
+     * @param threadCount The maximum number of scripts rendered at the same time.
+     * @return The number of scripts that failed.
+     */
+    int renderAll(const QStringList &paths, int threadCount) const;
+
+private:
+    BatchOptions options_; ///< The outputs and canvas settings.
+};
+
+#endif // BATCHRENDERER_HPP
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QGuiApplication>
+#include <QThread>
+#include "batchrenderer.hpp"
+
+// Renders turtle scripts without opening a window, e.g.
+//   turtle-batch --format png,svg --output renders scripts/
+int main(int argc, char *argv[])
+{
+    // Images are rendered into QImages, no display is needed
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName("turtle-batch");
+
+    QCommandLineParser commandLine;
+    commandLine.setApplicationDescription("Runs turtle scripts headlessly and writes the drawings.");
+    commandLine.addHelpOption();
+    commandLine.addPositionalArgument("paths", "Scripts, or directories of scripts (*.txt), to render.", "<path>...");
+
+    const QCommandLineOption outputOption({"o", "output"}, "Folder for the output files.", "folder", ".");
+    const QCommandLineOption formatOption({"f", "format"}, "Comma-separated outputs: png, svg, state.", "formats", "png");
+    const QCommandLineOption widthOption("width", "Canvas width in pixels.", "pixels", "900");
+    const QCommandLineOption heightOption("height", "Canvas height in pixels.", "pixels", "900");
+    const QCommandLineOption jobsOption({"j", "jobs"}, "Number of scripts rendered in parallel.", "count",
+                                        QString::number(QThread::idealThreadCount()));
+    commandLine.addOptions({outputOption, formatOption, widthOption, heightOption, jobsOption});
+    commandLine.process(app);
+
+    const QStringList paths = commandLine.positionalArguments();
+    if (paths.isEmpty()) {
+        commandLine.showHelp(1);
+    }
+
+    BatchOptions options;
+    options.outputFolder = commandLine.value(outputOption);
+    options.canvasSize = QSize(commandLine.value(widthOption).toInt(), commandLine.value(heightOption).toInt());
+
+    const QStringList formats = commandLine.value(formatOption).split(',', Qt::SkipEmptyParts);
+    options.b_png = formats.contains("png");
+    options.b_svg = formats.contains("svg");
+    options.b_state = formats.contains("state");
+
+    if (options.canvasSize.isEmpty() || !(options.b_png || options.b_svg || options.b_state)) {
+        qCritical("Invalid canvas size or output format.");
+        return 1;
+    }
+    if (!QDir().mkpath(options.outputFolder)) {
+        qCritical() << "Failed to create output folder:" << options.outputFolder;
+        return 1;
+    }
+
+    const BatchRenderer renderer(options);
+    const int failures = renderer.renderAll(paths, std::max(1, commandLine.value(jobsOption).toInt()));
+    return failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,220 @@
+#include "benchmarks.hpp"
+#include <QBuffer>
+#include <QDir>
+#include <QRandomGenerator>
+#include <vector>
+#include "benchmarksuite.hpp"
+#include "canvas.hpp"
+#include "lineindex.h"
+#include "linepainter.h"
+#include "lodpyramid.h"
+#include "parser.hpp"
+#include "SaveLoadManager.hpp"
+#include "turtlecontrol.h"
+
+namespace {
+
+// Size of the canvas used by all benchmarks, as in the application
+constexpr int CANVAS_SIZE = 900;
+
+// Seed of the generated scripts and drawings, so every run measures the same input
+constexpr quint32 RANDOM_SEED = 42;
+
+// Movements of the turtle per iteration of the collision benchmark
+constexpr int COLLISION_MOVES = 200;
+
+// Statements of the generated scripts, like tests/generate_parser_testscript_fuzz.cpp uses
+const char *const SCRIPT_STATEMENTS[] = {
+    "x=77",
+    "x = add(5, 10)",
+    "x = (x * 3 + 1) % 101",
+    "up()",
+    "down()",
+    "forward(10)",
+    "forward(x % 17)",
+    "turn(90)",
+    "setrot(45)",
+    "setsize(2)",
+    "setpos(10, 20)",
+    "arc(5, 90)",
+    "setcolor(255, x, 0)",
+    "LOOP 3 { forward(5); turn(120) }",
+};
+
+// Single lines as typed into the CLI
+const char *const CLI_LINES[] = {
+    "forward(10)",
+    "turn(90); forward(20)",
+    "LOOP 4 { forward(10); turn(90) }",
+    "setcolor(255, 0, 0)",
+};
+
+// Generates a script with one statement per line
+QByteArray generateScript(int lineCount) {
+    QRandomGenerator random(RANDOM_SEED);
+    const int statementCount = sizeof(SCRIPT_STATEMENTS) / sizeof(SCRIPT_STATEMENTS[0]);
+
+    QByteArray script;
+    script.reserve(lineCount * 16);
+    for (int i = 0; i < lineCount; ++i) {
+        script += SCRIPT_STATEMENTS[random.bounded(statementCount)];
+        script += '\n';
+    }
+    return script;
+}
+
+// Generates a random walk of connected lines across the canvas
+QVector<Line> generateLines(int lineCount) {
+    QRandomGenerator random(RANDOM_SEED);
+    const QColor colors[] = {Qt::black, Qt::red, Qt::blue, Qt::darkGreen};
+
+    QVector<Line> lines;
+    lines.reserve(lineCount);
+    QPointF position(CANVAS_SIZE / 2.0, CANVAS_SIZE / 2.0);
+    for (int i = 0; i < lineCount; ++i) {
+        const QPointF end(random.bounded(double(CANVAS_SIZE)), random.bounded(double(CANVAS_SIZE)));
+        // Keep the lines short like turtle movements, by moving a tenth of the way
+        const QPointF next = position + (end - position) / 10.0;
+        lines.append(Line(position, next, colors[(i / 100) % 4], 1.f + (i / 1000) % 3));
+        position = next;
+    }
+    return lines;
+}
+
+// Parser whose movements complete at once, as if a non-realtime turtle was connected
+void completeMovements(Parser &parser) {
+    QObject::connect(&parser, &Parser::forward, &parser, &Parser::animation_done);
+    QObject::connect(&parser, &Parser::arc, &parser, &Parser::animation_done);
+}
+
+} // namespace
+
+void benchmarkParser(BenchmarkSuite &suite, const BenchmarkOptions &options) {
+    Parser parser;
+    completeMovements(parser);
+
+    // Lines are compiled and executed on every call
+    const int lineCount = sizeof(CLI_LINES) / sizeof(CLI_LINES[0]);
+    for (int i = 0; i < lineCount; ++i) {
+        const QString line = CLI_LINES[i];
+        suite.run(QString("parse_line/%1").arg(i), 1000, 1000, [&parser, &line]() {
+            for (int n = 0; n < 1000; ++n) {
+                parser.parse_line(line);
+            }
+        });
+    }
+
+    std::vector<int> scriptSizes = {1000, 100000};
+    if (!options.b_quick) {
+        scriptSizes.push_back(1000000);
+    }
+    for (int size : scriptSizes) {
+        if (!suite.isSelected("parse_script")) {
+            break;
+        }
+        QByteArray script = generateScript(size);
+        QBuffer buffer(&script);
+        buffer.open(QIODevice::ReadOnly);
+
+        // The commands are discarded, like scripts loaded into the CLI without history
+        suite.run("parse_script", size, size,
+                  [&parser, &buffer]() { parser.parse_script(buffer, [](const script::ExecutedCommand &) {}); },
+                  [&buffer]() { buffer.seek(0); });
+    }
+}
+
+void benchmarkCollision(BenchmarkSuite &suite, const BenchmarkOptions &options) {
+    std::vector<int> obstacleCounts = {0, 10, 100};
+    if (!options.b_quick) {
+        obstacleCounts.push_back(1000);
+    }
+
+    for (int count : obstacleCounts) {
+        Canvas canvas;
+        canvas.set_width(CANVAS_SIZE);
+        canvas.set_height(CANVAS_SIZE);
+        const QPointF center(CANVAS_SIZE / 2.0, CANVAS_SIZE / 2.0);
+
+        suite.run("generate_obstacles", count, count,
+                  [&canvas, count, center]() { canvas.generate_obstacles(count, center); },
+                  [&canvas]() { canvas.clear_obstacles(); });
+
+        if (!suite.isSelected("collision")) {
+            continue;
+        }
+        canvas.clear_obstacles();
+        canvas.generate_obstacles(count, center);
+
+        // Every movement is tested for collisions segment by segment
+        TurtleControl turtle;
+        turtle.set_realtime(false);
+        turtle.set_canvas(&canvas);
+        suite.run("collision", count, COLLISION_MOVES, [&turtle]() {
+            for (int i = 0; i < COLLISION_MOVES; ++i) {
+                turtle.forward(20.f);
+                turtle.turn(37.f);
+            }
+        }, [&turtle]() { turtle.reset_state(); });
+    }
+}
+
+void benchmarkPersistence(BenchmarkSuite &suite, const BenchmarkOptions &options) {
+    std::vector<int> lineCounts = {1000, 10000};
+    if (!options.b_quick) {
+        lineCounts.push_back(100000);
+    }
+
+    const QString fileName = "turtle-bench-state";
+    const QString filePath = QDir(QDir::tempPath()).filePath(fileName + ".tgs"); // saveState adds ".tgs"
+
+    for (int count : lineCounts) {
+        if (!suite.isSelected("save_state") && !suite.isSelected("load_state")) {
+            break;
+        }
+        TurtleControl turtle;
+        turtle.set_lines(generateLines(count));
+
+        SaveLoadManager stateManager;
+        stateManager.setBuildFolder(QDir::tempPath());
+        stateManager.setTurtleControl(&turtle);
+
+        suite.run("save_state", count, count, [&stateManager, &fileName]() { stateManager.saveState(fileName); });
+
+        // Loading replaces the lines, the file written above is read every time
+        stateManager.saveState(fileName);
+        suite.run("load_state", count, count, [&stateManager, &filePath]() { stateManager.loadState(filePath); });
+    }
+
+    QFile::remove(filePath);
+}
+
+void benchmarkRendering(BenchmarkSuite &suite, const BenchmarkOptions &options) {
+    std::vector<int> lineCounts = {1000, 10000, 100000};
+    if (!options.b_quick) {
+        lineCounts.push_back(1000000);
+    }
+
+    const QSize size(CANVAS_SIZE, CANVAS_SIZE);
+    for (int count : lineCounts) {
+        if (!suite.isSelected("render_image") && !suite.isSelected("render_svg") && !suite.isSelected("lod_pyramid")
+            && !suite.isSelected("line_index") && !suite.isSelected("line_index_nearest")) {
+            break;
+        }
+        const QVector<Line> lines = generateLines(count);
+        suite.run("render_image", count, count, [&lines, &size]() { render_lines(lines, size); });
+        suite.run("render_svg", count, count, [&lines, &size]() { lines_to_svg(lines, size); });
+        // Building the levels of detail the line layer displays zoomed out views from
+        suite.run("lod_pyramid", count, count, [&lines]() { LodPyramid pyramid; pyramid.append(lines, 0); });
+
+        // Indexing the lines for hit-testing, then looking up the line under the mouse
+        suite.run("line_index", count, count, [&lines]() { LineIndex index(lines); index.update(); });
+        if (suite.isSelected("line_index_nearest")) {
+            LineIndex index(lines);
+            index.update();
+            QRandomGenerator random(RANDOM_SEED);
+            suite.run("line_index_nearest", count, 1, [&index, &random]() {
+                index.nearest(QPointF(random.bounded(double(CANVAS_SIZE)), random.bounded(double(CANVAS_SIZE))), 4.0);
+            });
+        }
+    }
+}
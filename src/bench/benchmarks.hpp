@@ -0,0 +1,35 @@
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+
+class BenchmarkSuite;
+
+/**
+ * @brief Options shared by the benchmarks.
+ */
+struct BenchmarkOptions
+{
+    bool b_quick = false; ///< Skips the largest problem sizes.
+};
+
+/**
+ * @brief Benchmarks the parser: single lines and generated scripts of increasing length.
+ */
+void benchmarkParser(BenchmarkSuite &suite, const BenchmarkOptions &options);
+
+/**
+ * @brief Benchmarks turtle movements colliding with increasing numbers of obstacles,
+ *        and the generation of the obstacles.
+ */
+void benchmarkCollision(BenchmarkSuite &suite, const BenchmarkOptions &options);
+
+/**
+ * @brief Benchmarks saving and loading turtle states with increasing numbers of lines.
+ */
+void benchmarkPersistence(BenchmarkSuite &suite, const BenchmarkOptions &options);
+
+/**
+ * @brief Benchmarks offscreen rendering, levels of detail and the line index with increasing numbers of lines.
+ */
+void benchmarkRendering(BenchmarkSuite &suite, const BenchmarkOptions &options);
+
+#endif // BENCHMARKS_HPP
@@ -0,0 +1,94 @@
+#include "benchmarksuite.hpp"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <limits>
+
+// Upper bound of the repetitions of fast benchmarks
+constexpr int MAX_ITERATIONS = 1000000;
+
+BenchmarkSuite::BenchmarkSuite(const QRegularExpression &filter, qint64 minTimeMs)
+    : filter_(filter), minTimeNs_(minTimeMs * 1000000) {}
+
+bool BenchmarkSuite::isSelected(const QString &name) const {
+    return filter_.match(name).hasMatch();
+}
+
+void BenchmarkSuite::run(const QString &name, qint64 size, qint64 items,
+                         const std::function<void()> &body, const std::function<void()> &setup) {
+    if (!isSelected(name)) {
+        return;
+    }
+
+    BenchmarkResult result;
+    result.name = name;
+    result.size = size;
+    result.items = items;
+    result.minNs = std::numeric_limits<double>::max();
+
+    qint64 totalNs = 0;
+    QElapsedTimer timer;
+    do {
+        if (setup) {
+            setup();
+        }
+        timer.start();
+        body();
+        const qint64 elapsed = timer.nsecsElapsed();
+
+        totalNs += elapsed;
+        ++result.iterations;
+        result.minNs = std::min(result.minNs, double(elapsed));
+        result.maxNs = std::max(result.maxNs, double(elapsed));
+    } while (totalNs < minTimeNs_ && result.iterations < MAX_ITERATIONS);
+    result.meanNs = double(totalNs) / result.iterations;
+
+    // Progress goes to stderr, so the JSON can be piped from stdout
+    QTextStream(stderr) << QString("%1/%2: %3 ms (%4 iterations)\n")
+                               .arg(name).arg(size).arg(result.minNs / 1e6, 0, 'f', 3).arg(result.iterations);
+    results_.append(result);
+}
+
+QJsonDocument BenchmarkSuite::toJson() const {
+    QJsonArray benchmarks;
+    for (const BenchmarkResult &result : results_) {
+        QJsonObject entry;
+        entry["name"] = result.name;
+        entry["size"] = result.size;
+        entry["items"] = result.items;
+        entry["iterations"] = result.iterations;
+        entry["min_ns"] = result.minNs;
+        entry["mean_ns"] = result.meanNs;
+        entry["max_ns"] = result.maxNs;
+        entry["items_per_second"] = result.minNs > 0.0 ? result.items * 1e9 / result.minNs : 0.0;
+        benchmarks.append(entry);
+    }
+
+    QJsonObject context;
+    context["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    context["qt_version"] = QString(qVersion());
+    context["cpu_architecture"] = QSysInfo::currentCpuArchitecture();
+    context["cpu_count"] = QThread::idealThreadCount();
+#if defined(__clang__)
+    context["compiler"] = QString("clang %1").arg(__clang_version__);
+#elif defined(__GNUC__)
+    context["compiler"] = QString("gcc %1").arg(__VERSION__);
+#elif defined(_MSC_VER)
+    context["compiler"] = QString("msvc %1").arg(_MSC_VER);
+#endif
+#ifdef NDEBUG
+    context["build_type"] = "release";
+#else
+    context["build_type"] = "debug";
+#endif
+
+    QJsonObject root;
+    root["context"] = context;
+    root["benchmarks"] = benchmarks;
+    return QJsonDocument(root);
+}
@@ -0,0 +1,77 @@
+#ifndef BENCHMARKSUITE_HPP
+#define BENCHMARKSUITE_HPP
+
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/**
+ * @brief Result of one benchmark.
+ */
+struct BenchmarkResult
+{
+    QString name;         ///< Name of the benchmark, e.g. "parse_script".
+    qint64 size = 0;      ///< Problem size, e.g. the number of script lines.
+    qint64 items = 0;     ///< Work items processed by one iteration, e.g. executed commands.
+    int iterations = 0;   ///< Number of timed iterations.
+    double minNs = 0.0;   ///< Duration of the fastest iteration in nanoseconds.
+    double meanNs = 0.0;  ///< Mean duration of an iteration in nanoseconds.
+    double maxNs = 0.0;   ///< Duration of the slowest iteration in nanoseconds.
+};
+
+/**
+ * @brief Runs benchmarks and collects their results as JSON.
+ *
+ * Every benchmark is repeated until it has run for a minimum time, and at least once.
+ * Only the body of a benchmark is timed, its setup runs before every iteration without
+ * being timed. The fastest iteration is the most stable figure to track between
+ * releases, the mean and the slowest iteration show the noise.
+ */
+class BenchmarkSuite
+{
+public:
+    /**
+     * @brief Constructs an empty suite.
+     * @param filter Only benchmarks whose name matches are run.
+     * @param minTimeMs The minimum time every benchmark is repeated for.
+     */
+    BenchmarkSuite(const QRegularExpression &filter, qint64 minTimeMs);
+
+    /**
+     * @brief Indicates if a benchmark is selected by the filter.
+     * @param name The name of the benchmark.
+     */
+    bool isSelected(const QString &name) const;
+
+    /**
+     * @brief Runs a benchmark if it is selected by the filter.
+     *
+     * @param name The name of the benchmark.
+     * @param size The problem size.
+     * @param items The number of work items processed by one iteration.
+     * @param body The timed work.
+     * @param setup Untimed preparation run before every iteration (optional).
+     */
+    void run(const QString &name, qint64 size, qint64 items,
+             const std::function<void()> &body, const std::function<void()> &setup = {});
+
+    /// @brief Returns the results of the benchmarks run so far.
+    const QVector<BenchmarkResult> &results() const { return results_; }
+
+    /**
+     * @brief Converts the results to JSON.
+     *
+     * The document holds the build context (Qt version, compiler, CPU count) and one
+     * entry per benchmark with its durations and the throughput in items per second.
+     */
+    QJsonDocument toJson() const;
+
+private:
+    QRegularExpression filter_;        ///< Selects the benchmarks to run.
+    qint64 minTimeNs_;                 ///< Minimum time every benchmark is repeated for.
+    QVector<BenchmarkResult> results_; ///< Results of the benchmarks run so far.
+};
+
+#endif // BENCHMARKSUITE_HPP
@@ -0,0 +1,59 @@
+#include <QCommandLineParser>
+#include <QFile>
+#include <QGuiApplication>
+#include <QRegularExpression>
+#include "benchmarks.hpp"
+#include "benchmarksuite.hpp"
+
+// Runs the benchmarks and writes their results as JSON, e.g.
+//   turtle-bench --filter "parse_.*" --output results.json
+int main(int argc, char *argv[])
+{
+    // Rendering goes to QImages, no display is needed
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QGuiApplication::setApplicationName("turtle-bench");
+
+    QCommandLineParser commandLine;
+    commandLine.setApplicationDescription("Benchmarks the parser, turtle, collisions, persistence and rendering.");
+    commandLine.addHelpOption();
+
+    const QCommandLineOption outputOption({"o", "output"}, "JSON file for the results, stdout if not given.", "file");
+    const QCommandLineOption filterOption({"f", "filter"}, "Regular expression selecting the benchmarks.", "regexp", ".*");
+    const QCommandLineOption minTimeOption("min-time", "Minimum time each benchmark is repeated for.", "ms", "500");
+    const QCommandLineOption quickOption("quick", "Skips the largest problem sizes.");
+    commandLine.addOptions({outputOption, filterOption, minTimeOption, quickOption});
+    commandLine.process(app);
+
+    const QRegularExpression filter(commandLine.value(filterOption));
+    if (!filter.isValid()) {
+        qCritical("Invalid filter: %s", qUtf8Printable(filter.errorString()));
+        return 1;
+    }
+
+    BenchmarkOptions options;
+    options.b_quick = commandLine.isSet(quickOption);
+
+    BenchmarkSuite suite(filter, commandLine.value(minTimeOption).toLongLong());
+    benchmarkParser(suite, options);
+    benchmarkCollision(suite, options);
+    benchmarkPersistence(suite, options);
+    benchmarkRendering(suite, options);
+
+    const QByteArray json = suite.toJson().toJson();
+    if (!commandLine.isSet(outputOption)) {
+        QFile output;
+        output.open(stdout, QIODevice::WriteOnly);
+        output.write(json);
+        return 0;
+    }
+
+    QFile output(commandLine.value(outputOption));
+    if (!output.open(QIODevice::WriteOnly) || output.write(json) < 0) {
+        qCritical("Failed to write %s", qUtf8Printable(output.fileName()));
+        return 1;
+    }
+    return 0;
+}
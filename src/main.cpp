@@ -1,3 +1,4 @@
+#include <QCommandLineParser>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
@@ -10,12 +11,20 @@ int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
 
+    QCommandLineParser commandLine;
+    commandLine.addHelpOption();
+    const QCommandLineOption listenOption("listen", "Accept commands from other processes on a local socket.", "name");
+    commandLine.addOption(listenOption);
+    commandLine.process(app);
+
     qmlRegisterType<Parser>("ParserModule", 1, 0, "Parser");
     qmlRegisterType<CLI>("CLIModule", 1, 0, "CLI");
     qmlRegisterType<SaveLoadManager>("SaveLoadManagerModule", 1, 0, "SaveLoadManager");
     qmlRegisterType<Canvas>("CanvasModule", 1, 0, "Canvas");
 
     QQmlApplicationEngine engine;
+    // Read by Main.qml once the CLI exists, empty if no server is wanted
+    engine.rootContext()->setContextProperty("commandServerName", commandLine.value(listenOption));
     engine.addImportPath(QString("%1/src/modules").arg(QGuiApplication::applicationDirPath()));
 
     engine.loadFromModule("turtlegraphics", "Main");
@@ -1,17 +1,130 @@
 #include "CLI.hpp"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QStandardPaths>
+#include "CommandServer.hpp"
+#include "OutputLogModel.hpp"
+#include "ScriptCache.hpp"
+#include "ScriptSession.hpp"
+#include "canvas.hpp"
+#include "obstacle.hpp"
 #include "parser.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+#include "turtlecontrol.h"
 
+namespace {
+
+// Holds back the batches of the command server while the parser runs other input,
+// as the parser processes events while waiting for animations
+class ServerPause
+{
+public:
+    explicit ServerPause(CommandServer *server) : server_(server) {
+        if (server_) {
+            server_->setPaused(true);
+        }
+    }
+    ~ServerPause() {
+        if (server_) {
+            server_->setPaused(false);
+        }
+    }
+
+private:
+    CommandServer *server_;
+};
+
+// Refuses undo and redo while the parser runs input, so an undo delivered while it
+// waits for animations cannot revert the lines it is drawing
+class HistoryLock
+{
+public:
+    explicit HistoryLock(TurtleControl *turtleControl) : turtleControl_(turtleControl) {
+        if (turtleControl_) {
+            turtleControl_->lock_history();
+        }
+    }
+    ~HistoryLock() {
+        if (turtleControl_) {
+            turtleControl_->unlock_history();
+        }
+    }
+
+private:
+    TurtleControl *turtleControl_;
+};
+
+} // namespace
 
 // Constructor: Initializes the CLI instance
 CLI::CLI(QObject *parent)
-    : QObject(parent), parser_(nullptr), historyIndex_(-1) {
-    outputLog_.append("Welcome to Turtle graphics");
+    : QObject(parent), parser_(nullptr), commandHistory_(HISTORY_CAPACITY),
+      typedLines_(HISTORY_CAPACITY + 1), historyIndex_(-1),
+      historySpill_(nullptr), outputLog_(new OutputLogModel(OUTPUT_LOG_CAPACITY, this)),
+      commandServer_(nullptr), turtleControl_(nullptr), canvas_(nullptr), scriptCache_(),
+      scriptSession_(), b_capturingResult_(false) {
+    outputLog_->append("Welcome to Turtle graphics");
     emit outputChanged(); // Notify UI of the initial state
 }
 
+CLI::~CLI() = default;
+
 // Sets the Parser object used by the CLI
 void CLI::setParser(Parser *parser) {
     parser_ = parser;
+    updateScriptSession();
+}
+
+void CLI::setTurtleControl(TurtleControl *turtleControl) {
+    turtleControl_ = turtleControl;
+    updateScriptSession();
+}
+
+void CLI::updateScriptSession() {
+    scriptSession_.reset();
+    if (parser_ && turtleControl_) {
+        scriptSession_ = std::make_unique<ScriptSession>(*parser_, *turtleControl_);
+    }
+}
+
+bool CLI::refuseBusyInput() {
+    if (!b_capturingResult_ && !(scriptSession_ && scriptSession_->isWaiting())) {
+        return false;
+    }
+    const QString errorMessage = "Error: Busy recording the running script, try again.";
+    outputLog_->append(errorMessage);
+    emit commandProcessed(errorMessage);
+    emit outputChanged();
+    return true;
+}
+
+void CLI::setCanvas(Canvas *canvas) {
+    if (canvas_) {
+        disconnect(canvas_, nullptr, this, nullptr);
+    }
+    canvas_ = canvas;
+
+    // Obstacle maps are loaded from the UI, their errors are shown in the output like those of scripts
+    if (canvas_) {
+        connect(canvas_, &Canvas::obstacles_load_failed, this, [this](const QString &filePath, const QString &error) {
+            const QString message = QString("Failed to load obstacles from %1: %2").arg(filePath, error);
+            outputLog_->append(message);
+            emit commandProcessed(message);
+            emit outputChanged();
+        });
+    }
+}
+
+void CLI::enableScriptCache(const QString &directory, qint64 maxBytes) {
+    const QString cacheDirectory = directory.isEmpty()
+        ? QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/scripts"
+        : directory;
+    scriptCache_ = std::make_unique<ScriptCache>(cacheDirectory, maxBytes > 0 ? maxBytes : ScriptCache::DEFAULT_MAX_BYTES);
+}
+
+void CLI::disableScriptCache() {
+    scriptCache_.reset();
 }
 
 // Processes a command entered by the user
@@ -21,15 +134,19 @@ void CLI::processCommand(const QString &command) {
         // Handle empty command case
         QString errorMessage = "Error: Command cannot be empty.";
         emit commandProcessed(errorMessage);
-        outputLog_.append(errorMessage);
+        outputLog_->append(errorMessage);
         emit outputChanged();
         return;
     }
 
+    if (refuseBusyInput()) {
+        return;
+    }
+
     // Skip script loading logic here
 
-    // Add the command to the history for undo/redo functionality
-    commandHistory_.push_back(trimmedCommand);
+    // Add the command to the history
+    addToHistory(trimmedCommand);
     historyIndex_ = commandHistory_.size();
 
     // Handle special commands
@@ -38,65 +155,339 @@ void CLI::processCommand(const QString &command) {
         return;
     } else if (trimmedCommand == "quit") {
         emit commandProcessed("Application quitting...");
-        outputLog_.append("Application quitting...");
+        outputLog_->append("Application quitting...");
         emit requestQuit();
         emit outputChanged();
         return;
+    } else if (trimmedCommand == "stats" || trimmedCommand == "stats reset") {
+        if (trimmedCommand == "stats reset") {
+            perf::reset();
+        }
+        const QString report = perf::report();
+        outputLog_->append(report);
+        emit commandProcessed(report);
+        emit outputChanged();
+        return;
+    } else if (trimmedCommand.section(' ', 0, 0) == "trace") {
+        processTraceCommand(trimmedCommand.split(' ', Qt::SkipEmptyParts).mid(1));
+        return;
+    } else if (trimmedCommand == "rerun") {
+        rerunScript();
+        return;
+    } else if (trimmedCommand.section(' ', 0, 0) == "cache") {
+        processCacheCommand(trimmedCommand.split(' ', Qt::SkipEmptyParts).mid(1));
+        return;
+    } else if (trimmedCommand == "undo" || trimmedCommand == "redo") {
+        if (turtleControl_ && turtleControl_->history_locked()) {
+            const QString errorMessage = QString("Error: Cannot %1 while a command or script is running.").arg(trimmedCommand);
+            outputLog_->append(errorMessage);
+            emit commandProcessed(errorMessage);
+            emit outputChanged();
+            return;
+        }
+        // The turtle refuses the request then, so it is reported here instead of claimed done
+        if (turtleControl_ && (turtleControl_->is_moving()
+                               || !(trimmedCommand == "undo" ? turtleControl_->can_undo() : turtleControl_->can_redo()))) {
+            const QString errorMessage = turtleControl_->is_moving()
+                ? QString("Error: Cannot %1 while the turtle is moving.").arg(trimmedCommand)
+                : QString("Error: Nothing to %1.").arg(trimmedCommand);
+            outputLog_->append(errorMessage);
+            emit commandProcessed(errorMessage);
+            emit outputChanged();
+            return;
+        }
+        if (trimmedCommand == "undo") {
+            emit undoRequested();
+        } else {
+            emit redoRequested();
+        }
+        const QString output = QString("Processed: %1").arg(trimmedCommand);
+        outputLog_->append(output);
+        emit commandProcessed(output);
+        emit outputChanged();
+        return;
     }
 
     if (!parser_) {
         QString errorMessage = "Error: Parser not set.";
         emit commandProcessed(errorMessage);
-        outputLog_.append(errorMessage);
+        outputLog_->append(errorMessage);
         emit outputChanged();
         return;
     }
 
     try {
         // Parse and execute the command
-        std::vector<std::string> parsedCommands = parser_->parse_line(trimmedCommand);
-        for (const auto &cmd : parsedCommands) {
-            commandHistory_.push_back(QString::fromStdString(cmd));
-        }
+        ServerPause pause(commandServer_);
+        HistoryLock lock(turtleControl_);
+        emit checkpointRequested();
+        parser_->parse_line(trimmedCommand, [this](const script::ExecutedCommand &cmd) { addToHistory(cmd); });
     } catch (const std::exception &e) {
         // Handle parsing or execution errors
         QString errorMessage = QString("Error: %1").arg(e.what());
         emit commandProcessed(errorMessage);
-        outputLog_.append(errorMessage);
+        outputLog_->append(errorMessage);
         emit outputChanged();
         return;
     }
 
     // Log the successful processing of the command
     QString output = QString("Processed: %1").arg(trimmedCommand);
-    outputLog_.append(output);
-    if (outputLog_.size() > 100) {
-        outputLog_.removeFirst(); // Maintain a max size for the log
-    }
+    outputLog_->append(output);
 
     emit commandProcessed(output);
     emit outputChanged();
 }
 
+void CLI::processTraceCommand(const QStringList &arguments) {
+    const QString action = arguments.value(0);
+    QString message;
+
+    if (action == "on" && arguments.size() == 1) {
+        trace::set_enabled(true);
+        message = "Tracing started.";
+    } else if (action == "off" && arguments.size() == 1) {
+        trace::set_enabled(false);
+        message = QString("Tracing stopped, %1 spans recorded.").arg(trace::event_count());
+    } else if (action == "clear" && arguments.size() == 1) {
+        trace::clear();
+        message = "Trace cleared.";
+    } else if (action == "save" && arguments.size() == 2) {
+        const QString filePath = arguments[1];
+        message = trace::save_chrome_json(filePath)
+                      ? QString("Trace of %1 spans saved: %2").arg(trace::event_count()).arg(filePath)
+                      : "Failed to save trace: " + filePath;
+    } else {
+        message = "Usage: trace on | trace off | trace clear | trace save <file.json>";
+    }
+
+    outputLog_->append(message);
+    emit commandProcessed(message);
+    emit outputChanged();
+}
+
+void CLI::processCacheCommand(const QStringList &arguments) {
+    const QString action = arguments.value(0);
+    QString message;
+
+    if (arguments.isEmpty()) {
+        message = scriptCache_
+                      ? QString("Script cache %1: %2 of %3 bytes used.")
+                            .arg(scriptCache_->directory())
+                            .arg(scriptCache_->size())
+                            .arg(scriptCache_->maxBytes())
+                      : "Script cache is off.";
+    } else if (action == "on" && arguments.size() == 1) {
+        if (!scriptCache_) {
+            enableScriptCache();
+        }
+        message = "Script cache on: " + scriptCache_->directory();
+    } else if (action == "off" && arguments.size() == 1) {
+        disableScriptCache();
+        message = "Script cache off.";
+    } else if (action == "clear" && arguments.size() == 1) {
+        if (scriptCache_) {
+            scriptCache_->clear();
+        }
+        message = scriptCache_ ? "Script cache cleared." : "Script cache is off.";
+    } else {
+        message = "Usage: cache | cache on | cache off | cache clear";
+    }
+
+    outputLog_->append(message);
+    emit commandProcessed(message);
+    emit outputChanged();
+}
+
+QByteArray CLI::scriptCacheContext() const {
+    QByteArray context;
+    QDataStream stream(&context, QIODevice::WriteOnly);
+
+    // The state a script starts from
+    stream << turtleControl_->position() << turtleControl_->rotation() << turtleControl_->get_speed()
+           << turtleControl_->pen_radius() << quint32(turtleControl_->pen_color().rgba())
+           << turtleControl_->pen_down() << turtleControl_->get_arc_segments();
+    stream << quint32(turtleControl_->saved_states().size());
+    for (const auto &savedState : turtleControl_->saved_states()) {
+        stream << savedState.first << savedState.second;
+    }
+
+    // The obstacles and borders that may stop the turtle
+    if (canvas_) {
+        stream << canvas_->width() << canvas_->height() << canvas_->bounded();
+        stream << quint32(canvas_->get_obstacles().size());
+        for (const Obstacle *obstacle : canvas_->get_obstacles()) {
+            stream << obstacle->get_points();
+        }
+    }
+
+    // The variables and functions the script may use
+    if (parser_) {
+        stream << QByteArray::fromStdString(parser_->fingerprint());
+    }
+    return context;
+}
+
+bool CLI::restoreCachedScript(QFile &file, const QByteArray &key, qint64 &bytesRead) {
+    ScriptCache::Entry entry;
+    if (!scriptCache_->load(key, entry)) {
+        return false;
+    }
+
+    // The functions defined by the script stay callable, as after running it
+    bytesRead = parser_->load_definitions(file);
+    for (const auto &global : entry.globals_) {
+        parser_->set_global(global.first, global.second);
+    }
+
+    turtleControl_->append_lines(entry.lines_);
+    turtleControl_->set_speed(entry.speed_);
+    turtleControl_->set_pen_radius(entry.penRadius_);
+    turtleControl_->set_pen_color(entry.penColor_);
+    turtleControl_->set_position(entry.position_);
+    turtleControl_->set_rotation(entry.rotation_);
+    turtleControl_->set_pen_down(entry.b_penDown_);
+    turtleControl_->set_saved_states(entry.savedStates_);
+    return true;
+}
+
+void CLI::storeScriptResult(const QByteArray &key, int firstLine) {
+    // The script returns while its last movement may still be animated. Input arriving
+    // meanwhile is refused, as its lines and state would be cached with the script.
+    b_capturingResult_ = true;
+    while (turtleControl_->is_moving()) {
+        QCoreApplication::processEvents();
+    }
+    b_capturingResult_ = false;
+    if (turtleControl_->line_count() < firstLine) {
+        return; // the lines were cleared while the script ran
+    }
+
+    ScriptCache::Entry entry;
+    entry.lines_ = turtleControl_->get_lines().mid(firstLine);
+    entry.position_ = turtleControl_->position();
+    entry.rotation_ = turtleControl_->rotation();
+    entry.speed_ = turtleControl_->get_speed();
+    entry.penRadius_ = turtleControl_->pen_radius();
+    entry.penColor_ = turtleControl_->pen_color();
+    entry.b_penDown_ = turtleControl_->pen_down();
+    entry.savedStates_ = turtleControl_->saved_states();
+    entry.globals_ = parser_->globals();
+    if (!scriptCache_->store(key, entry)) {
+        appendToOutputLog("Failed to cache the script in " + scriptCache_->directory());
+    }
+}
+
 // Retrieves the current output log
 QString CLI::getOutput() const {
-    return outputLog_.join("\n");
+    return outputLog_->join("\n");
+}
+
+OutputLogModel *CLI::outputModel() const {
+    return outputLog_;
 }
 
 // Clears the output log
 void CLI::clearOutput() {
-    outputLog_.clear();
+    outputLog_->clear();
     emit commandProcessed("Output cleared.");
     emit outputChanged();
 }
 
 // Retrieves the command history as a QStringList
 QStringList CLI::getCommandHistory() const {
-    return QStringList(commandHistory_.begin(), commandHistory_.end());
+    QStringList history;
+    history.reserve(commandHistory_.size());
+    for (std::size_t i = 0; i < commandHistory_.size(); ++i) {
+        history.append(QString::fromStdString(commandHistory_[i].to_string()));
+    }
+    return history;
+}
+
+void CLI::setHistorySpillFile(const QString &filePath) {
+    delete historySpill_;
+    historySpill_ = nullptr;
+    if (filePath.isEmpty()) {
+        return;
+    }
+
+    historySpill_ = new QFile(filePath, this);
+    if (!historySpill_->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        appendToOutputLog("Failed to open history file: " + filePath);
+        delete historySpill_;
+        historySpill_ = nullptr;
+    }
+}
+
+void CLI::addToHistory(const script::ExecutedCommand &command) {
+    script::ExecutedCommand evicted;
+    if (commandHistory_.push_back(command, &evicted) && historySpill_) {
+        // Keep the full history on disk, one command per line
+        const std::string text = evicted.to_string();
+        historySpill_->write(text.data(), qint64(text.size()));
+        historySpill_->write("\n", 1);
+    }
+}
+
+void CLI::addToHistory(const QString &line) {
+    // The records of typed lines point into typedLines_. It keeps one line more than the
+    // history has records, so the line of a record is still there when the record is evicted.
+    typedLines_.push_back(line.toStdString());
+    addToHistory(script::ExecutedCommand::text(typedLines_.back().c_str()));
+}
+
+bool CLI::startServer(const QString &name) {
+    if (!commandServer_) {
+        commandServer_ = new CommandServer([this](const QString &batch) { return runBatch(batch); }, this);
+    }
+
+    if (!commandServer_->listen(name)) {
+        appendToOutputLog(QString("Failed to listen on %1: %2").arg(name, commandServer_->errorString()));
+        return false;
+    }
+    appendToOutputLog("Listening for commands on " + commandServer_->fullServerName());
+    return true;
+}
+
+void CLI::stopServer() {
+    if (commandServer_ && commandServer_->isListening()) {
+        commandServer_->close();
+        appendToOutputLog("Stopped listening for commands.");
+    }
+}
+
+bool CLI::isServerListening() const {
+    return commandServer_ && commandServer_->isListening();
+}
+
+QByteArray CLI::runBatch(const QString &batch) {
+    if (!parser_) {
+        return "ERROR Parser not set.\n";
+    }
+
+    qulonglong parsedCommands = 0;
+    try {
+        // The whole batch is compiled at once, so blocks may span its lines
+        HistoryLock lock(turtleControl_);
+        emit checkpointRequested();
+        parser_->parse_line(batch, [this, &parsedCommands](const script::ExecutedCommand &cmd) {
+            addToHistory(cmd);
+            ++parsedCommands;
+        });
+    } catch (const std::exception &e) {
+        QString errorMessage = QString("Error in command batch: %1").arg(e.what());
+        appendToOutputLog(errorMessage);
+        return "ERROR " + QByteArray(e.what()).replace('\n', ' ') + '\n';
+    }
+    return "OK " + QByteArray::number(parsedCommands) + '\n';
 }
 
 // Assuming parser_ and outputLog_ are defined elsewhere in the CLI class
 void CLI::loadScript(const QString &filename) {
+    if (refuseBusyInput()) {
+        return;
+    }
+
     // Convert file URL to local file path
     QUrl fileUrl(filename);
     QString localFilePath = fileUrl.toLocalFile();
@@ -107,7 +498,7 @@ void CLI::loadScript(const QString &filename) {
     // Check if the file exists
     if (!QFile::exists(localFilePath)) {
         QString message = "File does not exist: " + localFilePath;
-        outputLog_.append(message);
+        outputLog_->append(message);
         emit commandProcessed(message);
         emit outputChanged();
         return;
@@ -116,44 +507,130 @@ void CLI::loadScript(const QString &filename) {
     // Debugging output: Print the current working directory
     qDebug() << "Current working directory:" << QDir::currentPath();
 
-    // Attempt to open the file for reading
-    std::ifstream file(localFilePath.toStdString());
-    if (!file.is_open()) {
+    // Attempt to open the file for reading, the parser reads it in large chunks itself
+    QFile file(localFilePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
         QString message = "Failed to open file: " + localFilePath;
-        outputLog_.append(message);
+        outputLog_->append(message);
         emit commandProcessed(message);
         emit outputChanged();
         return;
     }
 
-    // Check if the file is empty
-    file.seekg(0, std::ios::end);  // Move to the end to check size
-    if (file.tellg() == 0) {
+    qint64 bytesRead = 0;
+    bool b_cached = false;
+    try {
+        ServerPause pause(commandServer_);
+        HistoryLock lock(turtleControl_);
+        emit checkpointRequested();
+
+        // The script is recorded, so it can be rerun from a checkpoint after editing it
+        if (scriptSession_) {
+            scriptSession_->begin(localFilePath);
+        }
+
+        // A script run from a state seen before is restored from the cache instead; moving
+        // obstacles are only where a run leaves them if the script actually runs
+        QByteArray cacheKey;
+        const int firstLine = turtleControl_ ? turtleControl_->line_count() : 0;
+        if (scriptCache_ && turtleControl_ && !turtleControl_->self_collision() && !turtleControl_->is_moving()
+            && !(canvas_ && canvas_->has_moving_obstacles())) {
+            cacheKey = ScriptCache::key(file, scriptCacheContext());
+            file.seek(0);
+            b_cached = !cacheKey.isEmpty() && restoreCachedScript(file, cacheKey, bytesRead);
+        }
+
+        if (b_cached) {
+            if (scriptSession_) {
+                file.seek(0);
+                scriptSession_->skip(file);
+            }
+        } else {
+            // The script is executed while it is read, commands run by it are stored to history
+            const auto sink = [this](const script::ExecutedCommand &cmd) { addToHistory(cmd); };
+            bytesRead = scriptSession_ ? scriptSession_->run(file, sink) : parser_->parse_script(file, sink);
+            if (!cacheKey.isEmpty() && bytesRead > 0) {
+                storeScriptResult(cacheKey, firstLine);
+            }
+        }
+    } catch (const std::exception &e) {
+        // Handle execution errors, e.g. runaway recursion
+        QString message = QString("Error in script %1: %2").arg(localFilePath, e.what());
+        outputLog_->append(message);
+        emit commandProcessed(message);
+        emit outputChanged();
+        return;
+    }
+
+    // Check if the file was empty
+    if (bytesRead == 0) {
         QString message = "File is empty: " + localFilePath;
-        outputLog_.append(message);
+        outputLog_->append(message);
         emit commandProcessed(message);
         emit outputChanged();
         return;
     }
 
-    file.seekg(0, std::ios::beg);  // Reset position for reading
+    QString message = (b_cached ? "File loaded from cache: " : "File loaded successfully: ") + localFilePath;
+    outputLog_->append(message);
+    emit commandProcessed(message);
+    emit outputChanged();
+}
 
-    std::vector<std::string> parsedCommands = parser_->parse_script(file);
-    for (const auto &cmd : parsedCommands) { // store the commands run by script to history
-        commandHistory_.push_back(QString::fromStdString(cmd));
+void CLI::rerunScript(const QString &filename) {
+    if (refuseBusyInput()) {
+        return;
     }
 
-    QString message = "File loaded successfully: " + localFilePath;
-    outputLog_.append(message);
+    const QString localFilePath = filename.isEmpty()
+        ? (scriptSession_ ? scriptSession_->filePath() : QString())
+        : QUrl(filename).toLocalFile();
+    if (localFilePath.isEmpty()) {
+        QString message = "No script to rerun.";
+        outputLog_->append(message);
+        emit commandProcessed(message);
+        emit outputChanged();
+        return;
+    }
+
+    // Without a run to resume from, the script is loaded as a whole; so it is while obstacles
+    // move, as a checkpoint does not bring them back to where they were
+    if (!scriptSession_ || !scriptSession_->canResume(localFilePath) || (canvas_ && canvas_->has_moving_obstacles())) {
+        loadScript(QUrl::fromLocalFile(localFilePath).toString());
+        return;
+    }
+
+    QFile file(localFilePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        QString message = "Failed to open file: " + localFilePath;
+        outputLog_->append(message);
+        emit commandProcessed(message);
+        emit outputChanged();
+        return;
+    }
+
+    int line = 0;
+    try {
+        ServerPause pause(commandServer_);
+        HistoryLock lock(turtleControl_);
+        emit checkpointRequested();
+        line = scriptSession_->resume(file, [this](const script::ExecutedCommand &cmd) { addToHistory(cmd); });
+    } catch (const std::exception &e) {
+        QString message = QString("Error in script %1: %2").arg(localFilePath, e.what());
+        outputLog_->append(message);
+        emit commandProcessed(message);
+        emit outputChanged();
+        return;
+    }
+
+    QString message = QString("File rerun from line %1: %2").arg(line + 1).arg(localFilePath);
+    outputLog_->append(message);
     emit commandProcessed(message);
     emit outputChanged();
 }
 
 void CLI::appendToOutputLog(const QString &message) {
-    outputLog_.append(message);
-    if (outputLog_.size() > 100) {
-        outputLog_.removeFirst(); // Maintain a max size for the log
-    }
+    outputLog_->append(message);
     emit outputChanged();
 }
 
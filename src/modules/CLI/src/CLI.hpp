@@ -9,10 +9,20 @@
 #include <vector>
 #include <QDir>
 #include <QUrl>
-#include <fstream>
+#include <memory>
+#include <string>
+
+#include "RingBuffer.hpp"
+#include "script.hpp"
 
 
 class Parser;  // Forward declaration of the Parser class
+class OutputLogModel;
+class CommandServer;
+class ScriptCache;
+class ScriptSession;
+class TurtleControl;
+class Canvas;
 
 /**
  * @brief The CLI class provides an interface for processing commands, managing history,
@@ -21,14 +31,29 @@ class Parser;  // Forward declaration of the Parser class
 class CLI : public QObject
 {
     Q_OBJECT
+    Q_MOC_INCLUDE("OutputLogModel.hpp")
+
+    /**
+     * @brief The most recent output messages as a list model for QML views.
+     */
+    Q_PROPERTY(OutputLogModel *outputModel READ outputModel CONSTANT)
 
 public:
+    /// @brief Number of output messages kept for the output view.
+    static constexpr std::size_t OUTPUT_LOG_CAPACITY = 1000;
+
+    /// @brief Number of commands kept in memory, older ones go to the history spill file if set.
+    static constexpr std::size_t HISTORY_CAPACITY = 10000;
+
     /**
      * @brief Constructor for the CLI class.
      * @param parent Pointer to the parent QObject (optional).
      */
     explicit CLI(QObject *parent = nullptr);
 
+    /// @brief Destroys the CLI and its script cache.
+    ~CLI() override;
+
     /**
      * @brief Sets the parser instance to process commands.
      * @param parser Pointer to the Parser object.
@@ -36,8 +61,50 @@ public:
      */
     Q_INVOKABLE void setParser(Parser *parser);
 
+    /**
+     * @brief Sets the turtle drawing the scripts, whose lines and state are cached and rewound.
+     * @param turtleControl Pointer to the TurtleControl object.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void setTurtleControl(TurtleControl *turtleControl);
+
+    /**
+     * @brief Sets the canvas whose obstacles the cached script runs depend on.
+     *
+     * Errors of loading obstacle maps into the canvas are shown in the output.
+     *
+     * @param canvas Pointer to the Canvas object.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void setCanvas(Canvas *canvas);
+
+    /**
+     * @brief Caches the results of loaded scripts on disk.
+     *
+     * A script loaded again from the same turtle state, canvas and parser variables then
+     * restores the lines and state it produced before instead of running. Requires the
+     * turtle. The "cache" command switches the cache on and off and clears it.
+     *
+     * @param directory The directory of the cache, or an empty string for the cache location of the user.
+     * @param maxBytes The size limit of the cache, 0 for the default limit.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void enableScriptCache(const QString &directory = QString(), qint64 maxBytes = 0);
+
+    /**
+     * @brief Stops caching the results of loaded scripts, keeping the cached entries.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void disableScriptCache();
+
     /**
      * @brief Processes a given command by parsing and executing it.
+     *
+     * Every command line is a step that can be undone: a checkpoint is requested before it
+     * runs. "undo" and "redo" request to revert or reapply the last step instead of running.
+     * While a command, script or batch runs, the turtle's history is locked, so an undo
+     * delivered while the parser waits for an animation is refused.
+     *
      * @param command The command string to process.
      * @note This function is callable from QML.
      */
@@ -50,6 +117,12 @@ public:
      */
     Q_INVOKABLE QString getOutput() const;
 
+    /**
+     * @brief Retrieves the output log as a list model.
+     * @return The model holding the most recent output messages.
+     */
+    OutputLogModel *outputModel() const;
+
     /**
      * @brief Clears the output log.
      * @note This function is callable from QML.
@@ -62,17 +135,65 @@ public:
      * @note This function is callable from QML.
      */
     Q_INVOKABLE QStringList getCommandHistory() const;
+
+    /**
+     * @brief Sets a file that receives the commands dropped from the in-memory history.
+     *
+     * Only the most recent commands are kept in memory. With a spill file, older commands
+     * are appended to it instead of being discarded.
+     *
+     * @param filePath The path of the file, or an empty string to discard old commands.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void setHistorySpillFile(const QString &filePath);
       
      /**
      * @brief Loads and processes a script file by passing its contents to the parser.
      *
-     * This method opens the specified script file, reads its contents,
-     * and passes an ifstream to the parser for processing.
+     * This method opens the specified script file and streams it to the parser,
+     * which executes the script while it is being read.
      *
      * @param filename The filename of the script to be loaded.
      */
     Q_INVOKABLE void loadScript(const QString &filename);
+
+    /**
+     * @brief Runs an edited script again, replacing what its last run drew.
+     *
+     * Only the script from the last checkpoint before its first changed line is run. If the
+     * script was not the last one loaded, or lines were removed since it ran, it is loaded.
+     *
+     * @param filename The filename of the script, or empty for the last loaded script.
+     */
+    Q_INVOKABLE void rerunScript(const QString &filename = QString());
     
+    /**
+     * @brief Starts accepting commands from other processes on a local socket.
+     *
+     * Clients send commands separated by newlines and terminate each batch with a blank
+     * line. A batch is run like a command line of the CLI, so it may contain blocks spanning
+     * several lines. Each batch is answered with one line, "OK <n>" with the number of
+     * executed commands, or "ERROR <message>". Clients may send further batches before
+     * the replies arrive.
+     *
+     * @param name The name of the local socket (a Unix socket or a named pipe).
+     * @return True if the server is listening.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE bool startServer(const QString &name);
+
+    /**
+     * @brief Stops accepting commands on the local socket and disconnects all clients.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE void stopServer();
+
+    /**
+     * @brief Indicates if the CLI accepts commands on a local socket.
+     * @note This function is callable from QML.
+     */
+    Q_INVOKABLE bool isServerListening() const;
+
      /**
      * @brief Appends a message to the output log and emits the appropriate signals.
      * @param message The message to append to the output log.
@@ -95,12 +216,116 @@ signals:
      * @brief Emitted to request the application to quit.
      */
     void requestQuit();
+
+    /**
+     * @brief Emitted before a command line, script or command batch runs, so that it can be undone.
+     */
+    void checkpointRequested();
+
+    /**
+     * @brief Emitted by the "undo" command to revert the last command line, script or batch.
+     */
+    void undoRequested();
+
+    /**
+     * @brief Emitted by the "redo" command to apply the last undone step again.
+     */
+    void redoRequested();
     
 private:
-    Parser *parser_;                ///< Pointer to the Parser instance used to process commands.
-    QList<QString> commandHistory_; ///< List of commands entered by the user, for undo/redo functionality.
-    int historyIndex_;              ///< Index to track the current position in the command history.
-    QStringList outputLog_;         ///< List storing log messages for the output.
+    /**
+     * @brief Adds a command to the history, spilling the oldest command if the history is full.
+     * @param command The command to add.
+     */
+    void addToHistory(const script::ExecutedCommand &command);
+
+    /**
+     * @brief Adds a line entered by the user to the history.
+     *
+     * The text is kept in typedLines_ rather than interned, so memory for typed lines does
+     * not grow beyond the capacity of the history.
+     *
+     * @param line The line to add.
+     */
+    void addToHistory(const QString &line);
+
+    /**
+     * @brief Handles the "trace" commands controlling the recording of trace spans.
+     *
+     * "trace on" and "trace off" start and stop recording, "trace clear" discards the
+     * recorded spans and "trace save <file>" writes them as Chrome trace event JSON.
+     *
+     * @param arguments The words following "trace".
+     */
+    void processTraceCommand(const QStringList &arguments);
+
+    /**
+     * @brief Handles the "cache" commands controlling the script cache.
+     *
+     * "cache on" and "cache off" switch caching on and off, "cache clear" removes the cached
+     * entries and "cache" alone prints the location and size of the cache.
+     *
+     * @param arguments The words following "cache".
+     */
+    void processCacheCommand(const QStringList &arguments);
+
+    /**
+     * @brief Describes everything besides the script text that running a script depends on.
+     * @return The turtle state, the canvas, its obstacles and the parser state.
+     */
+    QByteArray scriptCacheContext() const;
+
+    /**
+     * @brief Applies the cached result of a script as if the script had run.
+     *
+     * The functions of the script are defined without running it.
+     *
+     * @param file The opened script.
+     * @param key The cache key of the script run.
+     * @param bytesRead Receives the size of the script.
+     * @return False if the result is not cached.
+     */
+    bool restoreCachedScript(QFile &file, const QByteArray &key, qint64 &bytesRead);
+
+    /**
+     * @brief Caches the result of a script that has run, once the turtle has stopped.
+     * @param key The cache key of the script run.
+     * @param firstLine The number of lines of the turtle before the script ran.
+     */
+    void storeScriptResult(const QByteArray &key, int firstLine);
+
+    /// @brief Creates the session recording the loaded scripts once the parser and turtle are set.
+    void updateScriptSession();
+
+    /**
+     * @brief Reports that input cannot run now, while a checkpoint or the result of a script is taken.
+     *
+     * Both wait for the last movement of the script, processing events that may deliver
+     * new input; what it drew would be recorded as a part of the script.
+     *
+     * @return True if the input is refused.
+     */
+    bool refuseBusyInput();
+
+    /**
+     * @brief Runs a batch of commands received by the command server.
+     * @param batch The commands separated by newlines.
+     * @return The reply line sent to the client.
+     */
+    QByteArray runBatch(const QString &batch);
+
+    Parser *parser_;                     ///< Pointer to the Parser instance used to process commands.
+    RingBuffer<script::ExecutedCommand> commandHistory_; ///< Most recent commands entered by the user or run by scripts.
+    RingBuffer<std::string> typedLines_; ///< Texts of the most recent lines entered by the user, see addToHistory().
+    int historyIndex_;                   ///< Index to track the current position in the command history.
+    QFile *historySpill_;                ///< File receiving the commands dropped from the history, or nullptr.
+    OutputLogModel *outputLog_;          ///< Model storing the most recent log messages for the output.
+    CommandServer *commandServer_;       ///< Server receiving commands from other processes, or nullptr.
+    TurtleControl *turtleControl_;       ///< The turtle drawing the scripts, or nullptr.
+    Canvas *canvas_;                     ///< The canvas of the turtle, or nullptr.
+    std::unique_ptr<ScriptCache> scriptCache_; ///< Cache of loaded scripts, or nullptr if disabled.
+    std::unique_ptr<ScriptSession> scriptSession_; ///< The last loaded script, or nullptr without a turtle.
+    bool b_capturingResult_;             ///< True while storeScriptResult waits for the turtle.
 };
 
 #endif // CLI_HPP
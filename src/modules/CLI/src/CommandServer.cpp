@@ -0,0 +1,128 @@
+#include "CommandServer.hpp"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+
+CommandServer::CommandServer(BatchHandler handler, QObject *parent)
+    : QObject(parent), server_(new QLocalServer(this)), handler_(std::move(handler)),
+      pauseCount_(0), b_running_(false) {
+    connect(server_, &QLocalServer::newConnection, this, &CommandServer::acceptConnections);
+}
+
+bool CommandServer::listen(const QString &name) {
+    close();
+    // A socket file left by a process that did not shut down cleanly blocks the name
+    QLocalServer::removeServer(name);
+    return server_->listen(name);
+}
+
+void CommandServer::close() {
+    server_->close();
+    const QList<QLocalSocket *> sockets = clients_.keys();
+    clients_.clear();
+    for (QLocalSocket *socket : sockets) {
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+}
+
+bool CommandServer::isListening() const {
+    return server_->isListening();
+}
+
+QString CommandServer::fullServerName() const {
+    return server_->fullServerName();
+}
+
+QString CommandServer::errorString() const {
+    return server_->errorString();
+}
+
+void CommandServer::setPaused(bool paused) {
+    pauseCount_ += paused ? 1 : -1;
+    if (pauseCount_ == 0 && !pending_.empty()) {
+        // Run the batches that arrived meanwhile once the caller has returned to the event loop
+        QMetaObject::invokeMethod(this, &CommandServer::processPending, Qt::QueuedConnection);
+    }
+}
+
+void CommandServer::acceptConnections() {
+    while (QLocalSocket *socket = server_->nextPendingConnection()) {
+        clients_.insert(socket, Client());
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { readClient(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() { removeClient(socket); });
+    }
+}
+
+void CommandServer::readClient(QLocalSocket *socket) {
+    auto it = clients_.find(socket);
+    if (it == clients_.end()) {
+        return;
+    }
+
+    Client &client = it.value();
+    client.line_ += socket->readAll();
+
+    qsizetype begin = 0;
+    for (qsizetype newline; (newline = client.line_.indexOf('\n', begin)) >= 0; begin = newline + 1) {
+        const QString line = QString::fromUtf8(client.line_.constData() + begin, newline - begin).trimmed();
+        if (!line.isEmpty()) {
+            if (!client.batch_.isEmpty()) {
+                client.batch_ += '\n';
+            }
+            client.batch_ += line;
+        } else if (!client.batch_.isEmpty()) {
+            // A blank line terminates the batch
+            pending_.push_back({socket, client.batch_});
+            client.batch_.clear();
+        }
+    }
+    client.line_.remove(0, begin);
+
+    processPending();
+}
+
+void CommandServer::removeClient(QLocalSocket *socket) {
+    readClient(socket); // data that arrived together with the disconnection
+    auto it = clients_.find(socket);
+    if (it == clients_.end()) {
+        return;
+    }
+
+    // The client may close the connection right after sending its last batch
+    Client &client = it.value();
+    const QString lastLine = QString::fromUtf8(client.line_).trimmed();
+    if (!lastLine.isEmpty()) {
+        if (!client.batch_.isEmpty()) {
+            client.batch_ += '\n';
+        }
+        client.batch_ += lastLine;
+    }
+    if (!client.batch_.isEmpty()) {
+        pending_.push_back({nullptr, client.batch_});
+    }
+
+    clients_.erase(it);
+    socket->deleteLater();
+    processPending();
+}
+
+void CommandServer::processPending() {
+    // Running a batch processes events, which may deliver more batches: those are only queued
+    if (b_running_ || pauseCount_ > 0) {
+        return;
+    }
+
+    b_running_ = true;
+    while (!pending_.empty() && pauseCount_ == 0) {
+        const Batch batch = std::move(pending_.front());
+        pending_.pop_front();
+
+        const QByteArray reply = handler_(batch.commands_);
+        if (batch.socket_ && batch.socket_->state() == QLocalSocket::ConnectedState) {
+            batch.socket_->write(reply);
+        }
+    }
+    b_running_ = false;
+}
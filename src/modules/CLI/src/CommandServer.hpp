@@ -0,0 +1,114 @@
+#ifndef COMMANDSERVER_HPP
+#define COMMANDSERVER_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <deque>
+#include <functional>
+
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * @brief Local socket server receiving batches of commands from other processes.
+ *
+ * Clients send commands separated by newlines. A blank line ends a batch, which is
+ * handed to the batch handler as one text and answered with one reply. Clients may
+ * send any number of batches without waiting for the replies, which are written in
+ * the order of the batches.
+ *
+ * Batches are never run while another batch is running or while the server is paused,
+ * e.g. when the handler waits for an animation and processes events in the meantime.
+ * They are queued instead and run as soon as the running batch has finished.
+ */
+class CommandServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Runs a batch and returns the reply sent to the client.
+     *
+     * The batch contains the commands of the batch separated by newlines.
+     */
+    using BatchHandler = std::function<QByteArray(const QString &batch)>;
+
+    /**
+     * @brief Constructs a server that is not listening yet.
+     * @param handler The function running the received batches.
+     * @param parent Pointer to the parent QObject (optional).
+     */
+    explicit CommandServer(BatchHandler handler, QObject *parent = nullptr);
+
+    /**
+     * @brief Starts listening, replacing a stale socket left by a crashed process.
+     * @param name The name of the local socket.
+     * @return True if the server is listening.
+     */
+    bool listen(const QString &name);
+
+    /// @brief Stops listening and disconnects all clients.
+    void close();
+
+    /// @brief Indicates if the server is listening.
+    bool isListening() const;
+
+    /// @brief Returns the full path of the socket, empty if the server is not listening.
+    QString fullServerName() const;
+
+    /// @brief Returns the reason of the last failure to listen.
+    QString errorString() const;
+
+    /**
+     * @brief Pauses or resumes running batches. Pauses nest.
+     * @param paused True to pause, false to undo one pause.
+     */
+    void setPaused(bool paused);
+
+public slots:
+    /**
+     * @brief Runs the queued batches, unless a batch is running or the server is paused.
+     */
+    void processPending();
+
+private slots:
+    /// @brief Accepts the pending connections.
+    void acceptConnections();
+
+    /**
+     * @brief Splits the received data into batches and queues them.
+     * @param socket The client that sent the data.
+     */
+    void readClient(QLocalSocket *socket);
+
+    /**
+     * @brief Forgets a client, running its last batch even if it was not terminated.
+     * @param socket The client that disconnected.
+     */
+    void removeClient(QLocalSocket *socket);
+
+private:
+    /// @brief Data received from a client that does not form a complete batch yet.
+    struct Client {
+        QByteArray line_;  ///< The incomplete last line.
+        QString batch_;    ///< The complete lines of the current batch.
+    };
+
+    /// @brief A complete batch waiting to be run.
+    struct Batch {
+        QPointer<QLocalSocket> socket_; ///< The client receiving the reply, null once it is gone.
+        QString commands_;              ///< The commands separated by newlines.
+    };
+
+    QLocalServer *server_;                  ///< The listening server.
+    BatchHandler handler_;                  ///< Runs the batches.
+    QHash<QLocalSocket *, Client> clients_; ///< The connected clients.
+    std::deque<Batch> pending_;             ///< Batches waiting to be run, oldest first.
+    int pauseCount_;                        ///< Number of active pauses.
+    bool b_running_;                        ///< True while a batch is running.
+};
+
+#endif // COMMANDSERVER_HPP
@@ -0,0 +1,53 @@
+#include "OutputLogModel.hpp"
+
+OutputLogModel::OutputLogModel(std::size_t capacity, QObject *parent)
+    : QAbstractListModel(parent), messages_(capacity) {}
+
+int OutputLogModel::rowCount(const QModelIndex &parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(messages_.size());
+}
+
+QVariant OutputLogModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() < 0 || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    if (role == Qt::DisplayRole || role == MessageRole) {
+        return messages_[index.row()];
+    }
+    return QVariant();
+}
+
+QHash<int, QByteArray> OutputLogModel::roleNames() const {
+    return {{MessageRole, "message"}};
+}
+
+void OutputLogModel::append(const QString &message) {
+    // Drop the oldest row first, so views never see more rows than the capacity
+    if (messages_.full()) {
+        beginRemoveRows(QModelIndex(), 0, 0);
+        messages_.pop_front();
+        endRemoveRows();
+    }
+
+    const int row = rowCount();
+    beginInsertRows(QModelIndex(), row, row);
+    messages_.push_back(message);
+    endInsertRows();
+}
+
+void OutputLogModel::clear() {
+    beginResetModel();
+    messages_.clear();
+    endResetModel();
+}
+
+QString OutputLogModel::join(const QString &separator) const {
+    QString text;
+    for (std::size_t i = 0; i < messages_.size(); ++i) {
+        if (i > 0) {
+            text += separator;
+        }
+        text += messages_[i];
+    }
+    return text;
+}
@@ -0,0 +1,72 @@
+#ifndef OUTPUTLOGMODEL_HPP
+#define OUTPUTLOGMODEL_HPP
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+#include <QString>
+
+#include "RingBuffer.hpp"
+
+/**
+ * @brief List model of the most recent CLI output messages.
+ *
+ * Messages are kept in a ring buffer of fixed capacity. Appending a message only
+ * inserts one row (and removes the oldest row when full), so views never have to
+ * rebuild the whole log.
+ */
+class OutputLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("The output log is provided by the CLI.")
+
+public:
+    /// @brief Roles of the model.
+    enum Roles {
+        MessageRole = Qt::UserRole + 1 ///< The message text, "message" in QML.
+    };
+
+    /**
+     * @brief Constructs an empty log.
+     * @param capacity The maximum number of messages kept.
+     * @param parent Pointer to the parent QObject (optional).
+     */
+    explicit OutputLogModel(std::size_t capacity, QObject *parent = nullptr);
+
+    /**
+     * @brief Returns the number of messages.
+     * @param parent Must be invalid, the model is a flat list.
+     */
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+    /**
+     * @brief Returns a message for the display or message role.
+     * @param index The row of the message, 0 being the oldest.
+     * @param role The requested role.
+     */
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    /// @brief Returns the role names used in QML.
+    QHash<int, QByteArray> roleNames() const override;
+
+    /**
+     * @brief Appends a message, removing the oldest message if the log is full.
+     * @param message The message to append.
+     */
+    void append(const QString &message);
+
+    /// @brief Removes all messages.
+    void clear();
+
+    /**
+     * @brief Joins the messages into one text.
+     * @param separator The text placed between messages.
+     * @return The messages from the oldest to the newest.
+     */
+    QString join(const QString &separator) const;
+
+private:
+    RingBuffer<QString> messages_; ///< The messages, oldest first.
+};
+
+#endif // OUTPUTLOGMODEL_HPP
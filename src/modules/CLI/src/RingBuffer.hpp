@@ -0,0 +1,98 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A fixed-capacity buffer that overwrites its oldest element when full.
+ *
+ * Elements are stored in a single allocation made on construction, so appending
+ * never allocates and never moves the other elements.
+ *
+ * @tparam T The element type.
+ */
+template<typename T>
+class RingBuffer
+{
+public:
+    /**
+     * @brief Constructs an empty buffer.
+     * @param capacity The maximum number of elements, at least 1.
+     */
+    explicit RingBuffer(std::size_t capacity)
+        : elements_(capacity > 0 ? capacity : 1), head_(0), size_(0) {}
+
+    /**
+     * @brief Appends an element, evicting the oldest element if the buffer is full.
+     * @param value The element to append.
+     * @param evicted Receives the evicted element, if any. Can be nullptr.
+     * @return True if an element was evicted.
+     */
+    bool push_back(T value, T *evicted = nullptr) {
+        const std::size_t tail = (head_ + size_) % capacity();
+        if (size_ < capacity()) {
+            elements_[tail] = std::move(value);
+            ++size_;
+            return false;
+        }
+
+        // Full: the new element takes the place of the oldest one
+        if (evicted) {
+            *evicted = std::move(elements_[head_]);
+        }
+        elements_[head_] = std::move(value);
+        head_ = (head_ + 1) % capacity();
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest element. The buffer must not be empty.
+     * @return The removed element.
+     */
+    T pop_front() {
+        T value = std::move(elements_[head_]);
+        elements_[head_] = T();
+        head_ = (head_ + 1) % capacity();
+        --size_;
+        return value;
+    }
+
+    /**
+     * @brief Returns an element.
+     * @param index The position of the element, 0 being the oldest.
+     */
+    const T &operator[](std::size_t index) const { return elements_[(head_ + index) % capacity()]; }
+
+    /// @brief Returns the newest element. The buffer must not be empty.
+    const T &back() const { return (*this)[size_ - 1]; }
+
+    /// @brief Returns the number of stored elements.
+    std::size_t size() const { return size_; }
+
+    /// @brief Returns the maximum number of elements.
+    std::size_t capacity() const { return elements_.size(); }
+
+    /// @brief Checks if the buffer is empty.
+    bool empty() const { return size_ == 0; }
+
+    /// @brief Checks if the next push_back evicts an element.
+    bool full() const { return size_ == capacity(); }
+
+    /// @brief Removes all elements.
+    void clear() {
+        for (T &element : elements_) {
+            element = T();
+        }
+        head_ = 0;
+        size_ = 0;
+    }
+
+private:
+    std::vector<T> elements_; ///< Storage, the elements start at head_ and wrap around.
+    std::size_t head_;        ///< Index of the oldest element in elements_.
+    std::size_t size_;        ///< Number of stored elements.
+};
+
+#endif // RINGBUFFER_HPP
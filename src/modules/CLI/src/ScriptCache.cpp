@@ -0,0 +1,169 @@
+#include "ScriptCache.hpp"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include "trace.hpp"
+
+namespace {
+
+// Marks the files of entries, "TSC" and the format version
+constexpr quint32 ENTRY_MAGIC = 0x54534302;
+
+// File name suffix of the entries
+const char *const ENTRY_SUFFIX = ".tsc";
+
+} // namespace
+
+ScriptCache::ScriptCache(const QString &directory, qint64 maxBytes)
+    : directory_(directory), maxBytes_(maxBytes) {}
+
+QByteArray ScriptCache::key(QIODevice &script, const QByteArray &context) {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(context);
+    if (!hash.addData(&script)) {
+        return QByteArray();
+    }
+    return hash.result().toHex();
+}
+
+QString ScriptCache::filePath(const QByteArray &key) const {
+    return QDir(directory_).filePath(QString::fromLatin1(key) + ENTRY_SUFFIX);
+}
+
+bool ScriptCache::load(const QByteArray &key, Entry &entry) const {
+    TRACE_SCOPE("ScriptCache::load");
+    QFile file(filePath(key));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    // The modification time orders the entries for eviction
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    QDataStream header(&file);
+    quint32 magic = 0;
+    header >> magic;
+    if (magic != ENTRY_MAGIC) {
+        return false;
+    }
+    const QByteArray payload = qUncompress(file.readAll());
+    if (payload.isEmpty()) {
+        return false;
+    }
+
+    QDataStream stream(payload);
+    quint32 color = 0;
+    stream >> entry.position_ >> entry.rotation_ >> entry.speed_ >> entry.penRadius_ >> color >> entry.b_penDown_;
+    entry.penColor_ = QColor::fromRgba(color);
+
+    quint32 savedStateCount = 0;
+    stream >> savedStateCount;
+    entry.savedStates_.clear();
+    for (quint32 i = 0; i < savedStateCount && stream.status() == QDataStream::Ok; ++i) {
+        QPointF position;
+        float rotation = 0.f;
+        stream >> position >> rotation;
+        entry.savedStates_.emplace_back(position, rotation);
+    }
+
+    quint32 globalCount = 0;
+    stream >> globalCount;
+    entry.globals_.clear();
+    for (quint32 i = 0; i < globalCount && stream.status() == QDataStream::Ok; ++i) {
+        QByteArray name;
+        double value = 0.0;
+        stream >> name >> value;
+        entry.globals_.emplace_back(name.toStdString(), value);
+    }
+
+    quint32 lineCount = 0;
+    stream >> lineCount;
+    entry.lines_.clear();
+    entry.lines_.reserve(static_cast<qsizetype>(std::min<quint64>(lineCount, payload.size())));
+    for (quint32 i = 0; i < lineCount && stream.status() == QDataStream::Ok; ++i) {
+        double x1, y1, x2, y2;
+        quint32 lineColor;
+        float width;
+        stream >> x1 >> y1 >> x2 >> y2 >> lineColor >> width;
+        entry.lines_.append(Line(QPointF(x1, y1), QPointF(x2, y2), QColor::fromRgba(lineColor), width));
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool ScriptCache::store(const QByteArray &key, const Entry &entry) {
+    TRACE_SCOPE("ScriptCache::store");
+    if (!QDir().mkpath(directory_)) {
+        return false;
+    }
+
+    QByteArray payload;
+    {
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << entry.position_ << entry.rotation_ << entry.speed_ << entry.penRadius_
+               << quint32(entry.penColor_.rgba()) << entry.b_penDown_;
+
+        stream << quint32(entry.savedStates_.size());
+        for (const auto &savedState : entry.savedStates_) {
+            stream << savedState.first << savedState.second;
+        }
+
+        stream << quint32(entry.globals_.size());
+        for (const auto &global : entry.globals_) {
+            stream << QByteArray::fromStdString(global.first) << global.second;
+        }
+
+        stream << quint32(entry.lines_.size());
+        for (const Line &line : entry.lines_) {
+            stream << line.start_.x() << line.start_.y() << line.end_.x() << line.end_.y()
+                   << quint32(line.color_.rgba()) << line.width_;
+        }
+    }
+
+    // Readers never see a partly written entry
+    QSaveFile file(filePath(key));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream header(&file);
+    header << ENTRY_MAGIC;
+    file.write(qCompress(payload));
+    if (!file.commit()) {
+        return false;
+    }
+
+    evict();
+    return true;
+}
+
+void ScriptCache::evict() {
+    // Newest first, so the least recently used entries are at the end
+    QDir dir(directory_);
+    const QFileInfoList entries = dir.entryInfoList({QString("*") + ENTRY_SUFFIX}, QDir::Files, QDir::Time);
+    qint64 total = 0;
+    for (const QFileInfo &info : entries) {
+        total += info.size();
+    }
+    for (qsizetype i = entries.size() - 1; i >= 0 && total > maxBytes_; --i) {
+        if (QFile::remove(entries[i].filePath())) {
+            total -= entries[i].size();
+        }
+    }
+}
+
+void ScriptCache::clear() {
+    QDir dir(directory_);
+    for (const QFileInfo &info : dir.entryInfoList({QString("*") + ENTRY_SUFFIX}, QDir::Files)) {
+        QFile::remove(info.filePath());
+    }
+}
+
+qint64 ScriptCache::size() const {
+    qint64 total = 0;
+    for (const QFileInfo &info : QDir(directory_).entryInfoList({QString("*") + ENTRY_SUFFIX}, QDir::Files)) {
+        total += info.size();
+    }
+    return total;
+}
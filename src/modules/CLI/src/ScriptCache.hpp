@@ -0,0 +1,109 @@
+#ifndef SCRIPTCACHE_HPP
+#define SCRIPTCACHE_HPP
+
+#include <QByteArray>
+#include <QColor>
+#include <QIODevice>
+#include <QPointF>
+#include <QString>
+#include <QVector>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "turtlecontrol.h"
+
+/**
+ * @brief On-disk cache of the results of running scripts.
+ *
+ * Entries are addressed by a hash of the script text and of everything else the run depends
+ * on (the starting turtle state, the canvas and its obstacles, the variables and functions
+ * of the parser), so a script run again from the same state can be restored instead of being
+ * executed and animated. An entry holds the lines drawn by the script, the final turtle state
+ * with its saved positions and the global variables, in a compressed binary file named after
+ * its key.
+ *
+ * The files are kept below a size limit by removing the least recently used ones, reading
+ * an entry marks it as used.
+ */
+class ScriptCache
+{
+public:
+    /// @brief The default size limit of all entries together.
+    static constexpr qint64 DEFAULT_MAX_BYTES = 256 * 1024 * 1024;
+
+    /**
+     * @brief The result of running a script.
+     */
+    struct Entry
+    {
+        QVector<Line> lines_;   ///< The lines drawn by the script.
+        QPointF position_;      ///< The final position of the turtle.
+        float rotation_ = 0.f;  ///< The final rotation of the turtle.
+        float speed_ = 0.f;     ///< The final speed of the turtle.
+        float penRadius_ = 0.f; ///< The final radius of the pen.
+        QColor penColor_;       ///< The final color of the pen.
+        bool b_penDown_ = true; ///< Indicates if the pen is down at the end.
+        std::vector<std::pair<QPointF, float>> savedStates_; ///< The positions and rotations saved by push_state at the end.
+        std::vector<std::pair<std::string, double>> globals_; ///< The global variables after the run.
+    };
+
+    /**
+     * @brief Constructs a cache storing its entries in a directory.
+     *
+     * @param directory The directory of the entries, created when the first entry is stored.
+     * @param maxBytes The size limit of all entries together.
+     */
+    explicit ScriptCache(const QString &directory, qint64 maxBytes = DEFAULT_MAX_BYTES);
+
+    /// @brief Gets the directory of the entries.
+    const QString &directory() const { return directory_; }
+
+    /// @brief Gets the size limit of all entries together.
+    qint64 maxBytes() const { return maxBytes_; }
+
+    /**
+     * @brief Computes the key of a script run.
+     *
+     * @param script The opened script, read to its end.
+     * @param context Everything besides the script text that the run depends on.
+     * @return The key as hexadecimal digits, or an empty array if the script could not be read.
+     */
+    static QByteArray key(QIODevice &script, const QByteArray &context);
+
+    /**
+     * @brief Reads the entry of a key and marks it as recently used.
+     *
+     * @param key The key of the entry.
+     * @param entry Receives the entry.
+     * @return False if there is no valid entry for the key.
+     */
+    bool load(const QByteArray &key, Entry &entry) const;
+
+    /**
+     * @brief Stores an entry, then removes the least recently used entries above the size limit.
+     *
+     * @param key The key of the entry.
+     * @param entry The entry.
+     * @return False if the entry could not be written.
+     */
+    bool store(const QByteArray &key, const Entry &entry);
+
+    /// @brief Removes all entries.
+    void clear();
+
+    /// @brief Returns the size of all entries together in bytes.
+    qint64 size() const;
+
+private:
+    QString directory_; ///< The directory of the entries.
+    qint64 maxBytes_;   ///< The size limit of all entries together.
+
+    /// @brief Returns the path of the file of a key.
+    QString filePath(const QByteArray &key) const;
+
+    /// @brief Removes the least recently used entries until the entries fit the size limit.
+    void evict();
+};
+
+#endif // SCRIPTCACHE_HPP
@@ -0,0 +1,104 @@
+#include "ScriptSession.hpp"
+#include <QCoreApplication>
+#include <algorithm>
+#include <functional>
+#include "trace.hpp"
+
+ScriptSession::ScriptSession(Parser &parser, TurtleControl &turtleControl)
+    : parser_(parser), turtleControl_(turtleControl), filePath_(), linesGeneration_(0), lineHashes_(),
+      checkpoints_(), offset_(0), commandsSinceCheckpoint_(0), b_waiting_(false) {}
+
+void ScriptSession::begin(const QString &filePath) {
+    clear();
+    filePath_ = filePath;
+    waitForTurtle();
+    linesGeneration_ = turtleControl_.lines_generation();
+    addCheckpoint();
+}
+
+void ScriptSession::clear() {
+    filePath_.clear();
+    lineHashes_.clear();
+    checkpoints_.clear();
+    offset_ = 0;
+    commandsSinceCheckpoint_ = 0;
+}
+
+void ScriptSession::waitForTurtle() const {
+    b_waiting_ = true;
+    while (turtleControl_.is_moving()) {
+        QCoreApplication::processEvents();
+    }
+    b_waiting_ = false;
+}
+
+void ScriptSession::addCheckpoint() {
+    // The last movement may still be animated, the next command would wait for it as well
+    waitForTurtle();
+    checkpoints_.push_back({static_cast<int>(lineHashes_.size()), offset_, turtleControl_.snapshot(), parser_.state()});
+    commandsSinceCheckpoint_ = 0;
+}
+
+qint64 ScriptSession::run(QIODevice &script, const Parser::CommandSink &sink) {
+    TRACE_SCOPE("ScriptSession::run");
+    const auto countCommand = [this, &sink](const script::ExecutedCommand &command) {
+        ++commandsSinceCheckpoint_;
+        sink(command);
+    };
+    const auto recordLine = [this](const std::string &line, bool b_betweenStatements) {
+        lineHashes_.push_back(std::hash<std::string>()(line));
+        offset_ += static_cast<qint64>(line.size()) + 1;
+        if (b_betweenStatements && commandsSinceCheckpoint_ >= CHECKPOINT_COMMANDS) {
+            addCheckpoint();
+        }
+    };
+    return parser_.parse_script(script, countCommand, recordLine);
+}
+
+void ScriptSession::skip(QIODevice &script) {
+    Parser::read_lines(script, [this](const std::string &line) {
+        lineHashes_.push_back(std::hash<std::string>()(line));
+        offset_ += static_cast<qint64>(line.size()) + 1;
+    });
+}
+
+bool ScriptSession::canResume(const QString &filePath) const {
+    return !checkpoints_.empty() && filePath == filePath_
+           && linesGeneration_ == turtleControl_.lines_generation();
+}
+
+int ScriptSession::resume(QIODevice &script, const Parser::CommandSink &sink) {
+    TRACE_SCOPE("ScriptSession::resume");
+
+    // The lines before the first changed one ran the same as in the last run
+    size_t unchanged = 0;
+    bool b_changed = false;
+    Parser::read_lines(script, [this, &unchanged, &b_changed](const std::string &line) {
+        if (b_changed || unchanged >= lineHashes_.size() || std::hash<std::string>()(line) != lineHashes_[unchanged]) {
+            b_changed = true;
+        } else {
+            ++unchanged;
+        }
+    });
+
+    // The start of the script is the first checkpoint, so there always is one
+    auto checkpoint = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), unchanged,
+                                       [](size_t line, const Checkpoint &checkpoint) {
+                                           return line < static_cast<size_t>(checkpoint.line_);
+                                       }) - 1;
+
+    waitForTurtle();
+    turtleControl_.rewind(checkpoint->turtle_);
+    parser_.restore_state(checkpoint->parser_);
+    linesGeneration_ = turtleControl_.lines_generation();
+
+    const int line = checkpoint->line_;
+    lineHashes_.resize(line);
+    offset_ = checkpoint->offset_;
+    checkpoints_.erase(checkpoint + 1, checkpoints_.end());
+    commandsSinceCheckpoint_ = 0;
+
+    script.seek(offset_);
+    run(script, sink);
+    return line;
+}
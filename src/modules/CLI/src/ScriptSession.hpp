@@ -0,0 +1,132 @@
+#ifndef SCRIPTSESSION_HPP
+#define SCRIPTSESSION_HPP
+
+#include <QIODevice>
+#include <QString>
+#include <vector>
+
+#include "parser.hpp"
+#include "turtlecontrol.h"
+
+/**
+ * @brief The last script run, recorded so an edited version of it can be run incrementally.
+ *
+ * While a script runs, a hash of every line is recorded, and every CHECKPOINT_COMMANDS
+ * commands a checkpoint is taken at the next line that ends between top-level statements:
+ * the position in the script, the turtle state with its number of lines and the variables
+ * and functions of the parser. All of these are small, the lines themselves are not copied.
+ *
+ * Running the edited script compares the hashes of its lines with the recorded ones, returns
+ * the turtle and parser to the last checkpoint before the first changed line and runs the
+ * script from there, so an edit near the end of a long script only runs its last commands.
+ */
+class ScriptSession
+{
+public:
+    /// @brief Minimum number of commands between two checkpoints.
+    static constexpr int CHECKPOINT_COMMANDS = 256;
+
+    /**
+     * @brief Constructs a session without a script.
+     *
+     * @param parser The parser running the scripts.
+     * @param turtleControl The turtle driven by the parser.
+     */
+    ScriptSession(Parser &parser, TurtleControl &turtleControl);
+
+    /// @brief Gets the path of the script of the session, empty if there is none.
+    const QString &filePath() const { return filePath_; }
+
+    /// @brief Gets the number of checkpoints recorded for the script.
+    int checkpointCount() const { return static_cast<int>(checkpoints_.size()); }
+
+    /**
+     * @brief Indicates if the session is waiting for the turtle, e.g. to take a checkpoint.
+     *
+     * Events are processed meanwhile, input they deliver must not run until the wait ends,
+     * as it would draw between the last command of the script and the checkpoint.
+     */
+    bool isWaiting() const { return b_waiting_; }
+
+    /**
+     * @brief Starts a session for a script about to run from the current state.
+     *
+     * @param filePath The path of the script.
+     */
+    void begin(const QString &filePath);
+
+    /// @brief Forgets the script of the session.
+    void clear();
+
+    /**
+     * @brief Runs the script of the session, from the current position of the device.
+     *
+     * @param script The opened script, at the position of the last checkpoint.
+     * @param sink Receives each command that was successfully executed.
+     * @return The number of bytes read from the device.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    qint64 run(QIODevice &script, const Parser::CommandSink &sink);
+
+    /**
+     * @brief Records the lines of a script whose effects were restored without running it.
+     *
+     * Only the checkpoint at the start of the script is available then.
+     *
+     * @param script The opened script.
+     */
+    void skip(QIODevice &script);
+
+    /**
+     * @brief Checks if an edited version of a script can be run from a checkpoint.
+     *
+     * That requires the script of the session, and that no lines were removed or replaced
+     * since it ran, e.g. by undo.
+     *
+     * @param filePath The path of the script.
+     */
+    bool canResume(const QString &filePath) const;
+
+    /**
+     * @brief Runs an edited version of the script from the last checkpoint before its first change.
+     *
+     * Lines drawn and variables assigned after that checkpoint, also by commands run after
+     * the script, are discarded.
+     *
+     * @param script The opened script, which canResume() must accept.
+     * @param sink Receives each command that was successfully executed.
+     * @return The index of the line the script was resumed from.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    int resume(QIODevice &script, const Parser::CommandSink &sink);
+
+private:
+    /**
+     * @brief A point between two top-level statements of the script.
+     */
+    struct Checkpoint
+    {
+        int line_;                         ///< Number of lines run before the checkpoint.
+        qint64 offset_;                    ///< Position of the next line in the script.
+        TurtleControl::Snapshot turtle_;   ///< State of the turtle.
+        Parser::State parser_;             ///< Variables and functions of the parser.
+    };
+
+    Parser &parser_;                       ///< The parser running the script.
+    TurtleControl &turtleControl_;         ///< The turtle driven by the parser.
+    QString filePath_;                     ///< Path of the script.
+    quint64 linesGeneration_;              ///< Generation of the turtle's lines the script started from.
+    std::vector<size_t> lineHashes_;       ///< Hashes of the lines run so far.
+    std::vector<Checkpoint> checkpoints_;  ///< Checkpoints in script order, the start of the script first.
+    qint64 offset_;                        ///< Position of the next line to run in the script.
+    int commandsSinceCheckpoint_;          ///< Commands run since the last checkpoint.
+    mutable bool b_waiting_;               ///< True while waitForTurtle processes events.
+
+    /// @brief Takes a checkpoint at the current line, once the turtle has stopped.
+    void addCheckpoint();
+
+    /// @brief Processes events until the last movement of the turtle is done.
+    void waitForTurtle() const;
+};
+
+#endif // SCRIPTSESSION_HPP
@@ -1,12 +1,16 @@
 #include "canvas.hpp"
 #include "obstacle.hpp"
+#include "obstaclemap.hpp"
 #include <QRandomGenerator64>
+#include <QSignalBlocker>
 
 Canvas::Canvas(QObject *parent)
     : QObject(parent)
     , m_width(0)
     , m_height(0)
+    , m_bounded(true)
 {
+    publish_collision_world();
 }
 
 Canvas::~Canvas()
@@ -18,6 +22,7 @@ void Canvas::set_width(qreal width)
 {
     if (m_width != width) {
         m_width = width;
+        publish_collision_world();
         emit width_changed();
     }
 }
@@ -26,10 +31,20 @@ void Canvas::set_height(qreal height)
 {
     if (m_height != height) {
         m_height = height;
+        publish_collision_world();
         emit height_changed();
     }
 }
 
+void Canvas::set_bounded(bool bounded)
+{
+    if (m_bounded != bounded) {
+        m_bounded = bounded;
+        publish_collision_world();
+        emit bounded_changed();
+    }
+}
+
 void Canvas::generate_obstacles(int count, const QPointF& turtle_pos)
 {
     const int MAX_ATTEMPTS = 100;
@@ -42,7 +57,7 @@ void Canvas::generate_obstacles(int count, const QPointF& turtle_pos)
             Obstacle* obstacle = create_random_obstacle();
 
             if (!check_turtle_overlap(obstacle, turtle_pos, TURTLE_WIDTH, TURTLE_HEIGHT)) {
-                m_obstacles.append(obstacle);
+                append_obstacle(obstacle);
                 i++;
                 break;
             }
@@ -56,9 +71,108 @@ void Canvas::generate_obstacles(int count, const QPointF& turtle_pos)
         }
     }
 
+    publish_collision_world();
     emit obstacles_changed();
 }
 
+bool Canvas::load_obstacles(const QString &file_path)
+{
+    QVector<ObstacleMap::Piece> pieces;
+    QString error;
+    if (!ObstacleMap::load(file_path, pieces, error)) {
+        emit obstacles_load_failed(file_path, error);
+        return false;
+    }
+
+    QVector<Obstacle*> obstacles;
+    obstacles.reserve(pieces.size());
+    for (const ObstacleMap::Piece &piece : pieces) {
+        obstacles.append(new Obstacle(piece.polygon_, piece.color_, this));
+    }
+    add_obstacles(obstacles);
+    return true;
+}
+
+void Canvas::add_obstacles(const QVector<Obstacle*> &obstacles)
+{
+    m_obstacles.reserve(m_obstacles.size() + obstacles.size());
+    for (Obstacle *obstacle : obstacles) {
+        obstacle->setParent(this);
+        append_obstacle(obstacle);
+    }
+    publish_collision_world();
+    emit obstacles_changed();
+}
+
+void Canvas::append_obstacle(Obstacle *obstacle)
+{
+    m_obstacles.append(obstacle);
+    connect(obstacle, &Obstacle::points_changed, this, &Canvas::publish_collision_world);
+    connect(obstacle, &Obstacle::motion_changed, this, &Canvas::publish_collision_world);
+}
+
+void Canvas::randomize_motion(qreal max_speed, qreal max_angular_speed)
+{
+    for (Obstacle *obstacle : m_obstacles) {
+        // Each motion change would take a new snapshot, one is taken for all of them below
+        const QSignalBlocker blocker(obstacle);
+        const qreal direction = QRandomGenerator::global()->generateDouble() * 2 * M_PI;
+        const qreal speed = QRandomGenerator::global()->generateDouble() * max_speed;
+        obstacle->set_velocity(QPointF(speed * std::cos(direction), speed * std::sin(direction)));
+        obstacle->set_angular_velocity(max_angular_speed > 0.0
+            ? (QRandomGenerator::global()->generateDouble() * 2 - 1) * max_angular_speed
+            : 0.0);
+    }
+    publish_collision_world();
+}
+
+bool Canvas::claim_clock(QObject *owner)
+{
+    if (!m_clock_owner) {
+        m_clock_owner = owner;
+    }
+    return m_clock_owner == owner;
+}
+
+void Canvas::release_clock(const QObject *owner)
+{
+    if (m_clock_owner == owner) {
+        m_clock_owner = nullptr;
+    }
+}
+
+void Canvas::advance_obstacles(qreal seconds)
+{
+    // Called on every step of the turtle, which must stay cheap among static obstacles
+    if (!has_moving_obstacles()) {
+        return;
+    }
+
+    // Even where the turtle may leave the canvas, obstacles stay on it
+    const QRectF area(0.0, 0.0, m_width, m_height);
+    for (Obstacle *obstacle : m_obstacles) {
+        if (obstacle->is_moving()) {
+            obstacle->advance(seconds, area);
+        }
+    }
+
+    // Only the moving obstacles are read again, in the order of the previous step
+    std::atomic_store(&m_collision_world, collision_world()->advanced(m_obstacles));
+    emit obstacles_moved();
+}
+
+void Canvas::publish_collision_world()
+{
+    const bool b_was_moving = has_moving_obstacles();
+    std::shared_ptr<const CollisionWorld> world = std::make_shared<const CollisionWorld>(
+        QRectF(QPointF(0.f, 0.f), QPointF(m_width, m_height)), m_bounded, m_obstacles);
+    const bool b_moving = world->moving_count() > 0;
+    std::atomic_store(&m_collision_world, std::move(world));
+    if (b_moving != b_was_moving) {
+        emit moving_changed();
+    }
+}
+
 Obstacle* Canvas::create_random_obstacle() const
 {
     const QVector<QColor> color_palette = {
@@ -131,6 +245,7 @@ void Canvas::clear_obstacles()
 {
     qDeleteAll(m_obstacles);
     m_obstacles.clear();
+    publish_collision_world();
     emit obstacles_changed();
 }
 
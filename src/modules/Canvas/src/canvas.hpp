@@ -3,8 +3,11 @@
 
 #include <QObject>
 #include <QPointF>
+#include <QPointer>
 #include <QQmlEngine>
 #include <QVector>
+#include <memory>
+#include "collisionworld.hpp"
 
 class Obstacle;
 
@@ -13,6 +16,15 @@ class Obstacle;
  *
  * This class allows for obstacle generation, clearing, and access to the obstacle count and properties.
  * The canvas size is adjustable, and the obstacles are generated randomly while avoiding overlap with a turtle.
+ * Whenever the size or the obstacles change, the canvas publishes a new CollisionWorld snapshot,
+ * which collision queries on any thread read instead of the canvas itself.
+ *
+ * Obstacles with a velocity or angular velocity are advanced together on a shared clock,
+ * which runs while any obstacle moves. Each step publishes one snapshot and emits
+ * obstacles_moved once for all of them. The clock is the one of a single owner, the first
+ * turtle to claim it, so the obstacles move at the same pace however many turtles share the
+ * canvas: in realtime with a realtime owner, and in bursts with the simulated steps of an
+ * owner that is not realtime. The other turtles only see the obstacles where they are.
  */
 class Canvas : public QObject
 {
@@ -40,6 +52,13 @@ class Canvas : public QObject
      */
     Q_PROPERTY(qreal height READ height WRITE set_height NOTIFY height_changed FINAL)
 
+    /**
+     * @brief Whether the turtle collides with the edges of the canvas.
+     *
+     * If false, the turtle can move anywhere and only obstacles stop it. True by default.
+     */
+    Q_PROPERTY(bool bounded READ bounded WRITE set_bounded NOTIFY bounded_changed FINAL)
+
 public:
     /**
      * @brief Constructs a Canvas object with optional parent.
@@ -76,6 +95,18 @@ public:
      */
     void set_height(qreal height);
 
+    /**
+     * @brief Returns whether the turtle collides with the edges of the canvas.
+     * @return True if the canvas stops the turtle at its edges.
+     */
+    bool bounded() const { return m_bounded; }
+
+    /**
+     * @brief Sets whether the turtle collides with the edges of the canvas and notifies the change.
+     * @param bounded True to stop the turtle at the edges.
+     */
+    void set_bounded(bool bounded);
+
     /**
      * @brief Returns the shape of the canvas.
      * @return The shape of the canvas, QPolygonF with the origin at (0,0) and 4 points forming a rectangle.
@@ -89,6 +120,68 @@ public:
      */
     Q_INVOKABLE void generate_obstacles(int count, const QPointF& turtle_pos);
 
+    /**
+     * @brief Adds obstacles read from an obstacle map file.
+     *
+     * Concave polygons are decomposed into convex obstacles, see ObstacleMap for the formats.
+     * All obstacles are added at once, with a single obstacles_changed emission.
+     *
+     * @param file_path The path or file URL of the map.
+     * @return False if the file cannot be read, the obstacles are unchanged then and
+     *         obstacles_load_failed is emitted.
+     */
+    Q_INVOKABLE bool load_obstacles(const QString &file_path);
+
+    /**
+     * @brief Adds obstacles with a single obstacles_changed emission.
+     * @param obstacles The obstacles, owned by the canvas from now on.
+     */
+    void add_obstacles(const QVector<Obstacle*> &obstacles);
+
+    /**
+     * @brief Gives every obstacle a random velocity and angular velocity, or stops them all.
+     *
+     * The snapshot is taken once for all obstacles; their motion_changed is not emitted.
+     *
+     * @param max_speed The maximum speed in pixels per second, 0 to keep the obstacles in place.
+     * @param max_angular_speed The maximum angular speed in degrees per second, 0 to keep them
+     *                          from rotating. Both 0 stop the obstacles.
+     */
+    Q_INVOKABLE void randomize_motion(qreal max_speed, qreal max_angular_speed);
+
+    /**
+     * @brief Makes an object the owner of the clock moving the obstacles, unless another one is.
+     *
+     * The owner is released when it is deleted, so another object may claim the clock then.
+     *
+     * @param owner The object advancing the obstacles, e.g. a turtle.
+     * @return True if owner owns the clock, and so has to call advance_obstacles().
+     */
+    bool claim_clock(QObject *owner);
+
+    /**
+     * @brief Releases the clock, if it is owned by an object.
+     * @param owner The object that may own the clock.
+     */
+    void release_clock(const QObject *owner);
+
+    /**
+     * @brief Checks if an object owns the clock moving the obstacles.
+     * @param owner The object.
+     * @return True if owner claimed the clock and did not release it.
+     */
+    bool owns_clock(const QObject *owner) const { return m_clock_owner == owner; }
+
+    /**
+     * @brief Moves and rotates the moving obstacles by their velocities over a time step.
+     *
+     * Called by the owner of the clock on every step, so obstacles and turtle move in lockstep.
+     * The obstacles bounce off the edges of the canvas.
+     *
+     * @param seconds The time step.
+     */
+    void advance_obstacles(qreal seconds);
+
     /**
      * @brief Clears all obstacles from the canvas.
      */
@@ -120,12 +213,49 @@ public:
      */
     const QVector<Obstacle*>& get_obstacles() const { return m_obstacles; }
 
+    /**
+     * @brief Returns the current collision snapshot of the canvas.
+     *
+     * Safe to call from any thread. The snapshot stays valid and unchanged while it is held,
+     * even if the obstacles are edited or the canvas is deleted meanwhile.
+     *
+     * @return The snapshot published after the last change of the size or the obstacles.
+     */
+    std::shared_ptr<const CollisionWorld> collision_world() const { return std::atomic_load(&m_collision_world); }
+
+    /**
+     * @brief Checks if any obstacle moves, so the clock has to run.
+     * @return True if the current snapshot has moving obstacles.
+     */
+    bool has_moving_obstacles() const
+    {
+        const std::shared_ptr<const CollisionWorld> world = collision_world();
+        return world && world->moving_count() > 0;
+    }
+
 signals:
     /**
      * @brief Signal emitted when the list of obstacles has changed.
      */
     void obstacles_changed();
 
+    /**
+     * @brief Signal emitted once per step of the clock in which obstacles moved.
+     */
+    void obstacles_moved();
+
+    /**
+     * @brief Signal emitted when the first obstacle starts or the last one stops moving.
+     */
+    void moving_changed();
+
+    /**
+     * @brief Signal emitted when load_obstacles cannot read a file, to report the error to the user.
+     * @param file_path The path or file URL of the file.
+     * @param error The reason, e.g. the line that cannot be parsed.
+     */
+    void obstacles_load_failed(const QString &file_path, const QString &error);
+
     /**
      * @brief Signal emitted when the width of the canvas has changed.
      */
@@ -136,10 +266,31 @@ signals:
      */
     void height_changed();
 
+    /**
+     * @brief Signal emitted when the canvas becomes bounded or unbounded.
+     */
+    void bounded_changed();
+
 private:
     QVector<Obstacle*> m_obstacles; ///< List of obstacles in the canvas
     qreal m_width; ///< The width of the canvas
     qreal m_height; ///< The height of the canvas
+    bool m_bounded; ///< True if the turtle collides with the edges of the canvas
+    std::shared_ptr<const CollisionWorld> m_collision_world; ///< The snapshot, only accessed atomically
+    QPointer<QObject> m_clock_owner; ///< The object advancing the moving obstacles, if any
+
+    /**
+     * @brief Takes a new collision snapshot and publishes it in place of the previous one.
+     *
+     * Emits moving_changed if obstacles started or stopped moving.
+     */
+    void publish_collision_world();
+
+    /**
+     * @brief Appends an obstacle and republishes the snapshot when its points or motion change.
+     * @param obstacle The obstacle, owned by the canvas from now on.
+     */
+    void append_obstacle(Obstacle *obstacle);
 
     /**
      * @brief Checks if an obstacle overlaps with the turtle area.
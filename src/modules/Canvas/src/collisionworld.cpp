@@ -0,0 +1,196 @@
+#include "collisionworld.hpp"
+#include "obstacle.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+CollisionWorld::CollisionWorld(const QRectF &bounds, bool bounded, const QVector<Obstacle*> &obstacles)
+    : m_bounds(bounds)
+    , m_shape(bounds)
+    , m_bounded(bounded)
+    , m_sweep_width(0.0)
+{
+    m_bodies.reserve(obstacles.size());
+    std::vector<int> static_bodies;
+    for (Obstacle *obstacle : obstacles) {
+        Body body;
+        body.polygon_ = obstacle->get_points();
+        body.bounds_ = obstacle->get_bounds();
+        body.obstacle_ = obstacle;
+        if (obstacle->is_moving()) {
+            m_sweep.push_back({body.bounds_.left(), obstacle_count()});
+            m_sweep_width = std::max(m_sweep_width, body.bounds_.width());
+        } else {
+            static_bodies.push_back(obstacle_count());
+        }
+        m_bodies.push_back(body);
+    }
+    build_grid(static_bodies);
+    sort_sweep();
+}
+
+std::shared_ptr<const CollisionWorld> CollisionWorld::advanced(const QVector<Obstacle*> &obstacles) const
+{
+    // The bodies share their polygons with this snapshot until they are replaced
+    std::shared_ptr<CollisionWorld> world = std::make_shared<CollisionWorld>(*this);
+    world->m_sweep_width = 0.0;
+    for (SweepEntry &entry : world->m_sweep) {
+        Body &body = world->m_bodies[entry.body_];
+        const Obstacle *obstacle = obstacles[entry.body_];
+        body.polygon_ = obstacle->get_points();
+        body.bounds_ = obstacle->get_bounds();
+        entry.left_ = body.bounds_.left();
+        world->m_sweep_width = std::max(world->m_sweep_width, body.bounds_.width());
+    }
+    world->sort_sweep();
+    return world;
+}
+
+void CollisionWorld::build_grid(const std::vector<int> &bodies)
+{
+    std::shared_ptr<Grid> grid = std::make_shared<Grid>();
+    grid->cell_starts_.assign(1, 0);
+    m_grid = grid;
+    if (bodies.empty()) {
+        return;
+    }
+
+    qreal extent_sum = 0.0;
+    for (int index : bodies) {
+        grid->bounds_ |= m_bodies[index].bounds_;
+        extent_sum += std::max(m_bodies[index].bounds_.width(), m_bodies[index].bounds_.height());
+    }
+
+    // Cells about as large as an average obstacle, so most of them overlap a few cells
+    const qreal extent = std::max(extent_sum / bodies.size(), qreal(1.0));
+    grid->columns_ = std::clamp(static_cast<int>(std::ceil(grid->bounds_.width() / extent)), 1, MAX_GRID_SIZE);
+    grid->rows_ = std::clamp(static_cast<int>(std::ceil(grid->bounds_.height() / extent)), 1, MAX_GRID_SIZE);
+
+    // Count the obstacles of each cell, then place them behind those of the cells before
+    grid->cell_starts_.assign(static_cast<size_t>(grid->columns_) * grid->rows_ + 1, 0);
+    for (int index : bodies) {
+        int first_x, first_y, last_x, last_y;
+        cell_range(*grid, m_bodies[index].bounds_, first_x, first_y, last_x, last_y);
+        for (int y = first_y; y <= last_y; ++y) {
+            for (int x = first_x; x <= last_x; ++x) {
+                ++grid->cell_starts_[static_cast<size_t>(y) * grid->columns_ + x + 1];
+            }
+        }
+    }
+    for (size_t cell = 1; cell < grid->cell_starts_.size(); ++cell) {
+        grid->cell_starts_[cell] += grid->cell_starts_[cell - 1];
+    }
+    grid->cell_bodies_.resize(grid->cell_starts_.back());
+    std::vector<int> next(grid->cell_starts_.begin(), grid->cell_starts_.end() - 1);
+    for (int index : bodies) {
+        int first_x, first_y, last_x, last_y;
+        cell_range(*grid, m_bodies[index].bounds_, first_x, first_y, last_x, last_y);
+        for (int y = first_y; y <= last_y; ++y) {
+            for (int x = first_x; x <= last_x; ++x) {
+                grid->cell_bodies_[next[static_cast<size_t>(y) * grid->columns_ + x]++] = index;
+            }
+        }
+    }
+}
+
+void CollisionWorld::sort_sweep()
+{
+    for (size_t i = 1; i < m_sweep.size(); ++i) {
+        const SweepEntry entry = m_sweep[i];
+        size_t j = i;
+        for (; j > 0 && m_sweep[j - 1].left_ > entry.left_; --j) {
+            m_sweep[j] = m_sweep[j - 1];
+        }
+        m_sweep[j] = entry;
+    }
+}
+
+bool CollisionWorld::cell_range(const Grid &grid, const QRectF &rect, int &first_x, int &first_y, int &last_x, int &last_y)
+{
+    if (grid.columns_ == 0 || rect.right() < grid.bounds_.left() || rect.left() > grid.bounds_.right()
+        || rect.bottom() < grid.bounds_.top() || rect.top() > grid.bounds_.bottom()) {
+        return false;
+    }
+    const qreal cell_width = grid.bounds_.width() / grid.columns_;
+    const qreal cell_height = grid.bounds_.height() / grid.rows_;
+    const auto column = [&](qreal x) {
+        return cell_width > 0.0
+            ? std::clamp(static_cast<int>(std::floor((x - grid.bounds_.left()) / cell_width)), 0, grid.columns_ - 1)
+            : 0;
+    };
+    const auto row = [&](qreal y) {
+        return cell_height > 0.0
+            ? std::clamp(static_cast<int>(std::floor((y - grid.bounds_.top()) / cell_height)), 0, grid.rows_ - 1)
+            : 0;
+    };
+    first_x = column(rect.left());
+    last_x = column(rect.right());
+    first_y = row(rect.top());
+    last_y = row(rect.bottom());
+    return true;
+}
+
+template<typename Visitor>
+bool CollisionWorld::visit_candidates(const QRectF &rect, Visitor visit) const
+{
+    const Grid &grid = *m_grid;
+    int first_x, first_y, last_x, last_y;
+    if (cell_range(grid, rect, first_x, first_y, last_x, last_y)) {
+        for (int y = first_y; y <= last_y; ++y) {
+            for (int x = first_x; x <= last_x; ++x) {
+                const size_t cell = static_cast<size_t>(y) * grid.columns_ + x;
+                for (int entry = grid.cell_starts_[cell]; entry < grid.cell_starts_[cell + 1]; ++entry) {
+                    if (visit(grid.cell_bodies_[entry])) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    // A moving obstacle overlapping the rectangle starts at most m_sweep_width to its left
+    auto entry = std::lower_bound(m_sweep.begin(), m_sweep.end(), rect.left() - m_sweep_width,
+                                  [](const SweepEntry &entry, qreal left) { return entry.left_ < left; });
+    for (; entry != m_sweep.end() && entry->left_ <= rect.right(); ++entry) {
+        if (visit(entry->body_)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int CollisionWorld::first_hit(const QPolygonF &polygon, int *tested) const
+{
+    const QRectF polygon_bounds = polygon.boundingRect();
+    std::vector<int> candidates;
+    visit_candidates(polygon_bounds, [&](int index) {
+        if (m_bodies[index].bounds_.intersects(polygon_bounds)) {
+            candidates.push_back(index);
+        }
+        return false;
+    });
+
+    // Obstacles spanning several cells are found more than once, the first in canvas order wins
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    int count = 0;
+    int hit = -1;
+    for (int index : candidates) {
+        ++count;
+        if (m_bodies[index].polygon_.intersects(polygon)) {
+            hit = index;
+            break;
+        }
+    }
+    if (tested) {
+        *tested = count;
+    }
+    return hit;
+}
+
+bool CollisionWorld::intersects(const QRectF &rect) const
+{
+    return visit_candidates(rect, [&](int index) {
+        return m_bodies[index].bounds_.intersects(rect);
+    });
+}
@@ -0,0 +1,177 @@
+#ifndef COLLISIONWORLD_H
+#define COLLISIONWORLD_H
+
+#include <QPolygonF>
+#include <QRectF>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+class Obstacle;
+
+/**
+ * @brief An immutable snapshot of everything the turtle can collide with on a canvas.
+ *
+ * The canvas publishes a new snapshot whenever its size or its obstacles change, and never
+ * modifies a published one, so any number of threads can query a snapshot without locks
+ * while the obstacles are edited. The obstacle polygons are copied together with their
+ * bounding boxes. Static obstacles are indexed by a uniform grid over them, so a query only
+ * tests the obstacles whose cells it touches. Moving obstacles are kept sorted by their left
+ * edge for sweep and prune: a query only tests those whose left edge lies between its own,
+ * less the width of the widest moving obstacle, and its right edge.
+ *
+ * While obstacles move, each step takes a snapshot with advanced(), which shares the grid
+ * of the static obstacles with the previous snapshot and re-sorts the moving ones from the
+ * previous order, which takes little more than a pass when they moved by small steps.
+ */
+class CollisionWorld
+{
+public:
+    /// @brief Maximum number of grid cells per side.
+    static constexpr int MAX_GRID_SIZE = 256;
+
+    /**
+     * @brief The geometry of an obstacle at the time of the snapshot.
+     */
+    struct Body
+    {
+        QPolygonF polygon_;  ///< The points of the obstacle.
+        QRectF bounds_;      ///< The bounding box of the points.
+        Obstacle *obstacle_; ///< The obstacle, only to identify it; it may be deleted since.
+    };
+
+    /**
+     * @brief Takes a snapshot of a canvas.
+     * @param bounds The canvas area, with the origin at (0,0).
+     * @param bounded True if the turtle collides with the edges of the canvas.
+     * @param obstacles The obstacles of the canvas.
+     */
+    CollisionWorld(const QRectF &bounds, bool bounded, const QVector<Obstacle*> &obstacles);
+
+    /**
+     * @brief Takes a snapshot after the moving obstacles moved.
+     *
+     * @param obstacles The obstacles of the canvas, the same as when this snapshot was taken
+     *                  by the constructor or advanced(); only the moving ones are read.
+     * @return The new snapshot.
+     */
+    std::shared_ptr<const CollisionWorld> advanced(const QVector<Obstacle*> &obstacles) const;
+
+    /**
+     * @brief Returns the canvas area.
+     * @return The rectangle from (0,0) to the width and height of the canvas.
+     */
+    const QRectF &bounds() const { return m_bounds; }
+
+    /**
+     * @brief Returns the canvas area as a polygon.
+     * @return The 4 corners of the canvas, as Canvas::get_shape().
+     */
+    const QPolygonF &shape() const { return m_shape; }
+
+    /**
+     * @brief Returns whether the turtle collides with the edges of the canvas.
+     * @return True if the canvas stops the turtle at its edges.
+     */
+    bool bounded() const { return m_bounded; }
+
+    /**
+     * @brief Returns the number of obstacles.
+     * @return The number of obstacles in the snapshot.
+     */
+    int obstacle_count() const { return static_cast<int>(m_bodies.size()); }
+
+    /**
+     * @brief Returns the number of moving obstacles.
+     * @return The number of obstacles in the sweep and prune list.
+     */
+    int moving_count() const { return static_cast<int>(m_sweep.size()); }
+
+    /**
+     * @brief Returns the geometry of an obstacle.
+     * @param index The index of the obstacle, in the order of Canvas::get_obstacles().
+     * @return The obstacle geometry.
+     */
+    const Body &body(int index) const { return m_bodies[index]; }
+
+    /**
+     * @brief Finds the first obstacle intersecting a polygon.
+     *
+     * @param polygon The polygon, e.g. the turtle shape.
+     * @param tested If not null, receives the number of obstacles tested polygon by polygon.
+     * @return The lowest index of an obstacle intersecting the polygon, or -1 if none does.
+     */
+    int first_hit(const QPolygonF &polygon, int *tested = nullptr) const;
+
+    /**
+     * @brief Checks if the bounding box of any obstacle intersects a rectangle.
+     * @param rect The rectangle.
+     * @return True if an obstacle may intersect the rectangle.
+     */
+    bool intersects(const QRectF &rect) const;
+
+private:
+    /**
+     * @brief The uniform grid indexing the static obstacles.
+     */
+    struct Grid
+    {
+        QRectF bounds_;                 ///< The area covered by the grid, the union of the obstacle bounds.
+        int columns_ = 0;               ///< The number of columns.
+        int rows_ = 0;                  ///< The number of rows.
+        std::vector<int> cell_starts_;  ///< First entry of each cell in cell_bodies_, row by row, plus the end.
+        std::vector<int> cell_bodies_;  ///< The indexes of the obstacles overlapping each cell.
+    };
+
+    /**
+     * @brief A moving obstacle in the sweep and prune list.
+     */
+    struct SweepEntry
+    {
+        qreal left_; ///< The left edge of the obstacle bounds.
+        int body_;   ///< The index of the obstacle.
+    };
+
+    QRectF m_bounds;              ///< The canvas area.
+    QPolygonF m_shape;            ///< The canvas area as a polygon.
+    bool m_bounded;               ///< True if the turtle collides with the edges of the canvas.
+    std::vector<Body> m_bodies;   ///< The obstacles, in canvas order.
+    std::shared_ptr<const Grid> m_grid; ///< The static obstacles, shared by the snapshots of advanced().
+    std::vector<SweepEntry> m_sweep;    ///< The moving obstacles, sorted by their left edge.
+    qreal m_sweep_width;          ///< The width of the widest moving obstacle.
+
+    /**
+     * @brief Builds the grid over the static obstacles.
+     * @param bodies The indexes of the static obstacles.
+     */
+    void build_grid(const std::vector<int> &bodies);
+
+    /**
+     * @brief Sorts the sweep and prune list after its left edges changed.
+     *
+     * Insertion sort, linear when the order barely changed.
+     */
+    void sort_sweep();
+
+    /**
+     * @brief Calls a function with the index of every obstacle that may intersect a rectangle.
+     *
+     * These are the static obstacles in the grid cells the rectangle touches, then the moving
+     * obstacles in the sweep range of the rectangle. A static obstacle overlapping several of
+     * these cells is visited once for each of them.
+     *
+     * @param rect The rectangle.
+     * @param visit The function, returning true to stop.
+     * @return True if the function stopped the visit.
+     */
+    template<typename Visitor>
+    bool visit_candidates(const QRectF &rect, Visitor visit) const;
+
+    /**
+     * @brief Returns the range of grid cells a rectangle touches.
+     * @return False if the rectangle is outside the grid.
+     */
+    static bool cell_range(const Grid &grid, const QRectF &rect, int &first_x, int &first_y, int &last_x, int &last_y);
+};
+
+#endif // COLLISIONWORLD_H
@@ -0,0 +1,533 @@
+#include "obstaclemap.hpp"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Relative area below which three points count as collinear
+constexpr qreal COLLINEAR_EPSILON = 1e-9;
+
+qreal cross(const QPointF &a, const QPointF &b, const QPointF &c)
+{
+    return (b.x() - a.x()) * (c.y() - b.y()) - (b.y() - a.y()) * (c.x() - b.x());
+}
+
+qreal signed_area(const std::vector<QPointF> &points)
+{
+    qreal area = 0.0;
+    for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+        area += points[j].x() * points[i].y() - points[i].x() * points[j].y();
+    }
+    return area * 0.5;
+}
+
+// Drops repeated and collinear points, and orients the rest to a positive signed area
+std::vector<QPointF> clean_polygon(const QPolygonF &polygon)
+{
+    std::vector<QPointF> points;
+    points.reserve(polygon.size());
+    for (const QPointF &point : polygon) {
+        if (points.empty() || point != points.back()) {
+            points.push_back(point);
+        }
+    }
+    while (points.size() > 1 && points.front() == points.back()) {
+        points.pop_back();
+    }
+
+    const QRectF bounds = polygon.boundingRect();
+    const qreal epsilon = COLLINEAR_EPSILON * std::max(bounds.width() * bounds.height(), qreal(1.0));
+    bool b_changed = true;
+    while (b_changed && points.size() >= 3) {
+        b_changed = false;
+        std::vector<QPointF> kept;
+        kept.reserve(points.size());
+        for (size_t i = 0; i < points.size(); ++i) {
+            const QPointF &previous = kept.empty() ? points.back() : kept.back();
+            const QPointF &next = points[(i + 1) % points.size()];
+            if (std::abs(cross(previous, points[i], next)) <= epsilon) {
+                b_changed = true;
+                continue;
+            }
+            kept.push_back(points[i]);
+        }
+        points.swap(kept);
+    }
+    if (points.size() < 3) {
+        return {};
+    }
+    if (signed_area(points) < 0.0) {
+        std::reverse(points.begin(), points.end());
+    }
+    return points;
+}
+
+bool in_triangle(const QPointF &p, const QPointF &a, const QPointF &b, const QPointF &c)
+{
+    return cross(a, b, p) >= 0.0 && cross(b, c, p) >= 0.0 && cross(c, a, p) >= 0.0;
+}
+
+quint64 edge_key(int from, int to)
+{
+    return (static_cast<quint64>(static_cast<quint32>(from)) << 32) | static_cast<quint32>(to);
+}
+
+// Reads the number starting at pos, e.g. "-1.5e3", and moves pos behind it
+bool read_number(const QByteArray &text, int &pos, qreal &value)
+{
+    const int start = pos;
+    if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+        ++pos;
+    }
+    bool b_digits = false;
+    while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+        ++pos;
+        b_digits = true;
+    }
+    if (pos < text.size() && text[pos] == '.') {
+        ++pos;
+        while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+            ++pos;
+            b_digits = true;
+        }
+    }
+    if (b_digits && pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+        int exponent = pos + 1;
+        if (exponent < text.size() && (text[exponent] == '-' || text[exponent] == '+')) {
+            ++exponent;
+        }
+        if (exponent < text.size() && std::isdigit(static_cast<unsigned char>(text[exponent]))) {
+            pos = exponent;
+            while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+                ++pos;
+            }
+        }
+    }
+    if (!b_digits) {
+        pos = start;
+        return false;
+    }
+    bool b_ok = false;
+    value = text.mid(start, pos - start).toDouble(&b_ok);
+    return b_ok;
+}
+
+void skip_separators(const QByteArray &text, int &pos)
+{
+    while (pos < text.size() && (std::isspace(static_cast<unsigned char>(text[pos])) || text[pos] == ',')) {
+        ++pos;
+    }
+}
+
+// Reads coordinate pairs separated by whitespace or commas, as in SVG points attributes
+bool read_points(const QByteArray &text, QPolygonF &polygon)
+{
+    int pos = 0;
+    skip_separators(text, pos);
+    while (pos < text.size()) {
+        qreal x, y;
+        if (!read_number(text, pos, x)) {
+            return false;
+        }
+        skip_separators(text, pos);
+        if (!read_number(text, pos, y)) {
+            return false;
+        }
+        polygon << QPointF(x, y);
+        skip_separators(text, pos);
+    }
+    return true;
+}
+
+// The fill color of an SVG element, from its fill attribute or style
+QColor svg_fill(const QXmlStreamAttributes &attributes, const QColor &inherited)
+{
+    QString fill = attributes.value(QStringLiteral("fill")).toString().trimmed();
+    const QStringList declarations = attributes.value(QStringLiteral("style")).toString().split(';');
+    for (const QString &declaration : declarations) {
+        const int colon = declaration.indexOf(':');
+        if (colon > 0 && declaration.left(colon).trimmed() == QStringLiteral("fill")) {
+            fill = declaration.mid(colon + 1).trimmed();
+        }
+    }
+    if (fill.isEmpty() || fill == QStringLiteral("inherit")) {
+        return inherited;
+    }
+    const QColor color = QColor::fromString(fill);
+    return color.isValid() ? color : inherited;
+}
+
+// Reads the straight segments of an SVG path, one polygon per subpath
+bool read_path(const QByteArray &d, QVector<QPolygonF> &polygons)
+{
+    QPolygonF polygon;
+    QPointF current;
+    QPointF subpath_start;
+    char command = 0;
+    int pos = 0;
+    const auto finish = [&]() {
+        if (polygon.size() >= 3) {
+            polygons.append(polygon);
+        }
+        polygon.clear();
+    };
+
+    skip_separators(d, pos);
+    while (pos < d.size()) {
+        if (std::isalpha(static_cast<unsigned char>(d[pos]))) {
+            command = d[pos++];
+            if (command == 'Z' || command == 'z') {
+                finish();
+                current = subpath_start;
+            }
+            skip_separators(d, pos);
+            continue;
+        }
+
+        const bool b_relative = std::islower(static_cast<unsigned char>(command));
+        qreal x = 0.0;
+        qreal y = 0.0;
+        switch (std::toupper(static_cast<unsigned char>(command))) {
+        case 'M':
+        case 'L':
+            if (!read_number(d, pos, x)) {
+                return false;
+            }
+            skip_separators(d, pos);
+            if (!read_number(d, pos, y)) {
+                return false;
+            }
+            current = b_relative ? current + QPointF(x, y) : QPointF(x, y);
+            if (command == 'M' || command == 'm') {
+                finish();
+                subpath_start = current;
+                command = b_relative ? 'l' : 'L'; // further pairs are lines
+            }
+            break;
+        case 'H':
+            if (!read_number(d, pos, x)) {
+                return false;
+            }
+            current.setX(b_relative ? current.x() + x : x);
+            break;
+        case 'V':
+            if (!read_number(d, pos, y)) {
+                return false;
+            }
+            current.setY(b_relative ? current.y() + y : y);
+            break;
+        default:
+            return false; // curves and arcs are not supported
+        }
+        polygon << current;
+        skip_separators(d, pos);
+    }
+    finish();
+    return true;
+}
+
+} // namespace
+
+bool ObstacleMap::load(const QString &file_path, QVector<Piece> &pieces, QString &error)
+{
+    const QString local_path = file_path.startsWith("file://") ? QUrl(file_path).toLocalFile() : file_path;
+    QFile file(local_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = "Failed to open file: " + local_path;
+        return false;
+    }
+    return parse(file.readAll(), QFileInfo(local_path).suffix().toLower(), pieces, error);
+}
+
+bool ObstacleMap::parse(const QByteArray &data, const QString &suffix, QVector<Piece> &pieces, QString &error)
+{
+    QVector<Shape> shapes;
+    bool b_parsed = false;
+    if (suffix == "json") {
+        b_parsed = parse_json(data, shapes, error);
+    } else if (suffix == "svg") {
+        b_parsed = parse_svg(data, shapes, error);
+    } else {
+        b_parsed = parse_text(data, shapes, error);
+    }
+    if (!b_parsed) {
+        return false;
+    }
+
+    QVector<Piece> decomposed;
+    for (const Shape &shape : shapes) {
+        for (const QPolygonF &polygon : decompose(shape.polygon_)) {
+            decomposed.append({polygon, shape.color_});
+        }
+    }
+    pieces = std::move(decomposed);
+    return true;
+}
+
+bool ObstacleMap::parse_text(const QByteArray &data, QVector<Shape> &shapes, QString &error)
+{
+    const QList<QByteArray> lines = data.split('\n');
+    for (int number = 0; number < lines.size(); ++number) {
+        QByteArray line = lines[number];
+        for (int pos = line.indexOf('#'); pos >= 0; pos = line.indexOf('#', pos + 1)) {
+            if (pos + 1 == line.size() || std::isspace(static_cast<unsigned char>(line[pos + 1]))) {
+                line.truncate(pos); // a comment, not a color
+                break;
+            }
+        }
+        line = line.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        Shape shape{QPolygonF(), QColor::fromRgba(DEFAULT_COLOR)};
+        int pos = 0;
+        if (!std::isdigit(static_cast<unsigned char>(line[0])) && line[0] != '-' && line[0] != '+' && line[0] != '.') {
+            while (pos < line.size() && !std::isspace(static_cast<unsigned char>(line[pos])) && line[pos] != ',') {
+                ++pos;
+            }
+            shape.color_ = QColor::fromString(QString::fromLatin1(line.left(pos)));
+            if (!shape.color_.isValid()) {
+                error = QString("Line %1: unknown color %2").arg(number + 1).arg(QString::fromLatin1(line.left(pos)));
+                return false;
+            }
+        }
+        if (!read_points(line.mid(pos), shape.polygon_) || shape.polygon_.size() < 3) {
+            error = QString("Line %1: expected at least 3 points as x y pairs").arg(number + 1);
+            return false;
+        }
+        shapes.append(shape);
+    }
+    return true;
+}
+
+bool ObstacleMap::parse_json(const QByteArray &data, QVector<Shape> &shapes, QString &error)
+{
+    QJsonParseError parse_error;
+    const QJsonDocument document = QJsonDocument::fromJson(data, &parse_error);
+    if (document.isNull()) {
+        error = "Invalid JSON: " + parse_error.errorString();
+        return false;
+    }
+    const QJsonArray obstacles = document.isArray() ? document.array()
+                                                    : document.object().value("obstacles").toArray();
+
+    for (int index = 0; index < obstacles.size(); ++index) {
+        const QJsonObject obstacle = obstacles[index].toObject();
+        const QJsonArray points = obstacle.value("points").toArray();
+        Shape shape{QPolygonF(), QColor::fromRgba(DEFAULT_COLOR)};
+        if (obstacle.contains("color")) {
+            shape.color_ = QColor::fromString(obstacle.value("color").toString());
+            if (!shape.color_.isValid()) {
+                error = QString("Obstacle %1: unknown color").arg(index);
+                return false;
+            }
+        }
+
+        // Either [[x, y], ...] or [x, y, x, y, ...]
+        for (int i = 0; i < points.size(); ++i) {
+            if (points[i].isArray()) {
+                const QJsonArray point = points[i].toArray();
+                if (point.size() != 2) {
+                    break;
+                }
+                shape.polygon_ << QPointF(point[0].toDouble(), point[1].toDouble());
+            } else if (i + 1 < points.size()) {
+                shape.polygon_ << QPointF(points[i].toDouble(), points[i + 1].toDouble());
+                ++i;
+            }
+        }
+        if (shape.polygon_.size() < 3) {
+            error = QString("Obstacle %1: expected at least 3 points").arg(index);
+            return false;
+        }
+        shapes.append(shape);
+    }
+    return true;
+}
+
+bool ObstacleMap::parse_svg(const QByteArray &data, QVector<Shape> &shapes, QString &error)
+{
+    QXmlStreamReader reader(data);
+    QVector<QColor> fills{QColor::fromRgba(DEFAULT_COLOR)}; // inherited from the enclosing groups
+
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isEndElement()) {
+            fills.removeLast();
+            continue;
+        }
+        if (!reader.isStartElement()) {
+            continue;
+        }
+
+        const QXmlStreamAttributes attributes = reader.attributes();
+        const QColor fill = svg_fill(attributes, fills.last());
+        fills.append(fill);
+        const QStringView name = reader.name();
+        QVector<QPolygonF> polygons;
+        if (name == QStringLiteral("polygon")) {
+            QPolygonF polygon;
+            if (!read_points(attributes.value(QStringLiteral("points")).toLatin1(), polygon)) {
+                error = QString("Line %1: invalid polygon points").arg(reader.lineNumber());
+                return false;
+            }
+            polygons.append(polygon);
+        } else if (name == QStringLiteral("rect")) {
+            const QRectF rect(attributes.value(QStringLiteral("x")).toDouble(),
+                              attributes.value(QStringLiteral("y")).toDouble(),
+                              attributes.value(QStringLiteral("width")).toDouble(),
+                              attributes.value(QStringLiteral("height")).toDouble());
+            polygons.append(QPolygonF(rect));
+        } else if (name == QStringLiteral("path")) {
+            if (!read_path(attributes.value(QStringLiteral("d")).toLatin1(), polygons)) {
+                error = QString("Line %1: only paths of straight segments are supported").arg(reader.lineNumber());
+                return false;
+            }
+        }
+        for (const QPolygonF &polygon : polygons) {
+            if (polygon.size() >= 3) {
+                shapes.append({polygon, fill});
+            }
+        }
+    }
+    if (reader.hasError()) {
+        error = QString("Line %1: %2").arg(reader.lineNumber()).arg(reader.errorString());
+        return false;
+    }
+    return true;
+}
+
+QVector<QPolygonF> ObstacleMap::decompose(const QPolygonF &polygon)
+{
+    const std::vector<QPointF> points = clean_polygon(polygon);
+    const int count = static_cast<int>(points.size());
+    if (count < 3) {
+        return {};
+    }
+
+    // Ear clipping: cut off convex corners whose triangle holds no other point
+    std::vector<std::vector<int>> pieces;
+    std::vector<int> remaining(count);
+    std::iota(remaining.begin(), remaining.end(), 0);
+    size_t corner = 0;
+    size_t attempts = 0;
+    while (remaining.size() > 3 && attempts < remaining.size()) {
+        const size_t size = remaining.size();
+        corner %= size;
+        const int a = remaining[(corner + size - 1) % size];
+        const int b = remaining[corner];
+        const int c = remaining[(corner + 1) % size];
+        bool b_ear = cross(points[a], points[b], points[c]) > 0.0;
+        for (size_t i = 0; b_ear && i < size; ++i) {
+            const int v = remaining[i];
+            b_ear = v == a || v == b || v == c || points[v] == points[a] || points[v] == points[b]
+                    || points[v] == points[c] || !in_triangle(points[v], points[a], points[b], points[c]);
+        }
+        if (b_ear) {
+            pieces.push_back({a, b, c});
+            remaining.erase(remaining.begin() + corner);
+            attempts = 0;
+        } else {
+            ++corner;
+            ++attempts;
+        }
+    }
+
+    // What cannot be clipped further, e.g. of a self-intersecting polygon, is kept as it is
+    std::vector<int> remainder;
+    if (remaining.size() == 3 && cross(points[remaining[0]], points[remaining[1]], points[remaining[2]]) > 0.0) {
+        pieces.push_back(remaining);
+    } else if (remaining.size() > 3) {
+        remainder = remaining;
+    }
+
+    // Hertel-Mehlhorn: remove every diagonal whose two pieces merge into a convex one
+    std::unordered_map<quint64, int> owners; // directed edge to the piece it bounds
+    for (int piece = 0; piece < static_cast<int>(pieces.size()); ++piece) {
+        for (size_t i = 0; i < pieces[piece].size(); ++i) {
+            owners[edge_key(pieces[piece][i], pieces[piece][(i + 1) % pieces[piece].size()])] = piece;
+        }
+    }
+    std::vector<std::pair<int, int>> diagonals;
+    for (const auto &owner : owners) {
+        const int from = static_cast<int>(owner.first >> 32);
+        const int to = static_cast<int>(owner.first & 0xffffffffu);
+        if (from < to && owners.count(edge_key(to, from))) {
+            diagonals.push_back({from, to});
+        }
+    }
+    std::sort(diagonals.begin(), diagonals.end());
+
+    for (const auto &diagonal : diagonals) {
+        const int a = diagonal.first;
+        const int b = diagonal.second;
+        const auto p_owner = owners.find(edge_key(a, b));
+        const auto q_owner = owners.find(edge_key(b, a));
+        if (p_owner == owners.end() || q_owner == owners.end() || p_owner->second == q_owner->second) {
+            continue;
+        }
+        const std::vector<int> &p = pieces[p_owner->second];
+        const std::vector<int> &q = pieces[q_owner->second];
+
+        // p runs ... a, b ..., q runs ... b, a ..., merged they run b ... a (p), then ... (q)
+        const size_t p_b = (std::find(p.begin(), p.end(), a) - p.begin() + 1) % p.size();
+        const size_t q_a = (std::find(q.begin(), q.end(), b) - q.begin() + 1) % q.size();
+        std::vector<int> merged;
+        merged.reserve(p.size() + q.size() - 2);
+        for (size_t i = 0; i < p.size(); ++i) {
+            merged.push_back(p[(p_b + i) % p.size()]);
+        }
+        for (size_t i = 1; i + 1 < q.size(); ++i) {
+            merged.push_back(q[(q_a + i) % q.size()]);
+        }
+        const size_t a_index = p.size() - 1;
+        if (cross(points[merged[a_index - 1]], points[a], points[merged[a_index + 1]]) < 0.0
+            || cross(points[merged.back()], points[b], points[merged[1]]) < 0.0) {
+            continue;
+        }
+
+        const int kept = p_owner->second;
+        const int removed = q_owner->second;
+        owners.erase(p_owner);
+        owners.erase(edge_key(b, a));
+        for (size_t i = 0; i < pieces[removed].size(); ++i) {
+            const quint64 key = edge_key(pieces[removed][i], pieces[removed][(i + 1) % pieces[removed].size()]);
+            const auto owner = owners.find(key);
+            if (owner != owners.end()) {
+                owner->second = kept;
+            }
+        }
+        pieces[kept] = std::move(merged);
+        pieces[removed].clear();
+    }
+
+    if (!remainder.empty()) {
+        pieces.push_back(remainder);
+    }
+    QVector<QPolygonF> polygons;
+    for (const std::vector<int> &piece : pieces) {
+        if (piece.empty()) {
+            continue;
+        }
+        QPolygonF polygon;
+        polygon.reserve(static_cast<int>(piece.size()));
+        for (int index : piece) {
+            polygon << points[index];
+        }
+        polygons.append(polygon);
+    }
+    return polygons;
+}
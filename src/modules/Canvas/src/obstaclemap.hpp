@@ -0,0 +1,82 @@
+#ifndef OBSTACLEMAP_H
+#define OBSTACLEMAP_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QPolygonF>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Reads obstacle layouts, such as mazes or floor plans, from files.
+ *
+ * Three formats are read, chosen by the file suffix:
+ * - .json: {"obstacles": [{"points": [[x, y], ...], "color": "#rrggbb"}, ...]}, or the
+ *   array of obstacles alone. The points may also be given as a flat [x, y, x, y, ...] array.
+ * - .svg: the polygon, rect and path elements, with their fill color. Paths may only contain
+ *   straight segments (M, L, H, V and Z commands); transforms are ignored.
+ * - Anything else is text: one polygon per line, its coordinates separated by whitespace or
+ *   commas, optionally preceded by a color. '#' followed by a space starts a comment.
+ *
+ * Concave polygons are decomposed into convex pieces while loading, by ear clipping followed
+ * by Hertel-Mehlhorn merging of the triangles, so collision tests only ever see convex pieces.
+ */
+class ObstacleMap
+{
+public:
+    /// @brief Color of the obstacles whose color is not given.
+    static constexpr QRgb DEFAULT_COLOR = 0xff808080;
+
+    /**
+     * @brief A convex piece of an obstacle.
+     */
+    struct Piece
+    {
+        QPolygonF polygon_; ///< The points of the piece, all pieces in the same orientation.
+        QColor color_;      ///< The color of the obstacle the piece belongs to.
+    };
+
+    /**
+     * @brief Reads a file and decomposes its polygons.
+     * @param file_path The path or file URL of the file.
+     * @param pieces Receives the convex pieces of all polygons.
+     * @param error Receives the reason if the file cannot be read.
+     * @return False if the file cannot be opened or parsed, pieces is unchanged then.
+     */
+    static bool load(const QString &file_path, QVector<Piece> &pieces, QString &error);
+
+    /**
+     * @brief Parses the contents of a file and decomposes its polygons.
+     * @param data The contents of the file.
+     * @param suffix The file suffix choosing the format, e.g. "json".
+     * @param pieces Receives the convex pieces of all polygons.
+     * @param error Receives the reason if the contents cannot be parsed.
+     * @return False if the contents cannot be parsed, pieces is unchanged then.
+     */
+    static bool parse(const QByteArray &data, const QString &suffix, QVector<Piece> &pieces, QString &error);
+
+    /**
+     * @brief Decomposes a simple polygon into convex pieces.
+     *
+     * Repeated and collinear points are dropped first. The polygon may be given in either
+     * orientation; a self-intersecting polygon is decomposed as far as possible, and its
+     * remainder returned as a last piece.
+     *
+     * @param polygon The polygon, closed or not.
+     * @return The convex pieces, none if the polygon has no area.
+     */
+    static QVector<QPolygonF> decompose(const QPolygonF &polygon);
+
+private:
+    struct Shape
+    {
+        QPolygonF polygon_;
+        QColor color_;
+    };
+
+    static bool parse_text(const QByteArray &data, QVector<Shape> &shapes, QString &error);
+    static bool parse_json(const QByteArray &data, QVector<Shape> &shapes, QString &error);
+    static bool parse_svg(const QByteArray &data, QVector<Shape> &shapes, QString &error);
+};
+
+#endif // OBSTACLEMAP_H
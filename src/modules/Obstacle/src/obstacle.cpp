@@ -1,13 +1,15 @@
 #include "obstacle.hpp"
 
 #include <QLineF>
+#include <QtMath>
 
 Obstacle::Obstacle(QObject *parent)
     : QObject(parent)
     , m_color(Qt::red)
     , m_bounding_radius(0.001f)
+    , m_angular_velocity(0.0)
 {
-    update_bounding_radius();
+    update_bounds();
 }
 
 Obstacle::Obstacle(const QPolygonF &points, const QColor &color, QObject *parent)
@@ -15,9 +17,10 @@ Obstacle::Obstacle(const QPolygonF &points, const QColor &color, QObject *parent
     , m_points(points)
     , m_color(color)
     , m_bounding_radius(0.001f)
+    , m_angular_velocity(0.0)
 {
     update_position();
-    update_bounding_radius();
+    update_bounds();
 }
 
 void Obstacle::set_points(const QPolygonF& points)
@@ -25,6 +28,7 @@ void Obstacle::set_points(const QPolygonF& points)
     if (m_points != points) {
         m_points = points;
         update_position();
+        update_bounds();
         emit points_changed();
     }
 }
@@ -43,14 +47,61 @@ void Obstacle::set_position(const QPointF& pos)
         QPointF delta = pos - m_position;
         m_position = pos;
         m_points.translate(delta);
+        m_bounds.translate(delta);
         emit position_changed();
         emit points_changed();
     }
 }
 
+void Obstacle::set_velocity(const QPointF& velocity)
+{
+    if (m_velocity != velocity) {
+        m_velocity = velocity;
+        emit motion_changed();
+    }
+}
+
+void Obstacle::set_angular_velocity(qreal angular_velocity)
+{
+    if (m_angular_velocity != angular_velocity) {
+        m_angular_velocity = angular_velocity;
+        emit motion_changed();
+    }
+}
+
+void Obstacle::advance(qreal seconds, const QRectF& area)
+{
+    const QPointF delta = m_velocity * seconds;
+    const qreal angle = qDegreesToRadians(m_angular_velocity * seconds);
+    const qreal cos_angle = std::cos(angle);
+    const qreal sin_angle = std::sin(angle);
+    for (QPointF& point : m_points) {
+        const QPointF offset = point - m_position;
+        point = m_position + delta + QPointF(offset.x() * cos_angle - offset.y() * sin_angle,
+                                             offset.x() * sin_angle + offset.y() * cos_angle);
+    }
+    m_position += delta;
+    if (angle != 0.0) {
+        update_bounds();
+    } else {
+        m_bounds.translate(delta);
+    }
+
+    if (!area.isEmpty()) {
+        if ((m_bounds.left() < area.left() && m_velocity.x() < 0.0)
+            || (m_bounds.right() > area.right() && m_velocity.x() > 0.0)) {
+            m_velocity.setX(-m_velocity.x());
+        }
+        if ((m_bounds.top() < area.top() && m_velocity.y() < 0.0)
+            || (m_bounds.bottom() > area.bottom() && m_velocity.y() > 0.0)) {
+            m_velocity.setY(-m_velocity.y());
+        }
+    }
+}
+
 bool Obstacle::intersects(const QRectF& rect) const
 {
-    return m_points.boundingRect().intersects(rect);
+    return m_bounds.intersects(rect);
 }
 
 void Obstacle::update_position()
@@ -64,9 +115,8 @@ void Obstacle::update_position()
     }
 }
 
-void Obstacle::update_bounding_radius()
+void Obstacle::update_bounds()
 {
-    const QRectF bounding_rect = m_points.boundingRect();
-    m_bounding_radius = QLineF(bounding_rect.topLeft(), bounding_rect.bottomRight()).length()
-                        * 0.5f;
+    m_bounds = m_points.boundingRect();
+    m_bounding_radius = QLineF(m_bounds.topLeft(), m_bounds.bottomRight()).length() * 0.5f;
 }
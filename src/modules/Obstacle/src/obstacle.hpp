@@ -40,6 +40,16 @@ class Obstacle : public QObject
      */
     Q_PROPERTY(QPointF position READ get_position WRITE set_position NOTIFY position_changed)
 
+    /**
+     * @brief Velocity of the obstacle, in pixels per second.
+     */
+    Q_PROPERTY(QPointF velocity READ get_velocity WRITE set_velocity NOTIFY motion_changed)
+
+    /**
+     * @brief Angular velocity of the obstacle around its position, in degrees per second.
+     */
+    Q_PROPERTY(qreal angular_velocity READ get_angular_velocity WRITE set_angular_velocity NOTIFY motion_changed)
+
 public:
     /**
      * @brief Default constructor for Obstacle.
@@ -88,6 +98,36 @@ public:
      */
     float get_bounding_radius() const { return m_bounding_radius; }
 
+    /**
+     * @brief Gets the bounding box of the obstacle's points.
+     *
+     * Kept up to date with the points, so collision tests need not compute it.
+     *
+     * @return The bounding box.
+     */
+    QRectF get_bounds() const { return m_bounds; }
+
+    /**
+     * @brief Gets the velocity of the obstacle.
+     *
+     * @return The velocity in pixels per second.
+     */
+    QPointF get_velocity() const { return m_velocity; }
+
+    /**
+     * @brief Gets the angular velocity of the obstacle.
+     *
+     * @return The angular velocity in degrees per second.
+     */
+    qreal get_angular_velocity() const { return m_angular_velocity; }
+
+    /**
+     * @brief Checks if the obstacle moves or rotates.
+     *
+     * @return True if the velocity or the angular velocity is not zero.
+     */
+    bool is_moving() const { return !m_velocity.isNull() || m_angular_velocity != 0.0; }
+
     /**
      * @brief Sets the points defining the obstacle's shape.
      *
@@ -113,6 +153,32 @@ public:
      */
     void set_position(const QPointF& pos);
 
+    /**
+     * @brief Sets the velocity of the obstacle.
+     *
+     * @param velocity The new velocity in pixels per second.
+     */
+    void set_velocity(const QPointF& velocity);
+
+    /**
+     * @brief Sets the angular velocity of the obstacle.
+     *
+     * @param angular_velocity The new angular velocity in degrees per second.
+     */
+    void set_angular_velocity(qreal angular_velocity);
+
+    /**
+     * @brief Moves and rotates the obstacle by its velocities over a time step.
+     *
+     * The obstacle bounces off the edges of an area: the velocity component leading out of
+     * it is reversed. Nothing is emitted, as obstacles are advanced together by the canvas,
+     * which notifies the whole step at once.
+     *
+     * @param seconds The time step.
+     * @param area The area to stay in, none if empty.
+     */
+    void advance(qreal seconds, const QRectF& area);
+
     /**
      * @brief Checks if the obstacle intersects with a given rectangle.
      *
@@ -139,11 +205,21 @@ signals:
      */
     void position_changed();
 
+    /**
+     * @brief Emitted when the velocity or the angular velocity of the obstacle changes.
+     *
+     * Not emitted when advance() bounces the obstacle off an edge.
+     */
+    void motion_changed();
+
 private:
     QPolygonF m_points; /**< The points defining the obstacle's shape. */
     QColor m_color;     /**< The color of the obstacle. */
     QPointF m_position; /**< The position (center point) of the obstacle. */
-    float m_bounding_radius; /**< The distance from the center to the furthest point of the obstacle polygon.
+    float m_bounding_radius; /**< The distance from the center to the furthest point of the obstacle polygon. */
+    QRectF m_bounds;    /**< The bounding box of the points. */
+    QPointF m_velocity; /**< The velocity in pixels per second. */
+    qreal m_angular_velocity; /**< The angular velocity in degrees per second. */
 
     /**
      * @brief Updates the position of the obstacle based on its points.
@@ -153,9 +229,9 @@ private:
     void update_position();
 
     /**
-     * @brief Updates the bounding radius.
+     * @brief Updates the bounding box and the bounding radius.
      */
-    void update_bounding_radius();
+    void update_bounds();
 };
 
 #endif
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cctype>
+#include <thread>
+#include <vector>
+
+#include "lsystem.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// Symbols below which rewriting on another thread does not pay off
+constexpr size_t MIN_SYMBOLS_PER_THREAD = 65536;
+
+unsigned char symbol_index(char symbol)
+{
+    return static_cast<unsigned char>(symbol);
+}
+
+} // namespace
+
+LSystem::LSystem()
+{
+    b_rewritten_.fill(false);
+}
+
+bool LSystem::set_rules(const std::string &rules)
+{
+    std::array<std::string, 256> replacements;
+    std::array<bool, 256> b_rewritten;
+    b_rewritten.fill(false);
+
+    size_t pos = 0;
+    for (;;) {
+        while (pos < rules.size() && (std::isspace(symbol_index(rules[pos])) || rules[pos] == ',')) {
+            ++pos;
+        }
+        if (pos == rules.size()) {
+            break;
+        }
+
+        size_t end = pos;
+        while (end < rules.size() && !std::isspace(symbol_index(rules[end])) && rules[end] != ',') {
+            ++end;
+        }
+        // A symbol, '=' and the replacement, e.g. "F=F+F" or "X=" to remove X
+        if (end - pos < 2 || rules[pos + 1] != '=' || b_rewritten[symbol_index(rules[pos])]) {
+            return false;
+        }
+        b_rewritten[symbol_index(rules[pos])] = true;
+        replacements[symbol_index(rules[pos])] = rules.substr(pos + 2, end - pos - 2);
+        pos = end;
+    }
+
+    replacements_ = std::move(replacements);
+    b_rewritten_ = b_rewritten;
+    return true;
+}
+
+bool LSystem::rewrite(const std::string &symbols, size_t max_size, std::string &next) const
+{
+    TRACE_SCOPE("LSystem::rewrite");
+    const size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    const int threads = static_cast<int>(
+        std::min(std::max<size_t>(symbols.size() / MIN_SYMBOLS_PER_THREAD, 1), hardware_threads));
+
+    // Pass 1: the size each range grows to
+    std::vector<size_t> offsets(threads + 1, 0);
+    parallel_ranges(symbols.size(), threads, [&](size_t first, size_t last, int range) {
+        size_t size = 0;
+        for (size_t i = first; i < last; ++i) {
+            const unsigned char symbol = symbol_index(symbols[i]);
+            size += b_rewritten_[symbol] ? replacements_[symbol].size() : 1;
+        }
+        offsets[range + 1] = size;
+    });
+    for (int range = 0; range < threads; ++range) {
+        offsets[range + 1] += offsets[range];
+    }
+    if (offsets[threads] > max_size) {
+        return false;
+    }
+
+    // Pass 2: each range writes its replacements behind those of the ranges before it
+    std::string result(offsets[threads], '\0');
+    parallel_ranges(symbols.size(), threads, [&](size_t first, size_t last, int range) {
+        char *out = &result[0] + offsets[range];
+        for (size_t i = first; i < last; ++i) {
+            const unsigned char symbol = symbol_index(symbols[i]);
+            if (b_rewritten_[symbol]) {
+                out = std::copy(replacements_[symbol].begin(), replacements_[symbol].end(), out);
+            } else {
+                *out++ = symbols[i];
+            }
+        }
+    });
+    next = std::move(result);
+    return true;
+}
+
+void LSystem::generate(const std::string &axiom, int iterations, const SymbolSink &sink) const
+{
+    TRACE_SCOPE("LSystem::generate");
+    std::string generation = axiom;
+    int remaining = std::max(0, std::min(iterations, MAX_ITERATIONS));
+    while (remaining > 0 && rewrite(generation, MAX_STORED_SYMBOLS, generation)) {
+        --remaining;
+    }
+
+    // Expand the remaining generations depth first, one replacement per generation at a time
+    struct Cursor
+    {
+        const char *next;
+        const char *end;
+        int depth; // generations still to be applied to these symbols
+    };
+    std::vector<Cursor> stack;
+    stack.reserve(remaining + 1);
+    stack.push_back({generation.data(), generation.data() + generation.size(), remaining});
+    while (!stack.empty()) {
+        Cursor &top = stack.back();
+        if (top.next == top.end) {
+            stack.pop_back();
+            continue;
+        }
+
+        const char symbol = *top.next++;
+        const int depth = top.depth;
+        if (depth > 0 && b_rewritten_[symbol_index(symbol)]) {
+            const std::string &replacement = replacements_[symbol_index(symbol)];
+            stack.push_back({replacement.data(), replacement.data() + replacement.size(), depth - 1});
+        } else {
+            sink(symbol);
+        }
+    }
+}
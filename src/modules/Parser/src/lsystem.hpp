@@ -0,0 +1,69 @@
+#ifndef LSYSTEM_H
+#define LSYSTEM_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+/**
+ * @class LSystem
+ * @brief A deterministic context-free L-system: every symbol has at most one replacement.
+ *
+ * Rewriting an axiom a number of times yields strings growing exponentially, so they are
+ * not stored as a whole. The first generations are rewritten in parallel, each thread
+ * counting the symbols its part of the string grows to before all of them write their
+ * replacements into the next generation. Once a generation would exceed
+ * MAX_STORED_SYMBOLS, the remaining generations are expanded depth first while the
+ * symbols are handed out, which needs memory for one replacement per remaining generation.
+ */
+class LSystem
+{
+public:
+    /// @brief Maximum number of symbols of a generation that is stored as a whole.
+    static constexpr size_t MAX_STORED_SYMBOLS = 1 << 20;
+
+    /// @brief Maximum number of generations, more would not finish drawing anyway.
+    static constexpr int MAX_ITERATIONS = 64;
+
+    /// @brief Receives the symbols of the last generation in order.
+    using SymbolSink = std::function<void(char)>;
+
+    /// @brief Constructs an L-system without rules, whose symbols are all kept.
+    LSystem();
+
+    /**
+     * @brief Sets the rules, replacing all earlier ones.
+     *
+     * @param rules Rules like "F=F+F-F", separated by whitespace or commas. A symbol
+     *              without a rule is kept, an empty replacement removes the symbol.
+     * @return False if a rule is not a single symbol followed by '=' and its replacement,
+     *         or a symbol has more than one rule. The rules are unchanged then.
+     */
+    bool set_rules(const std::string &rules);
+
+    /**
+     * @brief Rewrites every symbol of a generation at once.
+     *
+     * @param symbols The generation.
+     * @param max_size The maximum size of the next generation.
+     * @param next Receives the next generation.
+     * @return False if the next generation would be larger than max_size, next is unchanged then.
+     */
+    bool rewrite(const std::string &symbols, size_t max_size, std::string &next) const;
+
+    /**
+     * @brief Rewrites an axiom and hands out the symbols of the last generation.
+     *
+     * @param axiom The first generation.
+     * @param iterations The number of times the axiom is rewritten.
+     * @param sink Receives the symbols in order, while they are generated.
+     */
+    void generate(const std::string &axiom, int iterations, const SymbolSink &sink) const;
+
+private:
+    std::array<std::string, 256> replacements_; ///< Replacement of each symbol.
+    std::array<bool, 256> b_rewritten_;         ///< Indicates if a symbol has a rule.
+};
+
+#endif // LSYSTEM_H
@@ -0,0 +1,69 @@
+#ifndef MOTIONBATCH_H
+#define MOTIONBATCH_H
+
+#include <QMetaType>
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * @brief A run of movements the turtle executes as one movement.
+ *
+ * The commands are stored as a structure of arrays, so the turtle can scan the angles and
+ * lengths of long runs without touching the other fields.
+ */
+struct MotionBatch
+{
+    /// @brief The command of a motion.
+    enum Kind : quint8 {
+        kForward = 0, ///< forward(length)
+        kTurn,        ///< turn(degrees)
+        kArc,         ///< arc(length, degrees), the length being the radius
+        kPush,        ///< push_state()
+        kPop          ///< pop_state()
+    };
+
+    std::vector<quint8> kinds_;  ///< The command of each motion.
+    std::vector<float> lengths_; ///< The distance of a forward or the radius of an arc.
+    std::vector<float> degrees_; ///< The angle of a turn or an arc.
+
+    /// @brief Gets the number of motions.
+    size_t size() const { return kinds_.size(); }
+
+    /// @brief Indicates if there are no motions.
+    bool empty() const { return kinds_.empty(); }
+
+    /// @brief Removes all motions.
+    void clear()
+    {
+        kinds_.clear();
+        lengths_.clear();
+        degrees_.clear();
+    }
+
+    /// @brief Appends a forward movement.
+    void add_forward(float distance) { add(kForward, distance, 0.f); }
+
+    /// @brief Appends a turn.
+    void add_turn(float degrees) { add(kTurn, 0.f, degrees); }
+
+    /// @brief Appends an arc.
+    void add_arc(float radius, float degrees) { add(kArc, radius, degrees); }
+
+    /// @brief Appends saving the position and rotation.
+    void add_push() { add(kPush, 0.f, 0.f); }
+
+    /// @brief Appends returning to the last saved position and rotation.
+    void add_pop() { add(kPop, 0.f, 0.f); }
+
+private:
+    void add(Kind kind, float length, float degrees)
+    {
+        kinds_.push_back(kind);
+        lengths_.push_back(length);
+        degrees_.push_back(degrees);
+    }
+};
+
+Q_DECLARE_METATYPE(MotionBatch)
+
+#endif // MOTIONBATCH_H
@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Splits [0, count) into one contiguous range per thread and runs body(first, last, range)
+ *        for all of them, the first range on the calling thread.
+ *
+ * Used by the passes that count and then write their output per range, e.g. rewriting
+ * L-system generations and expanding motion batches.
+ *
+ * @param count The number of items.
+ * @param threads The number of ranges, at least 1.
+ * @param body The function run for each range, with the first item, the end and the range index.
+ */
+template<typename Index, typename Body>
+void parallel_ranges(Index count, int threads, const Body &body)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int range = 1; range < threads; ++range) {
+        workers.emplace_back([&body, count, threads, range]() {
+            body(count * range / threads, count * (range + 1) / threads, range);
+        });
+    }
+    body(Index(0), count / threads, 0);
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+#endif // PARALLEL_H
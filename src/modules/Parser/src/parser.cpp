@@ -1,306 +1,520 @@
+#include <algorithm>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <cmath>
-#include <regex>
+#include <stdexcept>
 #include <QString>
 #include <QColor>
 #include <QCoreApplication>
+#include <QIODevice>
 
+#include "lsystem.hpp"
 #include "parser.hpp"
+#include "scriptcompiler.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
 
-Parser::Parser(QObject *parent) : QObject(parent) {vars = {}; funcs = {}; movement_done = true;}
+using script::Opcode;
+using script::Statement;
+
+// Size of the chunks read from script sources
+constexpr qint64 READ_BUFFER_SIZE = 256 * 1024;
+
+class Parser::CallStackScope {
+public:
+    explicit CallStackScope(Parser& parser) : parser(parser), depth(parser.call_stack.size()) {}
+    ~CallStackScope() { parser.unwind_call_stack(depth); }
+    CallStackScope(const CallStackScope&) = delete;
+    CallStackScope& operator=(const CallStackScope&) = delete;
+
+private:
+    Parser& parser;
+    const size_t depth;
+};
+
+Parser::Parser(QObject *parent) : QObject(parent) {funcs = {}; movement_done = true; b_batch_motions = false;}
 
 void Parser::animation_done(){ movement_done = true; }
 
-std::vector<std::string> Parser::parse_script(std::ifstream& file) {
-    std::vector<std::string> parsed_commands; // Vector of commands that were parsed correctly and actually run
+void Parser::set_motion_batching(bool b_batch) {
+    flush_motions();
+    b_batch_motions = b_batch;
+}
 
-    std::string line;
+std::vector<script::ExecutedCommand> Parser::parse_script(std::istream& file) {
+    TRACE_SCOPE("Parser::parse_script");
+    std::vector<script::ExecutedCommand> parsed_commands; // Vector of commands that were parsed correctly and actually run
+    CallStackScope call_scope(*this);
 
-    // Regex strings for function and loop definitions
-    std::regex funcdef_regex(R"(^\s*DEF\s+([a-zA-Z_]\w*)\s*\(\s*([a-zA-Z_]\w*)?\s*\)\s*\{\s*$)");
-    std::regex loopdef_regex(R"(^\s*LOOP\s*(\d+)\s*\{\s*$)");
+    ScriptCompiler compiler(symbols);
+    std::string line;
+    const CommandSink sink = [&parsed_commands](const script::ExecutedCommand &command) { parsed_commands.push_back(command); };
 
     while (std::getline(file, line)) {
-        // Wait for animation to be done before processing next lines
-        while (!movement_done){
-            QCoreApplication::processEvents(); // this is required to process the on_movement_completed signal
-        }
+        run_script_line(compiler, line, sink);
+    }
+    finish_script(compiler, sink);
+    return parsed_commands;
+}
 
-        std::smatch match;
-
-        // Try function definition
-        if (std::regex_match(line, match, funcdef_regex)) {
-            std::string func_name = match[1];
-            std::string arg_name = match[2];
-            
-            std::ostringstream func_body;
-            while (std::getline(file, line)) { // Collect function body
-                if (line.find("}") != std::string::npos) break;
-                func_body << line << "\n";
-            }
-            funcs[func_name] = func_body.str();
+std::vector<script::ExecutedCommand> Parser::parse_script(QIODevice& source) {
+    std::vector<script::ExecutedCommand> parsed_commands; // Vector of commands that were parsed correctly and actually run
+    parse_script(source, [&parsed_commands](const script::ExecutedCommand &command) { parsed_commands.push_back(command); });
+    return parsed_commands;
+}
 
-            // store the name of the function argument variable only if it exists
-            if (!arg_name.empty()) { func_arg_names[func_name] = arg_name; }
+qint64 Parser::parse_script(QIODevice& source, const CommandSink& sink, const LineHook& on_line) {
+    TRACE_SCOPE("Parser::parse_script");
+    CallStackScope call_scope(*this);
+
+    ScriptCompiler compiler(symbols);
+    const qint64 total = read_lines(source, [this, &compiler, &sink, &on_line](const std::string &line) {
+        run_script_line(compiler, line, sink);
+        if (on_line) { on_line(line, !compiler.in_block()); }
+    });
+    finish_script(compiler, sink);
+    return total;
+}
 
-            std::cout << "Function defined: " << func_name << " with arg: " << arg_name << std::endl;
-            continue;
+qint64 Parser::load_definitions(QIODevice& source) {
+    TRACE_SCOPE("Parser::load_definitions");
+    ScriptCompiler compiler(symbols);
+    script::Block completed;
+    const auto define = [this, &completed]() {
+        for (const Statement &statement : completed) {
+            if (statement.kind_ == Statement::kDefine) {
+                funcs[statement.name_] = std::make_shared<const Statement>(statement);
+            }
         }
+        completed.clear();
+    };
+
+    const qint64 total = read_lines(source, [&compiler, &completed, &define](const std::string &line) {
+        compiler.feed_line(line, completed);
+        define();
+    });
+    compiler.finish(completed);
+    define();
+    update_slots();
+    return total;
+}
 
-        // Try loop definition
-        if (std::regex_match(line, match, loopdef_regex)) {
-            int loopCount = std::stoi(match[1]);
-            std::ostringstream loopBody;
-            while (std::getline(file, line)) { // Collect loop body
-                if (line.find("}") != std::string::npos) break;
-                loopBody << line << "\n";
-            }
-            std::vector<std::string> loop_cmds = run_loop(loopCount, loopBody.str());
-            for (const auto &cmd : loop_cmds) { // push the commands run by loop to the parsed_commands for this script
-                parsed_commands.push_back(cmd);
-            }
+qint64 Parser::read_lines(QIODevice& source, const std::function<void(const std::string&)>& on_line) {
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    std::string line; // a line that continues in the next chunk is kept here
+    qint64 total = 0;
+
+    for (;;) {
+        const qint64 count = source.read(buffer.data(), READ_BUFFER_SIZE);
+        if (count < 0) { break; } // read error, run what has been read so far
+        if (count == 0) {
+            // Pipes and sockets may not have received the next chunk yet
+            if (!source.isSequential() || !source.waitForReadyRead(-1)) { break; }
             continue;
         }
+        total += count;
+
+        // Run each complete line as soon as it has arrived
+        const char *begin = buffer.data();
+        const char *end = begin + count;
+        for (const char *newline; (newline = std::find(begin, end, '\n')) != end; begin = newline + 1) {
+            line.append(begin, newline);
+            on_line(line);
+            line.clear();
+        }
+        line.append(begin, end);
+    }
+
+    if (!line.empty()) { on_line(line); } // last line without a line break
+    return total;
+}
 
-        // Otherwise, parse line normally
-        std::vector<std::string> line_cmds = parse_line(QString::fromStdString(line));
-        for (const auto &cmd : line_cmds) { // push the commands run by line to the parsed_commands for this script
-            parsed_commands.push_back(cmd);
+std::vector<std::pair<std::string, double>> Parser::globals() const {
+    std::vector<std::pair<std::string, double>> result;
+    for (size_t slot = 0; slot < slot_values.size(); ++slot) {
+        if (!std::isnan(slot_values[slot])) {
+            result.emplace_back(symbols.name(static_cast<int>(slot)), slot_values[slot]);
         }
     }
-    return parsed_commands;
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void Parser::set_global(const std::string& name, double value) {
+    const int slot = symbols.slot(name);
+    update_slots();
+    slot_values[slot] = value;
 }
 
-std::vector<std::string> Parser::run_loop(int count, const std::string& loop_body) {
-    std::vector<std::string> parsed_commands; // Vector of commands that were parsed correctly and actually run
+std::string Parser::fingerprint() const {
+    std::string result;
+    for (const auto &global : globals()) {
+        result += global.first;
+        result += '=';
+        result.append(reinterpret_cast<const char *>(&global.second), sizeof(double)); // the exact bits
+        result += '\n';
+    }
 
-    for (int i = 0; i < count; ++i) {
-        std::istringstream loopStream(loop_body); // reset the loop stream
-        std::string line;
-        while (std::getline(loopStream, line)) {
-            std::vector<std::string> loop_cmds = parse_line(QString::fromStdString(line));
-            for (const auto &cmd : loop_cmds) { // push the commands run by line to the parsed_commands for this loop
-                parsed_commands.push_back(cmd);
-            }
+    // The functions in name order, as the map has no defined order
+    std::vector<const Statement *> functions;
+    for (const auto &function : funcs) { functions.push_back(function.second.get()); }
+    std::sort(functions.begin(), functions.end(), [](const Statement *a, const Statement *b) { return a->name_ < b->name_; });
+    for (const Statement *function : functions) {
+        script::append_fingerprint(*function, symbols, result);
+    }
+    return result;
+}
+
+Parser::State Parser::state() const {
+    return State{slot_values, funcs};
+}
+
+void Parser::restore_state(const State& state) {
+    slot_values = state.slot_values_;
+    funcs = state.funcs_;
+    update_slots();
+}
+
+void Parser::run_script_line(ScriptCompiler& compiler, const std::string& line, const CommandSink& sink) {
+    // Execute each top-level statement as soon as its last line has been read
+    script::Block completed;
+    compiler.feed_line(line, completed);
+    run_completed(completed, sink);
+}
+
+void Parser::finish_script(ScriptCompiler& compiler, const CommandSink& sink) {
+    // Blocks left open at the end of the file run as if they were closed
+    script::Block completed;
+    compiler.finish(completed);
+    run_completed(completed, sink);
+}
+
+void Parser::run_completed(const script::Block& completed, const CommandSink& sink) {
+    std::vector<script::ExecutedCommand> parsed_commands;
+    update_slots();
+    for (const Statement &statement : completed) {
+        try {
+            execute(statement, parsed_commands);
+        } catch (...) {
+            flush_motions(); // the movements before the error ran without batching too
+            throw;
         }
+        flush_motions();
+
+        // Hand the executed commands out per statement, so they are not collected for the whole script
+        for (const script::ExecutedCommand &command : parsed_commands) { sink(command); }
+        parsed_commands.clear();
     }
+}
+
+// Parses lines of commands from CLI or from script
+std::vector<script::ExecutedCommand> Parser::parse_line(const QString& inputQ) {
+    std::vector<script::ExecutedCommand> parsed_commands; // Vector of commands that were parsed correctly and actually run
+    parse_line(inputQ, [&parsed_commands](const script::ExecutedCommand &command) { parsed_commands.push_back(command); });
     return parsed_commands;
 }
 
-// Private helper function that tries to change ALL variable names in the command into their values 
-// (used in parse_line for each command)
-// Returns the command string with float-values substituted into it
-std::string Parser::varname_to_value(const std::string& command) {
-    std::string ret; // the transformed command-string that is returned by this function
-    std::regex var_regex(R"(\(([^\)]+)\))"); // variables occur inside parentheses
-    std::smatch match;
-    
-    std::string::const_iterator search_start = command.cbegin();
-    while (std::regex_search(search_start, command.cend(), match, var_regex)) {
-        ret.append(search_start, match.prefix().second); // The command-string up to the match
-        std::string contents = match[1]; // text inside brackets
-        std::istringstream var_stream(contents);
-
-        ret.append("(");
-        // Go through all comma-separated variables
-        bool first_var = true; std::string var_name;
-        while (std::getline(var_stream, var_name, ',')){
-            std::string var_value = var_name; // if value is not found just use the var_name as is... parse_line will encounter the error later
-
-            // handle possible minus sign in front of variable name
-            int sign = 1;
-            if (!var_name.empty() && var_name[0] == '-') { sign = -1; var_name = var_name.substr(1); }
-
-            // search vars for value
-            auto it = vars.find(var_name);
-            if (it != vars.end()) { var_value = std::to_string(sign*(it->second)); } // Variable has a value defined -> sub it in
-
-            if (!first_var) { ret.append(","); }
-            ret.append(var_value);
-            first_var = false;
-        }
-        ret.append(")");
+void Parser::parse_line(const QString& inputQ, const CommandSink& sink) {
+    TRACE_SCOPE("Parser::parse_line");
+    CallStackScope call_scope(*this);
 
-        search_start = match.suffix().first;
+    // Multiple cmds can be input on a single line by delimiting with ';',
+    // blocks (e.g. LOOP3{forward(10);turn(120)}) can be nested on a single line
+    run_completed(ScriptCompiler::compile(inputQ.toStdString(), symbols), sink);
+}
+
+void Parser::update_slots() {
+    if (slot_values.size() < static_cast<size_t>(symbols.size())) {
+        slot_values.resize(symbols.size(), NAN);
     }
-    ret.append(search_start, command.cend()); // Add remaining command-string
-
-    // check for variable assignment command, eg. for a=b, try to sub in value of b:
-    std::regex varassign_regex(R"(^\s*([a-zA-Z_]\w*)\s*=\s*([a-zA-Z_]\w*)\s*$)");
-    if (std::regex_match(ret, match, varassign_regex)) {
-        std::string assignee_var = match[1];
-        std::string var_name = match[2];
-        auto it = vars.find(var_name);
-        if (it != vars.end()) { ret = assignee_var + "=" + std::to_string(it->second); }
+}
+
+void Parser::unwind_call_stack(size_t depth) {
+    if (call_stack.size() <= depth) { return; }
+    local_values.resize(call_stack[depth].base_);
+    call_stack.resize(depth);
+}
+
+void Parser::run_loop(const Statement& loop, std::vector<script::ExecutedCommand>& parsed_commands) {
+    TRACE_SCOPE("Parser::run_loop");
+    std::vector<double> count;
+    if (!evaluate(loop.args_, count)) {
+        std::cout << "Parser failed to evaluate the loop count\n";
+        return;
     }
 
-    // whitespace MAY find its way into ret somehow... Erase whitespace here too
-    ret.erase(std::remove_if(ret.begin(), ret.end(), ::isspace), ret.end());
-    return ret;
+    for (double i = 0; i < count[0]; ++i) {
+        execute(loop.body_, parsed_commands);
+    }
 }
 
-// Parses lines of commands from CLI or from script
-std::vector<std::string> Parser::parse_line(const QString& inputQ) {
-    std::string input = inputQ.toStdString();
-    std::istringstream input_stream(input);
-    std::vector<std::string> parsed_commands; // Vector of commands that were parsed correctly and actually run
-
-    //////// REGEX DEFINITIONS ////////
-    
-    // Regex for single-line loops //
-    std::regex cli_loop_regex(R"(^\s*LOOP(\d+)\s*\{\s*(.*?)\s*\}\s*$)");
-    
-    // Regex for variable handling //
-    std::regex vardef_regex(R"(^\s*([a-zA-Z_]\w*)\s*=\s*(-?\d+(?:\.\d+)?)\s*$)");
-    std::regex varadd_regex(R"(^\s*([a-zA-Z_]\w*)\s*=\s*add\(\s*(-?\d+(?:\.\d+)?)\s*,\s*(-?\d+(?:\.\d+)?)\s*\)\s*$)");
-    std::regex varmul_regex(R"(^\s*([a-zA-Z_]\w*)\s*=\s*mul\(\s*(-?\d+(?:\.\d+)?)\s*,\s*(-?\d+(?:\.\d+)?)\s*\)\s*$)");
-
-    // Regex for each of the basic commands/functions:
-    
-    // Nullary functions (can be called either as up or up(), brackets are optional)
-    std::regex up_regex(R"(^\s*up\s*\(?\)?\s*$)");
-    std::regex down_regex(R"(^\s*down\s*\(?\)?\s*$)");
-
-    // Unitary functions (single float as argument)
-    std::regex forward_regex(R"(^\s*forward\s*\(\s*(-?\d*\.?\d+)\s*\)\s*$)");
-    std::regex turn_regex(R"(^\s*turn\s*\(\s*(-?\d*\.?\d+)\s*\)\s*$)");
-    std::regex setrot_regex(R"(^\s*setrot\s*\(\s*(-?\d*\.?\d+)\s*\)\s*$)");
-    std::regex setspeed_regex(R"(^\s*setspeed\s*\(\s*(-?\d*\.?\d+)\s*\)\s*$)");
-    std::regex setsize_regex(R"(^\s*setsize\s*\(\s*(-?\d*\.?\d+)\s*\)\s*$)");
-
-    // Binary functions (2 floats)
-    std::regex setpos_regex(R"(^\s*setpos\s*\(\s*(-?\d*\.?\d+)\s*,\s*(-?\d*\.?\d+)\s*\)\s*$)");
-    std::regex arc_regex(R"(^\s*arc\s*\(\s*(-?\d*\.?\d+)\s*,\s*(-?\d*\.?\d+)\s*\)\s*$)");
-
-    // Tertiary functions (3 floats) 
-    std::regex setcolor_regex(R"(^\s*setcolor\s*\(\s*(-?\d*\.?\d+)\s*,\s*(-?\d*\.?\d+)\s*,\s*(-?\d*\.?\d+)\s*\)\s*$)"); 
-
-    //////// START PARSING LINE ////////
-    std::string command;
-    std::getline(input_stream, command);
-    
-    // Remove ALL whitespace from command
-    command.erase(std::remove_if(command.begin(), command.end(), ::isspace), command.end());
-
-    std::smatch match; // regex-match var
-    
-    // Single-line loops needs to be handled here before the main while-loop below
-    // because possible ';'-characters in the loop would sunder the loop-body into separate commands
-    if (std::regex_match(command, match, cli_loop_regex)) {
-        int loop_count = std::stoi(match[1]);
-        std::string loop_body = match[2];
-        std::cout << "matched loop:" << loop_body << std::endl;
-        std::vector<std::string> loop_cmds = run_loop(loop_count, loop_body);
-        for (const auto &cmd : loop_cmds) { // push the commands run by line to the parsed_commands for this line
-            parsed_commands.push_back(cmd);
-        }
-        return parsed_commands;
+void Parser::execute(const script::Block& block, std::vector<script::ExecutedCommand>& parsed_commands) {
+    for (const Statement &statement : block) {
+        execute(statement, parsed_commands);
     }
+}
 
-    input_stream.str(input); // reset the input_stream after failing to match single-line loop above
-    input_stream.clear();
+void Parser::execute(const Statement& statement, std::vector<script::ExecutedCommand>& parsed_commands) {
+    std::vector<double> args;
+
+    switch (statement.kind_) {
+    case Statement::kCommand: {
+        if (b_batch_motions) {
+            if (!evaluate(statement.args_, args)) { break; }
+            if (!batch_motion(statement, args)) {
+                // Other commands apply after the movements before them
+                flush_motions();
+                wait_for_movement();
+                run_command(statement, args);
+            }
+        } else {
+            wait_for_movement();
+            if (!evaluate(statement.args_, args)) { break; }
+            run_command(statement, args);
+        }
+        perf::add(perf::Counter::kCommandsParsed);
 
-    // Multiple cmds can be input on a single line by delimiting with ';'
-    while (std::getline(input_stream, command, ';')) {
+        // push the command with its evaluated arguments to the command history
+        parsed_commands.push_back(script::ExecutedCommand::command(statement.opcode_, args));
+        return;
+    }
 
-        // Wait for animation to be done
-        while (!movement_done){
-            QCoreApplication::processEvents(); // this is required to process the signal to Parser
+    case Statement::kAssign: {
+        if (!evaluate(statement.args_, args)) { break; }
+
+        if (statement.local_) {
+            local_values[call_stack.back().base_ + statement.slot_] = args[0];
+        } else {
+            slot_values[statement.slot_] = args[0];
         }
-        // Now execute the loop normally:
 
-        // Attempt to change any variable names in the command into the corresponding float-values
-        command = varname_to_value(command);
+        parsed_commands.push_back(script::ExecutedCommand::assignment(statement.record_text_, args[0]));
+        return;
+    }
+
+    case Statement::kCall:
+        if (!call_function(statement, parsed_commands)) { break; }
+        return;
 
-        // Check if command calls a script-defined function
-        std::regex general_function_regex(R"((\w+)\(([-+]?\d*\.?\d+)?\))"); std::smatch fmatch;
-                
-        if (std::regex_match(command, fmatch, general_function_regex)) {
-            std::string function_name = fmatch[1]; std::string argument = fmatch[2];
+    case Statement::kLSystem: {
+        if (!evaluate(statement.args_, args) || !run_lsystem(statement, args)) { break; }
+        perf::add(perf::Counter::kCommandsParsed);
 
-            // If the function is defined by user
-            if (funcs.find(function_name) != funcs.end()) {
-                // Define a variable for use as the function argument (if the argument is defined and not "")
-                if (argument != ""){ vars[func_arg_names[function_name]] = std::stof(argument); }
+        // One history entry, the symbols drawn may be billions
+        parsed_commands.push_back(script::ExecutedCommand::lsystem(statement.record_text_, args));
+        return;
+    }
 
-                std::istringstream func_body_stream(funcs[function_name]);
-                std::string fline;
+    case Statement::kLoop:
+        run_loop(statement, parsed_commands);
+        return;
 
-                // Go through each line of the function body and parse_line to run it
-                while (std::getline(func_body_stream, fline)) { parse_line(QString::fromStdString(fline)); }
-                continue; // move on to the next command after function "call"
-            }
+    case Statement::kIf:
+        if (!evaluate(statement.args_, args)) { break; }
+        if (args[0] != 0.0) { execute(statement.body_, parsed_commands); }
+        return;
+
+    case Statement::kDefine: {
+        funcs[statement.name_] = std::make_shared<const Statement>(statement);
+
+        std::cout << "Function defined: " << statement.name_ << " with args:";
+        for (const std::string &parameter : statement.parameters_) { std::cout << " " << parameter; }
+        std::cout << std::endl;
+        return;
+    }
+
+    case Statement::kInvalid:
+    case Statement::kInvalidBlock:
+        break;
+    }
+
+    std::cout << "Parser failed to match the given input to a valid command\n";
+}
+
+bool Parser::call_function(const Statement& call, std::vector<script::ExecutedCommand>& parsed_commands) {
+    auto it = funcs.find(call.name_);
+    if (it == funcs.end()) { return false; }
+
+    // Hold a reference, as the function may be redefined while it runs
+    const std::shared_ptr<const Statement> function = it->second;
+    if (call.args_.size() != function->parameters_.size()) { return false; }
+
+    if (call_stack.size() >= MAX_CALL_DEPTH) {
+        throw std::runtime_error("Maximum call depth of " + std::to_string(MAX_CALL_DEPTH)
+                                 + " exceeded in function " + call_stack.back().function_->name_);
+    }
+
+    std::vector<double> args;
+    if (!evaluate(call.args_, args)) { return false; }
+
+    // The parameters are the first locals of the new frame, the other locals start undefined
+    const Frame frame = {function.get(), local_values.size()};
+    local_values.resize(frame.base_ + function->frame_size_, NAN);
+    std::copy(args.begin(), args.end(), local_values.begin() + frame.base_);
+
+    call_stack.push_back(frame);
+    execute(function->body_, parsed_commands);
+    call_stack.pop_back();
+    local_values.resize(frame.base_);
+    return true;
+}
+
+bool Parser::evaluate(const std::vector<script::Expr>& args, std::vector<double>& values) const {
+    const double *locals = call_stack.empty() ? nullptr : local_values.data() + call_stack.back().base_;
+
+    values.clear();
+    for (const script::Expr &arg : args) {
+        const double value = script::evaluate(arg, slot_values.data(), locals);
+        if (!std::isfinite(value)) { return false; } // undefined variable, division by zero, ...
+        values.push_back(value);
+    }
+    return true;
+}
+
+void Parser::wait_for_movement() {
+    if (movement_done) { return; }
+
+    TRACE_SCOPE("Parser::wait_for_movement");
+    while (!movement_done){
+        QCoreApplication::processEvents(); // this is required to process the signal to Parser
+    }
+}
+
+bool Parser::batch_motion(const Statement& statement, const std::vector<double>& args) {
+    switch (statement.opcode_) {
+    case Opcode::kForward:
+        send_motion(MotionBatch::kForward, args[0], 0.f);
+        return true;
+    case Opcode::kTurn:
+        send_motion(MotionBatch::kTurn, 0.f, args[0]);
+        return true;
+    case Opcode::kArc:
+        send_motion(MotionBatch::kArc, args[0], args[1]);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Parser::flush_motions() {
+    if (pending_motions.empty()) { return; }
+
+    wait_for_movement();
+    movement_done = false; // before emitting, as the turtle may complete the batch instantly
+    emit motion_batch(pending_motions);
+    pending_motions.clear();
+}
+
+void Parser::send_motion(MotionBatch::Kind kind, float length, float degrees) {
+    if (b_batch_motions) {
+        switch (kind) {
+        case MotionBatch::kForward: pending_motions.add_forward(length); break;
+        case MotionBatch::kTurn: pending_motions.add_turn(degrees); break;
+        case MotionBatch::kArc: pending_motions.add_arc(length, degrees); break;
+        case MotionBatch::kPush: pending_motions.add_push(); break;
+        case MotionBatch::kPop: pending_motions.add_pop(); break;
         }
+        if (pending_motions.size() >= MAX_BATCH_MOTIONS) { flush_motions(); }
+        return;
+    }
 
-        // push the command to the command history (this is undone below if an error is encountered) 
-        parsed_commands.push_back(command);
-
-        // Turtle movement commands
-        if (std::regex_match(command, match, forward_regex)) {
-            float distance = std::stof(match[1].str());
-            emit forward(distance);
-            movement_done = false; // start waiting for the forward-animation to be done
-
-        } else if (std::regex_match(command, match, turn_regex)) {
-            float angle = std::stof(match[1].str());
-            emit turn(angle);
-
-        } else if (std::regex_match(command, match, setrot_regex)) {
-            float rot = std::stof(match[1].str());
-            emit setrot(rot);
-
-        } else if (std::regex_match(command, match, setpos_regex)) {
-            float x = std::stof(match[1].str()); float y = std::stof(match[2].str());
-            QPointF pos(x, y);
-            emit setpos(pos);
-
-        } else if (std::regex_match(command, match, arc_regex)) {
-            float radius = std::stof(match[1].str()); float angle = std::stof(match[2].str());
-            emit arc(radius, angle);
-
-        // Pen commands (up, down, etc.)  
-        } else if (std::regex_match(command, up_regex)) {
-            emit up();
-
-        } else if (std::regex_match(command, down_regex)) {
-            emit down();
-        
-        } else if (std::regex_match(command, match, setsize_regex)) {
-            float size = std::stof(match[1].str());
-            emit setsize(size);
-
-        // Other commands
-        } else if (std::regex_match(command, match, setspeed_regex)) {
-            float speed = std::stof(match[1].str());
-            emit setspeed(speed);
-
-        } else if (std::regex_match(command, match, setcolor_regex)) {
-            int r = static_cast<int>(std::floor(std::abs(std::stof(match[1].str()))));
-            int g = static_cast<int>(std::floor(std::abs(std::stof(match[2].str()))));
-            int b = static_cast<int>(std::floor(std::abs(std::stof(match[3].str()))));
-            QColor color(r, g, b);
-            emit setcolor(color);
-        
-        } else if (std::regex_match(command, match, vardef_regex)) {
-            std::string var_name = match[1]; float value = std::stof(match[2]);
-            vars[var_name] = value;
-
-        } else if (std::regex_match(command, match, varadd_regex)) {
-            std::string var_name = match[1];
-            float value1 = std::stof(match[2]); float value2 = std::stof(match[3]);
-            float result = value1 + value2; vars[var_name] = result;
-
-        } else if (std::regex_match(command, match, varmul_regex)) {
-            std::string var_name = match[1];
-            float value1 = std::stof(match[2]); float value2 = std::stof(match[3]);
-            float result = value1 * value2; vars[var_name] = result;
+    wait_for_movement();
+    switch (kind) {
+    case MotionBatch::kForward:
+        movement_done = false;
+        emit forward(length);
+        break;
+    case MotionBatch::kTurn:
+        emit turn(degrees);
+        break;
+    case MotionBatch::kArc:
+        movement_done = false;
+        emit arc(length, degrees);
+        break;
+    case MotionBatch::kPush:
+        emit push_state();
+        break;
+    case MotionBatch::kPop:
+        emit pop_state();
+        break;
+    }
+}
 
-        } else {
-            parsed_commands.pop_back(); // remove the erroneous command from history
-            std::cout << "Parser failed to match the given input to a valid command\n";
+bool Parser::run_lsystem(const Statement& statement, const std::vector<double>& args) {
+    TRACE_SCOPE("Parser::run_lsystem");
+    const double iterations = std::floor(args[0]);
+    if (iterations < 0 || iterations > LSystem::MAX_ITERATIONS) { return false; }
+
+    LSystem lsystem;
+    if (!lsystem.set_rules(statement.strings_[1])) { return false; } // the compiler rejects invalid rules already
+    const float angle = static_cast<float>(args[1]);
+    const float step = static_cast<float>(args[2]);
+    lsystem.generate(statement.strings_[0], static_cast<int>(iterations), [this, angle, step](char symbol) {
+        switch (symbol) {
+        case 'F':
+        case 'G': send_motion(MotionBatch::kForward, step, 0.f); break;
+        case '+': send_motion(MotionBatch::kTurn, 0.f, angle); break;
+        case '-': send_motion(MotionBatch::kTurn, 0.f, -angle); break;
+        case '|': send_motion(MotionBatch::kTurn, 0.f, 180.f); break;
+        case '[': send_motion(MotionBatch::kPush, 0.f, 0.f); break;
+        case ']': send_motion(MotionBatch::kPop, 0.f, 0.f); break;
+        default: break; // only rewritten
         }
+    });
+    return true;
+}
+
+void Parser::run_command(const Statement& statement, const std::vector<double>& args) {
+    switch (statement.opcode_) {
+    // Turtle movement commands
+    case Opcode::kForward:
+        // start waiting for the forward-animation to be done
+        // (before emitting, as the turtle may complete the movement instantly)
+        movement_done = false;
+        emit forward(args[0]);
+        break;
+
+    case Opcode::kTurn:
+        emit turn(args[0]);
+        break;
+
+    case Opcode::kSetRot:
+        emit setrot(args[0]);
+        break;
+
+    case Opcode::kSetPos:
+        emit setpos(QPointF(args[0], args[1]));
+        break;
+
+    case Opcode::kArc:
+        movement_done = false; // start waiting for the arc-animation to be done
+        emit arc(args[0], args[1]);
+        break;
+
+    // Pen commands (up, down, etc.)
+    case Opcode::kUp:
+        emit up();
+        break;
+
+    case Opcode::kDown:
+        emit down();
+        break;
+
+    case Opcode::kSetSize:
+        emit setsize(args[0]);
+        break;
+
+    // Other commands
+    case Opcode::kSetSpeed:
+        emit setspeed(args[0]);
+        break;
+
+    case Opcode::kSetColor: {
+        int r = static_cast<int>(std::floor(std::abs(args[0])));
+        int g = static_cast<int>(std::floor(std::abs(args[1])));
+        int b = static_cast<int>(std::floor(std::abs(args[2])));
+        emit setcolor(QColor(r, g, b));
+        break;
+    }
     }
-    return parsed_commands;
 }
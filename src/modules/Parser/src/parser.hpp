@@ -4,7 +4,18 @@
 #include <QObject>
 #include <QPoint>
 #include <QColor>
-#include <fstream>
+#include <QIODevice>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "motionbatch.hpp"
+#include "script.hpp"
+
+class ScriptCompiler;
 
 /**
  * @class Parser
@@ -12,41 +23,216 @@
  * 
  * The Parser class has two key functions for parsing single command lines or entire scripts 
  * To execute commands, a corresponding Qt signal is sent to the Turtle module.
+ *
+ * Input is first compiled by a ScriptCompiler into a tree of statements, which is then
+ * executed. Loops and functions run their compiled bodies, so nested blocks are supported
+ * and their text is never parsed more than once. Scripts are executed while they are read,
+ * each top-level statement as soon as its last line has arrived.
+ *
+ * Each call of a script-defined function pushes a frame holding its parameters and local
+ * variables, so functions can call themselves recursively (up to MAX_CALL_DEPTH frames).
+ *
+ * lsystem("axiom", "rules", iterations, angle, step) draws an L-system: the axiom is rewritten
+ * with the rules and the symbols of the last generation are streamed to the turtle as they are
+ * generated. F and G move forward by step, + and - turn by plus and minus angle, | turns around,
+ * [ and ] save and restore the position and rotation. Other symbols are only rewritten.
+ *
+ * With motion batching, consecutive forward, turn and arc commands are not sent one by one
+ * but collected and sent as one motion_batch at the end of each top-level statement, or
+ * before any other command, so the turtle can expand long runs of movements at once.
  */
 class Parser : public QObject {
   Q_OBJECT
 
+public:
+    /// @brief Callback receiving each command that was successfully executed.
+    using CommandSink = std::function<void(const script::ExecutedCommand&)>;
+
+    /**
+     * @brief Callback receiving each line of a script after the statements it completed ran.
+     * 
+     * The flag is true if the line ends between top-level statements, i.e. no block is open,
+     * so the rest of the script can be run from there with a fresh compiler.
+     */
+    using LineHook = std::function<void(const std::string&, bool)>;
+
+    /**
+     * @brief The variables and functions of the parser at some point of a script.
+     * 
+     * The functions are shared with the parser, so taking a state copies pointers only.
+     */
+    struct State {
+        std::vector<double> slot_values_; ///< Values of the variable slots.
+        std::unordered_map<std::string, std::shared_ptr<const script::Statement>> funcs_; ///< The defined functions.
+    };
+
 private:
-    /// @brief Map of variable names to their float values.
-    std::unordered_map<std::string, float> vars;
-    
-    /// @brief Map of function names to their body definitions.
-    std::unordered_map<std::string, std::string> funcs;
+    /// @brief Slots allocated for the variable names used in the compiled statements.
+    script::SymbolTable symbols;
+
+    /// @brief Values of the variable slots, NaN for variables that were never assigned.
+    std::vector<double> slot_values;
     
-    /// @brief Map of function names to the argument names used as parameters to the function.
-    std::unordered_map<std::string, std::string> func_arg_names; 
+    /// @brief Map of function names to their compiled definitions (kDefine statements).
+    std::unordered_map<std::string, std::shared_ptr<const script::Statement>> funcs;
+
+    /// @brief A call of a script-defined function.
+    struct Frame {
+        const script::Statement *function_; ///< The definition of the called function.
+        size_t base_;                       ///< Index of the first local slot in local_values.
+    };
+
+    /// @brief The active function calls, innermost last.
+    std::vector<Frame> call_stack;
+
+    /// @brief Values of the local slots of all active calls, innermost frame last.
+    std::vector<double> local_values;
   
     /// @brief Tracks whether the animation of turtle movement is complete.
     bool movement_done;
 
+    /// @brief Indicates if movements are collected into batches instead of being sent one by one.
+    bool b_batch_motions;
+
+    /// @brief Movements collected since the last batch was sent.
+    MotionBatch pending_motions;
+
+    /// @brief Processes events until the turtle reports that the last movement is complete.
+    void wait_for_movement();
+
     /**
-     * @brief Executes a loop and returns the parsed commands.
+     * @brief Adds a forward, turn or arc command to the pending batch.
      * 
-     * @param count Number of loop iterations.
-     * @param loop_body The body of the loop to execute.
-     * @return Vector of commands that were successfully parsed and executed.
+     * @param statement The compiled command.
+     * @param args The evaluated arguments of the command.
+     * @return False if the command is not a movement that can be batched.
      */
-    std::vector<std::string> run_loop(int count, const std::string& loop_body); 
+    bool batch_motion(const script::Statement& statement, const std::vector<double>& args);
+
+    /// @brief Sends the pending movements to the turtle, once it has completed the last movement.
+    void flush_motions();
 
     /**
-     * @brief Replaces variable names in a command with their respective values.
+     * @brief Sends a movement to the turtle, or adds it to the pending batch.
      * 
-     * @param command The command string containing variable names.
-     * @return The command string with variables substituted by their values.
-     */ 
-    std::string varname_to_value(const std::string& command);
+     * @param kind The movement.
+     * @param length The distance of a forward or the radius of an arc.
+     * @param degrees The angle of a turn or an arc.
+     */
+    void send_motion(MotionBatch::Kind kind, float length, float degrees);
+
+    /**
+     * @brief Draws an L-system, streaming its symbols to the turtle.
+     * 
+     * @param statement The compiled lsystem statement.
+     * @param args The evaluated iteration count, angle and step length.
+     * @return False if the iteration count is negative or above LSystem::MAX_ITERATIONS,
+     *         or the rules are invalid.
+     */
+    bool run_lsystem(const script::Statement& statement, const std::vector<double>& args);
+
+    /**
+     * @brief Executes a loop statement.
+     * 
+     * @param loop The compiled loop.
+     * @param parsed_commands Receives the commands that were successfully executed.
+     */
+    void run_loop(const script::Statement& loop, std::vector<script::ExecutedCommand>& parsed_commands);
+
+    /**
+     * @brief Calls a script-defined function in a new frame.
+     * 
+     * @param call The compiled call.
+     * @param parsed_commands Receives the commands that were successfully executed.
+     * @return False if the function is unknown or the arguments do not match its parameters.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    bool call_function(const script::Statement& call, std::vector<script::ExecutedCommand>& parsed_commands);
+
+    /**
+     * @brief Executes a sequence of compiled statements.
+     * 
+     * @param block The statements to execute.
+     * @param parsed_commands Receives the commands that were successfully executed.
+     */
+    void execute(const script::Block& block, std::vector<script::ExecutedCommand>& parsed_commands);
+
+    /**
+     * @brief Executes a single compiled statement.
+     * 
+     * @param statement The statement to execute.
+     * @param parsed_commands Receives the commands that were successfully executed.
+     */
+    void execute(const script::Statement& statement, std::vector<script::ExecutedCommand>& parsed_commands);
+
+    /**
+     * @brief Sends a built-in command to the Turtle.
+     * 
+     * @param statement The compiled command.
+     * @param args The evaluated arguments of the command.
+     */
+    void run_command(const script::Statement& statement, const std::vector<double>& args);
+
+    /**
+     * @brief Evaluates the arguments of a statement.
+     * 
+     * @param args The argument expressions to evaluate.
+     * @param values Receives the values of the arguments.
+     * @return False if an argument is not a finite number (e.g. uses an undefined variable).
+     */
+    bool evaluate(const std::vector<script::Expr>& args, std::vector<double>& values) const;
+
+    /// @brief Allocates values for the variable slots created by the compiler.
+    void update_slots();
+
+    /**
+     * @brief Discards the frames above a depth, left by calls that were aborted by an exception.
+     * @param depth The number of frames to keep.
+     */
+    void unwind_call_stack(size_t depth);
+
+    /**
+     * @brief Unwinds the call stack to its depth at construction when it goes out of scope.
+     * 
+     * Input may be parsed again while a script waits for the turtle, as the events processed
+     * meanwhile can deliver it. Such nested input runs on top of the active calls and only
+     * discards its own frames, whether it ends or is aborted.
+     */
+    class CallStackScope;
+
+    /**
+     * @brief Compiles one line of a script and executes the top-level statements it completes.
+     * 
+     * @param compiler The compiler of the script.
+     * @param line The line, without the line terminator.
+     * @param sink Receives the commands that were successfully executed.
+     */
+    void run_script_line(ScriptCompiler& compiler, const std::string& line, const CommandSink& sink);
+
+    /**
+     * @brief Closes the blocks left open at the end of a script and executes them.
+     * 
+     * @param compiler The compiler of the script.
+     * @param sink Receives the commands that were successfully executed.
+     */
+    void finish_script(ScriptCompiler& compiler, const CommandSink& sink);
+
+    /**
+     * @brief Executes compiled top-level statements.
+     * 
+     * @param completed The statements to execute.
+     * @param sink Receives the commands that were successfully executed, after each statement.
+     */
+    void run_completed(const script::Block& completed, const CommandSink& sink);
+
 
  public:
+    /// @brief Maximum number of nested function calls, deeper recursion aborts the script.
+    static constexpr size_t MAX_CALL_DEPTH = 1000;
+
+    /// @brief Maximum number of movements sent in one batch, longer runs are split.
+    static constexpr size_t MAX_BATCH_MOTIONS = 65536;
+
     /**
      * @brief Constructs a Parser object.
      * 
@@ -59,16 +245,123 @@ private:
      * 
      * @param inputQ The input line as a QString.
      * @return Vector of commands that were successfully parsed and executed.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
      */
-    Q_INVOKABLE std::vector<std::string> parse_line(const QString& inputQ);
+    Q_INVOKABLE std::vector<script::ExecutedCommand> parse_line(const QString& inputQ);
+
+    /**
+     * @brief Parses a single line of input and hands out the commands while they run.
+     * 
+     * @param inputQ The input line as a QString.
+     * @param sink Receives each command that was successfully executed, after each top-level statement.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    void parse_line(const QString& inputQ, const CommandSink& sink);
 
     /**
      * @brief Parses an entire script file and executes the commands.
      * 
-     * @param file The input script file as an ifstream.
+     * @param file The input script file or any other input stream (e.g. std::cin).
      * @return Vector of commands that were successfully parsed and executed.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
      */    
-    Q_INVOKABLE std::vector<std::string> parse_script(std::ifstream& file);
+    Q_INVOKABLE std::vector<script::ExecutedCommand> parse_script(std::istream& file);
+
+    /**
+     * @brief Parses a script read from a device (file, pipe, socket, ...) and executes the commands.
+     * 
+     * @param source The opened device to read the script from.
+     * @return Vector of commands that were successfully parsed and executed.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    Q_INVOKABLE std::vector<script::ExecutedCommand> parse_script(QIODevice& source);
+
+    /**
+     * @brief Streams a script from a device and executes it while it is being read.
+     * 
+     * The device is read in large chunks and every line is compiled as soon as it has
+     * arrived, so memory use does not grow with the length of the script. Sequential
+     * devices (pipes, sockets) are waited on until they are closed.
+     * 
+     * @param source The opened device to read the script from.
+     * @param sink Receives each command that was successfully executed.
+     * @param on_line Optionally receives each line after it ran.
+     * @return The number of bytes read from the device.
+     * @throws std::runtime_error If the maximum call depth is exceeded.
+     */
+    qint64 parse_script(QIODevice& source, const CommandSink& sink, const LineHook& on_line = LineHook());
+
+    /**
+     * @brief Reads a device in large chunks and hands out every line as soon as it has arrived.
+     * 
+     * Lines are split as the scripts run by the parser are.
+     * 
+     * @param source The opened device to read.
+     * @param on_line Receives each line, without the line terminator.
+     * @return The number of bytes read from the device.
+     */
+    static qint64 read_lines(QIODevice& source, const std::function<void(const std::string&)>& on_line);
+
+    /**
+     * @brief Compiles a script and defines its top-level functions without running anything else.
+     * 
+     * Used when the effects of running the script are restored from elsewhere, e.g. a cache.
+     * 
+     * @param source The opened device to read the script from.
+     * @return The number of bytes read from the device.
+     */
+    qint64 load_definitions(QIODevice& source);
+
+    /**
+     * @brief Returns the global variables that have a value.
+     * @return The names and values of the variables, ordered by name.
+     */
+    std::vector<std::pair<std::string, double>> globals() const;
+
+    /**
+     * @brief Assigns a global variable, as an assignment statement would.
+     * 
+     * @param name The name of the variable.
+     * @param value The value.
+     */
+    void set_global(const std::string& name, double value);
+
+    /**
+     * @brief Describes everything a script run may depend on besides its own text.
+     * 
+     * The description holds the values of the global variables and the compiled functions,
+     * so equal descriptions mean a script behaves the same.
+     * 
+     * @return A binary description of the state.
+     */
+    std::string fingerprint() const;
+
+    /**
+     * @brief Takes the current values of the variables and the defined functions.
+     * @return The state, to be restored with restore_state().
+     */
+    State state() const;
+
+    /**
+     * @brief Returns the variables and functions to a state taken earlier.
+     * 
+     * Variables created since then are unassigned again, functions defined since then are removed.
+     * 
+     * @param state The state to restore.
+     */
+    void restore_state(const State& state);
+
+    /**
+     * @brief Sets whether movements are sent as batches.
+     * 
+     * Only turtles connected to the motion_batch signal can follow a batching parser.
+     * 
+     * @param b_batch True to send runs of movements with motion_batch.
+     */
+    Q_INVOKABLE void set_motion_batching(bool b_batch);
+
+    /// @brief Indicates if movements are sent as batches.
+    bool motion_batching() const { return b_batch_motions; }
  
     signals: // Commands that are sent to the Turtle as signals
       /**
@@ -130,6 +423,25 @@ private:
        */
       void arc(float radius, float angle);
 
+      /**
+       * @brief Signal to run a sequence of forward, turn and arc movements.
+       * 
+       * Sent instead of the single movement signals while motion batching is enabled.
+       * The turtle reports the completion of the whole batch once.
+       * @param batch The movements in order.
+       */
+      void motion_batch(const MotionBatch &batch);
+
+      /**
+       * @brief Signal to save the turtle's position and rotation.
+       */
+      void push_state();
+
+      /**
+       * @brief Signal to return the turtle to the last saved position and rotation.
+       */
+      void pop_state();
+
   public slots:
     /**
      * @brief Slot to process the end of an animation.
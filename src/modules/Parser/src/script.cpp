@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+#include "script.hpp"
+
+namespace script {
+
+namespace {
+
+// Correlation between degrees and radians
+constexpr double DEGREES_TO_RADIANS = M_PI / 180.0;
+
+void append_number(double value, std::string &out)
+{
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+}
+
+void append_name(const std::string &name, std::string &out)
+{
+    append_number(static_cast<double>(name.size()), out);
+    out += name;
+}
+
+void append_fingerprint(const Expr &expr, const SymbolTable &globals, std::string &out)
+{
+    out += static_cast<char>(expr.kind_);
+    switch (expr.kind_) {
+    case Expr::kConstant: append_number(expr.value_, out); break;
+    case Expr::kVariable: append_name(globals.name(expr.slot_), out); break;
+    case Expr::kLocal: append_number(expr.slot_, out); break;
+    case Expr::kUnary:
+    case Expr::kBinary: out += static_cast<char>(expr.operator_); break;
+    case Expr::kCall: out += static_cast<char>(expr.function_); break;
+    }
+    append_number(static_cast<double>(expr.args_.size()), out);
+    for (const Expr &arg : expr.args_) {
+        append_fingerprint(arg, globals, out);
+    }
+}
+
+} // namespace
+
+int SymbolTable::slot(const std::string &name)
+{
+    auto it = slots_.find(name);
+    if (it != slots_.end()) {
+        return it->second;
+    }
+
+    const int new_slot = size();
+    slots_.emplace(name, new_slot);
+    names_.push_back(name);
+    return new_slot;
+}
+
+int SymbolTable::find(const std::string &name) const
+{
+    auto it = slots_.find(name);
+    return it != slots_.end() ? it->second : -1;
+}
+
+const char *opcode_name(Opcode opcode)
+{
+    switch (opcode) {
+    case Opcode::kForward: return "forward";
+    case Opcode::kTurn: return "turn";
+    case Opcode::kSetRot: return "setrot";
+    case Opcode::kSetPos: return "setpos";
+    case Opcode::kArc: return "arc";
+    case Opcode::kUp: return "up";
+    case Opcode::kDown: return "down";
+    case Opcode::kSetSize: return "setsize";
+    case Opcode::kSetSpeed: return "setspeed";
+    case Opcode::kSetColor: return "setcolor";
+    }
+    return "";
+}
+
+int opcode_arity(Opcode opcode)
+{
+    switch (opcode) {
+    case Opcode::kUp:
+    case Opcode::kDown:
+        return 0;
+    case Opcode::kSetPos:
+    case Opcode::kArc:
+        return 2;
+    case Opcode::kSetColor:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+double apply_operator(Operator op, double a, double b)
+{
+    // Comparisons, logical operators and pow would turn an undefined operand into a number
+    if (std::isnan(a) || std::isnan(b)) {
+        return NAN;
+    }
+    switch (op) {
+    case Operator::kNegate: return -a;
+    case Operator::kNot: return a == 0.0 ? 1.0 : 0.0;
+    case Operator::kAdd: return a + b;
+    case Operator::kSubtract: return a - b;
+    case Operator::kMultiply: return a * b;
+    case Operator::kDivide: return a / b;
+    case Operator::kModulo: return std::fmod(a, b);
+    case Operator::kPower: return std::pow(a, b);
+    case Operator::kLess: return a < b ? 1.0 : 0.0;
+    case Operator::kLessEqual: return a <= b ? 1.0 : 0.0;
+    case Operator::kGreater: return a > b ? 1.0 : 0.0;
+    case Operator::kGreaterEqual: return a >= b ? 1.0 : 0.0;
+    case Operator::kEqual: return a == b ? 1.0 : 0.0;
+    case Operator::kNotEqual: return a != b ? 1.0 : 0.0;
+    case Operator::kAnd: return (a != 0.0 && b != 0.0) ? 1.0 : 0.0;
+    case Operator::kOr: return (a != 0.0 || b != 0.0) ? 1.0 : 0.0;
+    }
+    return NAN;
+}
+
+double apply_function(Function function, const double *args)
+{
+    // fmin and fmax would ignore an undefined argument
+    if (std::isnan(args[0]) || std::isnan(args[1])) {
+        return NAN;
+    }
+    switch (function) {
+    case Function::kSin: return std::sin(args[0] * DEGREES_TO_RADIANS);
+    case Function::kCos: return std::cos(args[0] * DEGREES_TO_RADIANS);
+    case Function::kTan: return std::tan(args[0] * DEGREES_TO_RADIANS);
+    case Function::kAtan2: return std::atan2(args[0], args[1]) / DEGREES_TO_RADIANS;
+    case Function::kSqrt: return std::sqrt(args[0]);
+    case Function::kAbs: return std::abs(args[0]);
+    case Function::kFloor: return std::floor(args[0]);
+    case Function::kCeil: return std::ceil(args[0]);
+    case Function::kRound: return std::round(args[0]);
+    case Function::kMin: return std::fmin(args[0], args[1]);
+    case Function::kMax: return std::fmax(args[0], args[1]);
+    case Function::kPow: return std::pow(args[0], args[1]);
+    case Function::kAdd: return args[0] + args[1];
+    case Function::kMul: return args[0] * args[1];
+    }
+    return NAN;
+}
+
+double evaluate(const Expr &expr, const double *globals, const double *locals)
+{
+    switch (expr.kind_) {
+    case Expr::kConstant:
+        return expr.value_;
+
+    case Expr::kVariable:
+        return globals[expr.slot_];
+
+    case Expr::kLocal:
+        return locals[expr.slot_];
+
+    case Expr::kUnary:
+        return apply_operator(expr.operator_, evaluate(expr.args_[0], globals, locals));
+
+    case Expr::kBinary: {
+        const double a = evaluate(expr.args_[0], globals, locals);
+        // Logical operators short-circuit
+        if (expr.operator_ == Operator::kAnd && a == 0.0) {
+            return 0.0;
+        }
+        if (expr.operator_ == Operator::kOr && a != 0.0 && !std::isnan(a)) {
+            return 1.0;
+        }
+        return apply_operator(expr.operator_, a, evaluate(expr.args_[1], globals, locals));
+    }
+
+    case Expr::kCall: {
+        double args[2] = {0.0, 0.0};
+        for (size_t i = 0; i < expr.args_.size() && i < 2; ++i) {
+            args[i] = evaluate(expr.args_[i], globals, locals);
+        }
+        return apply_function(expr.function_, args);
+    }
+    }
+    return NAN;
+}
+
+void append_fingerprint(const Statement &statement, const SymbolTable &globals, std::string &out)
+{
+    out += static_cast<char>(statement.kind_);
+    out += static_cast<char>(statement.opcode_);
+    append_name(statement.name_, out);
+    append_number(static_cast<double>(statement.parameters_.size()), out);
+    for (const std::string &parameter : statement.parameters_) {
+        append_name(parameter, out);
+    }
+    if (statement.kind_ == Statement::kAssign) {
+        out += statement.local_ ? 'l' : 'g';
+        if (statement.local_) {
+            append_number(statement.slot_, out);
+        }
+    }
+    append_number(statement.frame_size_, out);
+    append_number(static_cast<double>(statement.args_.size()), out);
+    for (const Expr &arg : statement.args_) {
+        append_fingerprint(arg, globals, out);
+    }
+    append_number(static_cast<double>(statement.strings_.size()), out);
+    for (const std::string &text : statement.strings_) {
+        append_name(text, out);
+    }
+    append_number(static_cast<double>(statement.body_.size()), out);
+    for (const Statement &child : statement.body_) {
+        append_fingerprint(child, globals, out);
+    }
+}
+
+ExecutedCommand ExecutedCommand::command(Opcode opcode, const std::vector<double> &args)
+{
+    ExecutedCommand record;
+    record.kind_ = kCommand;
+    record.opcode_ = opcode;
+    record.arg_count_ = static_cast<unsigned char>(std::min<size_t>(args.size(), MAX_ARGS));
+    std::copy(args.begin(), args.begin() + record.arg_count_, record.args_);
+    return record;
+}
+
+ExecutedCommand ExecutedCommand::assignment(const char *name, double value)
+{
+    ExecutedCommand record;
+    record.kind_ = kAssign;
+    record.text_ = name;
+    record.arg_count_ = 1;
+    record.args_[0] = value;
+    return record;
+}
+
+ExecutedCommand ExecutedCommand::lsystem(const char *strings, const std::vector<double> &args)
+{
+    ExecutedCommand record = command(Opcode::kForward, args);
+    record.kind_ = kLSystem;
+    record.text_ = strings;
+    return record;
+}
+
+ExecutedCommand ExecutedCommand::text(const char *line)
+{
+    ExecutedCommand record;
+    record.text_ = line;
+    return record;
+}
+
+std::string ExecutedCommand::to_string() const
+{
+    std::ostringstream out;
+    switch (kind_) {
+    case kCommand:
+        out << opcode_name(opcode_) << "(";
+        for (int i = 0; i < arg_count_; ++i) {
+            out << (i ? "," : "") << args_[i];
+        }
+        out << ")";
+        break;
+    case kAssign: out << text_ << "=" << args_[0]; break;
+    case kLSystem:
+        out << "lsystem(" << text_;
+        for (int i = 0; i < arg_count_; ++i) {
+            out << "," << args_[i];
+        }
+        out << ")";
+        break;
+    case kText: out << text_; break;
+    }
+    return out.str();
+}
+
+const char *intern(const std::string &text)
+{
+    // Nodes of the set never move, so the strings stay where they are while it grows.
+    // It is never destroyed, records may still be formatted while static objects are.
+    static std::mutex mutex;
+    static auto *texts = new std::unordered_set<std::string>();
+    std::lock_guard<std::mutex> lock(mutex);
+    return texts->insert(text).first->c_str();
+}
+
+} // namespace script
@@ -0,0 +1,310 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Compiled representation of turtle scripts.
+ *
+ * Scripts are compiled once into a tree of statements. Blocks (loops and function
+ * definitions) keep their body as nested statements, so nested blocks are executed
+ * directly from the tree instead of re-parsing their text on every iteration.
+ * Arguments are expression trees whose variables refer to numbered slots, so
+ * evaluating them never involves strings.
+ *
+ * Inside function bodies, the parameters and the variables assigned in the body are
+ * locals: they live in the call frame of the function, whose slots are numbered
+ * separately from the global slots. Other variables refer to globals.
+ */
+namespace script {
+
+/**
+ * @brief Built-in turtle commands.
+ */
+enum class Opcode : unsigned char {
+    kForward = 0, ///< forward(distance)
+    kTurn,        ///< turn(angle)
+    kSetRot,      ///< setrot(rotation)
+    kSetPos,      ///< setpos(x, y)
+    kArc,         ///< arc(radius, angle)
+    kUp,          ///< up()
+    kDown,        ///< down()
+    kSetSize,     ///< setsize(size)
+    kSetSpeed,    ///< setspeed(speed)
+    kSetColor     ///< setcolor(r, g, b)
+};
+
+/**
+ * @brief Operators of expressions.
+ */
+enum class Operator {
+    kNegate = 0,   ///< -a
+    kNot,          ///< !a
+    kAdd,          ///< a + b
+    kSubtract,     ///< a - b
+    kMultiply,     ///< a * b
+    kDivide,       ///< a / b
+    kModulo,       ///< a % b
+    kPower,        ///< a ^ b
+    kLess,         ///< a < b
+    kLessEqual,    ///< a <= b
+    kGreater,      ///< a > b
+    kGreaterEqual, ///< a >= b
+    kEqual,        ///< a == b
+    kNotEqual,     ///< a != b
+    kAnd,          ///< a && b
+    kOr            ///< a || b
+};
+
+/**
+ * @brief Built-in functions usable in expressions. Angles are in degrees.
+ */
+enum class Function {
+    kSin = 0, ///< sin(degrees)
+    kCos,     ///< cos(degrees)
+    kTan,     ///< tan(degrees)
+    kAtan2,   ///< atan2(y, x) in degrees
+    kSqrt,    ///< sqrt(a)
+    kAbs,     ///< abs(a)
+    kFloor,   ///< floor(a)
+    kCeil,    ///< ceil(a)
+    kRound,   ///< round(a)
+    kMin,     ///< min(a, b)
+    kMax,     ///< max(a, b)
+    kPow,     ///< pow(a, b)
+    kAdd,     ///< add(a, b), kept for older scripts
+    kMul      ///< mul(a, b), kept for older scripts
+};
+
+/**
+ * @brief A node of an expression tree.
+ *
+ * Subexpressions that only depend on constants are folded into kConstant nodes
+ * when the expression is compiled.
+ */
+struct Expr
+{
+    /// @brief The kind of the node.
+    enum Kind {
+        kConstant = 0, ///< The number value_.
+        kVariable,     ///< The global variable stored in slot slot_.
+        kLocal,        ///< The local variable stored in slot slot_ of the current call frame.
+        kUnary,        ///< operator_ applied to args_[0].
+        kBinary,       ///< operator_ applied to args_[0] and args_[1].
+        kCall          ///< function_ applied to args_.
+    };
+
+    Kind kind_ = kConstant;                 ///< The kind of the node.
+    double value_ = 0.0;                    ///< The value of a kConstant node.
+    int slot_ = -1;                         ///< The slot of a kVariable or kLocal node.
+    Operator operator_ = Operator::kAdd;    ///< The operator of a kUnary or kBinary node.
+    Function function_ = Function::kSin;    ///< The function of a kCall node.
+    std::vector<Expr> args_;                ///< The operands of the node.
+};
+
+/**
+ * @brief Maps variable names to the slots holding their values.
+ */
+class SymbolTable
+{
+public:
+    /**
+     * @brief Returns the slot of a variable, allocating a new slot for unknown names.
+     * @param name The variable name.
+     * @return The slot index.
+     */
+    int slot(const std::string &name);
+
+    /**
+     * @brief Returns the slot of a variable without allocating one.
+     * @param name The variable name.
+     * @return The slot index, or -1 if the variable is unknown.
+     */
+    int find(const std::string &name) const;
+
+    /// @brief Returns the number of allocated slots.
+    int size() const { return static_cast<int>(names_.size()); }
+
+    /// @brief Returns the name of the variable stored in a slot.
+    const std::string &name(int slot) const { return names_[slot]; }
+
+private:
+    std::unordered_map<std::string, int> slots_; ///< Slot of each variable name.
+    std::vector<std::string> names_;             ///< Variable name of each slot.
+};
+
+/**
+ * @brief A single compiled statement.
+ *
+ * Block statements (kLoop, kDefine and kInvalidBlock) store their contents in body_.
+ * A kLSystem statement stores its axiom and rules in strings_ and its iteration count,
+ * angle and step length in args_.
+ */
+struct Statement
+{
+    /// @brief The kind of the statement.
+    enum Kind {
+        kCommand = 0,   ///< Built-in turtle command, see opcode_.
+        kAssign,        ///< Variable assignment: slot_ = args_[0].
+        kCall,          ///< Call of a user-defined function called name_.
+        kLoop,          ///< Loop executing body_ args_[0] times.
+        kIf,            ///< Block executing body_ if args_[0] is not zero.
+        kDefine,        ///< Definition of the function name_ with the parameters parameters_.
+        kLSystem,       ///< L-system drawn from the axiom and rules in strings_, see args_.
+        kInvalid,       ///< Text that does not match any statement.
+        kInvalidBlock   ///< Block with a header that does not match any block statement.
+    };
+
+    Kind kind_ = kInvalid;             ///< The kind of the statement.
+    Opcode opcode_ = Opcode::kForward; ///< The command of a kCommand statement.
+    std::string name_;                 ///< Variable, function name or invalid source text.
+    std::vector<std::string> parameters_; ///< Parameter names of a kDefine statement.
+    int slot_ = -1;                    ///< The assigned slot of a kAssign statement.
+    bool local_ = false;               ///< True if a kAssign statement assigns a local variable.
+    int frame_size_ = 0;               ///< Number of local slots (parameters first) of kDefine.
+    std::vector<Expr> args_;           ///< Arguments of the statement (kLoop count, kIf condition).
+    std::vector<std::string> strings_; ///< String arguments of a kLSystem statement.
+    const char *record_text_ = nullptr; ///< Interned text recorded by kAssign and kLSystem, see ExecutedCommand.
+    std::vector<Statement> body_;      ///< Nested statements of a block.
+};
+
+/// @brief A sequence of statements.
+using Block = std::vector<Statement>;
+
+/**
+ * @brief A command that was executed, as recorded in the command history.
+ *
+ * Records hold the command and its evaluated arguments instead of their text, so running
+ * millions of commands does not allocate a string for each of them. Texts that are part of
+ * a record are interned or kept by the history, and the command is only formatted when it
+ * is displayed.
+ */
+struct ExecutedCommand
+{
+    /// @brief The kind of the record.
+    enum Kind : unsigned char {
+        kCommand = 0, ///< Built-in command opcode_ applied to args_.
+        kAssign,      ///< Assignment of args_[0] to the variable text_.
+        kLSystem,     ///< L-system drawn from the quoted axiom and rules text_ and args_.
+        kText         ///< The line text_ as it was entered.
+    };
+
+    /// @brief Maximum number of evaluated arguments of a record.
+    static constexpr int MAX_ARGS = 3;
+
+    Kind kind_ = kText;                ///< The kind of the record.
+    Opcode opcode_ = Opcode::kForward; ///< The command of a kCommand record.
+    unsigned char arg_count_ = 0;      ///< Number of used args_.
+    const char *text_ = "";            ///< Interned text or text owned by the history, see Kind.
+    double args_[MAX_ARGS] = {};       ///< The evaluated arguments.
+
+    /**
+     * @brief Records a built-in command.
+     * @param opcode The command.
+     * @param args The evaluated arguments, at most MAX_ARGS.
+     */
+    static ExecutedCommand command(Opcode opcode, const std::vector<double> &args);
+
+    /**
+     * @brief Records an assignment.
+     * @param name The interned variable name.
+     * @param value The assigned value.
+     */
+    static ExecutedCommand assignment(const char *name, double value);
+
+    /**
+     * @brief Records an L-system.
+     * @param strings The interned axiom and rules, quoted and separated by a comma.
+     * @param args The evaluated iteration count, angle and step length.
+     */
+    static ExecutedCommand lsystem(const char *strings, const std::vector<double> &args);
+
+    /**
+     * @brief Records a line as it was entered.
+     * @param line The line, interned or kept by the owner of the record for as long as the record.
+     */
+    static ExecutedCommand text(const char *line);
+
+    /**
+     * @brief Formats the record as a command, e.g. "forward(10)" or "x=2".
+     * @return The command with its evaluated arguments.
+     */
+    std::string to_string() const;
+};
+
+/**
+ * @brief Returns a copy of a text that lives until the process ends.
+ *
+ * Equal texts share one copy, so texts recorded over and over, like the names of assigned
+ * variables, are stored once. Can be called from any thread.
+ *
+ * @param text The text.
+ * @return The interned copy, null-terminated.
+ */
+const char *intern(const std::string &text);
+
+/**
+ * @brief Returns the script name of a built-in command.
+ * @param opcode The command.
+ * @return The name used in scripts, e.g. "forward".
+ */
+const char *opcode_name(Opcode opcode);
+
+/**
+ * @brief Returns the number of arguments a built-in command takes.
+ * @param opcode The command.
+ * @return The argument count.
+ */
+int opcode_arity(Opcode opcode);
+
+/**
+ * @brief Applies an operator to constant operands.
+ *
+ * Comparison and logical operators return 1 for true and 0 for false. An undefined (NaN)
+ * operand makes any result NaN, so statements using it are rejected.
+ *
+ * @param op The operator.
+ * @param a The first operand.
+ * @param b The second operand, ignored by unary operators.
+ * @return The result.
+ */
+double apply_operator(Operator op, double a, double b = 0.0);
+
+/**
+ * @brief Applies a built-in function to constant arguments.
+ *
+ * An undefined (NaN) argument makes the result NaN, as for apply_operator().
+ *
+ * @param function The function.
+ * @param args Two arguments, those the function does not take set to 0.
+ * @return The result.
+ */
+double apply_function(Function function, const double *args);
+
+/**
+ * @brief Evaluates an expression.
+ *
+ * @param expr The expression.
+ * @param globals The values of the global variable slots.
+ * @param locals The values of the local slots of the current call frame.
+ * @return The value of the expression, NaN if an undefined variable is used.
+ */
+double evaluate(const Expr &expr, const double *globals, const double *locals);
+
+/**
+ * @brief Appends a description of a compiled statement that identifies its behavior.
+ *
+ * Equal statements give equal descriptions. Global variables are described by their names,
+ * so the description does not depend on the slots a symbol table allocated for them.
+ *
+ * @param statement The statement, including its body.
+ * @param globals The table of the global slots used by the statement.
+ * @param out Receives the description.
+ */
+void append_fingerprint(const Statement &statement, const SymbolTable &globals, std::string &out);
+
+} // namespace script
+
+#endif // SCRIPT_H
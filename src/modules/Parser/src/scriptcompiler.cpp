@@ -0,0 +1,702 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <regex>
+#include <sstream>
+
+#include "lsystem.hpp"
+#include "scriptcompiler.hpp"
+#include "trace.hpp"
+
+using script::Block;
+using script::Expr;
+using script::Function;
+using script::Opcode;
+using script::Operator;
+using script::Statement;
+using script::SymbolTable;
+
+namespace {
+
+// Removes all whitespace from the text, except in quoted strings
+std::string strip_whitespace(const std::string &text)
+{
+    std::string stripped;
+    bool b_quoted = false;
+    for (char c : text) {
+        if (c == '"') {
+            b_quoted = !b_quoted;
+        }
+        if (b_quoted || !std::isspace(static_cast<unsigned char>(c))) {
+            stripped += c;
+        }
+    }
+    return stripped;
+}
+
+// Splits the text at the commas that are neither nested in parentheses nor quoted
+std::vector<std::string> split_arguments(const std::string &text)
+{
+    std::vector<std::string> parts;
+    int depth = 0;
+    bool b_quoted = false;
+    size_t start = 0;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        if (i == text.size() || (text[i] == ',' && depth == 0 && !b_quoted)) {
+            parts.push_back(text.substr(start, i - start));
+            start = i + 1;
+        } else if (text[i] == '"') {
+            b_quoted = !b_quoted;
+        } else if (b_quoted) {
+            continue;
+        } else if (text[i] == '(') {
+            ++depth;
+        } else if (text[i] == ')') {
+            --depth;
+        }
+    }
+    return parts;
+}
+
+// Gets the text between the quotes of a quoted string
+bool unquote(const std::string &text, std::string &contents)
+{
+    if (text.size() < 2 || text.front() != '"' || text.back() != '"'
+        || text.find('"', 1) != text.size() - 1) {
+        return false;
+    }
+    contents = text.substr(1, text.size() - 2);
+    return true;
+}
+
+bool is_identifier_start(char c)
+{
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool is_identifier_char(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// Returns true if the whole text is an identifier
+bool is_identifier(const std::string &text)
+{
+    return !text.empty() && is_identifier_start(text[0])
+           && std::all_of(text.begin(), text.end(), is_identifier_char);
+}
+
+// Built-in commands by script name
+const std::vector<std::pair<std::string, Opcode>> &command_names()
+{
+    static const std::vector<std::pair<std::string, Opcode>> names = {
+        {"forward", Opcode::kForward}, {"turn", Opcode::kTurn},     {"setrot", Opcode::kSetRot},
+        {"setpos", Opcode::kSetPos},   {"arc", Opcode::kArc},       {"up", Opcode::kUp},
+        {"down", Opcode::kDown},       {"setsize", Opcode::kSetSize},
+        {"setspeed", Opcode::kSetSpeed}, {"setcolor", Opcode::kSetColor},
+    };
+    return names;
+}
+
+// Built-in expression functions by name, with their argument count
+struct FunctionInfo
+{
+    const char *name;
+    Function function;
+    int arity;
+};
+
+const FunctionInfo *find_function(const std::string &name)
+{
+    static const FunctionInfo functions[] = {
+        {"sin", Function::kSin, 1},     {"cos", Function::kCos, 1},
+        {"tan", Function::kTan, 1},     {"atan2", Function::kAtan2, 2},
+        {"sqrt", Function::kSqrt, 1},   {"abs", Function::kAbs, 1},
+        {"floor", Function::kFloor, 1}, {"ceil", Function::kCeil, 1},
+        {"round", Function::kRound, 1}, {"min", Function::kMin, 2},
+        {"max", Function::kMax, 2},     {"pow", Function::kPow, 2},
+        {"add", Function::kAdd, 2},     {"mul", Function::kMul, 2},
+    };
+    for (const FunctionInfo &info : functions) {
+        if (name == info.name) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+// Splits "name(args)" into its parts if the parentheses enclose the rest of the text
+bool split_call(const std::string &text, std::string &name, std::string &args)
+{
+    const size_t open = text.find('(');
+    if (open == std::string::npos || text.back() != ')') {
+        return false;
+    }
+
+    // The '(' after the name must be closed by the last character
+    int depth = 0;
+    bool b_quoted = false;
+    for (size_t i = open; i < text.size(); ++i) {
+        if (text[i] == '"') {
+            b_quoted = !b_quoted;
+        } else if (b_quoted) {
+            continue;
+        } else if (text[i] == '(') {
+            ++depth;
+        } else if (text[i] == ')' && --depth == 0 && i != text.size() - 1) {
+            return false;
+        }
+    }
+
+    name = text.substr(0, open);
+    args = text.substr(open + 1, text.size() - open - 2);
+    return is_identifier(name);
+}
+
+Expr make_constant(double value)
+{
+    Expr expr;
+    expr.kind_ = Expr::kConstant;
+    expr.value_ = value;
+    return expr;
+}
+
+// Creates an operator node, folding it if the operands are constant
+Expr make_operator(Operator op, std::vector<Expr> &&args)
+{
+    const bool b_constant = std::all_of(args.begin(), args.end(), [](const Expr &arg) {
+        return arg.kind_ == Expr::kConstant;
+    });
+    if (b_constant) {
+        return make_constant(script::apply_operator(op,
+                                                    args[0].value_,
+                                                    args.size() > 1 ? args[1].value_ : 0.0));
+    }
+
+    Expr expr;
+    expr.kind_ = args.size() == 1 ? Expr::kUnary : Expr::kBinary;
+    expr.operator_ = op;
+    expr.args_ = std::move(args);
+    return expr;
+}
+
+// Creates a function call node, folding it if the arguments are constant
+Expr make_call(Function function, std::vector<Expr> &&args)
+{
+    const bool b_constant = std::all_of(args.begin(), args.end(), [](const Expr &arg) {
+        return arg.kind_ == Expr::kConstant;
+    });
+    if (b_constant) {
+        double values[2] = {0.0, 0.0};
+        for (size_t i = 0; i < args.size() && i < 2; ++i) {
+            values[i] = args[i].value_;
+        }
+        return make_constant(script::apply_function(function, values));
+    }
+
+    Expr expr;
+    expr.kind_ = Expr::kCall;
+    expr.function_ = function;
+    expr.args_ = std::move(args);
+    return expr;
+}
+
+/**
+ * Recursive descent parser for expressions, from the lowest to the highest precedence:
+ *   or:             and ('||' and)*
+ *   and:            equality ('&&' equality)*
+ *   equality:       relational (('=='|'!=') relational)*
+ *   relational:     additive (('<'|'<='|'>'|'>=') additive)*
+ *   additive:       multiplicative (('+'|'-') multiplicative)*
+ *   multiplicative: unary (('*'|'/'|'%') unary)*
+ *   unary:          ('-'|'+'|'!') unary | power
+ *   power:          primary ('^' unary)?
+ *   primary:        number | variable | function '(' arguments ')' | '(' or ')'
+ */
+class ExpressionParser
+{
+public:
+    ExpressionParser(const std::string &text, SymbolTable &symbols, const SymbolTable *locals)
+        : text_(text)
+        , pos_(0)
+        , symbols_(symbols)
+        , locals_(locals)
+    {}
+
+    bool parse(Expr &expr) { return parse_or(expr) && pos_ == text_.size(); }
+
+private:
+    using OperatorTable = std::vector<std::pair<const char *, Operator>>;
+
+    const std::string &text_;
+    size_t pos_;
+    SymbolTable &symbols_;
+    const SymbolTable *locals_; // locals of the enclosing function, if any
+
+    // Consumes the token if the text continues with it
+    bool accept(const char *token)
+    {
+        const size_t length = std::char_traits<char>::length(token);
+        if (text_.compare(pos_, length, token) != 0) {
+            return false;
+        }
+        pos_ += length;
+        return true;
+    }
+
+    // Parses a left-associative chain of binary operators
+    template<typename Operand>
+    bool parse_chain(Expr &expr, Operand operand, const OperatorTable &operators)
+    {
+        if (!(this->*operand)(expr)) {
+            return false;
+        }
+        for (;;) {
+            bool b_matched = false;
+            for (const auto &candidate : operators) {
+                if (accept(candidate.first)) {
+                    Expr rhs;
+                    if (!(this->*operand)(rhs)) {
+                        return false;
+                    }
+                    std::vector<Expr> args;
+                    args.push_back(std::move(expr));
+                    args.push_back(std::move(rhs));
+                    expr = make_operator(candidate.second, std::move(args));
+                    b_matched = true;
+                    break;
+                }
+            }
+            if (!b_matched) {
+                return true;
+            }
+        }
+    }
+
+    bool parse_or(Expr &expr)
+    {
+        static const OperatorTable operators = {{"||", Operator::kOr}};
+        return parse_chain(expr, &ExpressionParser::parse_and, operators);
+    }
+
+    bool parse_and(Expr &expr)
+    {
+        static const OperatorTable operators = {{"&&", Operator::kAnd}};
+        return parse_chain(expr, &ExpressionParser::parse_equality, operators);
+    }
+
+    bool parse_equality(Expr &expr)
+    {
+        static const OperatorTable operators = {{"==", Operator::kEqual},
+                                                {"!=", Operator::kNotEqual}};
+        return parse_chain(expr, &ExpressionParser::parse_relational, operators);
+    }
+
+    bool parse_relational(Expr &expr)
+    {
+        // Two-character operators are tried first
+        static const OperatorTable operators = {{"<=", Operator::kLessEqual},
+                                                {">=", Operator::kGreaterEqual},
+                                                {"<", Operator::kLess},
+                                                {">", Operator::kGreater}};
+        return parse_chain(expr, &ExpressionParser::parse_additive, operators);
+    }
+
+    bool parse_additive(Expr &expr)
+    {
+        static const OperatorTable operators = {{"+", Operator::kAdd},
+                                                {"-", Operator::kSubtract}};
+        return parse_chain(expr, &ExpressionParser::parse_multiplicative, operators);
+    }
+
+    bool parse_multiplicative(Expr &expr)
+    {
+        static const OperatorTable operators = {{"*", Operator::kMultiply},
+                                                {"/", Operator::kDivide},
+                                                {"%", Operator::kModulo}};
+        return parse_chain(expr, &ExpressionParser::parse_unary, operators);
+    }
+
+    bool parse_unary(Expr &expr)
+    {
+        Operator op;
+        if (accept("-")) {
+            op = Operator::kNegate;
+        } else if (accept("!")) {
+            op = Operator::kNot;
+        } else if (accept("+")) {
+            return parse_unary(expr);
+        } else {
+            return parse_power(expr);
+        }
+
+        Expr operand;
+        if (!parse_unary(operand)) {
+            return false;
+        }
+        std::vector<Expr> args;
+        args.push_back(std::move(operand));
+        expr = make_operator(op, std::move(args));
+        return true;
+    }
+
+    bool parse_power(Expr &expr)
+    {
+        if (!parse_primary(expr)) {
+            return false;
+        }
+        if (!accept("^")) {
+            return true;
+        }
+
+        // Right-associative: 2^3^2 == 2^(3^2)
+        Expr exponent;
+        if (!parse_unary(exponent)) {
+            return false;
+        }
+        std::vector<Expr> args;
+        args.push_back(std::move(expr));
+        args.push_back(std::move(exponent));
+        expr = make_operator(Operator::kPower, std::move(args));
+        return true;
+    }
+
+    bool parse_primary(Expr &expr)
+    {
+        if (pos_ >= text_.size()) {
+            return false;
+        }
+
+        const char c = text_[pos_];
+
+        // Parenthesized expression
+        if (accept("(")) {
+            return parse_or(expr) && accept(")");
+        }
+
+        // Number
+        if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+            const char *start = text_.c_str() + pos_;
+            char *end = nullptr;
+            const double value = std::strtod(start, &end);
+            if (end == start) {
+                return false;
+            }
+            pos_ += end - start;
+            expr = make_constant(value);
+            return true;
+        }
+
+        if (!is_identifier_start(c)) {
+            return false;
+        }
+
+        const size_t start = pos_;
+        while (pos_ < text_.size() && is_identifier_char(text_[pos_])) {
+            ++pos_;
+        }
+        const std::string name = text_.substr(start, pos_ - start);
+
+        // Function call
+        if (accept("(")) {
+            const FunctionInfo *info = find_function(name);
+            if (!info) {
+                return false;
+            }
+
+            std::vector<Expr> args;
+            if (!accept(")")) {
+                do {
+                    Expr arg;
+                    if (!parse_or(arg)) {
+                        return false;
+                    }
+                    args.push_back(std::move(arg));
+                } while (accept(","));
+                if (!accept(")")) {
+                    return false;
+                }
+            }
+            if (static_cast<int>(args.size()) != info->arity) {
+                return false;
+            }
+            expr = make_call(info->function, std::move(args));
+            return true;
+        }
+
+        // Variable, local if the enclosing function has a local of that name
+        expr = Expr();
+        const int local = locals_ ? locals_->find(name) : -1;
+        if (local >= 0) {
+            expr.kind_ = Expr::kLocal;
+            expr.slot_ = local;
+        } else {
+            expr.kind_ = Expr::kVariable;
+            expr.slot_ = symbols_.slot(name);
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+void ScriptCompiler::feed_line(const std::string &line, Block &completed)
+{
+    std::string text; // text of the statement being scanned
+    bool b_quoted = false; // separators in quoted strings are part of the string
+
+    for (char c : line) {
+        if (c == '"') {
+            b_quoted = !b_quoted;
+            text += c;
+        } else if (b_quoted) {
+            text += c;
+        } else if (c == '#') { // comment until the end of the line
+            break;
+        } else if (c == ';') {
+            add_statement(text, completed);
+            text.clear();
+        } else if (c == '{') {
+            open_block(text);
+            text.clear();
+        } else if (c == '}') {
+            add_statement(text, completed);
+            text.clear();
+            close_block(completed);
+        } else {
+            text += c;
+        }
+    }
+    add_statement(text, completed);
+}
+
+void ScriptCompiler::finish(Block &completed)
+{
+    while (in_block()) {
+        close_block(completed);
+    }
+}
+
+Block ScriptCompiler::compile(const std::string &source, SymbolTable &symbols)
+{
+    TRACE_SCOPE("ScriptCompiler::compile");
+    ScriptCompiler compiler(symbols);
+    Block statements;
+    std::istringstream source_stream(source);
+    std::string line;
+    while (std::getline(source_stream, line)) {
+        compiler.feed_line(line, statements);
+    }
+    compiler.finish(statements);
+    return statements;
+}
+
+bool ScriptCompiler::compile_expression(const std::string &text, Expr &expr)
+{
+    ExpressionParser parser(text, symbols_, local_scopes_.empty() ? nullptr : &local_scopes_.back());
+    return parser.parse(expr);
+}
+
+bool ScriptCompiler::compile_arguments(const std::string &text, std::vector<Expr> &args)
+{
+    args.clear();
+    if (text.empty()) {
+        return true;
+    }
+
+    for (const std::string &part : split_arguments(text)) {
+        Expr arg;
+        if (!compile_expression(part, arg)) {
+            return false;
+        }
+        args.push_back(std::move(arg));
+    }
+    return true;
+}
+
+bool ScriptCompiler::compile_lsystem(const std::string &text, Statement &statement)
+{
+    // lsystem("axiom", "rules", iterations, angle, step)
+    const std::vector<std::string> parts = split_arguments(text);
+    std::string axiom;
+    std::string rules;
+    if (parts.size() != 5 || !unquote(parts[0], axiom) || !unquote(parts[1], rules)
+        || !LSystem().set_rules(rules)) {
+        return false;
+    }
+
+    std::vector<Expr> args;
+    for (size_t i = 2; i < parts.size(); ++i) {
+        Expr arg;
+        if (!compile_expression(parts[i], arg)) {
+            return false;
+        }
+        args.push_back(std::move(arg));
+    }
+
+    statement.kind_ = Statement::kLSystem;
+    statement.name_ = "lsystem";
+    axiom.erase(std::remove_if(axiom.begin(), axiom.end(), ::isspace), axiom.end());
+    statement.strings_ = {axiom, rules};
+    statement.record_text_ = script::intern("\"" + axiom + "\",\"" + rules + "\"");
+    statement.args_ = std::move(args);
+    return true;
+}
+
+void ScriptCompiler::add_statement(const std::string &text, Block &completed)
+{
+    const std::string stripped = strip_whitespace(text);
+    if (stripped.empty()) {
+        return;
+    }
+    emit_statement(compile_statement(stripped), completed);
+}
+
+void ScriptCompiler::open_block(const std::string &header)
+{
+    open_blocks_.push_back(compile_header(strip_whitespace(header)));
+
+    // The body of a function gets its own scope, starting with the parameters
+    const Statement &block = open_blocks_.back();
+    if (block.kind_ == Statement::kDefine) {
+        SymbolTable locals;
+        for (const std::string &parameter : block.parameters_) {
+            locals.slot(parameter);
+        }
+        local_scopes_.push_back(std::move(locals));
+    }
+}
+
+void ScriptCompiler::close_block(Block &completed)
+{
+    if (open_blocks_.empty()) {
+        // A '}' without a matching '{'
+        Statement stray;
+        stray.kind_ = Statement::kInvalid;
+        stray.name_ = "}";
+        emit_statement(std::move(stray), completed);
+        return;
+    }
+
+    Statement block = std::move(open_blocks_.back());
+    open_blocks_.pop_back();
+    if (block.kind_ == Statement::kDefine) {
+        block.frame_size_ = local_scopes_.back().size();
+        local_scopes_.pop_back();
+    }
+    emit_statement(std::move(block), completed);
+}
+
+void ScriptCompiler::emit_statement(Statement &&statement, Block &completed)
+{
+    if (open_blocks_.empty()) {
+        completed.push_back(std::move(statement));
+    } else {
+        open_blocks_.back().body_.push_back(std::move(statement));
+    }
+}
+
+Statement ScriptCompiler::compile_statement(const std::string &text)
+{
+    Statement statement;
+    statement.kind_ = Statement::kInvalid;
+    statement.name_ = text;
+
+    // Nullary commands can be called either as up or up()
+    for (const char *nullary : {"up", "down"}) {
+        if (text == nullary || text == std::string(nullary) + "()") {
+            statement.kind_ = Statement::kCommand;
+            statement.opcode_ = text[0] == 'u' ? Opcode::kUp : Opcode::kDown;
+            return statement;
+        }
+    }
+
+    // Variable assignment: name=expression (but not a comparison like a==b)
+    const size_t equals = text.find('=');
+    if (equals != std::string::npos && equals + 1 < text.size() && text[equals + 1] != '='
+        && is_identifier(text.substr(0, equals))) {
+        Expr value;
+        if (compile_expression(text.substr(equals + 1), value)) {
+            statement.kind_ = Statement::kAssign;
+            statement.name_ = text.substr(0, equals);
+            // Inside a function, assigned variables are locals of the call
+            statement.local_ = !local_scopes_.empty();
+            statement.slot_ = statement.local_ ? local_scopes_.back().slot(statement.name_)
+                                               : symbols_.slot(statement.name_);
+            statement.args_.push_back(std::move(value));
+            statement.record_text_ = script::intern(statement.name_);
+        }
+        return statement;
+    }
+
+    // Built-in command or call of a script-defined function: name(arguments)
+    std::string name;
+    std::string args_text;
+    if (split_call(text, name, args_text) && name == "lsystem") {
+        compile_lsystem(args_text, statement);
+        return statement;
+    }
+    if (!split_call(text, name, args_text) || !compile_arguments(args_text, statement.args_)) {
+        statement.args_.clear();
+        return statement;
+    }
+
+    for (const auto &command : command_names()) {
+        if (command.first == name) {
+            if (static_cast<int>(statement.args_.size()) != script::opcode_arity(command.second)) {
+                statement.args_.clear();
+                return statement; // wrong number of arguments
+            }
+            statement.kind_ = Statement::kCommand;
+            statement.opcode_ = command.second;
+            return statement;
+        }
+    }
+
+    statement.kind_ = Statement::kCall;
+    statement.name_ = name;
+    return statement;
+}
+
+Statement ScriptCompiler::compile_header(const std::string &header)
+{
+    static const std::regex define_regex(
+        R"(^DEF([a-zA-Z_]\w*)\(([a-zA-Z_]\w*(?:,[a-zA-Z_]\w*)*)?\)$)");
+
+    Statement block;
+    block.kind_ = Statement::kInvalidBlock;
+    block.name_ = header;
+    std::smatch match;
+
+    // LOOP followed by the iteration count expression, e.g. LOOP 3 or LOOP n*2
+    if (header.compare(0, 4, "LOOP") == 0) {
+        Expr count;
+        if (compile_expression(header.substr(4), count)) {
+            block.kind_ = Statement::kLoop;
+            block.args_.push_back(std::move(count));
+        }
+    } else if (header.compare(0, 2, "IF") == 0) {
+        // IF followed by the condition, e.g. IF depth > 0
+        Expr condition;
+        if (compile_expression(header.substr(2), condition)) {
+            block.kind_ = Statement::kIf;
+            block.args_.push_back(std::move(condition));
+        }
+    } else if (std::regex_match(header, match, define_regex)) {
+        // Comma-separated parameter names, each may only appear once
+        std::vector<std::string> parameters;
+        std::istringstream parameter_stream(match[2]);
+        std::string parameter;
+        while (std::getline(parameter_stream, parameter, ',')) {
+            if (std::find(parameters.begin(), parameters.end(), parameter) != parameters.end()) {
+                return block;
+            }
+            parameters.push_back(parameter);
+        }
+
+        block.kind_ = Statement::kDefine;
+        block.name_ = match[1];
+        block.parameters_ = std::move(parameters);
+    }
+    return block;
+}
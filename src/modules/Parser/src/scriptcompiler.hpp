@@ -0,0 +1,152 @@
+#ifndef SCRIPTCOMPILER_H
+#define SCRIPTCOMPILER_H
+
+#include <string>
+#include <vector>
+
+#include "script.hpp"
+
+/**
+ * @class ScriptCompiler
+ * @brief Compiles script source text into statements, one line at a time.
+ *
+ * Statements are separated by newlines or ';'. Blocks are opened by a header followed by
+ * '{' (e.g. "LOOP 3 {", "IF n > 0 {" or "DEF square(size) {") and closed by the matching
+ * '}', so blocks can be nested and may span any number of lines, or share a single line
+ * with their body.
+ * Everything after '#' on a line is a comment. Quoted strings, used by the lsystem statement,
+ * may contain any of these characters and keep their whitespace.
+ *
+ * Arguments are compiled into expression trees supporting arithmetic, comparison and
+ * logical operators as well as built-in functions (sin, cos, sqrt, min, ...). Constant
+ * subexpressions are folded during compilation and variables are resolved to slots
+ * of the symbol table given to the compiler. Parameters of a function and variables
+ * assigned in its body are allocated in a separate local scope of the function.
+ *
+ * Top-level statements are handed out as soon as they are complete, which allows
+ * executing a script while it is still being read.
+ */
+class ScriptCompiler
+{
+public:
+    /**
+     * @brief Constructs a compiler.
+     *
+     * @param symbols The table used to allocate slots for the variables of the script.
+     */
+    explicit ScriptCompiler(script::SymbolTable &symbols) : symbols_(symbols) {}
+
+    /**
+     * @brief Compiles one line of source text.
+     *
+     * @param line The source line, without the line terminator.
+     * @param completed Top-level statements completed by this line are appended here.
+     */
+    void feed_line(const std::string &line, script::Block &completed);
+
+    /**
+     * @brief Closes all blocks left open at the end of the input.
+     *
+     * @param completed The statements completed by closing the blocks are appended here.
+     */
+    void finish(script::Block &completed);
+
+    /**
+     * @brief Indicates if a block is currently open.
+     * @return True if more input is needed to complete the current top-level statement.
+     */
+    bool in_block() const { return !open_blocks_.empty(); }
+
+    /**
+     * @brief Compiles a whole source text.
+     *
+     * @param source The source text, lines separated by '\n'.
+     * @param symbols The table used to allocate slots for the variables of the script.
+     * @return The compiled top-level statements.
+     */
+    static script::Block compile(const std::string &source, script::SymbolTable &symbols);
+
+    /**
+     * @brief Compiles an expression.
+     *
+     * @param text The expression text with all whitespace removed.
+     * @param expr Receives the compiled expression.
+     * @return False if the text is not a valid expression.
+     */
+    bool compile_expression(const std::string &text, script::Expr &expr);
+
+private:
+    /// @brief The table of variable slots.
+    script::SymbolTable &symbols_;
+
+    /// @brief Blocks that have been opened but not yet closed, innermost last.
+    std::vector<script::Statement> open_blocks_;
+
+    /// @brief Local scopes of the function definitions being compiled, innermost last.
+    std::vector<script::SymbolTable> local_scopes_;
+
+    /**
+     * @brief Compiles a simple (non-block) statement and adds it to the current block.
+     *
+     * @param text The statement text.
+     * @param completed Receives the statement if no block is open.
+     */
+    void add_statement(const std::string &text, script::Block &completed);
+
+    /**
+     * @brief Opens a new block.
+     * @param header The text preceding the '{'.
+     */
+    void open_block(const std::string &header);
+
+    /**
+     * @brief Closes the innermost open block and adds it to its parent.
+     *
+     * @param completed Receives the block if it was a top-level block.
+     */
+    void close_block(script::Block &completed);
+
+    /**
+     * @brief Adds a compiled statement to the innermost open block, or to completed.
+     *
+     * @param statement The statement to add.
+     * @param completed Receives the statement if no block is open.
+     */
+    void emit_statement(script::Statement &&statement, script::Block &completed);
+
+    /**
+     * @brief Compiles the text of a simple statement.
+     *
+     * @param text The statement text with all whitespace removed.
+     * @return The compiled statement, of kind kInvalid if nothing matched.
+     */
+    script::Statement compile_statement(const std::string &text);
+
+    /**
+     * @brief Compiles the header of a block.
+     *
+     * @param header The header text with all whitespace removed.
+     * @return The (still empty) block statement, of kind kInvalidBlock if nothing matched.
+     */
+    script::Statement compile_header(const std::string &header);
+
+    /**
+     * @brief Compiles comma-separated arguments.
+     *
+     * @param text The text between the parentheses of a call.
+     * @param args Receives the compiled arguments.
+     * @return False if an argument is not a valid expression.
+     */
+    bool compile_arguments(const std::string &text, std::vector<script::Expr> &args);
+
+    /**
+     * @brief Compiles the arguments of an lsystem statement.
+     *
+     * @param text The text between the parentheses, e.g. "F", "F=F+F-F", 4, 60, 5.
+     * @param statement Receives the strings and arguments, and becomes a kLSystem statement.
+     * @return False if the arguments or the rules are not valid, the statement is unchanged then.
+     */
+    bool compile_lsystem(const std::string &text, script::Statement &statement);
+};
+
+#endif // SCRIPTCOMPILER_H
@@ -0,0 +1,157 @@
+#include "perf.hpp"
+
+#include <QStringList>
+#include <algorithm>
+#include <chrono>
+
+namespace perf {
+
+namespace {
+
+constexpr int COUNTER_COUNT = static_cast<int>(Counter::kCount);
+constexpr int GAUGE_COUNT = static_cast<int>(Gauge::kCount);
+constexpr int HISTOGRAM_COUNT = static_cast<int>(Histogram::kCount);
+constexpr int BUCKET_COUNT = 65;
+
+struct AtomicHistogram
+{
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> max{0};
+    std::atomic<std::uint64_t> buckets[BUCKET_COUNT] = {};
+};
+
+std::atomic<std::uint64_t> g_counters[COUNTER_COUNT] = {};
+std::atomic<std::int64_t> g_gauges[GAUGE_COUNT] = {};
+AtomicHistogram g_histograms[HISTOGRAM_COUNT];
+
+// Start of the period the counters cover, in steady clock nanoseconds
+std::atomic<std::int64_t> g_reset_time{std::chrono::steady_clock::now().time_since_epoch().count()};
+
+double seconds_since_reset()
+{
+    const std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    return std::chrono::duration<double>(std::chrono::steady_clock::duration(now - g_reset_time.load())).count();
+}
+
+// Number of significant bits, 0 for 0
+int bit_width(std::uint64_t value)
+{
+    int width = 0;
+    for (; value; value >>= 1) {
+        ++width;
+    }
+    return width;
+}
+
+} // namespace
+
+std::uint64_t HistogramSnapshot::percentile(double fraction) const
+{
+    const double rank = fraction * count;
+    std::uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= rank && seen > 0) {
+            // The largest value of bit width i
+            return i == 0 ? 0 : std::min(max, (i == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << i) - 1));
+        }
+    }
+    return max;
+}
+
+void add(Counter counter, std::uint64_t amount)
+{
+    g_counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void set(Gauge gauge, std::int64_t value)
+{
+    g_gauges[static_cast<int>(gauge)].store(value, std::memory_order_relaxed);
+}
+
+void record(Histogram histogram, std::uint64_t value)
+{
+    AtomicHistogram &target = g_histograms[static_cast<int>(histogram)];
+    target.count.fetch_add(1, std::memory_order_relaxed);
+    target.sum.fetch_add(value, std::memory_order_relaxed);
+    target.buckets[bit_width(value)].fetch_add(1, std::memory_order_relaxed);
+
+    std::uint64_t max = target.max.load(std::memory_order_relaxed);
+    while (value > max && !target.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+std::uint64_t value(Counter counter)
+{
+    return g_counters[static_cast<int>(counter)].load(std::memory_order_relaxed);
+}
+
+std::int64_t value(Gauge gauge)
+{
+    return g_gauges[static_cast<int>(gauge)].load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot snapshot(Histogram histogram)
+{
+    const AtomicHistogram &source = g_histograms[static_cast<int>(histogram)];
+    HistogramSnapshot result;
+    result.count = source.count.load(std::memory_order_relaxed);
+    result.sum = source.sum.load(std::memory_order_relaxed);
+    result.max = source.max.load(std::memory_order_relaxed);
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        result.buckets[i] = source.buckets[i].load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void reset()
+{
+    g_reset_time.store(std::chrono::steady_clock::now().time_since_epoch().count());
+    for (auto &counter : g_counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    for (AtomicHistogram &histogram : g_histograms) {
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.sum.store(0, std::memory_order_relaxed);
+        histogram.max.store(0, std::memory_order_relaxed);
+        for (auto &bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+QString report()
+{
+    QStringList lines;
+    const double seconds = std::max(seconds_since_reset(), 1e-3);
+    lines << QString("Commands parsed: %1 (%2 per second)")
+                 .arg(value(Counter::kCommandsParsed)).arg(value(Counter::kCommandsParsed) / seconds, 0, 'f', 1)
+          << QString("Moves executed: %1").arg(value(Counter::kMovesExecuted))
+          << QString("Lines stored: %1 (%2 KiB)")
+                 .arg(value(Gauge::kLinesStored)).arg(value(Gauge::kLineStorageBytes) / 1024)
+          << QString("Collision tests: %1").arg(value(Counter::kCollisionTests))
+          << QString("Obstacles tested: %1, culled: %2")
+                 .arg(value(Counter::kObstaclesTested)).arg(value(Counter::kObstaclesCulled));
+
+    const HistogramSnapshot tests = snapshot(Histogram::kCollisionTestsPerFrame);
+    lines << QString("Collision tests per frame: mean %1, p99 %2, max %3")
+                 .arg(tests.mean(), 0, 'f', 1).arg(tests.percentile(0.99)).arg(tests.max);
+
+    const HistogramSnapshot paint = snapshot(Histogram::kPaintTime);
+    lines << QString("Paint time per frame: mean %1 ms, p99 %2 ms, max %3 ms (%4 frames)")
+                 .arg(paint.mean() / 1000.0, 0, 'f', 2).arg(paint.percentile(0.99) / 1000.0, 0, 'f', 2)
+                 .arg(paint.max / 1000.0, 0, 'f', 2).arg(paint.count);
+
+    // Bytes per microsecond are megabytes per second
+    const HistogramSnapshot save = snapshot(Histogram::kSaveTime);
+    const HistogramSnapshot load = snapshot(Histogram::kLoadTime);
+    lines << QString("Saved: %1 states, %2 KiB, %3 MB/s")
+                 .arg(save.count).arg(value(Counter::kBytesSaved) / 1024)
+                 .arg(save.sum ? double(value(Counter::kBytesSaved)) / save.sum : 0.0, 0, 'f', 1)
+          << QString("Loaded: %1 states, %2 KiB, %3 MB/s")
+                 .arg(load.count).arg(value(Counter::kBytesLoaded) / 1024)
+                 .arg(load.sum ? double(value(Counter::kBytesLoaded)) / load.sum : 0.0, 0, 'f', 1);
+    return lines.join('\n');
+}
+
+} // namespace perf
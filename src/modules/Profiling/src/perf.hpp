@@ -0,0 +1,109 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Process-wide performance counters, gauges and histograms.
+ *
+ * All values are relaxed atomics, so they can be updated from any thread for the cost
+ * of one atomic addition. Hot loops should count locally and add the total once.
+ */
+namespace perf {
+
+/// @brief Monotonic counters.
+enum class Counter {
+    kCommandsParsed = 0, ///< Turtle commands executed by parsers.
+    kMovesExecuted,      ///< Movements (forward and arc) started by turtles.
+    kCollisionTests,     ///< Collision tests of turtle positions.
+    kObstaclesTested,    ///< Obstacles tested for an intersection with the turtle shape.
+    kObstaclesCulled,    ///< Obstacles skipped because their bounding circle is out of reach.
+    kBytesSaved,         ///< Bytes of state files written.
+    kBytesLoaded,        ///< Bytes of state files read.
+    kCount
+};
+
+/// @brief Values describing the current state, set by the last update.
+enum class Gauge {
+    kLinesStored = 0,    ///< Lines stored by the last updated turtle.
+    kLineStorageBytes,   ///< Bytes allocated for those lines.
+    kCount
+};
+
+/// @brief Distributions of values.
+enum class Histogram {
+    kCollisionTestsPerFrame = 0, ///< Collision tests per simulation clock step.
+    kPaintTime,                  ///< Time to paint one frame of lines, in microseconds.
+    kSaveTime,                   ///< Time to save a state, in microseconds.
+    kLoadTime,                   ///< Time to load a state, in microseconds.
+    kCount
+};
+
+/**
+ * @brief A snapshot of a histogram.
+ *
+ * Values are counted in power of two buckets, so percentiles are upper bounds
+ * within a factor of two.
+ */
+struct HistogramSnapshot
+{
+    std::uint64_t count = 0; ///< Number of recorded values.
+    std::uint64_t sum = 0;   ///< Sum of the recorded values.
+    std::uint64_t max = 0;   ///< Largest recorded value.
+    std::uint64_t buckets[65] = {}; ///< Bucket i counts the values of bit width i.
+
+    /// @brief Returns the mean of the recorded values, 0 if there are none.
+    double mean() const { return count ? double(sum) / count : 0.0; }
+
+    /**
+     * @brief Returns an upper bound of a percentile.
+     * @param fraction The percentile between 0 and 1, e.g. 0.99.
+     */
+    std::uint64_t percentile(double fraction) const;
+};
+
+/**
+ * @brief Adds to a counter.
+ * @param counter The counter.
+ * @param amount The amount to add.
+ */
+void add(Counter counter, std::uint64_t amount = 1);
+
+/**
+ * @brief Sets a gauge.
+ * @param gauge The gauge.
+ * @param value The new value.
+ */
+void set(Gauge gauge, std::int64_t value);
+
+/**
+ * @brief Records a value in a histogram.
+ * @param histogram The histogram.
+ * @param value The value.
+ */
+void record(Histogram histogram, std::uint64_t value);
+
+/// @brief Returns the value of a counter.
+std::uint64_t value(Counter counter);
+
+/// @brief Returns the value of a gauge.
+std::int64_t value(Gauge gauge);
+
+/// @brief Returns a snapshot of a histogram.
+HistogramSnapshot snapshot(Histogram histogram);
+
+/// @brief Resets all counters and histograms, gauges keep their values.
+/// Rates in the report are averaged since the last reset or the start of the process.
+void reset();
+
+/**
+ * @brief Formats all values as text, one value per line.
+ * @return The report, as printed by the "stats" command of the CLI.
+ */
+QString report();
+
+} // namespace perf
+
+#endif // PERF_H
@@ -0,0 +1,100 @@
+#include "perfstats.hpp"
+#include <QTimer>
+#include "perf.hpp"
+
+// Interval between two samples of the counters
+constexpr int SAMPLE_INTERVAL_MS = 1000;
+
+PerfStats::PerfStats(QObject *parent)
+    : QObject(parent)
+    , timer_(new QTimer(this))
+    , last_commands_(perf::value(perf::Counter::kCommandsParsed))
+    , last_frames_(0)
+    , last_frame_tests_(0)
+    , last_tested_(perf::value(perf::Counter::kObstaclesTested))
+    , last_culled_(perf::value(perf::Counter::kObstaclesCulled))
+    , last_paints_(0)
+    , last_paint_time_(0)
+    , commands_per_second_(0.0)
+    , collision_tests_per_frame_(0.0)
+    , obstacle_cull_ratio_(0.0)
+    , paint_time_ms_(0.0)
+{
+    const perf::HistogramSnapshot frames = perf::snapshot(perf::Histogram::kCollisionTestsPerFrame);
+    last_frames_ = frames.count;
+    last_frame_tests_ = frames.sum;
+    const perf::HistogramSnapshot paints = perf::snapshot(perf::Histogram::kPaintTime);
+    last_paints_ = paints.count;
+    last_paint_time_ = paints.sum;
+
+    connect(timer_, &QTimer::timeout, this, &PerfStats::sample);
+    timer_->start(SAMPLE_INTERVAL_MS);
+}
+
+qint64 PerfStats::moves_executed() const
+{
+    return static_cast<qint64>(perf::value(perf::Counter::kMovesExecuted));
+}
+
+qint64 PerfStats::lines_stored() const
+{
+    return perf::value(perf::Gauge::kLinesStored);
+}
+
+qint64 PerfStats::line_storage_bytes() const
+{
+    return perf::value(perf::Gauge::kLineStorageBytes);
+}
+
+QString PerfStats::summary() const
+{
+    return QString("Commands/s: %1\nLines: %2 (%3 KiB)\nCollision tests/frame: %4\nObstacles culled: %5%\nPaint: %6 ms")
+        .arg(commands_per_second_, 0, 'f', 0)
+        .arg(lines_stored())
+        .arg(line_storage_bytes() / 1024)
+        .arg(collision_tests_per_frame_, 0, 'f', 1)
+        .arg(obstacle_cull_ratio_ * 100.0, 0, 'f', 0)
+        .arg(paint_time_ms_, 0, 'f', 2);
+}
+
+void PerfStats::record_paint_time(double milliseconds)
+{
+    perf::record(perf::Histogram::kPaintTime, static_cast<std::uint64_t>(milliseconds * 1000.0));
+}
+
+void PerfStats::reset()
+{
+    perf::reset();
+    last_commands_ = last_frames_ = last_frame_tests_ = 0;
+    last_tested_ = last_culled_ = last_paints_ = last_paint_time_ = 0;
+    sample();
+}
+
+void PerfStats::sample()
+{
+    // Counters only decrease when reset from elsewhere, e.g. by the CLI
+    const auto delta = [](std::uint64_t current, std::uint64_t &last) {
+        const std::uint64_t difference = current >= last ? current - last : current;
+        last = current;
+        return difference;
+    };
+
+    const double seconds = SAMPLE_INTERVAL_MS / 1000.0;
+    commands_per_second_ = delta(perf::value(perf::Counter::kCommandsParsed), last_commands_) / seconds;
+
+    const perf::HistogramSnapshot frames = perf::snapshot(perf::Histogram::kCollisionTestsPerFrame);
+    const std::uint64_t frame_count = delta(frames.count, last_frames_);
+    const std::uint64_t frame_tests = delta(frames.sum, last_frame_tests_);
+    collision_tests_per_frame_ = frame_count ? double(frame_tests) / frame_count : 0.0;
+
+    const std::uint64_t tested = delta(perf::value(perf::Counter::kObstaclesTested), last_tested_);
+    const std::uint64_t culled = delta(perf::value(perf::Counter::kObstaclesCulled), last_culled_);
+    obstacle_cull_ratio_ = tested + culled ? double(culled) / (tested + culled) : 0.0;
+
+    const perf::HistogramSnapshot paints = perf::snapshot(perf::Histogram::kPaintTime);
+    const std::uint64_t paint_count = delta(paints.count, last_paints_);
+    const std::uint64_t paint_time = delta(paints.sum, last_paint_time_);
+    paint_time_ms_ = paint_count ? paint_time / 1000.0 / paint_count : 0.0;
+
+    emit updated();
+}
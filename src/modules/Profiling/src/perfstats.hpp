@@ -0,0 +1,94 @@
+#ifndef PERFSTATS_H
+#define PERFSTATS_H
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QString>
+#include <cstdint>
+
+class QTimer;
+
+/**
+ * @brief QML view of the performance counters of the perf namespace.
+ *
+ * The counters are sampled once per second. Rates and per-frame values refer to the
+ * last sampling interval, totals to the time since the last reset.
+ */
+class PerfStats : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_SINGLETON
+
+    /// @brief Turtle commands executed per second.
+    Q_PROPERTY(double commands_per_second READ commands_per_second NOTIFY updated FINAL)
+
+    /// @brief Total number of movements executed.
+    Q_PROPERTY(qint64 moves_executed READ moves_executed NOTIFY updated FINAL)
+
+    /// @brief Number of lines stored by the turtle.
+    Q_PROPERTY(qint64 lines_stored READ lines_stored NOTIFY updated FINAL)
+
+    /// @brief Bytes allocated for the stored lines.
+    Q_PROPERTY(qint64 line_storage_bytes READ line_storage_bytes NOTIFY updated FINAL)
+
+    /// @brief Mean number of collision tests per simulation clock step.
+    Q_PROPERTY(double collision_tests_per_frame READ collision_tests_per_frame NOTIFY updated FINAL)
+
+    /// @brief Share of the obstacles skipped by the bounding circle test, between 0 and 1.
+    Q_PROPERTY(double obstacle_cull_ratio READ obstacle_cull_ratio NOTIFY updated FINAL)
+
+    /// @brief Mean time to paint a frame of lines in milliseconds.
+    Q_PROPERTY(double paint_time_ms READ paint_time_ms NOTIFY updated FINAL)
+
+    /// @brief All values formatted for display, one per line.
+    Q_PROPERTY(QString summary READ summary NOTIFY updated FINAL)
+
+public:
+    /**
+     * @brief Constructs the sampler and starts sampling.
+     * @param parent Pointer to the parent QObject.
+     */
+    explicit PerfStats(QObject *parent = nullptr);
+
+    double commands_per_second() const { return commands_per_second_; }
+    qint64 moves_executed() const;
+    qint64 lines_stored() const;
+    qint64 line_storage_bytes() const;
+    double collision_tests_per_frame() const { return collision_tests_per_frame_; }
+    double obstacle_cull_ratio() const { return obstacle_cull_ratio_; }
+    double paint_time_ms() const { return paint_time_ms_; }
+    QString summary() const;
+
+    /**
+     * @brief Records the time a QML canvas took to paint a frame.
+     * @param milliseconds The paint time.
+     */
+    Q_INVOKABLE void record_paint_time(double milliseconds);
+
+    /// @brief Resets the counters and histograms.
+    Q_INVOKABLE void reset();
+
+signals:
+    /// @brief Emitted after every sample.
+    void updated();
+
+private:
+    /// @brief Samples the counters and updates the values of the last interval.
+    void sample();
+
+    QTimer *timer_;                      ///< Timer triggering the samples.
+    std::uint64_t last_commands_;        ///< Commands parsed at the last sample.
+    std::uint64_t last_frames_;          ///< Clock steps at the last sample.
+    std::uint64_t last_frame_tests_;     ///< Collision tests of the clock steps at the last sample.
+    std::uint64_t last_tested_;          ///< Obstacles tested at the last sample.
+    std::uint64_t last_culled_;          ///< Obstacles culled at the last sample.
+    std::uint64_t last_paints_;          ///< Painted frames at the last sample.
+    std::uint64_t last_paint_time_;      ///< Total paint time in microseconds at the last sample.
+    double commands_per_second_;         ///< Commands per second in the last interval.
+    double collision_tests_per_frame_;   ///< Collision tests per clock step in the last interval.
+    double obstacle_cull_ratio_;         ///< Share of culled obstacles in the last interval.
+    double paint_time_ms_;               ///< Mean paint time in the last interval.
+};
+
+#endif // PERFSTATS_H
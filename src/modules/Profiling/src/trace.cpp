@@ -0,0 +1,271 @@
+#include "trace.hpp"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QThread>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace trace {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+// Number of spans per chunk of a thread buffer
+constexpr std::size_t CHUNK_SIZE = 4096;
+
+// Chunks a thread may allocate, further spans are dropped (1M spans, 24 MB per thread)
+constexpr std::size_t MAX_CHUNKS = 256;
+
+// A recorded span
+struct Event
+{
+    const char *name_;
+    std::int64_t start_;
+    std::int64_t end_;
+};
+
+// A span stored in a thread buffer. Exporters may read it while a reset lets the owner
+// overwrite it, so the fields are atomics, accessed relaxed (plain moves on common CPUs).
+struct StoredEvent
+{
+    std::atomic<const char *> name_;
+    std::atomic<std::int64_t> start_;
+    std::atomic<std::int64_t> end_;
+
+    void store(const Event &event)
+    {
+        name_.store(event.name_, std::memory_order_relaxed);
+        start_.store(event.start_, std::memory_order_relaxed);
+        end_.store(event.end_, std::memory_order_relaxed);
+    }
+
+    Event load() const
+    {
+        return {name_.load(std::memory_order_relaxed), start_.load(std::memory_order_relaxed),
+                end_.load(std::memory_order_relaxed)};
+    }
+};
+
+// A fixed-size block of spans, chunks are never moved once allocated
+struct Chunk
+{
+    StoredEvent events_[CHUNK_SIZE];
+};
+
+// Time origin of the trace
+const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+// Incremented by clear(), buffers of an older generation are considered empty
+std::atomic<unsigned> g_generation{0};
+
+std::atomic<std::size_t> g_dropped{0};
+
+/*
+ * Spans recorded by one thread. Only the owning thread writes, exporters read concurrently:
+ * - Spans are appended behind size_, which is published with release semantics, so
+ *   the spans below the size read by an exporter are complete.
+ * - The owner resets the buffer when it notices a clear(). The sequence is odd during
+ *   the reset and is changed by it, so an exporter that read while the reset
+ *   overwrote spans discards what it read. The spans are read through relaxed atomics
+ *   followed by an acquire fence before the sequence is checked again, as in a seqlock,
+ *   so such reads are stale rather than racy.
+ */
+class ThreadBuffer
+{
+public:
+    ThreadBuffer(int thread_id, const QString &thread_name)
+        : thread_id_(thread_id), thread_name_(thread_name), generation_(g_generation.load()) {}
+
+    ~ThreadBuffer()
+    {
+        for (auto &chunk : chunks_) {
+            delete chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    ThreadBuffer(const ThreadBuffer &) = delete;
+    ThreadBuffer &operator=(const ThreadBuffer &) = delete;
+
+    void append(const Event &event)
+    {
+        const unsigned generation = g_generation.load(std::memory_order_acquire);
+        if (generation != generation_.load(std::memory_order_relaxed)) {
+            reset(generation);
+        }
+
+        const std::size_t size = size_.load(std::memory_order_relaxed);
+        const std::size_t chunk = size / CHUNK_SIZE;
+        if (chunk == MAX_CHUNKS) {
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Chunk *events = chunks_[chunk].load(std::memory_order_relaxed);
+        if (!events) {
+            // Published together with the size below
+            events = new Chunk;
+            chunks_[chunk].store(events, std::memory_order_relaxed);
+        }
+        events->events_[size % CHUNK_SIZE].store(event);
+        size_.store(size + 1, std::memory_order_release);
+    }
+
+    // Appends the spans of the current generation to events
+    void collect(std::vector<Event> &events) const
+    {
+        const unsigned sequence = sequence_.load(std::memory_order_acquire);
+        if ((sequence & 1) || generation_.load(std::memory_order_acquire) != g_generation.load()) {
+            return; // being reset, or cleared but not reset yet
+        }
+
+        const std::size_t size = size_.load(std::memory_order_acquire);
+        const std::size_t first = events.size();
+        for (std::size_t i = 0; i < size; ++i) {
+            const Chunk *chunk = chunks_[i / CHUNK_SIZE].load(std::memory_order_relaxed);
+            events.push_back(chunk->events_[i % CHUNK_SIZE].load());
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) != sequence) {
+            events.resize(first); // reset while reading
+        }
+    }
+
+    std::size_t size() const
+    {
+        return generation_.load(std::memory_order_acquire) == g_generation.load()
+                   ? size_.load(std::memory_order_acquire) : 0;
+    }
+
+    int thread_id() const { return thread_id_; }
+    const QString &thread_name() const { return thread_name_; }
+
+private:
+    void reset(unsigned generation)
+    {
+        sequence_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        size_.store(0, std::memory_order_relaxed);
+        generation_.store(generation, std::memory_order_relaxed);
+        sequence_.fetch_add(1, std::memory_order_release);
+    }
+
+    const int thread_id_;
+    const QString thread_name_;
+    std::atomic<Chunk *> chunks_[MAX_CHUNKS] = {}; // allocated on demand, kept for reuse after a reset
+    std::atomic<std::size_t> size_{0};
+    std::atomic<unsigned> generation_;
+    std::atomic<unsigned> sequence_{0};
+};
+
+// Buffers of all threads that recorded spans, kept after their threads finished
+std::mutex g_registry_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_registry;
+
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+ThreadBuffer &thread_buffer()
+{
+    if (!t_buffer) {
+        const bool b_main_thread = QCoreApplication::instance()
+                                   && QThread::currentThread() == QCoreApplication::instance()->thread();
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        const int thread_id = static_cast<int>(g_registry.size()) + 1;
+        t_buffer = std::make_shared<ThreadBuffer>(
+            thread_id, b_main_thread ? QString("Main thread") : QString("Thread %1").arg(thread_id));
+        g_registry.push_back(t_buffer);
+    }
+    return *t_buffer;
+}
+
+// Converts nanoseconds to the microseconds of trace events
+QByteArray microseconds(std::int64_t nanoseconds)
+{
+    return QByteArray::number(nanoseconds / 1000.0, 'f', 3);
+}
+
+} // namespace
+
+void set_enabled(bool b_enabled)
+{
+    g_enabled.store(b_enabled, std::memory_order_relaxed);
+}
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void record(const char *name, std::int64_t start, std::int64_t end)
+{
+    thread_buffer().append({name, start, end});
+}
+
+void clear()
+{
+    g_generation.fetch_add(1, std::memory_order_release);
+    g_dropped.store(0, std::memory_order_relaxed);
+}
+
+std::size_t event_count()
+{
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    std::size_t count = 0;
+    for (const auto &buffer : g_registry) {
+        count += buffer->size();
+    }
+    return count;
+}
+
+std::size_t dropped_count()
+{
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+QByteArray to_chrome_json()
+{
+    const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":"
+                      + QByteArray::number(qulonglong(dropped_count())) + "},\"traceEvents\":[";
+    bool b_first = true;
+    std::vector<Event> events;
+
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for (const auto &buffer : g_registry) {
+        events.clear();
+        buffer->collect(events);
+        if (events.empty()) {
+            continue;
+        }
+
+        const QByteArray tid = QByteArray::number(buffer->thread_id());
+        json += b_first ? "" : ",";
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                + ",\"args\":{\"name\":\"" + buffer->thread_name().toUtf8() + "\"}}";
+        b_first = false;
+
+        // Complete events, span names are string literals without characters to escape
+        json.reserve(json.size() + static_cast<qsizetype>(events.size()) * 96);
+        for (const Event &event : events) {
+            json += ",{\"name\":\"";
+            json += event.name_;
+            json += "\",\"cat\":\"turtle\",\"ph\":\"X\",\"ts\":" + microseconds(event.start_)
+                    + ",\"dur\":" + microseconds(event.end_ - event.start_)
+                    + ",\"pid\":" + pid + ",\"tid\":" + tid + "}";
+        }
+    }
+    json += "]}\n";
+    return json;
+}
+
+bool save_chrome_json(const QString &file_path)
+{
+    QFile file(file_path);
+    return file.open(QIODevice::WriteOnly) && file.write(to_chrome_json()) >= 0;
+}
+
+} // namespace trace
@@ -0,0 +1,104 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lightweight tracing of scoped spans, exported as Chrome trace events.
+ *
+ * A span is recorded by placing TRACE_SCOPE("name") at the start of a block: it measures
+ * the time until the end of the block. Every thread records into its own buffer without
+ * locking or waiting for exporters, so spans can be exported while threads keep recording.
+ *
+ * Tracing is disabled by default. A disabled span costs one relaxed atomic load and a
+ * branch, so spans can stay in hot paths.
+ *
+ * The exported JSON can be opened in chrome://tracing or https://ui.perfetto.dev.
+ */
+namespace trace {
+
+/// @brief Indicates if spans are recorded, use enabled() to read it.
+extern std::atomic<bool> g_enabled;
+
+/// @brief Indicates if spans are recorded.
+inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Starts or stops recording spans.
+ * @param b_enabled True to record spans.
+ */
+void set_enabled(bool b_enabled);
+
+/// @brief Returns the time elapsed since the start of the process in nanoseconds.
+std::int64_t now();
+
+/**
+ * @brief Records a completed span in the buffer of the calling thread.
+ *
+ * @param name The name of the span, a string literal which must outlive the trace.
+ * @param start The start time returned by now().
+ * @param end The end time returned by now().
+ */
+void record(const char *name, std::int64_t start, std::int64_t end);
+
+/// @brief Discards the spans recorded so far by all threads.
+void clear();
+
+/// @brief Returns the number of recorded spans.
+std::size_t event_count();
+
+/// @brief Returns the number of spans dropped because a thread's buffer was full.
+std::size_t dropped_count();
+
+/**
+ * @brief Exports the recorded spans in the Chrome trace event format.
+ * @return The JSON document.
+ */
+QByteArray to_chrome_json();
+
+/**
+ * @brief Writes the recorded spans to a file in the Chrome trace event format.
+ * @param file_path The path of the file.
+ * @return False if the file could not be written.
+ */
+bool save_chrome_json(const QString &file_path);
+
+/**
+ * @brief Records the time from its construction to its destruction as a span.
+ *
+ * Whether the span is recorded is decided when it starts, so a span never ends
+ * without having started.
+ */
+class Scope
+{
+public:
+    /// @param name The name of the span, a string literal.
+    explicit Scope(const char *name) : name_(enabled() ? name : nullptr), start_(name_ ? now() : 0) {}
+
+    ~Scope()
+    {
+        if (name_) {
+            record(name_, start_, now());
+        }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name_;   ///< The name of the span, nullptr if tracing was disabled at the start.
+    std::int64_t start_; ///< The start time of the span.
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+/// @brief Records the rest of the enclosing block as a span called name.
+#define TRACE_SCOPE(name) const trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif // TRACE_H
@@ -0,0 +1,37 @@
+#include "tracer.hpp"
+#include <QUrl>
+#include "trace.hpp"
+
+Tracer::Tracer(QObject *parent)
+    : QObject(parent)
+{}
+
+bool Tracer::enabled() const
+{
+    return trace::enabled();
+}
+
+void Tracer::set_enabled(bool b_enabled)
+{
+    if (trace::enabled() != b_enabled) {
+        trace::set_enabled(b_enabled);
+        emit enabled_changed();
+    }
+}
+
+void Tracer::clear()
+{
+    trace::clear();
+}
+
+int Tracer::event_count() const
+{
+    return static_cast<int>(trace::event_count());
+}
+
+bool Tracer::save(const QString &file_path)
+{
+    // File dialogs return URLs
+    const QString local_path = file_path.startsWith("file:") ? QUrl(file_path).toLocalFile() : file_path;
+    return trace::save_chrome_json(local_path);
+}
@@ -0,0 +1,55 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QObject>
+#include <QQmlEngine>
+#include <QString>
+
+/**
+ * @brief QML access to the trace spans recorded by TRACE_SCOPE.
+ *
+ * The trace is global: all Tracer instances control and export the same spans.
+ */
+class Tracer : public QObject
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    /// @brief Indicates if spans are recorded.
+    Q_PROPERTY(bool enabled READ enabled WRITE set_enabled NOTIFY enabled_changed FINAL)
+
+public:
+    /**
+     * @brief Constructs a Tracer.
+     * @param parent Pointer to the parent QObject.
+     */
+    explicit Tracer(QObject *parent = nullptr);
+
+    /// @brief Indicates if spans are recorded.
+    bool enabled() const;
+
+    /**
+     * @brief Starts or stops recording spans.
+     * @param b_enabled True to record spans.
+     */
+    void set_enabled(bool b_enabled);
+
+    /// @brief Discards the recorded spans.
+    Q_INVOKABLE void clear();
+
+    /// @brief Returns the number of recorded spans.
+    Q_INVOKABLE int event_count() const;
+
+    /**
+     * @brief Writes the recorded spans as Chrome trace event JSON.
+     * @param file_path The path or file URL of the file.
+     * @return False if the file could not be written.
+     */
+    Q_INVOKABLE bool save(const QString &file_path);
+
+signals:
+    /// @brief Emitted when recording is started or stopped.
+    void enabled_changed();
+};
+
+#endif // TRACER_H
@@ -0,0 +1,496 @@
+#include "LineCodec.hpp"
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "trace.hpp"
+
+namespace {
+
+// Bits of the run header telling which style fields follow it
+constexpr quint64 COLOR_CHANGED = 1;
+constexpr quint64 WIDTH_CHANGED = 2;
+constexpr int RUN_FLAG_BITS = 2;
+
+// Marks the end of the block index, "TGI" and the format version
+constexpr quint32 INDEX_MAGIC = 0x54474902;
+
+// Bytes of an index entry and of the trailer following the index
+constexpr qint64 INDEX_ENTRY_SIZE = 48;
+constexpr qint64 TRAILER_SIZE = 20;
+
+// An entry of the block index
+struct Block
+{
+    quint64 offset_ = 0;    // Position of the compressed block in the data.
+    quint32 size_ = 0;      // Size of the compressed block.
+    quint32 lineCount_ = 0; // Number of lines of the block.
+    double left_ = 0.0;     // Bounding box of the lines of the block.
+    double top_ = 0.0;
+    double right_ = 0.0;
+    double bottom_ = 0.0;
+};
+
+// Runs body(block) for every block, on as many threads as there are blocks and cores
+template<typename Body>
+void forEachBlock(int blockCount, const Body &body) {
+    const int threadCount = std::min<int>(blockCount, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<int> next(0);
+    const auto work = [&next, blockCount, &body]() {
+        for (int block = next++; block < blockCount; block = next++) {
+            body(block);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(std::max(threadCount - 1, 0));
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
+
+qint64 quantize(qreal coordinate) {
+    return qRound64(coordinate * LineCodec::POSITION_SCALE);
+}
+
+bool blockIntersects(const Block &block, const QRectF &region) {
+    return block.left_ <= region.right() && block.right_ >= region.left()
+        && block.top_ <= region.bottom() && block.bottom_ >= region.top();
+}
+
+// Position of a cell along a Hilbert curve through a grid of size x size cells, size being a
+// power of two. Neighboring cells get close positions.
+quint32 hilbertIndex(quint32 size, quint32 x, quint32 y) {
+    quint32 index = 0;
+    for (quint32 half = size / 2; half > 0; half /= 2) {
+        const quint32 right = (x & half) ? 1 : 0;
+        const quint32 lower = (y & half) ? 1 : 0;
+        index += half * half * ((3 * right) ^ lower);
+        // Turn the quadrant so the curve enters and leaves it where the neighbors continue
+        if (lower == 0) {
+            if (right == 1) {
+                x = size - 1 - x;
+                y = size - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+// Orders the lines along the Hilbert curve by their midpoints, then by their drawing order.
+// Each key holds the position on the curve in its high and the index of the line in its low half.
+std::vector<quint64> spatialOrder(const QVector<Line> &lines) {
+    std::vector<quint64> keys(lines.size());
+    if (lines.size() <= LineCodec::LINES_PER_BLOCK) {
+        // A single block, its order does not matter
+        for (quint32 i = 0; i < keys.size(); ++i) {
+            keys[i] = i;
+        }
+        return keys;
+    }
+
+    // Enough cells for about BLOCKS_PER_CELL blocks each
+    const double cells = double(lines.size()) / (LineCodec::LINES_PER_BLOCK * LineCodec::BLOCKS_PER_CELL);
+    quint32 size = 1;
+    while (size < quint32(LineCodec::MAX_GRID_SIZE) && double(size) * size < cells) {
+        size *= 2;
+    }
+
+    double left = lines[0].start_.x();
+    double top = lines[0].start_.y();
+    double right = left;
+    double bottom = top;
+    for (const Line &line : lines) {
+        const QPointF middle = (line.start_ + line.end_) / 2;
+        left = std::min(left, middle.x());
+        right = std::max(right, middle.x());
+        top = std::min(top, middle.y());
+        bottom = std::max(bottom, middle.y());
+    }
+
+    const double scaleX = right > left ? size / (right - left) : 0.0;
+    const double scaleY = bottom > top ? size / (bottom - top) : 0.0;
+    for (quint32 i = 0; i < keys.size(); ++i) {
+        const QPointF middle = (lines[i].start_ + lines[i].end_) / 2;
+        const quint32 cellX = std::min(quint32((middle.x() - left) * scaleX), size - 1);
+        const quint32 cellY = std::min(quint32((middle.y() - top) * scaleY), size - 1);
+        keys[i] = (quint64(hilbertIndex(size, cellX, cellY)) << 32) | i;
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+quint32 lineIndex(quint64 key) {
+    return quint32(key);
+}
+
+void appendVarint(QByteArray &out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+void appendDelta(QByteArray &out, qint64 delta) {
+    // Zig-zag: small negative deltas become small unsigned values
+    appendVarint(out, (quint64(delta) << 1) ^ quint64(delta >> 63));
+}
+
+template<typename T>
+void appendFixed(QByteArray &out, T value) {
+    const T little = qToLittleEndian(value);
+    out.append(reinterpret_cast<const char *>(&little), sizeof(little));
+}
+
+void appendReal(QByteArray &out, double value) {
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendFixed(out, bits);
+}
+
+// Reads the fields of a block or of the index, remembering if it ran past the end
+class Reader {
+public:
+    Reader(const uchar *data, qint64 size) : next_(data), end_(data + size) {}
+
+    bool atEnd() const { return next_ == end_; }
+    bool failed() const { return b_failed_; }
+
+    quint64 varint() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64 && next_ != end_; shift += 7) {
+            const uchar byte = *next_++;
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        b_failed_ = true;
+        return 0;
+    }
+
+    qint64 delta() {
+        const quint64 value = varint();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+
+    template<typename T>
+    T fixed() {
+        if (size_t(end_ - next_) < sizeof(T)) {
+            b_failed_ = true;
+            return T(0);
+        }
+        const T value = qFromLittleEndian<T>(next_);
+        next_ += sizeof(T);
+        return value;
+    }
+
+    double real() {
+        const quint64 bits = fixed<quint64>();
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+private:
+    const uchar *next_;
+    const uchar *end_;
+    bool b_failed_ = false;
+};
+
+// Encodes the lines of a block given by their keys, and computes its bounding box
+QByteArray encodeBlock(const QVector<Line> &lines, const quint64 *keys, int count, Block &block) {
+    QByteArray out;
+    out.reserve(count * 3);
+
+    // Every block starts from the origin and an unset style, so it decodes on its own
+    qint64 x = 0;
+    qint64 y = 0;
+    quint32 nextIndex = 0;
+    QRgb color = 0;
+    float width = 0.f;
+    bool b_styled = false;
+    block.left_ = block.right_ = lines[lineIndex(keys[0])].start_.x();
+    block.top_ = block.bottom_ = lines[lineIndex(keys[0])].start_.y();
+
+    int first = 0;
+    while (first < count) {
+        // The run goes on while each line was drawn right after the one before, where it ends, in the same style
+        const Line &start = lines[lineIndex(keys[first])];
+        const QRgb runColor = start.color_.rgba();
+        int last = first + 1;
+        while (last < count && lineIndex(keys[last]) == lineIndex(keys[last - 1]) + 1) {
+            const Line &previous = lines[lineIndex(keys[last - 1])];
+            const Line &line = lines[lineIndex(keys[last])];
+            if (line.color_.rgba() != runColor || line.width_ != start.width_
+                || quantize(line.start_.x()) != quantize(previous.end_.x())
+                || quantize(line.start_.y()) != quantize(previous.end_.y())) {
+                break;
+            }
+            ++last;
+        }
+
+        quint64 flags = 0;
+        if (!b_styled || runColor != color) {
+            flags |= COLOR_CHANGED;
+        }
+        if (!b_styled || std::memcmp(&start.width_, &width, sizeof(width)) != 0) {
+            flags |= WIDTH_CHANGED;
+        }
+        appendVarint(out, (quint64(last - first) << RUN_FLAG_BITS) | flags);
+        appendDelta(out, qint64(lineIndex(keys[first])) - qint64(nextIndex));
+        if (flags & COLOR_CHANGED) {
+            appendFixed(out, quint32(runColor));
+        }
+        if (flags & WIDTH_CHANGED) {
+            quint32 bits;
+            std::memcpy(&bits, &start.width_, sizeof(bits));
+            appendFixed(out, bits);
+        }
+        color = runColor;
+        width = start.width_;
+        b_styled = true;
+        nextIndex = lineIndex(keys[last - 1]) + 1;
+
+        // The start of the run, then the end of each of its lines
+        const qint64 startX = quantize(start.start_.x());
+        const qint64 startY = quantize(start.start_.y());
+        appendDelta(out, startX - x);
+        appendDelta(out, startY - y);
+        x = startX;
+        y = startY;
+        for (int i = first; i < last; ++i) {
+            const Line &line = lines[lineIndex(keys[i])];
+            const qint64 endX = quantize(line.end_.x());
+            const qint64 endY = quantize(line.end_.y());
+            appendDelta(out, endX - x);
+            appendDelta(out, endY - y);
+            x = endX;
+            y = endY;
+
+            block.left_ = std::min({block.left_, line.start_.x(), line.end_.x()});
+            block.right_ = std::max({block.right_, line.start_.x(), line.end_.x()});
+            block.top_ = std::min({block.top_, line.start_.y(), line.end_.y()});
+            block.bottom_ = std::max({block.bottom_, line.start_.y(), line.end_.y()});
+        }
+        first = last;
+    }
+    return out;
+}
+
+// Decodes a block, handing out each line with its index in drawing order
+template<typename Sink>
+bool decodeBlock(const QByteArray &data, quint32 count, quint32 lineCount, const Sink &sink) {
+    Reader reader(reinterpret_cast<const uchar *>(data.constData()), data.size());
+    qint64 x = 0;
+    qint64 y = 0;
+    qint64 nextIndex = 0;
+    QColor color;
+    float width = 0.f;
+
+    quint32 decoded = 0;
+    while (!reader.atEnd()) {
+        const quint64 header = reader.varint();
+        const quint64 runLength = header >> RUN_FLAG_BITS;
+        const qint64 index = nextIndex + reader.delta();
+        if (runLength == 0 || runLength > count - decoded || index < 0 || quint64(index) + runLength > lineCount) {
+            return false;
+        }
+        if (header & COLOR_CHANGED) {
+            color = QColor::fromRgba(reader.fixed<quint32>());
+        }
+        if (header & WIDTH_CHANGED) {
+            const quint32 bits = reader.fixed<quint32>();
+            std::memcpy(&width, &bits, sizeof(width));
+        }
+
+        x += reader.delta();
+        y += reader.delta();
+        QPointF previous(qreal(x) / LineCodec::POSITION_SCALE, qreal(y) / LineCodec::POSITION_SCALE);
+        for (quint64 i = 0; i < runLength; ++i) {
+            x += reader.delta();
+            y += reader.delta();
+            const QPointF end(qreal(x) / LineCodec::POSITION_SCALE, qreal(y) / LineCodec::POSITION_SCALE);
+            sink(quint32(index + i), Line(previous, end, color, width));
+            previous = end;
+        }
+        if (reader.failed()) {
+            return false;
+        }
+        decoded += quint32(runLength);
+        nextIndex = index + qint64(runLength);
+    }
+    return decoded == count;
+}
+
+// Reads the trailer and the block index at the end of the data
+bool readIndex(const uchar *data, qint64 size, quint32 &lineCount, std::vector<Block> &blocks) {
+    if (size < TRAILER_SIZE) {
+        return false;
+    }
+    Reader trailer(data + size - TRAILER_SIZE, TRAILER_SIZE);
+    lineCount = trailer.fixed<quint32>();
+    const quint32 blockCount = trailer.fixed<quint32>();
+    const quint64 indexOffset = trailer.fixed<quint64>();
+
+    // The index fills the space between the blocks and the trailer. The offset is checked
+    // before anything is added to it, as a corrupt offset could make the sum wrap around.
+    const quint64 indexEnd = quint64(size - TRAILER_SIZE);
+    if (trailer.fixed<quint32>() != INDEX_MAGIC || indexOffset > indexEnd
+        || blockCount > (indexEnd - indexOffset) / INDEX_ENTRY_SIZE
+        || blockCount * quint64(INDEX_ENTRY_SIZE) != indexEnd - indexOffset) {
+        return false;
+    }
+
+    Reader index(data + indexOffset, blockCount * INDEX_ENTRY_SIZE);
+    blocks.resize(blockCount);
+    quint64 total = 0;
+    for (Block &block : blocks) {
+        block.offset_ = index.fixed<quint64>();
+        block.size_ = index.fixed<quint32>();
+        block.lineCount_ = index.fixed<quint32>();
+        block.left_ = index.real();
+        block.top_ = index.real();
+        block.right_ = index.real();
+        block.bottom_ = index.real();
+        if (block.size_ > indexOffset || block.offset_ > indexOffset - block.size_
+            || block.lineCount_ > quint32(LineCodec::LINES_PER_BLOCK)) {
+            return false;
+        }
+        total += block.lineCount_;
+    }
+    return !index.failed() && total == lineCount;
+}
+
+QByteArray uncompressBlock(const uchar *data, const Block &block) {
+    return qUncompress(data + block.offset_, qsizetype(block.size_));
+}
+
+} // namespace
+
+bool LineCodec::intersects(const Line &line, const QRectF &region) {
+    return std::min(line.start_.x(), line.end_.x()) <= region.right()
+        && std::max(line.start_.x(), line.end_.x()) >= region.left()
+        && std::min(line.start_.y(), line.end_.y()) <= region.bottom()
+        && std::max(line.start_.y(), line.end_.y()) >= region.top();
+}
+
+bool LineCodec::write(QIODevice &device, const QVector<Line> &lines) {
+    TRACE_SCOPE("LineCodec::write");
+    const std::vector<quint64> keys = spatialOrder(lines);
+    const int blockCount = int((lines.size() + LINES_PER_BLOCK - 1) / LINES_PER_BLOCK);
+    std::vector<QByteArray> compressed(blockCount);
+    std::vector<Block> blocks(blockCount);
+    forEachBlock(blockCount, [&lines, &keys, &compressed, &blocks](int block) {
+        const int first = block * LINES_PER_BLOCK;
+        const int count = std::min<int>(LINES_PER_BLOCK, int(lines.size()) - first);
+        blocks[block].lineCount_ = quint32(count);
+        compressed[block] = qCompress(encodeBlock(lines, keys.data() + first, count, blocks[block]));
+    });
+
+    // The blocks, then their index, then the trailer locating the index
+    QByteArray index;
+    quint64 offset = 0;
+    for (int block = 0; block < blockCount; ++block) {
+        if (device.write(compressed[block]) != compressed[block].size()) {
+            return false;
+        }
+        blocks[block].offset_ = offset;
+        blocks[block].size_ = quint32(compressed[block].size());
+        offset += blocks[block].size_;
+
+        appendFixed(index, blocks[block].offset_);
+        appendFixed(index, blocks[block].size_);
+        appendFixed(index, blocks[block].lineCount_);
+        appendReal(index, blocks[block].left_);
+        appendReal(index, blocks[block].top_);
+        appendReal(index, blocks[block].right_);
+        appendReal(index, blocks[block].bottom_);
+    }
+    appendFixed(index, quint32(lines.size()));
+    appendFixed(index, quint32(blockCount));
+    appendFixed(index, offset);
+    appendFixed(index, INDEX_MAGIC);
+    return device.write(index) == index.size();
+}
+
+bool LineCodec::read(const uchar *data, qint64 size, QVector<Line> &lines) {
+    TRACE_SCOPE("LineCodec::read");
+    quint32 lineCount = 0;
+    std::vector<Block> blocks;
+    if (!readIndex(data, size, lineCount, blocks)) {
+        return false;
+    }
+
+    // Every block puts its lines back to their place in drawing order
+    QVector<Line> decoded(lineCount);
+    Line *out = decoded.data();
+    std::atomic<bool> b_valid(true);
+    forEachBlock(int(blocks.size()), [data, &blocks, out, lineCount, &b_valid](int block) {
+        const auto place = [out](quint32 index, const Line &line) { out[index] = line; };
+        if (!decodeBlock(uncompressBlock(data, blocks[block]), blocks[block].lineCount_, lineCount, place)) {
+            b_valid = false;
+        }
+    });
+    if (!b_valid) {
+        return false;
+    }
+    lines = std::move(decoded);
+    return true;
+}
+
+bool LineCodec::readRegion(const uchar *data, qint64 size, const QRectF &region, QVector<Line> &lines) {
+    TRACE_SCOPE("LineCodec::readRegion");
+    quint32 lineCount = 0;
+    std::vector<Block> blocks;
+    if (!readIndex(data, size, lineCount, blocks)) {
+        return false;
+    }
+
+    const QRectF area = region.normalized();
+    std::vector<Block> touched;
+    std::copy_if(blocks.begin(), blocks.end(), std::back_inserter(touched),
+                 [&area](const Block &block) { return blockIntersects(block, area); });
+
+    std::vector<std::vector<std::pair<quint32, Line>>> found(touched.size());
+    std::atomic<bool> b_valid(true);
+    forEachBlock(int(touched.size()), [data, &touched, &found, &area, lineCount, &b_valid](int block) {
+        std::vector<std::pair<quint32, Line>> &inside = found[block];
+        const auto keep = [&inside, &area](quint32 index, const Line &line) {
+            if (LineCodec::intersects(line, area)) {
+                inside.emplace_back(index, line);
+            }
+        };
+        if (!decodeBlock(uncompressBlock(data, touched[block]), touched[block].lineCount_, lineCount, keep)) {
+            b_valid = false;
+        }
+    });
+    if (!b_valid) {
+        return false;
+    }
+
+    std::vector<std::pair<quint32, Line>> ordered;
+    for (std::vector<std::pair<quint32, Line>> &inside : found) {
+        ordered.insert(ordered.end(), inside.begin(), inside.end());
+    }
+    std::sort(ordered.begin(), ordered.end(),
+              [](const std::pair<quint32, Line> &a, const std::pair<quint32, Line> &b) { return a.first < b.first; });
+
+    QVector<Line> result;
+    result.reserve(qsizetype(ordered.size()));
+    for (const std::pair<quint32, Line> &entry : ordered) {
+        result.append(entry.second);
+    }
+    lines = std::move(result);
+    return true;
+}
@@ -0,0 +1,82 @@
+#ifndef LINECODEC_HPP
+#define LINECODEC_HPP
+
+#include <QIODevice>
+#include <QRectF>
+#include <QVector>
+#include "turtlecontrol.h"
+
+/**
+ * @class LineCodec
+ * @brief Compact binary encoding of the lines of a drawing, used by .tgs state files.
+ *
+ * The lines are sorted along a Hilbert curve through a grid over the drawing and cut into
+ * blocks of LINES_PER_BLOCK lines, so every block covers a compact area. The grid has
+ * about one cell per BLOCKS_PER_CELL blocks, as polylines are split where they cross cells. The blocks are
+ * compressed separately and followed by an index holding the position and bounding box of
+ * each block, so the lines of a region are read without touching the other blocks, and all
+ * blocks are encoded and decoded in parallel.
+ *
+ * Within a block, lines are grouped into polyline runs: lines drawn one after another in
+ * the same color and width, each starting where the previous one ends. A run stores the
+ * drawing order index of its first line, its color and width only if they differ from the
+ * previous run, then its points as deltas of fixed-point coordinates written as zig-zag
+ * varints, so short segments take two or three bytes each.
+ */
+class LineCodec
+{
+public:
+    /// @brief Number of fixed-point steps per pixel, positions are rounded to 1/1024 pixel.
+    static constexpr int POSITION_SCALE = 1024;
+
+    /// @brief Maximum number of lines of a block.
+    static constexpr int LINES_PER_BLOCK = 16384;
+
+    /// @brief Maximum number of cells per side of the grid ordering the lines, a power of two.
+    static constexpr int MAX_GRID_SIZE = 1024;
+
+    /// @brief Number of blocks sharing a cell of the grid, fewer cells keep polylines in one piece.
+    static constexpr int BLOCKS_PER_CELL = 4;
+
+    /**
+     * @brief Writes lines at the current position of a device.
+     * @param device The device to write to.
+     * @param lines The lines to write.
+     * @return False if the device failed to write.
+     */
+    static bool write(QIODevice &device, const QVector<Line> &lines);
+
+    /**
+     * @brief Reads all lines written by write(), in drawing order.
+     * @param data The written bytes, e.g. mapped from a file.
+     * @param size The number of written bytes.
+     * @param lines Receives the lines.
+     * @return False if the data is truncated or corrupt, lines is unchanged then.
+     */
+    static bool read(const uchar *data, qint64 size, QVector<Line> &lines);
+
+    /**
+     * @brief Reads the lines written by write() whose bounding box intersects a region.
+     *
+     * Only the blocks whose bounding box intersects the region are decoded.
+     *
+     * @param data The written bytes, e.g. mapped from a file.
+     * @param size The number of written bytes.
+     * @param region The region, in drawing coordinates.
+     * @param lines Receives the lines, in drawing order.
+     * @return False if the data is truncated or corrupt, lines is unchanged then.
+     */
+    static bool readRegion(const uchar *data, qint64 size, const QRectF &region, QVector<Line> &lines);
+
+    /**
+     * @brief Checks if the bounding box of a line intersects a region.
+     *
+     * Horizontal and vertical lines, whose bounding box has no area, are included.
+     *
+     * @param line The line.
+     * @param region The region, with a non-negative width and height.
+     */
+    static bool intersects(const Line &line, const QRectF &region);
+};
+
+#endif // LINECODEC_HPP
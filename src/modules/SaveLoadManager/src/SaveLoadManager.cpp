@@ -1,6 +1,21 @@
 #include "SaveLoadManager.hpp"
+#include <QDataStream>
+#include <QElapsedTimer>
 #include "turtlecontrol.h"
 #include "CLI.hpp"
+#include "LineCodec.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// Marks binary state files, "TGS" and the format version
+constexpr quint32 STATE_MAGIC = 0x54475302;
+
+// File name suffix of saved states
+const char *const STATE_SUFFIX = ".tgs";
+
+} // namespace
 
 SaveLoadManager::SaveLoadManager(QObject *parent)
     : QObject(parent),
@@ -44,6 +59,7 @@ void SaveLoadManager::setBuildFolder(const QString &buildFolder) {
 }
 
 void SaveLoadManager::saveScreenshot() {
+    TRACE_SCOPE("SaveLoadManager::saveScreenshot");
     if (!m_mainWindow) {
         return;
     }
@@ -71,34 +87,12 @@ void SaveLoadManager::saveScreenshot() {
 
 void SaveLoadManager::saveState(const QString &fileName)
 {
+    TRACE_SCOPE("SaveLoadManager::saveState");
     if (!m_turtleControl) {
         return;
     }
-
-    // Get the turtle's current state: position, rotation, pen settings
-    QString state = QString("%1;%2;%3;%4;%5;%6;")
-        .arg(m_turtleControl->position().x())   // Turtle position x
-        .arg(m_turtleControl->position().y())   // Turtle position y
-        .arg(m_turtleControl->rotation())       // Turtle rotation
-        .arg(m_turtleControl->pen_down())       // Pen state (down or up)
-        .arg(m_turtleControl->pen_radius())     // Pen radius
-        .arg(m_turtleControl->pen_color().name()); // Pen color as hex string
-
-    // Save lines data
-    QVector<Line> lines = m_turtleControl->get_lines();  // Get all the lines
-    QString lineData;
-    for (const auto &line : lines) {
-        lineData += QString("%1;%2;%3;%4;%5;%6\n")
-                        .arg(line.start_.x())     // Line start x
-                        .arg(line.start_.y())     // Line start y
-                        .arg(line.end_.x())       // Line end x
-                        .arg(line.end_.y())       // Line end y
-                        .arg(line.color_.name())  // Line color in hex
-                        .arg(line.width_);        // Line width
-    }
-
-    // Combine turtle data and line data
-    QString fullData = state + "\n" + lineData;
+    QElapsedTimer timer;
+    timer.start();
 
     // Save the full state to a file
     QDir dir(m_buildFolder);
@@ -106,32 +100,113 @@ void SaveLoadManager::saveState(const QString &fileName)
         return;
     }
 
-    QString filePath = dir.filePath(fileName + ".txt");
-    saveToFile(filePath, fullData);
+    QString filePath = dir.filePath(fileName + STATE_SUFFIX);
+    QFile file(filePath);
+    bool b_saved = file.open(QIODevice::WriteOnly);
+    if (b_saved) {
+        // The turtle's current state: position, rotation, pen settings, then the lines
+        QDataStream stream(&file);
+        stream << STATE_MAGIC << m_turtleControl->position() << m_turtleControl->rotation()
+               << m_turtleControl->pen_down() << m_turtleControl->pen_radius()
+               << quint32(m_turtleControl->pen_color().rgba());
+        b_saved = stream.status() == QDataStream::Ok && LineCodec::write(file, m_turtleControl->get_lines());
+    }
+    if (!b_saved) {
+        logAndEmitOutput("Failed to save to file: " + filePath);
+        return;
+    }
+
+    perf::add(perf::Counter::kBytesSaved, file.size());
+    file.close();
+    perf::record(perf::Histogram::kSaveTime, timer.nsecsElapsed() / 1000);
     logAndEmitOutput("State saved successfully: " + filePath);
 }
 
 void SaveLoadManager::loadState(const QString& filePath) {
+    TRACE_SCOPE("SaveLoadManager::loadState");
+    load(filePath, nullptr);
+}
+
+void SaveLoadManager::loadRegion(const QString &filePath, const QRectF &region) {
+    TRACE_SCOPE("SaveLoadManager::loadRegion");
+    load(filePath, &region);
+}
+
+void SaveLoadManager::load(const QString &filePath, const QRectF *region) {
     if (!m_turtleControl) {
         return;
     }
+    QElapsedTimer timer;
+    timer.start();
 
-    // Load content from the file
-    QStringList stateList = loadFromFile(filePath);
+    // Load content from the file, mapped so that only the parts read are paged in
+    QFile file;
+    const QByteArray content = loadFromFile(filePath, file);
 
-    // Check if the list is empty
-    if (stateList.isEmpty()) {
+    // Check if the file is empty
+    if (content.isEmpty()) {
         logAndEmitOutput("Failed to load state: File is empty or does not exist.");
         return;  // No data to process
     }
 
-    // Load turtle data from the first line
-    QStringList state = stateList[0].split(";");
-    if (state.size() < 6) {
+    // Binary states start with their magic number, anything else is the older text format
+    QDataStream stream(content);
+    quint32 magic = 0;
+    stream >> magic;
+    const bool b_loaded = magic == STATE_MAGIC ? loadBinaryState(content, stream, region)
+                                               : loadTextState(content, region);
+    if (!b_loaded) {
         logAndEmitOutput("Failed to load state: Invalid data format.");
         return;  // Invalid data, return early
     }
 
+    if (!region) {
+        // A region is read from a small part of the file
+        perf::add(perf::Counter::kBytesLoaded, content.size());
+    }
+    perf::record(perf::Histogram::kLoadTime, timer.nsecsElapsed() / 1000);
+    logAndEmitOutput((region ? "Region loaded successfully: " : "State loaded successfully: ") + filePath);
+}
+
+bool SaveLoadManager::loadBinaryState(const QByteArray &content, QDataStream &stream, const QRectF *region) {
+    QPointF position;
+    float rotation = 0.f;
+    bool penDown = true;
+    float penRadius = 1.f;
+    quint32 penColor = 0;
+    stream >> position >> rotation >> penDown >> penRadius >> penColor;
+    if (stream.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    // The lines follow the turtle state
+    const qint64 offset = stream.device()->pos();
+    const uchar *lineData = reinterpret_cast<const uchar *>(content.constData()) + offset;
+    const qint64 lineDataSize = content.size() - offset;
+    QVector<Line> lines;
+    if (region ? !LineCodec::readRegion(lineData, lineDataSize, *region, lines)
+               : !LineCodec::read(lineData, lineDataSize, lines)) {
+        return false;
+    }
+
+    m_turtleControl->set_position(position);
+    m_turtleControl->set_rotation(rotation);
+    m_turtleControl->set_pen_down(penDown);
+    m_turtleControl->set_pen_radius(penRadius);
+    m_turtleControl->set_pen_color(QColor::fromRgba(penColor));
+    m_turtleControl->set_lines(lines);
+    return true;
+}
+
+bool SaveLoadManager::loadTextState(const QByteArray &content, const QRectF *region) {
+    const QStringList stateList = QString::fromUtf8(content).split('\n');
+
+    // Load turtle data from the first line
+    QStringList state = stateList[0].trimmed().split(";");
+    if (state.size() < 6) {
+        return false;
+    }
+
     // Parse the turtle state
     double posX = state[0].toDouble();
     double posY = state[1].toDouble();
@@ -148,12 +223,11 @@ void SaveLoadManager::loadState(const QString& filePath) {
     m_turtleControl->set_pen_color(penColor);
 
     // Load line data from the subsequent lines
+    const QRectF area = region ? region->normalized() : QRectF();
     QVector<Line> lines;
     for (int i = 1; i < stateList.size(); ++i) {
-        QString lineData = stateList[i];
-
         // Split by semicolons (since each line is separated by ; in your case)
-        QStringList lineParts = lineData.split(";", Qt::SkipEmptyParts);
+        QStringList lineParts = stateList[i].trimmed().split(";", Qt::SkipEmptyParts);
 
         if (lineParts.size() != 5 && lineParts.size() != 6) {
             continue;  // Invalid line format, skip it
@@ -166,60 +240,45 @@ void SaveLoadManager::loadState(const QString& filePath) {
         // Parse color (hex string)
         QColor color(lineParts[4]);
 
-        // Parse width
-        float width = lineParts[5].toFloat();
+        // Parse width, missing in some older files
+        float width = lineParts.size() == 6 ? lineParts[5].toFloat() : 1.f;
 
         // Create Line object and add it to the lines vector
-        lines.append(Line(start, end, color, width));
+        Line line(start, end, color, width);
+        if (!region || LineCodec::intersects(line, area)) {
+            lines.append(line);
+        }
     }
 
     // Set the loaded lines to TurtleControl
     m_turtleControl->set_lines(lines);
-    logAndEmitOutput("State loaded successfully: " + filePath);
+    return true;
 }
 
-void SaveLoadManager::saveToFile(const QString &filePath, const QString &content) {
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        logAndEmitOutput("Failed to save to file: " + filePath);
-        return;
-    }
-
-    QTextStream out(&file);
-    out << content;
-    file.close();
-}
-
-QStringList SaveLoadManager::loadFromFile(const QString &filePath)
+QByteArray SaveLoadManager::loadFromFile(const QString &filePath, QFile &file)
 {
     QString localFilePath = filePath;
     if (filePath.startsWith("file://")) {
         localFilePath = QUrl(filePath).toLocalFile();
     }
 
-    QFile file(localFilePath);
+    file.setFileName(localFilePath);
 
     if (!file.exists()) {
         logAndEmitOutput("File does not exist: " + localFilePath);
-        return QStringList();  // Return an empty list if the file doesn't exist
+        return QByteArray();  // Return an empty array if the file doesn't exist
     }
 
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (!file.open(QIODevice::ReadOnly)) {
         logAndEmitOutput("Failed to open file: " + localFilePath);
-        return QStringList();  // Return an empty list if file cannot be opened
+        return QByteArray();  // Return an empty array if file cannot be opened
     }
 
-    QTextStream in(&file);
-    QStringList lines;
-
-    // Read each line from the file and append it to the QStringList
-    while (!in.atEnd()) {
-        QString line = in.readLine().trimmed();
-        lines.append(line);  // Add the trimmed line to the list
+    // Files that cannot be mapped, e.g. on some network drives, are read as a whole
+    if (const uchar *mapped = file.map(0, file.size())) {
+        return QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), file.size());
     }
-
-    file.close();
-    return lines;  // Return the list of lines
+    return file.readAll();
 }
 
 QString SaveLoadManager::getCurrentDateTimeString() const {
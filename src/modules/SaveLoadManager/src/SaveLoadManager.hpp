@@ -4,7 +4,9 @@
 #include <QObject>
 #include <QString>
 #include <QPointF>
+#include <QRectF>
 #include <QColor>
+#include <QDataStream>
 #include <QDateTime>
 #include <QFile>
 #include <QImage>
@@ -104,8 +106,9 @@ public:
 
     /**
      * @brief Saves the current state to the specified file.
-     * @param fileName The name of the file to save the state to.
+     * @param fileName The name of the file to save the state to, without the ".tgs" suffix.
      *
+     * States are saved in a compact binary format, the lines being encoded by LineCodec.
      * This function is Q_INVOKABLE to allow QML access.
      */
     Q_INVOKABLE void saveState(const QString &fileName);
@@ -114,10 +117,23 @@ public:
      * @brief Loads a state from the specified file.
      * @param filePath The path of the file to load the state from.
      *
+     * Both binary .tgs files and text files saved by older versions are loaded.
      * This function is Q_INVOKABLE to allow QML access.
      */
     Q_INVOKABLE void loadState(const QString &filePath);
 
+    /**
+     * @brief Loads a state from the specified file, with only the lines in a region.
+     * @param filePath The path of the file to load the state from.
+     * @param region The region, in drawing coordinates. Lines whose bounding box
+     *               intersects it are loaded.
+     *
+     * Only the parts of a .tgs file holding lines near the region are read, so a small
+     * window of a huge drawing loads quickly. Text files are read as a whole.
+     * This function is Q_INVOKABLE to allow QML access.
+     */
+    Q_INVOKABLE void loadRegion(const QString &filePath, const QRectF &region);
+
 signals:
     /**
      * @brief Signal emitted when the main window reference changes.
@@ -131,18 +147,36 @@ signals:
 
 private:
     /**
-     * @brief Saves content to a specified file.
-     * @param filePath The path of the file to save content to.
-     * @param content The content to save as a QString.
+     * @brief Loads a state from the specified file.
+     * @param filePath The path of the file to load the state from.
+     * @param region The region whose lines are loaded, or nullptr to load all lines.
      */
-    void saveToFile(const QString &filePath, const QString &content);
+    void load(const QString &filePath, const QRectF *region);
 
     /**
      * @brief Loads content from a specified file.
-     * @param filePath The path of the file to load content from.
-     * @return The loaded content as a QStringList.
+     * @param filePath The path or file URL of the file to load content from.
+     * @param file Receives the opened file, the content is only valid while it is open.
+     * @return The content, mapped if possible, empty if the file could not be read.
+     */
+    QByteArray loadFromFile(const QString &filePath, QFile &file);
+
+    /**
+     * @brief Applies a binary state to the turtle.
+     * @param content The content of the state file.
+     * @param stream The stream reading the content, following the magic number.
+     * @param region The region whose lines are loaded, or nullptr to load all lines.
+     * @return False if the state is invalid, the turtle is unchanged then.
+     */
+    bool loadBinaryState(const QByteArray &content, QDataStream &stream, const QRectF *region);
+
+    /**
+     * @brief Applies a state in the text format of older versions to the turtle.
+     * @param content The text of the state file.
+     * @param region The region whose lines are loaded, or nullptr to load all lines.
+     * @return False if the turtle state line is invalid.
      */
-    QStringList loadFromFile(const QString &filePath);
+    bool loadTextState(const QByteArray &content, const QRectF *region);
 
     /**
      * @brief Gets the current date and time in the format "dd_MM_hh_mm".
@@ -0,0 +1,67 @@
+#ifndef GRIDCELLS_H
+#define GRIDCELLS_H
+
+#include <QPointF>
+#include <QRectF>
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Returns the key of a cell of a uniform grid.
+ *
+ * @param cell_x The column of the cell, may be negative.
+ * @param cell_y The row of the cell, may be negative.
+ * @return The column and row packed into 64 bits.
+ */
+inline quint64 grid_cell_key(int cell_x, int cell_y)
+{
+    return (static_cast<quint64>(static_cast<quint32>(cell_x)) << 32) | static_cast<quint32>(cell_y);
+}
+
+/**
+ * @brief Calls a function with every cell of a uniform grid that a thick segment touches.
+ *
+ * The cells are visited column by column, so long diagonal segments only visit the cells
+ * along them instead of their whole bounding box. Every cell is visited once.
+ *
+ * @param start The start point of the segment.
+ * @param end The end point of the segment.
+ * @param margin Half the width of the segment.
+ * @param cell_size The width and height of a cell.
+ * @param visit The function called with the column and row of each cell.
+ * @return The bounding box of the segment, grown by the margin.
+ */
+template<typename Visitor>
+QRectF for_each_grid_cell(const QPointF &start, const QPointF &end, qreal margin, qreal cell_size, Visitor visit)
+{
+    const QPointF direction = end - start;
+    const QRectF bounds = QRectF(start, end).normalized().adjusted(-margin, -margin, margin, margin);
+
+    const int first_x = static_cast<int>(std::floor(bounds.left() / cell_size));
+    const int last_x = static_cast<int>(std::floor(bounds.right() / cell_size));
+    for (int cell_x = first_x; cell_x <= last_x; ++cell_x) {
+        qreal top = bounds.top();
+        qreal bottom = bounds.bottom();
+        if (direction.x() != 0.0 && first_x != last_x) {
+            // The part of the segment reaching into the column
+            const qreal left = cell_x * cell_size - margin;
+            const qreal right = (cell_x + 1) * cell_size + margin;
+            const qreal t1 = std::clamp((left - start.x()) / direction.x(), 0.0, 1.0);
+            const qreal t2 = std::clamp((right - start.x()) / direction.x(), 0.0, 1.0);
+            const qreal y1 = start.y() + t1 * direction.y();
+            const qreal y2 = start.y() + t2 * direction.y();
+            top = std::min(y1, y2) - margin;
+            bottom = std::max(y1, y2) + margin;
+        }
+
+        const int first_y = static_cast<int>(std::floor(top / cell_size));
+        const int last_y = static_cast<int>(std::floor(bottom / cell_size));
+        for (int cell_y = first_y; cell_y <= last_y; ++cell_y) {
+            visit(cell_x, cell_y);
+        }
+    }
+    return bounds;
+}
+
+#endif // GRIDCELLS_H
@@ -0,0 +1,260 @@
+#include "lineindex.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "gridcells.h"
+
+// Tolerance of the segment parameters when testing crossings
+constexpr qreal CROSSING_EPSILON = 1e-9;
+
+// 2D cross product, the signed area of the parallelogram spanned by the vectors
+static qreal cross(const QPointF &a, const QPointF &b)
+{
+    return a.x() * b.y() - a.y() * b.x();
+}
+
+LineIndex::LineIndex(const QVector<Line> &lines)
+    : lines_(lines)
+    , count_(0)
+    , cells_()
+    , min_cell_x_(INT_MAX)
+    , max_cell_x_(INT_MIN)
+    , min_cell_y_(INT_MAX)
+    , max_cell_y_(INT_MIN)
+{}
+
+void LineIndex::clear()
+{
+    cells_.clear();
+    count_ = 0;
+    min_cell_x_ = INT_MAX;
+    max_cell_x_ = INT_MIN;
+    min_cell_y_ = INT_MAX;
+    max_cell_y_ = INT_MIN;
+}
+
+void LineIndex::update()
+{
+    if (lines_.size() < count_) {
+        rebuild();
+        return;
+    }
+
+    for (int i = count_; i < lines_.size(); ++i) {
+        for_each_grid_cell(lines_[i].start_, lines_[i].end_, 0.0, CELL_SIZE, [this, i](int cell_x, int cell_y) {
+            cells_[grid_cell_key(cell_x, cell_y)].push_back(i);
+            min_cell_x_ = std::min(min_cell_x_, cell_x);
+            max_cell_x_ = std::max(max_cell_x_, cell_x);
+            min_cell_y_ = std::min(min_cell_y_, cell_y);
+            max_cell_y_ = std::max(max_cell_y_, cell_y);
+        });
+    }
+    count_ = lines_.size();
+}
+
+void LineIndex::rebuild()
+{
+    clear();
+    update();
+}
+
+void LineIndex::truncate(int count)
+{
+    for (int i = count_ - 1; i >= count; --i) {
+        for_each_grid_cell(lines_[i].start_, lines_[i].end_, 0.0, CELL_SIZE, [this, count](int cell_x, int cell_y) {
+            auto it = cells_.find(grid_cell_key(cell_x, cell_y));
+            if (it == cells_.end()) {
+                return;
+            }
+            // The removed lines are the last ones, so they are at the end of every cell
+            std::vector<int> &indices = it->second;
+            while (!indices.empty() && indices.back() >= count) {
+                indices.pop_back();
+            }
+            if (indices.empty()) {
+                cells_.erase(it);
+            }
+        });
+    }
+    count_ = std::min(count_, count);
+}
+
+const std::vector<int> *LineIndex::cell(int cell_x, int cell_y) const
+{
+    auto it = cells_.find(grid_cell_key(cell_x, cell_y));
+    return it != cells_.end() ? &it->second : nullptr;
+}
+
+int LineIndex::nearest(const QPointF &point, qreal max_distance) const
+{
+    if (cells_.empty()) {
+        return -1;
+    }
+
+    const int center_x = static_cast<int>(std::floor(point.x() / CELL_SIZE));
+    const int center_y = static_cast<int>(std::floor(point.y() / CELL_SIZE));
+
+    // Rings of cells around the point, up to max_distance but not beyond the used cells
+    const qreal max_rings = std::ceil(max_distance / CELL_SIZE);
+    const qint64 extent = std::max({qAbs(qint64(center_x) - min_cell_x_), qAbs(qint64(center_x) - max_cell_x_),
+                                    qAbs(qint64(center_y) - min_cell_y_), qAbs(qint64(center_y) - max_cell_y_)});
+    const int last_ring = static_cast<int>(std::min<qreal>(max_rings, extent));
+
+    int best = -1;
+    qreal best_distance = max_distance;
+    const auto visit = [&](int cell_x, int cell_y) {
+        // Skip cells farther away than the closest line found so far
+        const qreal dx = std::max({cell_x * CELL_SIZE - point.x(), 0.0, point.x() - (cell_x + 1) * CELL_SIZE});
+        const qreal dy = std::max({cell_y * CELL_SIZE - point.y(), 0.0, point.y() - (cell_y + 1) * CELL_SIZE});
+        if (dx * dx + dy * dy > best_distance * best_distance) {
+            return;
+        }
+        const std::vector<int> *indices = cell(cell_x, cell_y);
+        if (!indices) {
+            return;
+        }
+        for (int index : *indices) {
+            const qreal distance = distance_to_segment(point, lines_[index].start_, lines_[index].end_);
+            if (distance < best_distance || (distance == best_distance && index > best)) {
+                best_distance = distance;
+                best = index;
+            }
+        }
+    };
+
+    for (int ring = 0; ring <= last_ring; ++ring) {
+        if (ring == 0) {
+            visit(center_x, center_y);
+        } else {
+            for (int dx = -ring; dx <= ring; ++dx) {
+                visit(center_x + dx, center_y - ring);
+                visit(center_x + dx, center_y + ring);
+            }
+            for (int dy = -ring + 1; dy < ring; ++dy) {
+                visit(center_x - ring, center_y + dy);
+                visit(center_x + ring, center_y + dy);
+            }
+        }
+
+        // Lines in the next ring are at least this far from the point
+        if (best >= 0 && best_distance <= ring * CELL_SIZE) {
+            break;
+        }
+    }
+    return best;
+}
+
+std::vector<int> LineIndex::query(const QRectF &rect) const
+{
+    std::vector<int> result;
+    if (cells_.empty()) {
+        return result;
+    }
+
+    const QRectF area = rect.normalized();
+    const int first_x = std::max(static_cast<int>(std::floor(area.left() / CELL_SIZE)), min_cell_x_);
+    const int last_x = std::min(static_cast<int>(std::floor(area.right() / CELL_SIZE)), max_cell_x_);
+    const int first_y = std::max(static_cast<int>(std::floor(area.top() / CELL_SIZE)), min_cell_y_);
+    const int last_y = std::min(static_cast<int>(std::floor(area.bottom() / CELL_SIZE)), max_cell_y_);
+    if (first_x > last_x || first_y > last_y) {
+        return result;
+    }
+
+    // Lines spanning several cells are collected more than once
+    const qint64 range_cells = (qint64(last_x) - first_x + 1) * (qint64(last_y) - first_y + 1);
+    if (range_cells > static_cast<qint64>(cells_.size())) {
+        for (const auto &entry : cells_) {
+            const int cell_x = static_cast<int>(static_cast<quint32>(entry.first >> 32));
+            const int cell_y = static_cast<int>(static_cast<quint32>(entry.first));
+            if (cell_x >= first_x && cell_x <= last_x && cell_y >= first_y && cell_y <= last_y) {
+                result.insert(result.end(), entry.second.begin(), entry.second.end());
+            }
+        }
+    } else {
+        for (int cell_y = first_y; cell_y <= last_y; ++cell_y) {
+            for (int cell_x = first_x; cell_x <= last_x; ++cell_x) {
+                if (const std::vector<int> *indices = cell(cell_x, cell_y)) {
+                    result.insert(result.end(), indices->begin(), indices->end());
+                }
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    // The cells at the border of the rectangle also hold lines passing outside of it
+    const auto outside = [this, &area](int index) {
+        const QPointF start = lines_[index].start_;
+        const QPointF end = lines_[index].end_;
+        if (area.contains(start) || area.contains(end)) {
+            return false;
+        }
+        return !crosses(start, end, area.topLeft(), area.topRight())
+               && !crosses(start, end, area.topRight(), area.bottomRight())
+               && !crosses(start, end, area.bottomRight(), area.bottomLeft())
+               && !crosses(start, end, area.bottomLeft(), area.topLeft());
+    };
+    result.erase(std::remove_if(result.begin(), result.end(), outside), result.end());
+    return result;
+}
+
+int LineIndex::first_crossing(const QPointF &start, const QPointF &end) const
+{
+    int first = -1;
+    for_each_grid_cell(start, end, 0.0, CELL_SIZE, [&](int cell_x, int cell_y) {
+        const std::vector<int> *indices = cell(cell_x, cell_y);
+        if (!indices) {
+            return;
+        }
+        for (int index : *indices) {
+            if (first >= 0 && index >= first) {
+                break; // a lower index was found already
+            }
+            if (crosses(start, end, lines_[index].start_, lines_[index].end_)) {
+                first = index;
+                break;
+            }
+        }
+    });
+    return first;
+}
+
+qreal LineIndex::distance_to_segment(const QPointF &point, const QPointF &start, const QPointF &end)
+{
+    const QPointF direction = end - start;
+    const QPointF offset = point - start;
+    const qreal length_squared = QPointF::dotProduct(direction, direction);
+    const qreal t = length_squared > 0.0
+                        ? std::clamp(QPointF::dotProduct(offset, direction) / length_squared, 0.0, 1.0)
+                        : 0.0;
+    const QPointF distance = offset - t * direction;
+    return std::sqrt(QPointF::dotProduct(distance, distance));
+}
+
+bool LineIndex::crosses(const QPointF &start, const QPointF &end, const QPointF &line_start, const QPointF &line_end)
+{
+    const QPointF direction = end - start;
+    const QPointF line_direction = line_end - line_start;
+    const QPointF offset = line_start - start;
+    const qreal denominator = cross(direction, line_direction);
+
+    const qreal length_squared = QPointF::dotProduct(direction, direction);
+    if (length_squared == 0.0) {
+        return false;
+    }
+
+    if (std::abs(denominator) <= CROSSING_EPSILON * std::sqrt(length_squared * QPointF::dotProduct(line_direction, line_direction))) {
+        // Parallel segments cross if they are on the same line and overlap
+        if (std::abs(cross(offset, direction)) > CROSSING_EPSILON * length_squared) {
+            return false;
+        }
+        const qreal t1 = QPointF::dotProduct(offset, direction) / length_squared;
+        const qreal t2 = QPointF::dotProduct(line_end - start, direction) / length_squared;
+        return std::max(std::min(t1, t2), 0.0) < std::min(std::max(t1, t2), 1.0) - CROSSING_EPSILON;
+    }
+
+    const qreal t = cross(offset, line_direction) / denominator; // along the crossing segment
+    const qreal u = cross(offset, direction) / denominator;      // along the crossed segment
+    return t > CROSSING_EPSILON && t < 1.0 - CROSSING_EPSILON
+           && u >= -CROSSING_EPSILON && u <= 1.0 + CROSSING_EPSILON;
+}
@@ -0,0 +1,130 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <unordered_map>
+#include <vector>
+
+#include "turtlecontrol.h"
+
+/**
+ * @brief Spatial index over the lines drawn by a turtle.
+ *
+ * The lines are bucketed into the cells of a uniform grid that their center lines pass
+ * through, so finding the lines near a point, inside a rectangle or crossing a segment only
+ * looks at the lines of the cells involved instead of all lines. Each cell lists its lines in
+ * ascending order, so lines appended to the turtle are added with push_back and removing the
+ * last lines is a pop_back in the cells they touch.
+ *
+ * The index refers to the lines of a vector it does not own, and has to be updated whenever
+ * that vector changes.
+ */
+class LineIndex
+{
+public:
+    /// @brief Width and height of a cell of the grid.
+    static constexpr qreal CELL_SIZE = 8.0;
+
+    /**
+     * @brief Constructs an empty index.
+     *
+     * @param lines The lines to index, the vector must outlive the index.
+     */
+    explicit LineIndex(const QVector<Line> &lines);
+
+    /// @brief Gets the number of indexed lines.
+    int size() const { return count_; }
+
+    /// @brief Removes all lines from the index.
+    void clear();
+
+    /**
+     * @brief Indexes the lines appended since the last update.
+     *
+     * Rebuilds the index if the vector has fewer lines than the index.
+     */
+    void update();
+
+    /// @brief Indexes all lines again, after the lines were replaced.
+    void rebuild();
+
+    /**
+     * @brief Removes the last lines from the index.
+     *
+     * Must be called while the removed lines are still in the vector.
+     *
+     * @param count The number of lines to keep.
+     */
+    void truncate(int count);
+
+    /**
+     * @brief Finds the line closest to a point.
+     *
+     * Of equally close lines, the one drawn last is returned.
+     *
+     * @param point The point.
+     * @param max_distance The maximum distance of the line from the point.
+     * @return The index of the line, or -1 if no line is within max_distance.
+     */
+    int nearest(const QPointF &point, qreal max_distance) const;
+
+    /**
+     * @brief Finds the lines intersecting a rectangle.
+     *
+     * @param rect The rectangle.
+     * @return The ascending indices of the lines.
+     */
+    std::vector<int> query(const QRectF &rect) const;
+
+    /**
+     * @brief Finds the first line crossed by a segment.
+     *
+     * Lines touched by the end points of the segment only, e.g. the line the segment
+     * continues, are not crossed. Lines running along the segment are.
+     *
+     * @param start The start point of the segment.
+     * @param end The end point of the segment.
+     * @return The lowest index of a crossed line, or -1 if no line is crossed.
+     */
+    int first_crossing(const QPointF &start, const QPointF &end) const;
+
+    /**
+     * @brief Returns the distance between a point and a segment.
+     *
+     * @param point The point.
+     * @param start The start point of the segment.
+     * @param end The end point of the segment.
+     */
+    static qreal distance_to_segment(const QPointF &point, const QPointF &start, const QPointF &end);
+
+    /**
+     * @brief Checks if a segment crosses another.
+     *
+     * @param start The start point of the crossing segment.
+     * @param end The end point of the crossing segment.
+     * @param line_start The start point of the crossed segment.
+     * @param line_end The end point of the crossed segment.
+     * @return True if the segments share a point other than the end points of the crossing segment.
+     */
+    static bool crosses(const QPointF &start, const QPointF &end, const QPointF &line_start, const QPointF &line_end);
+
+private:
+    const QVector<Line> &lines_;                          ///< The indexed lines.
+    int count_;                                           ///< Number of lines of lines_ in the index.
+    std::unordered_map<quint64, std::vector<int>> cells_; ///< Ascending line indices by grid_cell_key().
+    int min_cell_x_;                                      ///< The leftmost column of the cells used so far.
+    int max_cell_x_;                                      ///< The rightmost column of the cells used so far.
+    int min_cell_y_;                                      ///< The top row of the cells used so far.
+    int max_cell_y_;                                      ///< The bottom row of the cells used so far.
+
+    /**
+     * @brief Gets the lines of a cell.
+     *
+     * @return The ascending line indices, or nullptr if the cell is empty.
+     */
+    const std::vector<int> *cell(int cell_x, int cell_y) const;
+};
+
+#endif // LINEINDEX_H
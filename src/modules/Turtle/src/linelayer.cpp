@@ -0,0 +1,320 @@
+#include "linelayer.h"
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QPen>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "perf.hpp"
+#include "trace.hpp"
+
+// Extra margin around a segment in pixels, covering antialiased pixels
+constexpr qreal ANTIALIASING_MARGIN = 1.0;
+
+LineLayer::LineLayer(QQuickItem *parent)
+    : QQuickPaintedItem(parent)
+    , turtle_control_(nullptr)
+    , pyramid_()
+    , tiles_()
+    , rasterized_count_(0)
+    , last_rasterized_()
+    , zoom_(1.0)
+    , pan_()
+    , paint_count_(0)
+{
+    // Only transparent pixels outside the tiles, the background shows through
+    setFillColor(Qt::transparent);
+}
+
+void LineLayer::set_turtle_control(TurtleControl *turtle_control)
+{
+    if (turtle_control_ == turtle_control) {
+        return;
+    }
+    if (turtle_control_) {
+        disconnect(turtle_control_, nullptr, this, nullptr);
+    }
+    turtle_control_ = turtle_control;
+    if (turtle_control_) {
+        connect(turtle_control_, &TurtleControl::lines_changed, this, &LineLayer::update_tiles);
+        connect(turtle_control_, &TurtleControl::lines_truncated, this, &LineLayer::truncate_tiles);
+    }
+
+    pyramid_.clear();
+    tiles_.clear();
+    rasterized_count_ = 0;
+    update_tiles();
+    update();
+    emit turtle_control_changed();
+}
+
+void LineLayer::set_zoom(qreal zoom)
+{
+    zoom = std::clamp(zoom, MIN_ZOOM, MAX_ZOOM);
+    if (zoom_ == zoom) {
+        return;
+    }
+    zoom_ = zoom;
+    update();
+    emit view_changed();
+}
+
+void LineLayer::set_pan(const QPointF &pan)
+{
+    if (pan_ == pan) {
+        return;
+    }
+    pan_ = pan;
+    update();
+    emit view_changed();
+}
+
+int LineLayer::level() const
+{
+    // The finest level whose scale is not above the zoom, so tiles are never magnified
+    const int level = static_cast<int>(std::floor(-std::log2(zoom_) + 1e-9));
+    return std::min(level, LodPyramid::LEVEL_COUNT - 1);
+}
+
+void LineLayer::zoom_at(const QPointF &point, qreal factor)
+{
+    const QPointF anchor = map_to_drawing(point);
+    const qreal zoom = std::clamp(zoom_ * factor, MIN_ZOOM, MAX_ZOOM);
+    if (zoom_ == zoom) {
+        return;
+    }
+    zoom_ = zoom;
+    pan_ = point - anchor * zoom_;
+    update();
+    emit view_changed();
+}
+
+void LineLayer::pan_by(const QPointF &delta)
+{
+    set_pan(pan_ + delta);
+}
+
+void LineLayer::reset_view()
+{
+    if (zoom_ == 1.0 && pan_.isNull()) {
+        return;
+    }
+    zoom_ = 1.0;
+    pan_ = QPointF();
+    update();
+    emit view_changed();
+}
+
+QPointF LineLayer::map_to_drawing(const QPointF &point) const
+{
+    return (point - pan_) / zoom_;
+}
+
+QPointF LineLayer::map_from_drawing(const QPointF &point) const
+{
+    return point * zoom_ + pan_;
+}
+
+quint64 LineLayer::tile_key(int level, int tile_x, int tile_y)
+{
+    // 6 bits for the level and 29 bits for each coordinate
+    return (static_cast<quint64>(level + 32) << 58)
+           | (static_cast<quint64>(static_cast<quint32>(tile_x) & 0x1fffffff) << 29)
+           | (static_cast<quint32>(tile_y) & 0x1fffffff);
+}
+
+int LineLayer::tile_cell(int level, int tile)
+{
+    // Tiles below level 0 split the cells of level 0
+    return level >= 0 ? tile : static_cast<int>(std::floor(std::ldexp(tile, level)));
+}
+
+void LineLayer::update_tiles()
+{
+    const QVector<Line> lines = turtle_control_ ? turtle_control_->get_lines() : QVector<Line>();
+
+    // Lines are only ever appended, unless they were cleared or replaced
+    const bool b_replaced = lines.size() < rasterized_count_
+                            || (rasterized_count_ > 0
+                                && (lines[rasterized_count_ - 1].start_ != last_rasterized_.start_
+                                    || lines[rasterized_count_ - 1].end_ != last_rasterized_.end_
+                                    || lines[rasterized_count_ - 1].color_ != last_rasterized_.color_));
+    if (b_replaced) {
+        pyramid_.clear();
+        tiles_.clear();
+        rasterized_count_ = 0;
+        update();
+    }
+
+    if (lines.size() == rasterized_count_) {
+        return;
+    }
+
+    TRACE_SCOPE("LineLayer::update_tiles");
+    const LodPyramid::Changes changes = pyramid_.append(lines, rasterized_count_);
+    rasterized_count_ = lines.size();
+    last_rasterized_ = lines.last();
+    apply_changes(changes);
+
+    if (!b_replaced) {
+        update(QRectF(map_from_drawing(changes.area_.topLeft()),
+                      map_from_drawing(changes.area_.bottomRight())).toAlignedRect());
+    }
+}
+
+void LineLayer::truncate_tiles(int count)
+{
+    if (!turtle_control_ || count >= rasterized_count_) {
+        return;
+    }
+
+    TRACE_SCOPE("LineLayer::truncate_tiles");
+    const QVector<Line> lines = turtle_control_->get_lines();
+    const LodPyramid::Changes changes = pyramid_.truncate(lines, count);
+    rasterized_count_ = count;
+    last_rasterized_ = count > 0 ? lines[count - 1] : Line();
+    apply_changes(changes);
+
+    update(QRectF(map_from_drawing(changes.area_.topLeft()),
+                  map_from_drawing(changes.area_.bottomRight())).toAlignedRect());
+}
+
+void LineLayer::apply_changes(const LodPyramid::Changes &changes)
+{
+    for (auto it = tiles_.begin(); it != tiles_.end();) {
+        Tile &tile = it->second;
+        const int geometry_level = std::max(tile.level_, 0);
+        const quint64 cell = LodPyramid::cell_key(tile_cell(tile.level_, tile.x_), tile_cell(tile.level_, tile.y_));
+        if (changes.cells_[geometry_level].count(cell) == 0) {
+            ++it;
+            continue;
+        }
+
+        // Lines added to level 0 are painted on its tiles. Segments of the other levels may have
+        // been replaced, removed segments have to be erased, and tiles below level 0 only show
+        // a part of their cell.
+        if (tile.level_ == 0 && !changes.b_removed_) {
+            const std::vector<int> *indices = pyramid_.cell(0, tile.x_, tile.y_);
+            if (indices) {
+                paint_segments(tile.image_, 0, tile.x_, tile.y_, *indices, changes.first_added_);
+            }
+            ++it;
+        } else {
+            it = tiles_.erase(it);
+        }
+    }
+}
+
+void LineLayer::rasterize(int level, int tile_x, int tile_y, QImage &image) const
+{
+    const std::vector<int> *indices = pyramid_.cell(std::max(level, 0), tile_cell(level, tile_x), tile_cell(level, tile_y));
+    if (!indices) {
+        image = QImage();
+        return;
+    }
+
+    TRACE_SCOPE("LineLayer::rasterize");
+    image = QImage(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    paint_segments(image, level, tile_x, tile_y, *indices, 0);
+}
+
+void LineLayer::paint_segments(QImage &image, int level, int tile_x, int tile_y,
+                               const std::vector<int> &indices, int first) const
+{
+    const int geometry_level = std::max(level, 0);
+    const qreal scale = LodPyramid::level_scale(level);
+    const QRectF area(tile_x * TILE_SIZE / scale, tile_y * TILE_SIZE / scale, TILE_SIZE / scale, TILE_SIZE / scale);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.translate(-tile_x * TILE_SIZE, -tile_y * TILE_SIZE);
+    painter.scale(scale, scale);
+
+    quint32 style = UINT_MAX;
+    for (auto it = std::lower_bound(indices.begin(), indices.end(), first); it != indices.end(); ++it) {
+        const LodSegment &segment = pyramid_.segment(geometry_level, *it);
+
+        // Lines are at least a pixel wide, so they do not vanish when zoomed out
+        const qreal width = std::max<qreal>(pyramid_.width(segment.style_), 1.0 / scale);
+        const qreal margin = width / 2.0 + ANTIALIASING_MARGIN / scale;
+        if (!QRectF(segment.start(), segment.end()).normalized()
+                 .adjusted(-margin, -margin, margin, margin).intersects(area)) {
+            continue;
+        }
+
+        if (segment.style_ != style) {
+            style = segment.style_;
+            painter.setPen(QPen(pyramid_.color(style), width, Qt::SolidLine, Qt::FlatCap));
+        }
+        painter.drawLine(segment.start(), segment.end());
+    }
+}
+
+void LineLayer::paint(QPainter *painter)
+{
+    TRACE_SCOPE("LineLayer::paint");
+    QElapsedTimer timer;
+    timer.start();
+    ++paint_count_;
+
+    // The area to repaint in pixels of the displayed level
+    const int level = this->level();
+    const qreal scale = LodPyramid::level_scale(level);
+    const QRectF area = painter->hasClipping() ? painter->clipBoundingRect() : boundingRect();
+    const QRectF level_area(map_to_drawing(area.topLeft()) * scale, area.size() * (scale / zoom_));
+
+    const int first_x = static_cast<int>(std::floor(level_area.left() / TILE_SIZE));
+    const int last_x = static_cast<int>(std::floor(level_area.right() / TILE_SIZE));
+    const int first_y = static_cast<int>(std::floor(level_area.top() / TILE_SIZE));
+    const int last_y = static_cast<int>(std::floor(level_area.bottom() / TILE_SIZE));
+
+    painter->save();
+    painter->translate(pan_);
+    painter->scale(zoom_ / scale, zoom_ / scale);
+    if (zoom_ != scale) {
+        painter->setRenderHint(QPainter::SmoothPixmapTransform);
+    }
+
+    for (int tile_y = first_y; tile_y <= last_y; ++tile_y) {
+        for (int tile_x = first_x; tile_x <= last_x; ++tile_x) {
+            const quint64 key = tile_key(level, tile_x, tile_y);
+            auto it = tiles_.find(key);
+            if (it == tiles_.end()) {
+                QImage image;
+                rasterize(level, tile_x, tile_y, image);
+                if (image.isNull()) {
+                    continue; // no lines in the tile
+                }
+                it = tiles_.emplace(key, Tile{std::move(image), level, tile_x, tile_y, 0}).first;
+            }
+            it->second.last_used_ = paint_count_;
+            painter->drawImage(QPointF(tile_x * TILE_SIZE, tile_y * TILE_SIZE), it->second.image_);
+        }
+    }
+
+    painter->restore();
+    evict_tiles();
+    perf::record(perf::Histogram::kPaintTime, timer.nsecsElapsed() / 1000);
+}
+
+void LineLayer::evict_tiles()
+{
+    if (static_cast<int>(tiles_.size()) <= MAX_CACHED_TILES) {
+        return;
+    }
+
+    // Tiles shown in the last paint are kept
+    std::vector<std::pair<quint64, quint64>> unused; // last use and key
+    for (const auto &entry : tiles_) {
+        if (entry.second.last_used_ != paint_count_) {
+            unused.emplace_back(entry.second.last_used_, entry.first);
+        }
+    }
+
+    const size_t count = std::min(unused.size(), tiles_.size() - MAX_CACHED_TILES);
+    std::nth_element(unused.begin(), unused.begin() + count, unused.end());
+    for (size_t i = 0; i < count; ++i) {
+        tiles_.erase(unused[i].second);
+    }
+}
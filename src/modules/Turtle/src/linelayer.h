@@ -0,0 +1,245 @@
+#ifndef LINELAYER_H
+#define LINELAYER_H
+
+#include <QImage>
+#include <QQuickPaintedItem>
+#include <unordered_map>
+
+#include "lodpyramid.h"
+#include "turtlecontrol.h"
+
+/**
+ * @brief Displays the lines drawn by a turtle from a cache of raster tiles.
+ *
+ * The drawing is shown through a viewport that can be panned and zoomed: a point of the
+ * drawing is displayed at point * zoom + pan. The lines are kept in a LodPyramid, and each
+ * zoom is drawn from the level whose scale is the closest one above the zoom, so zoomed out
+ * views only draw the simplified segments of the visible cells.
+ *
+ * The visible part of a level is rasterized into square tiles when it is first painted, and
+ * painting the item after that, e.g. after panning, only copies the tiles. When the turtle
+ * adds lines, they are painted into the cached tiles of level 0, while the tiles of the other
+ * levels touched by the lines are rasterized again when they are next shown. The least recently
+ * shown tiles are dropped when more than MAX_CACHED_TILES are cached. When the lines are
+ * replaced or cleared (loading a state, resetting the turtle) the tiles are rebuilt.
+ */
+class LineLayer : public QQuickPaintedItem
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    /// @brief The turtle whose lines are displayed.
+    Q_PROPERTY(TurtleControl *turtle_control READ turtle_control WRITE set_turtle_control NOTIFY turtle_control_changed FINAL)
+
+    /// @brief The scale the drawing is displayed at, between MIN_ZOOM and MAX_ZOOM.
+    Q_PROPERTY(qreal zoom READ zoom WRITE set_zoom NOTIFY view_changed FINAL)
+
+    /// @brief The position of the drawing's origin in the item.
+    Q_PROPERTY(QPointF pan READ pan WRITE set_pan NOTIFY view_changed FINAL)
+
+    /// @brief The level of the LodPyramid displayed at the current zoom.
+    Q_PROPERTY(int level READ level NOTIFY view_changed FINAL)
+
+public:
+    /// @brief Width and height of a tile in pixels.
+    static constexpr int TILE_SIZE = LodPyramid::CELL_SIZE;
+
+    /// @brief Maximum number of tiles kept in the cache.
+    static constexpr int MAX_CACHED_TILES = 256;
+
+    /// @brief The smallest zoom, displaying the coarsest level at its scale.
+    static constexpr qreal MIN_ZOOM = 1.0 / (1 << (LodPyramid::LEVEL_COUNT - 1));
+
+    /// @brief The largest zoom.
+    static constexpr qreal MAX_ZOOM = 16.0;
+
+    /**
+     * @brief Constructs an empty layer.
+     *
+     * @param parent The parent item.
+     */
+    explicit LineLayer(QQuickItem *parent = nullptr);
+
+    /// @brief Gets the turtle whose lines are displayed.
+    TurtleControl *turtle_control() const { return turtle_control_; }
+
+    /**
+     * @brief Sets the turtle whose lines are displayed.
+     *
+     * @param turtle_control The turtle, or nullptr to display nothing.
+     */
+    void set_turtle_control(TurtleControl *turtle_control);
+
+    /// @brief Gets the scale the drawing is displayed at.
+    qreal zoom() const { return zoom_; }
+
+    /**
+     * @brief Sets the scale the drawing is displayed at.
+     *
+     * @param zoom The scale, clamped between MIN_ZOOM and MAX_ZOOM.
+     */
+    void set_zoom(qreal zoom);
+
+    /// @brief Gets the position of the drawing's origin in the item.
+    QPointF pan() const { return pan_; }
+
+    /**
+     * @brief Sets the position of the drawing's origin in the item.
+     *
+     * @param pan The position.
+     */
+    void set_pan(const QPointF &pan);
+
+    /// @brief Gets the level displayed at the current zoom.
+    int level() const;
+
+    /**
+     * @brief Zooms while keeping a point of the item in place.
+     *
+     * @param point The point in item coordinates, e.g. the mouse position.
+     * @param factor The factor the zoom is multiplied by.
+     */
+    Q_INVOKABLE void zoom_at(const QPointF &point, qreal factor);
+
+    /**
+     * @brief Moves the drawing.
+     *
+     * @param delta The distance to move in item coordinates.
+     */
+    Q_INVOKABLE void pan_by(const QPointF &delta);
+
+    /// @brief Displays the drawing at its original position and scale.
+    Q_INVOKABLE void reset_view();
+
+    /**
+     * @brief Maps a point of the item to the drawing.
+     *
+     * @param point The point in item coordinates.
+     * @return The point in the coordinates of the turtle.
+     */
+    Q_INVOKABLE QPointF map_to_drawing(const QPointF &point) const;
+
+    /**
+     * @brief Maps a point of the drawing to the item.
+     *
+     * @param point The point in the coordinates of the turtle.
+     * @return The point in item coordinates.
+     */
+    Q_INVOKABLE QPointF map_from_drawing(const QPointF &point) const;
+
+    /// @brief Gets the number of cached tiles.
+    int tile_count() const { return static_cast<int>(tiles_.size()); }
+
+    /// @brief Gets the number of lines added to the pyramid.
+    int rasterized_count() const { return rasterized_count_; }
+
+    /// @brief Gets the multi-resolution geometry of the lines.
+    const LodPyramid &pyramid() const { return pyramid_; }
+
+    /**
+     * @brief Copies the tiles covering the area to repaint, rasterizing missing tiles.
+     *
+     * @param painter The painter of the item.
+     */
+    void paint(QPainter *painter) override;
+
+public slots:
+    /**
+     * @brief Adds the lines added since the last update to the pyramid and the cached tiles.
+     *
+     * Rebuilds all tiles if the lines were replaced. Called when the lines of the turtle change.
+     */
+    void update_tiles();
+
+    /**
+     * @brief Removes the last lines from the pyramid and the cached tiles.
+     *
+     * Only the tiles touched by the removed lines are rasterized again. Called when the
+     * turtle drops its last lines, e.g. on undo.
+     *
+     * @param count The number of remaining lines.
+     */
+    void truncate_tiles(int count);
+
+signals:
+    /// @brief Emitted when the turtle changes.
+    void turtle_control_changed();
+
+    /// @brief Emitted when the zoom or pan changes.
+    void view_changed();
+
+private:
+    /// @brief A rasterized tile.
+    struct Tile
+    {
+        QImage image_;      ///< The pixels of the tile.
+        int level_;         ///< The level of the tile.
+        int x_;             ///< The column of the tile.
+        int y_;             ///< The row of the tile.
+        quint64 last_used_; ///< The paint in which the tile was last shown.
+    };
+
+    TurtleControl *turtle_control_;          ///< The turtle whose lines are displayed.
+    LodPyramid pyramid_;                     ///< The lines at all levels of detail.
+    std::unordered_map<quint64, Tile> tiles_; ///< Tiles containing lines by tile_key().
+    int rasterized_count_;                   ///< Number of lines of the turtle in the pyramid.
+    Line last_rasterized_;                   ///< The last line in the pyramid, to detect replaced lines.
+    qreal zoom_;                             ///< The scale the drawing is displayed at.
+    QPointF pan_;                            ///< The position of the drawing's origin in the item.
+    quint64 paint_count_;                    ///< Number of paints, to find the least recently shown tiles.
+
+    /**
+     * @brief Returns the key of a tile in tiles_.
+     *
+     * @param level The level of the tile, may be negative.
+     * @param tile_x The column of the tile, may be negative.
+     * @param tile_y The row of the tile, may be negative.
+     */
+    static quint64 tile_key(int level, int tile_x, int tile_y);
+
+    /**
+     * @brief Rasterizes the segments of a tile.
+     *
+     * Levels below 0 are level 0 rasterized at scales above 1.
+     *
+     * @param level The level of the tile.
+     * @param tile_x The column of the tile.
+     * @param tile_y The row of the tile.
+     * @param image Receives the tile, or a null image if the tile has no segments.
+     */
+    void rasterize(int level, int tile_x, int tile_y, QImage &image) const;
+
+    /**
+     * @brief Paints segments into a tile.
+     *
+     * @param image The tile.
+     * @param level The level of the tile.
+     * @param tile_x The column of the tile.
+     * @param tile_y The row of the tile.
+     * @param indices The ascending indices of the segments of the cell containing the tile.
+     * @param first The index of the first segment to paint.
+     */
+    void paint_segments(QImage &image, int level, int tile_x, int tile_y,
+                        const std::vector<int> &indices, int first) const;
+
+    /**
+     * @brief Returns the cell of the pyramid containing a tile.
+     *
+     * @param level The level of the tile.
+     * @param tile The column or row of the tile.
+     * @return The column or row of the cell at level max(level, 0).
+     */
+    static int tile_cell(int level, int tile);
+
+    /**
+     * @brief Updates the cached tiles touched by changed geometry.
+     *
+     * @param changes The changes of the pyramid.
+     */
+    void apply_changes(const LodPyramid::Changes &changes);
+
+    /// @brief Drops the least recently shown tiles above MAX_CACHED_TILES.
+    void evict_tiles();
+};
+
+#endif // LINELAYER_H
@@ -0,0 +1,60 @@
+#include "linepainter.h"
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QPen>
+#include <QTextStream>
+#include "perf.hpp"
+#include "trace.hpp"
+
+void paint_lines(QPainter &painter, const QVector<Line> &lines)
+{
+    TRACE_SCOPE("paint_lines");
+    QElapsedTimer timer;
+    timer.start();
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    QPen pen(Qt::NoPen);
+    for (const Line &line : lines) {
+        // Consecutive lines usually share the pen, only update it on changes
+        if (pen.style() == Qt::NoPen || pen.color() != line.color_ || pen.widthF() != line.width_) {
+            pen = QPen(line.color_, line.width_, Qt::SolidLine, Qt::FlatCap);
+            painter.setPen(pen);
+        }
+        painter.drawLine(line.start_, line.end_);
+    }
+    perf::record(perf::Histogram::kPaintTime, timer.nsecsElapsed() / 1000);
+}
+
+QImage render_lines(const QVector<Line> &lines, const QSize &size, const QColor &background)
+{
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(background);
+
+    QPainter painter(&image);
+    paint_lines(painter, lines);
+    painter.end();
+    return image;
+}
+
+QString lines_to_svg(const QVector<Line> &lines, const QSize &size, const QColor &background)
+{
+    TRACE_SCOPE("lines_to_svg");
+    QString svg;
+    QTextStream out(&svg);
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << size.width() << "\" height=\""
+        << size.height() << "\" viewBox=\"0 0 " << size.width() << " " << size.height() << "\">\n";
+    if (background.isValid()) {
+        out << "<rect width=\"100%\" height=\"100%\" fill=\"" << background.name() << "\"/>\n";
+    }
+
+    out << "<g fill=\"none\" stroke-linecap=\"butt\">\n";
+    for (const Line &line : lines) {
+        out << "<line x1=\"" << line.start_.x() << "\" y1=\"" << line.start_.y() << "\" x2=\""
+            << line.end_.x() << "\" y2=\"" << line.end_.y() << "\" stroke=\"" << line.color_.name()
+            << "\" stroke-width=\"" << line.width_ << "\"/>\n";
+    }
+    out << "</g>\n</svg>\n";
+    return svg;
+}
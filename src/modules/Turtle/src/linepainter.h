@@ -0,0 +1,45 @@
+#ifndef LINEPAINTER_H
+#define LINEPAINTER_H
+
+#include <QColor>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "turtlecontrol.h"
+
+class QPainter;
+
+/**
+ * @brief Paints lines drawn by a turtle with a QPainter.
+ *
+ * The lines are stroked like the QML canvas of the application draws them:
+ * with flat caps and the width and color of each line.
+ *
+ * @param painter The painter to paint with.
+ * @param lines The lines to paint.
+ */
+void paint_lines(QPainter &painter, const QVector<Line> &lines);
+
+/**
+ * @brief Renders lines into a new image.
+ *
+ * @param lines The lines to render.
+ * @param size The size of the image in pixels.
+ * @param background The color the image is filled with before painting.
+ * @return The rendered image.
+ */
+QImage render_lines(const QVector<Line> &lines, const QSize &size, const QColor &background = Qt::white);
+
+/**
+ * @brief Converts lines into an SVG document.
+ *
+ * @param lines The lines to convert.
+ * @param size The size of the drawing.
+ * @param background The color of the background, or an invalid color for a transparent background.
+ * @return The SVG document.
+ */
+QString lines_to_svg(const QVector<Line> &lines, const QSize &size, const QColor &background = Qt::white);
+
+#endif // LINEPAINTER_H
@@ -0,0 +1,264 @@
+#include "lodpyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "gridcells.h"
+
+// Maximum deviation of a simplified level in pixels at its scale. The levels are simplified
+// from each other, so the deviations add up to less than twice this.
+constexpr qreal SIMPLIFY_TOLERANCE = 0.25;
+
+// Extra margin around a segment in pixels at the scale of its level, covering antialiased pixels
+constexpr qreal ANTIALIASING_MARGIN = 1.0;
+
+LodPyramid::LodPyramid()
+    : levels_()
+    , styles_()
+    , style_ids_()
+    , chunks_()
+    , chunk_points_()
+    , chunk_style_(0)
+    , b_chunk_changed_(false)
+{}
+
+void LodPyramid::clear()
+{
+    for (Level &level : levels_) {
+        level.segments_.clear();
+        level.cells_.clear();
+    }
+    styles_.clear();
+    style_ids_.clear();
+    chunks_.clear();
+    chunk_points_.clear();
+    b_chunk_changed_ = false;
+}
+
+quint64 LodPyramid::cell_key(int cell_x, int cell_y)
+{
+    return grid_cell_key(cell_x, cell_y);
+}
+
+qreal LodPyramid::level_scale(int level)
+{
+    return std::ldexp(1.0, -level);
+}
+
+const std::vector<int> *LodPyramid::cell(int level, int cell_x, int cell_y) const
+{
+    const auto &cells = levels_[level].cells_;
+    auto it = cells.find(cell_key(cell_x, cell_y));
+    return it != cells.end() ? &it->second : nullptr;
+}
+
+quint32 LodPyramid::style_id(const QColor &color, float width)
+{
+    quint32 width_bits;
+    std::memcpy(&width_bits, &width, sizeof(width_bits));
+    const quint64 key = (static_cast<quint64>(color.rgba()) << 32) | width_bits;
+
+    auto it = style_ids_.find(key);
+    if (it != style_ids_.end()) {
+        return it->second;
+    }
+    const quint32 id = static_cast<quint32>(styles_.size());
+    styles_.emplace_back(color, width);
+    style_ids_.emplace(key, id);
+    return id;
+}
+
+LodPyramid::Changes LodPyramid::append(const QVector<Line> &lines, int first)
+{
+    Changes changes;
+    changes.first_added_ = segment_count(0);
+    changes.b_removed_ = false;
+
+    for (int i = first; i < lines.size(); ++i) {
+        const Line &line = lines[i];
+        const quint32 style = style_id(line.color_, line.width_);
+
+        // Lines continuing the open chunk are added to it, others start a new chunk
+        const bool b_continues = !chunk_points_.empty()
+                                 && style == chunk_style_
+                                 && line.start_ == chunk_points_.back()
+                                 && static_cast<int>(chunk_points_.size()) < CHUNK_POINTS;
+        if (!b_continues) {
+            if (b_chunk_changed_) {
+                simplify_chunk(changes);
+            }
+            chunk_points_.assign(1, line.start_);
+            chunk_style_ = style;
+            Chunk chunk;
+            for (int level = 0; level < LEVEL_COUNT; ++level) {
+                chunk.first_segments_[level] = segment_count(level);
+            }
+            chunks_.push_back(chunk);
+        }
+        chunk_points_.push_back(line.end_);
+        b_chunk_changed_ = true;
+
+        add_segment(0, line.start_, line.end_, style, changes);
+    }
+
+    if (b_chunk_changed_) {
+        simplify_chunk(changes);
+    }
+    return changes;
+}
+
+LodPyramid::Changes LodPyramid::truncate(const QVector<Line> &lines, int count)
+{
+    Changes changes;
+    changes.first_added_ = segment_count(0);
+    changes.b_removed_ = false;
+    if (count >= segment_count(0)) {
+        return changes;
+    }
+
+    // Drop the chunks starting at or after the first removed line, the chunk holding the
+    // last remaining line is opened again
+    const auto removed = std::lower_bound(chunks_.begin(), chunks_.end(), count, [](const Chunk &chunk, int line) {
+        return chunk.first_segments_[0] < line;
+    });
+    chunks_.erase(removed, chunks_.end());
+
+    for (int level = 1; level < LEVEL_COUNT; ++level) {
+        remove_segments(level, chunks_.empty() ? 0 : chunks_.back().first_segments_[level], changes);
+    }
+    remove_segments(0, count, changes);
+    changes.first_added_ = count;
+    changes.b_removed_ = true;
+
+    chunk_points_.clear();
+    if (!chunks_.empty()) {
+        const int first = chunks_.back().first_segments_[0];
+        chunk_points_.push_back(lines[first].start_);
+        for (int i = first; i < count; ++i) {
+            chunk_points_.push_back(lines[i].end_);
+        }
+        chunk_style_ = segment(0, first).style_;
+        simplify_chunk(changes);
+    }
+    return changes;
+}
+
+void LodPyramid::simplify_chunk(Changes &changes)
+{
+    // Each level is simplified from the previous one, which gets cheaper as the levels get coarser
+    std::vector<QPointF> points = chunk_points_;
+    std::vector<QPointF> simplified;
+
+    for (int level = 1; level < LEVEL_COUNT; ++level) {
+        remove_segments(level, chunks_.back().first_segments_[level], changes);
+
+        simplify(points, SIMPLIFY_TOLERANCE / level_scale(level), simplified);
+        for (size_t i = 1; i < simplified.size(); ++i) {
+            add_segment(level, simplified[i - 1], simplified[i], chunk_style_, changes);
+        }
+        points.swap(simplified);
+    }
+    b_chunk_changed_ = false;
+}
+
+void LodPyramid::simplify(const std::vector<QPointF> &points, qreal tolerance, std::vector<QPointF> &result)
+{
+    result.clear();
+    if (points.size() <= 2) {
+        result = points;
+        return;
+    }
+
+    std::vector<char> keep(points.size(), 0);
+    keep.front() = 1;
+    keep.back() = 1;
+
+    // Ranges whose inner points are not decided yet, handled without recursion
+    std::vector<std::pair<size_t, size_t>> ranges = {{0, points.size() - 1}};
+    while (!ranges.empty()) {
+        const size_t first = ranges.back().first;
+        const size_t last = ranges.back().second;
+        ranges.pop_back();
+
+        const QPointF start = points[first];
+        const QPointF direction = points[last] - start;
+        const qreal length_squared = QPointF::dotProduct(direction, direction);
+
+        // Find the point farthest from the segment between the ends of the range
+        qreal max_distance = -1.0;
+        size_t farthest = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const QPointF offset = points[i] - start;
+            const qreal t = length_squared > 0.0
+                                ? std::clamp(QPointF::dotProduct(offset, direction) / length_squared, 0.0, 1.0)
+                                : 0.0;
+            const QPointF distance = offset - t * direction;
+            const qreal distance_squared = QPointF::dotProduct(distance, distance);
+            if (distance_squared > max_distance) {
+                max_distance = distance_squared;
+                farthest = i;
+            }
+        }
+
+        if (max_distance > tolerance * tolerance) {
+            keep[farthest] = 1;
+            if (farthest - first > 1) {
+                ranges.emplace_back(first, farthest);
+            }
+            if (last - farthest > 1) {
+                ranges.emplace_back(farthest, last);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) {
+            result.push_back(points[i]);
+        }
+    }
+}
+
+template<typename Visitor>
+QRectF LodPyramid::for_each_cell(int level, const LodSegment &segment, Visitor visit) const
+{
+    // The margin matches the pen of the line layer, which is at least one pixel wide
+    const qreal scale = level_scale(level);
+    const qreal margin = std::max<qreal>(width(segment.style_), 1.0 / scale) / 2.0 + ANTIALIASING_MARGIN / scale;
+    return for_each_grid_cell(segment.start(), segment.end(), margin, CELL_SIZE / scale,
+                              [&visit](int cell_x, int cell_y) { visit(cell_key(cell_x, cell_y)); });
+}
+
+void LodPyramid::add_segment(int level, const QPointF &start, const QPointF &end, quint32 style, Changes &changes)
+{
+    Level &target = levels_[level];
+    const int index = static_cast<int>(target.segments_.size());
+    target.segments_.push_back({static_cast<float>(start.x()), static_cast<float>(start.y()),
+                                static_cast<float>(end.x()), static_cast<float>(end.y()), style});
+
+    changes.area_ |= for_each_cell(level, target.segments_.back(), [&](quint64 key) {
+        target.cells_[key].push_back(index);
+        changes.cells_[level].insert(key);
+    });
+}
+
+void LodPyramid::remove_segments(int level, int first, Changes &changes)
+{
+    Level &target = levels_[level];
+    for (int i = static_cast<int>(target.segments_.size()) - 1; i >= first; --i) {
+        changes.area_ |= for_each_cell(level, target.segments_[i], [&](quint64 key) {
+            auto it = target.cells_.find(key);
+            if (it == target.cells_.end()) {
+                return;
+            }
+            // The removed segments are the last ones, so they are at the end of every cell
+            std::vector<int> &indices = it->second;
+            while (!indices.empty() && indices.back() >= first) {
+                indices.pop_back();
+            }
+            if (indices.empty()) {
+                target.cells_.erase(it);
+            }
+            changes.cells_[level].insert(key);
+        });
+    }
+    target.segments_.resize(first);
+}
@@ -0,0 +1,213 @@
+#ifndef LODPYRAMID_H
+#define LODPYRAMID_H
+
+#include <QColor>
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "turtlecontrol.h"
+
+/**
+ * @brief A line segment stored in a level of a LodPyramid.
+ *
+ * The coordinates are stored as floats to halve the memory of large drawings.
+ */
+struct LodSegment
+{
+    float x1_;       ///< The x coordinate of the start point.
+    float y1_;       ///< The y coordinate of the start point.
+    float x2_;       ///< The x coordinate of the end point.
+    float y2_;       ///< The y coordinate of the end point.
+    quint32 style_;  ///< The index of the color and width of the segment, see LodPyramid::color().
+
+    /// @brief Gets the start point.
+    QPointF start() const { return QPointF(x1_, y1_); }
+
+    /// @brief Gets the end point.
+    QPointF end() const { return QPointF(x2_, y2_); }
+};
+
+/**
+ * @brief Multi-resolution geometry of the lines drawn by a turtle.
+ *
+ * Level 0 holds the lines as they are. Each further level is meant to be displayed at half
+ * the scale of the previous one (level L at scale 2^-L), and holds the lines simplified with
+ * the Douglas-Peucker algorithm so that they deviate less than half a pixel at that scale.
+ * Consecutive lines of the same color and width form polylines, which are simplified in
+ * chunks of at most CHUNK_POINTS points, so appending lines only simplifies the open chunk again.
+ * Removing the last lines likewise only simplifies the chunk they end in again.
+ *
+ * The segments of every level are bucketed into square cells of CELL_SIZE pixels at the scale
+ * of the level, so the segments needed to draw an area at a level are found without looking at
+ * the others. The segment indices in a cell are in ascending order.
+ */
+class LodPyramid
+{
+public:
+    /// @brief The number of levels, the coarsest level is displayed at scale 2^-(LEVEL_COUNT - 1).
+    static constexpr int LEVEL_COUNT = 10;
+
+    /// @brief Width and height of a cell in pixels at the scale of its level.
+    static constexpr int CELL_SIZE = 256;
+
+    /// @brief Maximum number of points of a simplified polyline chunk.
+    static constexpr int CHUNK_POINTS = 256;
+
+    /**
+     * @brief The geometry changed by appending or removing lines.
+     */
+    struct Changes
+    {
+        std::array<std::unordered_set<quint64>, LEVEL_COUNT> cells_; ///< Keys of the changed cells of each level.
+        QRectF area_;      ///< The area covered by the added and removed segments, including their width.
+        int first_added_;  ///< Index of the first segment added to level 0.
+        bool b_removed_;   ///< True if segments were removed from level 0.
+    };
+
+    /// @brief Constructs an empty pyramid.
+    LodPyramid();
+
+    /// @brief Removes all lines.
+    void clear();
+
+    /**
+     * @brief Adds lines to all levels.
+     *
+     * @param lines The lines of the turtle.
+     * @param first The index of the first line to add.
+     * @return The changed cells and area.
+     */
+    Changes append(const QVector<Line> &lines, int first);
+
+    /**
+     * @brief Removes the last lines from all levels.
+     *
+     * @param lines The lines of the turtle, at least the remaining ones.
+     * @param count The number of lines to keep.
+     * @return The changed cells and area.
+     */
+    Changes truncate(const QVector<Line> &lines, int count);
+
+    /**
+     * @brief Gets the number of segments of a level.
+     *
+     * @param level The level.
+     */
+    int segment_count(int level) const { return static_cast<int>(levels_[level].segments_.size()); }
+
+    /**
+     * @brief Gets a segment of a level.
+     *
+     * @param level The level.
+     * @param index The index of the segment.
+     */
+    const LodSegment &segment(int level, int index) const { return levels_[level].segments_[index]; }
+
+    /**
+     * @brief Gets the segments touching a cell.
+     *
+     * @param level The level.
+     * @param cell_x The column of the cell, may be negative.
+     * @param cell_y The row of the cell, may be negative.
+     * @return The ascending indices of the segments, or nullptr if the cell is empty.
+     */
+    const std::vector<int> *cell(int level, int cell_x, int cell_y) const;
+
+    /// @brief Gets the color of a segment style.
+    const QColor &color(quint32 style) const { return styles_[style].first; }
+
+    /// @brief Gets the width of a segment style.
+    float width(quint32 style) const { return styles_[style].second; }
+
+    /**
+     * @brief Returns the key of a cell in Changes::cells_.
+     *
+     * @param cell_x The column of the cell, may be negative.
+     * @param cell_y The row of the cell, may be negative.
+     */
+    static quint64 cell_key(int cell_x, int cell_y);
+
+    /**
+     * @brief Returns the scale a level is displayed at.
+     *
+     * @param level The level, negative levels are level 0 displayed at scales above 1.
+     * @return 2^-level.
+     */
+    static qreal level_scale(int level);
+
+    /**
+     * @brief Simplifies a polyline with the Douglas-Peucker algorithm.
+     *
+     * @param points The points of the polyline.
+     * @param tolerance The maximum distance of the removed points from the result.
+     * @param result Receives the remaining points, including the first and last point.
+     */
+    static void simplify(const std::vector<QPointF> &points, qreal tolerance, std::vector<QPointF> &result);
+
+private:
+    /// @brief The segments of a level and the cells they touch.
+    struct Level
+    {
+        std::vector<LodSegment> segments_;                     ///< The segments.
+        std::unordered_map<quint64, std::vector<int>> cells_;  ///< Ascending segment indices by cell_key().
+    };
+
+    std::array<Level, LEVEL_COUNT> levels_;          ///< The levels, finest first.
+    std::vector<std::pair<QColor, float>> styles_;   ///< Color and width of each style.
+    std::unordered_map<quint64, quint32> style_ids_; ///< Style indices by color and width.
+
+    /// @brief Where a polyline chunk starts in the levels.
+    struct Chunk
+    {
+        std::array<int, LEVEL_COUNT> first_segments_; ///< Index of the first segment in each level, the first line in level 0.
+    };
+
+    std::vector<Chunk> chunks_;                      ///< The chunks in the order of their lines, the last one is open.
+    std::vector<QPointF> chunk_points_;              ///< The points of the open polyline chunk.
+    quint32 chunk_style_;                            ///< The style of the open chunk.
+    bool b_chunk_changed_;                           ///< True if the open chunk has points not yet simplified.
+
+    /**
+     * @brief Returns the style index of a color and width, adding the style if it is new.
+     */
+    quint32 style_id(const QColor &color, float width);
+
+    /**
+     * @brief Simplifies the open chunk into the levels above 0, replacing its previous segments.
+     *
+     * @param changes Receives the changed cells and area.
+     */
+    void simplify_chunk(Changes &changes);
+
+    /**
+     * @brief Adds a segment to a level and its cells.
+     */
+    void add_segment(int level, const QPointF &start, const QPointF &end, quint32 style, Changes &changes);
+
+    /**
+     * @brief Removes the last segments of a level from the level and their cells.
+     *
+     * @param level The level.
+     * @param first The index of the first segment to remove.
+     * @param changes Receives the changed cells and area.
+     */
+    void remove_segments(int level, int first, Changes &changes);
+
+    /**
+     * @brief Calls a function with the key of every cell a segment touches.
+     *
+     * @param level The level of the segment.
+     * @param segment The segment.
+     * @param visit The function called with each cell key.
+     * @return The area covered by the segment, including its width.
+     */
+    template<typename Visitor>
+    QRectF for_each_cell(int level, const LodSegment &segment, Visitor visit) const;
+};
+
+#endif // LODPYRAMID_H
@@ -1,15 +1,54 @@
 #include "turtlecontrol.h"
 #include <QLineF>
-#include <QParallelAnimationGroup>
-#include <QPropertyAnimation>
 #include <QRandomGenerator64>
+#include <QTimer>
 #include <QtMath>
+#include <algorithm>
+#include <limits>
+#include <thread>
 #include "canvas.hpp"
+#include "lineindex.h"
 #include "obstacle.hpp"
+#include "parallel.hpp"
+#include "perf.hpp"
+#include "trace.hpp"
 
 // Correlation between degrees and radians
 constexpr float DEGREES_TO_RADIANS = M_PI / 180.0f;
 
+// Duration of one simulation clock step in milliseconds (60 steps per simulated second)
+constexpr float CLOCK_TIME_STEP = 1000.f / 60.f;
+
+// Upper limit for the clock steps of a single movement (e.g. when the speed is 0)
+constexpr double MAX_MOTION_STEPS = 1e7;
+
+// Arcs with a smaller radius do not move the turtle
+constexpr float MIN_ARC_RADIUS = 0.001f;
+
+// Segments of a batch below which expanding them on another thread does not pay off
+constexpr qint64 MIN_SEGMENTS_PER_THREAD = 16384;
+
+// Number of whole clock steps needed to play a movement of the given duration
+static int steps_for_duration(float duration, float time_step)
+{
+    const double steps = std::ceil(static_cast<double>(duration) / time_step);
+    return static_cast<int>(std::max(1.0, std::min(steps, MAX_MOTION_STEPS)));
+}
+
+// Number of threads sharing the expansion of the given number of segments
+static int expansion_threads(qint64 segments)
+{
+    const qint64 threads = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<int>(std::clamp<qint64>(segments / MIN_SEGMENTS_PER_THREAD, 1, threads));
+}
+
+// Publishes the size of the line storage to the performance counters
+static void publish_line_stats(const QVector<Line> &lines)
+{
+    perf::set(perf::Gauge::kLinesStored, lines.size());
+    perf::set(perf::Gauge::kLineStorageBytes, static_cast<qint64>(lines.capacity()) * sizeof(Line));
+}
+
 TurtleControl::TurtleControl(QObject *parent)
     : QObject(parent)
     , position_(QPointF(450.f, 450.f))
@@ -20,15 +59,43 @@ TurtleControl::TurtleControl(QObject *parent)
     , pen_radius_(3.f)
     , pen_color_(Qt::black)
     , lines_(QVector<Line>())
-    , current_anim_(nullptr)
+    , line_index_(std::make_unique<LineIndex>(lines_))
+    , b_self_collision_(false)
+    , history_()
+    , history_position_(0)
+    , redo_lines_()
+    , history_locks_(0)
+    , lines_generation_(0)
+    , motion_()
+    , b_moving_(false)
+    , b_realtime_(true)
+    , time_step_(CLOCK_TIME_STEP)
+    , simulation_steps_(0)
+    , clock_(new QTimer(this))
+    , clock_time_()
+    , clock_steps_(0)
     , canvas_(nullptr)
     , previous_position_(position_)
     , previous_rotation_(rotation_)
     , shape_(QPolygonF())
+    , saved_states_()
+    , batch_()
+    , batch_position_(0)
+    , b_batch_running_(false)
+    , b_batch_starting_(false)
+    , b_batch_blocked_(false)
 {
     update_shape();
+
+    // The timer only paces the clock, the simulated time always advances by time_step_
+    // and catches up with the wall time, so the timer fires at least once per step
+    clock_->setTimerType(Qt::PreciseTimer);
+    clock_->setInterval(static_cast<int>(time_step_));
+    connect(clock_, &QTimer::timeout, this, &TurtleControl::tick);
 }
 
+TurtleControl::~TurtleControl() = default;
+
 void TurtleControl::set_position(QPointF position)
 {
     if (position_ == position)
@@ -39,20 +106,59 @@ void TurtleControl::set_position(QPointF position)
     emit position_changed();
 }
 
+void TurtleControl::set_canvas(Canvas *canvas)
+{
+    if (canvas_) {
+        disconnect(canvas_, nullptr, this, nullptr);
+        canvas_->release_clock(this);
+    }
+    canvas_ = canvas;
+    if (canvas_) {
+        canvas_->claim_clock(this);
+        connect(canvas_, &Canvas::moving_changed, this, &TurtleControl::update_clock);
+    }
+    update_clock();
+}
+
+void TurtleControl::set_realtime(bool b_realtime)
+{
+    if (b_realtime_ == b_realtime)
+        return;
+
+    b_realtime_ = b_realtime;
+    update_clock();
+    if (!b_realtime_) {
+        run_until_idle();
+    }
+    emit realtime_changed();
+}
+
+void TurtleControl::set_self_collision(bool b_self_collision)
+{
+    if (b_self_collision_ == b_self_collision)
+        return;
+
+    b_self_collision_ = b_self_collision;
+    emit self_collision_changed();
+}
+
 void TurtleControl::set_rotation(float rotation)
 {
     if (rotation_ == rotation)
         return;
 
+    rotation_ = normalized_rotation(rotation);
+    emit rotation_changed();
+}
+
+float TurtleControl::normalized_rotation(float rotation)
+{
     if (rotation >= 360.f) {
-        rotation_ = fmod(rotation, 360.f);
+        return fmod(rotation, 360.f);
     } else if (rotation <= 0.f) {
-        rotation_ = fmod(360.f + rotation, 360.f);
-    } else {
-        rotation_ = rotation;
+        return fmod(360.f + rotation, 360.f);
     }
-
-    emit rotation_changed();
+    return rotation;
 }
 
 void TurtleControl::set_pen_down(bool b_pen_down)
@@ -86,14 +192,6 @@ void TurtleControl::set_pen_color(const QColor &color)
     }
 }
 
-void TurtleControl::set_current_anim(QParallelAnimationGroup *anim)
-{
-    if (current_anim_) {
-        current_anim_->stop();
-    }
-    current_anim_ = anim;
-}
-
 Line TurtleControl::get_line(int index) const
 {
     if (index >= 0 && index < lines_.size()) {
@@ -102,16 +200,187 @@ Line TurtleControl::get_line(int index) const
     return Line(); // Return a default-initialized line
 }
 
+int TurtleControl::line_at(const QPointF &point, qreal max_distance) const
+{
+    return line_index_->nearest(point, max_distance);
+}
+
+void TurtleControl::mark_checkpoint()
+{
+    // A new command discards the undone ones
+    history_.resize(history_position_);
+    redo_lines_.clear();
+    history_.push_back(snapshot());
+    history_position_ = static_cast<int>(history_.size());
+    emit history_changed();
+}
+
+bool TurtleControl::undo()
+{
+    if (!can_undo() || b_moving_ || history_locked()) {
+        return false;
+    }
+
+    // Keep the current state, so the command can be redone
+    if (history_position_ == static_cast<int>(history_.size())) {
+        history_.push_back(snapshot());
+    }
+    --history_position_;
+    restore(history_[history_position_]);
+    emit history_changed();
+    return true;
+}
+
+bool TurtleControl::redo()
+{
+    if (!can_redo() || b_moving_ || history_locked()) {
+        return false;
+    }
+
+    ++history_position_;
+    restore(history_[history_position_]);
+    emit history_changed();
+    return true;
+}
+
+void TurtleControl::lock_history()
+{
+    ++history_locks_;
+}
+
+void TurtleControl::unlock_history()
+{
+    if (history_locks_ > 0) {
+        --history_locks_;
+    }
+}
+
+void TurtleControl::clear_history()
+{
+    if (history_.empty() && redo_lines_.empty()) {
+        return;
+    }
+    history_.clear();
+    history_position_ = 0;
+    redo_lines_.clear();
+    emit history_changed();
+}
+
+TurtleControl::Snapshot TurtleControl::snapshot() const
+{
+    return Snapshot{position_, rotation_, speed_, pen_radius_, pen_color_.rgba(), b_pen_down_, static_cast<int>(lines_.size()),
+                    saved_states_};
+}
+
+void TurtleControl::restore(const Snapshot &snapshot)
+{
+    TRACE_SCOPE("TurtleControl::restore");
+    const int count = snapshot.line_count_;
+    if (count < lines_.size()) {
+        // Move the lines of the undone command to the redo stack
+        redo_lines_.reserve(redo_lines_.size() + lines_.size() - count);
+        for (int i = count; i < lines_.size(); ++i) {
+            redo_lines_.append(lines_[i]);
+        }
+        line_index_->truncate(count);
+        lines_.resize(count);
+        ++lines_generation_;
+        publish_line_stats(lines_);
+        emit lines_truncated(count);
+        emit lines_changed();
+    } else if (count > lines_.size()) {
+        // Move the lines of the redone command back from the redo stack
+        const int first = redo_lines_.size() - (count - lines_.size());
+        Q_ASSERT(first >= 0);
+        for (int i = first; i < redo_lines_.size(); ++i) {
+            lines_.append(redo_lines_[i]);
+        }
+        redo_lines_.resize(first);
+        line_index_->update();
+        publish_line_stats(lines_);
+        emit lines_changed();
+    }
+    restore_pose(snapshot);
+}
+
+void TurtleControl::rewind(const Snapshot &snapshot)
+{
+    TRACE_SCOPE("TurtleControl::rewind");
+    const int count = snapshot.line_count_;
+    Q_ASSERT(count <= lines_.size());
+    if (count < lines_.size()) {
+        // The checkpoints and redo stack refer to the discarded lines
+        clear_history();
+        line_index_->truncate(count);
+        lines_.resize(count);
+        ++lines_generation_;
+        publish_line_stats(lines_);
+        emit lines_truncated(count);
+        emit lines_changed();
+    }
+    restore_pose(snapshot);
+}
+
+void TurtleControl::restore_pose(const Snapshot &snapshot)
+{
+    set_speed(snapshot.speed_);
+    set_pen_radius(snapshot.pen_radius_);
+    set_pen_color(QColor::fromRgba(snapshot.pen_color_));
+    set_pen_down(snapshot.b_pen_down_);
+    set_position(snapshot.position_);
+    set_rotation(snapshot.rotation_);
+    saved_states_ = snapshot.saved_states_;
+    previous_position_ = position_;
+    previous_rotation_ = rotation_;
+}
+
+int TurtleControl::erase_lines(const QRectF &rect)
+{
+    const std::vector<int> erased = line_index_->query(rect);
+    if (erased.empty()) {
+        return 0;
+    }
+
+    // Keep the other lines in their order
+    QVector<Line> kept;
+    kept.reserve(lines_.size() - static_cast<int>(erased.size()));
+    auto next_erased = erased.begin();
+    for (int i = 0; i < lines_.size(); ++i) {
+        if (next_erased != erased.end() && *next_erased == i) {
+            ++next_erased;
+        } else {
+            kept.append(lines_[i]);
+        }
+    }
+    lines_ = kept;
+    line_index_->rebuild();
+    ++lines_generation_;
+    clear_history();
+    publish_line_stats(lines_);
+    emit lines_changed();
+    return static_cast<int>(erased.size());
+}
+
 QPointF TurtleControl::get_forward_vector() const
 {
-    const float forward_rotation = rotation_ - 90.f;
+    return forward_vector(rotation_);
+}
+
+QPointF TurtleControl::get_right_vector() const
+{
+    return right_vector(rotation_);
+}
+
+QPointF TurtleControl::forward_vector(float rotation)
+{
+    const float forward_rotation = rotation - 90.f;
     return QPointF(qCos(qDegreesToRadians(forward_rotation)),
                    qSin(qDegreesToRadians(forward_rotation)));
 }
 
-QPointF TurtleControl::get_right_vector() const
+QPointF TurtleControl::right_vector(float rotation)
 {
-    return QPointF(qCos(qDegreesToRadians(rotation_)), qSin(qDegreesToRadians(rotation_)));
+    return QPointF(qCos(qDegreesToRadians(rotation)), qSin(qDegreesToRadians(rotation)));
 }
 
 void TurtleControl::update_shape(const QPointF &translation_vector)
@@ -141,53 +410,73 @@ void TurtleControl::set_lines(const QVector<Line> &lines)
         return;
     }
     lines_ = lines; // Replace current lines with the passed
+    line_index_->rebuild();
+    ++lines_generation_;
+    clear_history();
+    publish_line_stats(lines_);
     previous_position_ = position_;
     emit lines_changed(); // Notify QML or other listeners that lines have changed
     
 }
 
-QVector<Line> TurtleControl::get_lines() const
+void TurtleControl::append_lines(const QVector<Line> &lines)
 {
-    return lines_; 
+    if (lines.empty()) {
+        return;
+    }
+    lines_.append(lines);
+    line_index_->update();
+    publish_line_stats(lines_);
+    previous_position_ = position_;
+    emit lines_changed();
 }
 
-bool TurtleControl::is_moving() const
+QVector<Line> TurtleControl::get_lines() const
 {
-    return current_anim_ && current_anim_->state() == QAbstractAnimation::State::Running;
+    return lines_; 
 }
 
 bool TurtleControl::test_collision()
 {
+    TRACE_SCOPE("TurtleControl::test_collision");
     QObject *hit_object = nullptr;
     QPolygonF hit_polygon;
 
+    perf::add(perf::Counter::kCollisionTests);
     if (canvas_) {
-        const QPolygonF turtle_polygon = get_shape();
-        const QPolygonF canvas_polygon = canvas_->get_shape();
-        if (canvas_polygon.intersects(turtle_polygon)) {
-            QVector<Obstacle *> obstacles = canvas_->get_obstacles();
-            for (const auto &obstacle : obstacles) {
-                const QPolygonF polygon = obstacle->get_points();
-                const float bounding_radius = obstacle->get_bounding_radius();
-                const float distance_to_center = QLineF(position_, obstacle->get_position()).length();
-                if (bounding_radius >= distance_to_center && polygon.intersects(turtle_polygon)) {
-                    hit_object = obstacle;
-                    hit_polygon = polygon;
-                    break;
-                }
+        // The snapshot stays unchanged while it is held, whatever happens to the canvas
+        const std::shared_ptr<const CollisionWorld> world = canvas_->collision_world();
+        const QPolygonF &turtle_polygon = get_shape();
+        if (!world->bounded() || world->shape().intersects(turtle_polygon)) {
+            int tested = 0; // counted locally, the counters are shared by all threads
+            const int hit = world->first_hit(turtle_polygon, &tested);
+            if (hit >= 0) {
+                hit_object = world->body(hit).obstacle_;
+                hit_polygon = world->body(hit).polygon_;
             }
+            perf::add(perf::Counter::kObstaclesTested, tested);
+            perf::add(perf::Counter::kObstaclesCulled, world->obstacle_count() - tested);
         } else {
             hit_object = canvas_;
-            hit_polygon = canvas_polygon;
+            hit_polygon = world->shape();
+        }
+    }
+
+    // The segment about to be drawn must not cross the lines drawn before
+    if (!hit_object && b_self_collision_ && b_pen_down_ && previous_position_ != position_) {
+        const int crossed = line_index_->first_crossing(previous_position_, position_);
+        if (crossed >= 0) {
+            hit_object = this;
+            hit_polygon = QPolygonF({lines_[crossed].start_, lines_[crossed].end_});
         }
     }
 
     if (hit_object) {
-        set_current_anim(nullptr);
+        stop_motion();
         set_position(previous_position_);
         set_rotation(previous_rotation_);
 
-        emit on_movement_completed(MovementResult::kBlocked);
+        complete_motion(MovementResult::kBlocked);
         emit on_collision(hit_object, hit_polygon);
         return true;
     }
@@ -197,6 +486,7 @@ bool TurtleControl::test_collision()
 
 void TurtleControl::update_lines()
 {
+    TRACE_SCOPE("TurtleControl::update_lines");
     if (previous_position_ == position_) {
         return;
     }
@@ -207,49 +497,164 @@ void TurtleControl::update_lines()
                          pen_color_,
                          pen_radius_}; // Create a new line at the start of the movement
         lines_.append(new_line);       // Append the new line at the start
+        line_index_->update();
+        publish_line_stats(lines_);
         emit lines_changed();          // Notify QML to redraw
     }
 }
 
-void TurtleControl::anim_value_changed()
+void TurtleControl::start_motion(const Motion &motion)
+{
+    perf::add(perf::Counter::kMovesExecuted);
+    motion_ = motion;
+    b_moving_ = true;
+
+    if (b_realtime_) {
+        update_clock();
+    } else {
+        run_until_idle();
+    }
+}
+
+void TurtleControl::stop_motion()
+{
+    b_moving_ = false;
+    update_clock();
+}
+
+void TurtleControl::start_clock()
 {
-    if (!current_anim_) {
+    clock_time_.start();
+    clock_steps_ = 0;
+    clock_->start();
+}
+
+void TurtleControl::update_clock()
+{
+    // Only the owner of the canvas clock runs it for the obstacles, claiming it again takes
+    // over from an owner deleted since
+    const bool b_moves_obstacles = canvas_ && canvas_->has_moving_obstacles() && canvas_->claim_clock(this);
+    if ((b_realtime_ && b_moving_) || b_moves_obstacles) {
+        // Already running for the obstacles, the movement joins their steps
+        if (!clock_->isActive()) {
+            start_clock();
+        }
+    } else {
+        clock_->stop();
+    }
+}
+
+void TurtleControl::tick()
+{
+    // Recomputed after every step, as a step may complete the movement and start the next one
+    const auto due_steps = [this]() {
+        return static_cast<qint64>(clock_time_.nsecsElapsed() / (time_step_ * 1e6));
+    };
+    while (clock_->isActive() && clock_steps_ < due_steps()) {
+        ++clock_steps_;
+        step();
+    }
+}
+
+void TurtleControl::finish_motion()
+{
+    stop_motion();
+    complete_motion(MovementResult::kSuccess);
+}
+
+void TurtleControl::complete_motion(MovementResult result)
+{
+    if (!b_batch_running_) {
+        emit on_movement_completed(result);
         return;
     }
 
-    // if (current_anim_->animationCount() > 1) {
-    //     // Do stuff here
-    // }
+    // A batch reports its completion once, after its last movement
+    b_batch_blocked_ = b_batch_blocked_ || result == MovementResult::kBlocked;
+    if (!b_batch_starting_) {
+        run_batch_motions();
+    }
+}
 
-    if (!test_collision()) {
-        update_lines();
-        previous_position_ = position_;
-        previous_rotation_ = rotation_;
+QPointF TurtleControl::segment_position(const Motion &motion, int segment)
+{
+    // The last segment lands exactly on the target to avoid accumulating rounding errors
+    if (segment >= motion.segments_) {
+        return motion.end_position_;
+    }
+
+    const float progress = static_cast<float>(segment) / motion.segments_;
+    if (motion.degrees_ == 0.f) {
+        return motion.start_position_ + (motion.end_position_ - motion.start_position_) * progress;
+    }
+
+    // Circular movement around the arc center
+    const float start_radians = motion.start_rotation_ * DEGREES_TO_RADIANS;
+    const float rotation_radians = start_radians + motion.degrees_ * DEGREES_TO_RADIANS * progress;
+    const int b_move_clockwise = motion.degrees_ > 0.f ? -1 : 1;
+    const QPointF position_delta = b_move_clockwise * motion.radius_
+                                   * (QPointF(qCos(rotation_radians), qSin(rotation_radians))
+                                      - QPointF(qCos(start_radians), qSin(start_radians)));
+    return motion.start_position_ + position_delta;
+}
+
+float TurtleControl::segment_rotation(const Motion &motion, int segment)
+{
+    if (segment >= motion.segments_) {
+        return motion.start_rotation_ + motion.degrees_;
+    }
+    const float progress = static_cast<float>(segment) / motion.segments_;
+    return motion.start_rotation_ + motion.degrees_ * progress;
+}
+
+void TurtleControl::apply_motion_segment(int segment)
+{
+    set_position(segment_position(motion_, segment));
+    if (motion_.degrees_ != 0.f) {
+        set_rotation(segment_rotation(motion_, segment));
     }
 }
 
-void TurtleControl::anim_state_changed(QAbstractAnimation::State new_state,
-                                       QAbstractAnimation::State old_state)
+void TurtleControl::step()
 {
-    if (new_state == old_state) {
+    TRACE_SCOPE("TurtleControl::step");
+    // The obstacles move first, so the segments of this step are tested where they are now
+    if (canvas_ && canvas_->owns_clock(this)) {
+        canvas_->advance_obstacles(time_step_ / 1000.f);
+    }
+    if (!b_moving_) {
+        update_clock();
         return;
     }
 
-    switch (new_state) {
-    case QAbstractAnimation::State::Paused:
-        emit on_movement_completed(MovementResult::kPaused);
-        break;
-    default:
-    case QAbstractAnimation::State::Stopped:
-    case QAbstractAnimation::State::Running:
-        break;
+    ++simulation_steps_;
+    ++motion_.step_;
+
+    // Segments are spread evenly over the clock steps of the movement
+    const int target_segment = static_cast<int>(static_cast<qint64>(motion_.segments_)
+                                                * motion_.step_ / motion_.steps_);
+    perf::record(perf::Histogram::kCollisionTestsPerFrame, std::max(target_segment - motion_.segment_, 0));
+    while (motion_.segment_ < target_segment) {
+        ++motion_.segment_;
+        apply_motion_segment(motion_.segment_);
+        if (test_collision()) {
+            return;
+        }
+        update_lines();
+        previous_position_ = position_;
+        previous_rotation_ = rotation_;
+    }
+
+    if (motion_.step_ >= motion_.steps_) {
+        finish_motion();
     }
 }
 
-void TurtleControl::anim_finished()
+void TurtleControl::run_until_idle()
 {
-    set_current_anim(nullptr);
-    emit on_movement_completed(MovementResult::kSuccess);
+    while (b_moving_) {
+        step();
+    }
 }
 
 float TurtleControl::turn(float degrees)
@@ -259,11 +664,16 @@ float TurtleControl::turn(float degrees)
         return 0.001f;
     }
 
+    apply_turn(degrees);
+    emit on_movement_completed(MovementResult::kSuccess);
+    return 0.001f;
+}
+
+void TurtleControl::apply_turn(float degrees)
+{
     const float new_rotation = rotation_ + degrees;
     previous_rotation_ = new_rotation;
     set_rotation(new_rotation);
-    emit on_movement_completed(MovementResult::kSuccess);
-    return 0.001f;
 }
 
 float TurtleControl::forward(float distance)
@@ -273,27 +683,30 @@ float TurtleControl::forward(float distance)
         return 0.001f;
     }
 
-    const QPointF new_position = position_ + get_forward_vector() * distance;
-    const float duration = QLineF(position_, new_position).length() * 1000.f / speed_;
-
-    // Creating an animation group that will play multiple animations
-    QParallelAnimationGroup *group = new QParallelAnimationGroup;
-
-    // Animating the forward movement
-    QPropertyAnimation *anim = new QPropertyAnimation(this, "position", this);
-    anim->setDuration(duration);
-    anim->setStartValue(position_);
-    anim->setEndValue(new_position);
-    group->addAnimation(anim);
+    const Motion motion = forward_motion(position_, rotation_, distance);
+    start_motion(motion);
+    return motion.duration_;
+}
 
-    // Handling animation progress
-    connect(anim, &QPropertyAnimation::valueChanged, this, &TurtleControl::anim_value_changed);
-    connect(group, &QParallelAnimationGroup::stateChanged, this, &TurtleControl::anim_state_changed);
-    connect(group, &QParallelAnimationGroup::finished, this, &TurtleControl::anim_finished);
+TurtleControl::Motion TurtleControl::forward_motion(const QPointF &position, float rotation,
+                                                    float distance) const
+{
+    const QPointF new_position = position + forward_vector(rotation) * distance;
+    const float duration = QLineF(position, new_position).length() * 1000.f / speed_;
+    const int steps = steps_for_duration(duration, time_step_);
 
-    current_anim_ = group;
-    group->start(QParallelAnimationGroup::DeleteWhenStopped);
-    return duration;
+    Motion motion;
+    motion.start_position_ = position;
+    motion.end_position_ = new_position;
+    motion.start_rotation_ = rotation;
+    motion.degrees_ = 0.f;
+    motion.radius_ = 0.f;
+    motion.duration_ = duration;
+    motion.steps_ = steps;
+    motion.segments_ = steps;
+    motion.step_ = 0;
+    motion.segment_ = 0;
+    return motion;
 }
 
 float TurtleControl::arc(float radius, float degrees)
@@ -303,68 +716,314 @@ float TurtleControl::arc(float radius, float degrees)
         return 0.001f;
     }
 
-    if (radius < 0.001f) {
-        anim_finished();
+    if (radius < MIN_ARC_RADIUS) {
+        emit on_movement_completed(MovementResult::kSuccess);
         return 0.001f;
     }
 
+    const Motion motion = arc_motion(position_, rotation_, radius, degrees);
+    start_motion(motion);
+    return motion.duration_;
+}
+
+TurtleControl::Motion TurtleControl::arc_motion(const QPointF &position, float rotation,
+                                                float radius, float degrees) const
+{
     // Correlation between the arc and a full circle
     const float arc_factor = std::abs(degrees) / 360.f;
     const float path_length = arc_factor * 2 * M_PI * radius;
     const float duration = path_length / speed_ * 1000.f;
-    const float rotation_radians = rotation_ * DEGREES_TO_RADIANS;
-    const float new_rotation = rotation_ + degrees;
-    const float degrees_radians = degrees * DEGREES_TO_RADIANS;
-    const float new_rotation_radians = new_rotation * DEGREES_TO_RADIANS;
+    const float new_rotation_radians = (rotation + degrees) * DEGREES_TO_RADIANS;
     const int b_move_clockwise = degrees > 0.f ? -1 : 1;
-    const QPointF new_position = position_
+    const QPointF new_position = position
                                  + b_move_clockwise * radius
                                        * (QPointF(qCos(new_rotation_radians),
                                                   qSin(new_rotation_radians))
-                                          - get_right_vector());
-
-    // Creating an animation group that will play multiple animations
-    QParallelAnimationGroup *group = new QParallelAnimationGroup;
-
-    // Rotation anim
-    QPropertyAnimation *rotation_anim = new QPropertyAnimation(this, "rotation", this);
-    rotation_anim->setDuration(duration);
-    rotation_anim->setStartValue(rotation_);
-    rotation_anim->setEndValue(new_rotation);
-    group->addAnimation(rotation_anim);
-
-    // Position anim
-    QPropertyAnimation *position_anim = new QPropertyAnimation(this, "position", this);
-    position_anim->setDuration(duration);
-    position_anim->setStartValue(position_);
-    // Setting position values describing a circular movement
-    const float step_delta = 1.f / (arc_segments_ * arc_factor);
-    for (float step = 0.f; step < 1.f; step += step_delta) {
-        const float rotation_delta = rotation_radians + degrees_radians * step;
-        const QPointF position_delta = b_move_clockwise * radius
-                                       * (QPointF(qCos(rotation_delta), qSin(rotation_delta))
-                                          - get_right_vector());
-        position_anim->setKeyValueAt(step, position_ + position_delta);
-    }
-    position_anim->setEndValue(new_position);
-    group->addAnimation(position_anim);
-
-    // Handling animation progress
-    connect(position_anim,
-            &QPropertyAnimation::valueChanged,
-            this,
-            &TurtleControl::anim_value_changed);
-    // Uncomment belowto signal rotation updates
-    // connect(rotation_anim,
-    //         &QPropertyAnimation::valueChanged,
-    //         this,
-    //         &TurtleControl::anim_value_changed);
-    connect(group, &QParallelAnimationGroup::stateChanged, this, &TurtleControl::anim_state_changed);
-    connect(group, &QParallelAnimationGroup::finished, this, &TurtleControl::anim_finished);
-
-    current_anim_ = group;
-    group->start(QParallelAnimationGroup::DeleteWhenStopped);
-    return duration;
+                                          - right_vector(rotation));
+    const int steps = steps_for_duration(duration, time_step_);
+    // Fast arcs still get at least the configured number of segments per circle
+    const int segments = std::max(steps, steps_for_duration(arc_segments_ * arc_factor, 1.f));
+
+    Motion motion;
+    motion.start_position_ = position;
+    motion.end_position_ = new_position;
+    motion.start_rotation_ = rotation;
+    motion.degrees_ = degrees;
+    motion.radius_ = radius;
+    motion.duration_ = duration;
+    motion.steps_ = steps;
+    motion.segments_ = segments;
+    motion.step_ = 0;
+    motion.segment_ = 0;
+    return motion;
+}
+
+void TurtleControl::push_state()
+{
+    saved_states_.emplace_back(position_, rotation_);
+}
+
+void TurtleControl::pop_state()
+{
+    if (saved_states_.empty()) {
+        return;
+    }
+
+    const std::pair<QPointF, float> state = saved_states_.back();
+    saved_states_.pop_back();
+    set_position(state.first);
+    set_rotation(state.second);
+    // The jump back is not a segment, so it draws no line
+    previous_position_ = position_;
+    previous_rotation_ = rotation_;
+}
+
+void TurtleControl::run_motion_batch(const MotionBatch &batch)
+{
+    TRACE_SCOPE("TurtleControl::run_motion_batch");
+    if (is_moving() || b_batch_running_) {
+        emit on_movement_completed(MovementResult::kFailure);
+        return;
+    }
+
+    if (expand_motions(batch)) {
+        emit on_movement_completed(MovementResult::kSuccess);
+        return;
+    }
+
+    batch_ = batch;
+    batch_position_ = 0;
+    b_batch_running_ = true;
+    b_batch_blocked_ = false;
+    run_batch_motions();
+}
+
+void TurtleControl::run_batch_motions()
+{
+    // Movements completing instantly are continued by this loop, not by complete_motion
+    b_batch_starting_ = true;
+    while (batch_position_ < batch_.size()) {
+        const size_t i = batch_position_++;
+        const float length = batch_.lengths_[i];
+        const float degrees = batch_.degrees_[i];
+        switch (batch_.kinds_[i]) {
+        case MotionBatch::kForward:
+            start_motion(forward_motion(position_, rotation_, length));
+            break;
+        case MotionBatch::kTurn:
+            apply_turn(degrees);
+            break;
+        case MotionBatch::kArc:
+            if (length >= MIN_ARC_RADIUS) {
+                start_motion(arc_motion(position_, rotation_, length, degrees));
+            }
+            break;
+        case MotionBatch::kPush:
+            push_state();
+            break;
+        case MotionBatch::kPop:
+            pop_state();
+            break;
+        }
+
+        if (b_moving_) {
+            b_batch_starting_ = false;
+            return; // animated, complete_motion continues the batch
+        }
+    }
+    b_batch_starting_ = false;
+
+    b_batch_running_ = false;
+    batch_.clear();
+    emit on_movement_completed(b_batch_blocked_ ? MovementResult::kBlocked : MovementResult::kSuccess);
+}
+
+bool TurtleControl::expand_motions(const MotionBatch &batch)
+{
+    TRACE_SCOPE("TurtleControl::expand_motions");
+    // Animated movements, collisions with the own lines and moving obstacles depend on each segment in turn
+    if (b_realtime_ || b_self_collision_ || (canvas_ && canvas_->has_moving_obstacles())) {
+        return false;
+    }
+
+    // Chain the poses in order, exactly as running the movements one by one would, as
+    // reassociating the sums would change the rounding of the positions and rotations
+    std::vector<Motion> motions;
+    std::vector<QPointF> motion_previous; // where the first line of each movement starts
+    std::vector<QRectF> motion_bounds;
+    std::vector<qint64> first_segments(1, 0); // prefix sums of the segment counts
+    std::vector<std::pair<QPointF, float>> saved_states = saved_states_;
+    QPointF position = position_;
+    QPointF previous_position = previous_position_;
+    float rotation = rotation_;
+    float previous_rotation = previous_rotation_;
+    quint64 steps = 0;
+    const qreal margin = pen_radius_ + 1.0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const float length = batch.lengths_[i];
+        const float degrees = batch.degrees_[i];
+        if (batch.kinds_[i] == MotionBatch::kTurn) {
+            previous_rotation = rotation + degrees;
+            if (rotation != previous_rotation) {
+                rotation = normalized_rotation(previous_rotation);
+            }
+            continue;
+        }
+        if (batch.kinds_[i] == MotionBatch::kPush) {
+            saved_states.emplace_back(position, rotation);
+            continue;
+        }
+        if (batch.kinds_[i] == MotionBatch::kPop) {
+            if (!saved_states.empty()) {
+                position = saved_states.back().first;
+                if (rotation != saved_states.back().second) {
+                    rotation = normalized_rotation(saved_states.back().second);
+                }
+                saved_states.pop_back();
+                previous_position = position;
+                previous_rotation = rotation;
+            }
+            continue;
+        }
+        if (batch.kinds_[i] == MotionBatch::kArc && length < MIN_ARC_RADIUS) {
+            continue;
+        }
+
+        Motion motion;
+        QRectF bounds;
+        if (batch.kinds_[i] == MotionBatch::kForward) {
+            motion = forward_motion(position, rotation, length);
+            bounds = QRectF(motion.start_position_, motion.end_position_).normalized();
+        } else {
+            motion = arc_motion(position, rotation, length, degrees);
+            // The circle of the arc lies within twice its radius around the start
+            bounds = QRectF(position, position).adjusted(-2 * length, -2 * length, 2 * length, 2 * length);
+            for (int segment = 1; segment <= motion.segments_; ++segment) {
+                const float requested = segment_rotation(motion, segment);
+                if (rotation != requested) {
+                    rotation = normalized_rotation(requested);
+                }
+            }
+        }
+        motion_previous.push_back(previous_position);
+        position = motion.end_position_;
+        previous_position = position;
+        previous_rotation = rotation;
+        steps += motion.steps_;
+        motions.push_back(motion);
+        motion_bounds.push_back(bounds.adjusted(-margin, -margin, margin, margin));
+        first_segments.push_back(first_segments.back() + motion.segments_);
+    }
+    const qint64 segment_count = first_segments.back();
+    if (segment_count > std::numeric_limits<int>::max() - lines_.size()) {
+        return false;
+    }
+
+    // Without any possible collision, the segments need not be tested one by one
+    if (canvas_) {
+        QRectF path_bounds;
+        for (const QRectF &bounds : motion_bounds) {
+            path_bounds |= bounds;
+        }
+        const std::shared_ptr<const CollisionWorld> world = canvas_->collision_world();
+        if (world->bounded() && !motion_bounds.empty() && !world->bounds().contains(path_bounds)) {
+            return false;
+        }
+        if (world->intersects(path_bounds)) {
+            for (const QRectF &bounds : motion_bounds) {
+                if (world->intersects(bounds)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    if (segment_count > 0 && b_pen_down_) {
+        // Global segment g ends at the position of segment g - first_segments[m] + 1 of motion m
+        const auto motion_of = [&first_segments](qint64 segment) {
+            return static_cast<size_t>(std::upper_bound(first_segments.begin(), first_segments.end(), segment)
+                                       - first_segments.begin() - 1);
+        };
+        const auto position_before = [&](qint64 segment, size_t m) {
+            if (segment == first_segments[m]) {
+                return motion_previous[m];
+            }
+            return segment_position(motions[m], static_cast<int>(segment - first_segments[m]));
+        };
+
+        // Pass 1: the segment positions, and how many of them move and so draw a line
+        const int threads = expansion_threads(segment_count);
+        std::vector<qreal> xs(segment_count);
+        std::vector<qreal> ys(segment_count);
+        std::vector<qint64> drawn(threads + 1, 0);
+        parallel_ranges(segment_count, threads, [&](qint64 first, qint64 last, int range) {
+            if (first == last) {
+                return;
+            }
+            size_t m = motion_of(first);
+            QPointF previous = position_before(first, m);
+            qint64 count = 0;
+            for (qint64 g = first; g < last; ++g) {
+                while (g >= first_segments[m + 1]) {
+                    ++m;
+                    previous = motion_previous[m];
+                }
+                const QPointF position = segment_position(motions[m], static_cast<int>(g - first_segments[m] + 1));
+                xs[g] = position.x();
+                ys[g] = position.y();
+                count += position != previous;
+                previous = position;
+            }
+            drawn[range + 1] = count;
+        });
+        for (int range = 0; range < threads; ++range) {
+            drawn[range + 1] += drawn[range];
+        }
+
+        // Pass 2: each range writes its lines behind those of the ranges before it
+        const qsizetype line_offset = lines_.size();
+        lines_.resize(line_offset + drawn[threads]);
+        Line *const lines = lines_.data() + line_offset;
+        const QColor color = pen_color_;
+        const float width = pen_radius_;
+        parallel_ranges(segment_count, threads, [&](qint64 first, qint64 last, int range) {
+            if (first == last) {
+                return;
+            }
+            size_t m = motion_of(first);
+            QPointF previous = position_before(first, m);
+            Line *out = lines + drawn[range];
+            for (qint64 g = first; g < last; ++g) {
+                while (g >= first_segments[m + 1]) {
+                    ++m;
+                    previous = motion_previous[m];
+                }
+                const QPointF position(xs[g], ys[g]);
+                if (position != previous) {
+                    *out++ = Line(previous, position, color, width);
+                }
+                previous = position;
+            }
+        });
+
+        if (drawn[threads] > 0) {
+            line_index_->update();
+            publish_line_stats(lines_);
+            emit lines_changed();
+        }
+    }
+
+    perf::add(perf::Counter::kMovesExecuted, motions.size());
+    simulation_steps_ += steps;
+    set_position(position);
+    if (rotation_ != rotation) {
+        rotation_ = rotation;
+        emit rotation_changed();
+    }
+    previous_position_ = previous_position;
+    previous_rotation_ = previous_rotation;
+    saved_states_ = std::move(saved_states);
+    return true;
 }
 
 void TurtleControl::on_clicked()
@@ -390,6 +1049,10 @@ void TurtleControl::on_clicked()
 
 void TurtleControl::reset_state()
 {
+    stop_motion();
+    b_batch_running_ = false;
+    batch_.clear();
+    saved_states_.clear();
     TurtleControl::set_pen_down(false);
     // Set the position to (450, 450)
     position_ = QPointF(450, 450);
@@ -401,6 +1064,10 @@ void TurtleControl::reset_state()
 
     // Clear the lines vector
     lines_.clear();
+    line_index_->clear();
+    ++lines_generation_;
+    clear_history();
+    publish_line_stats(lines_);
     emit lines_changed();
     
     // Ensure that the Parser will not get blocked when resetting the state while running a script
@@ -2,15 +2,21 @@
 #define TURTLECONTROL_H
 
 #include <QColor>
+#include <QElapsedTimer>
 #include <QObject>
-#include <QParallelAnimationGroup>
 #include <QPoint>
 #include <QPolygon>
 #include <QQmlEngine>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "motionbatch.hpp"
 
 class Canvas;
+class LineIndex;
 Q_DECLARE_OPAQUE_POINTER(Canvas *);
 class QLine;
+class QTimer;
 
 /**
  * @brief A structure representing a line segment with customizable attributes.
@@ -59,6 +65,17 @@ enum MovementResult {
  * into QML-based applications. The class provides properties for position, 
  * rotation, pen state, radius, and color, along with methods to control 
  * the turtle's movement.
+ *
+ * Movements are driven by a fixed-step simulation clock. Every clock step advances the
+ * current movement by exactly the same amount of simulated time, so the resulting
+ * positions, collisions and lines only depend on the issued commands and never on the
+ * machine load. In realtime mode a timer paces the steps to the wall clock, otherwise
+ * a movement is simulated to completion as soon as it is issued.
+ *
+ * Commands can be undone and redone. Before each command a checkpoint records the number
+ * of lines and a small snapshot of the turtle state. Lines are only ever appended between
+ * checkpoints, so undoing a command moves its lines from the end of the lines vector to a
+ * redo stack and restores the snapshot, without copying or replaying the rest of the drawing.
  */
 class TurtleControl : public QObject
 {
@@ -83,7 +100,34 @@ class TurtleControl : public QObject
     /// @brief The total number of lines drawn by the turtle.
     Q_PROPERTY(int line_count READ line_count NOTIFY lines_changed FINAL)
 
+    /// @brief Indicates whether the simulation clock is paced to the wall clock.
+    Q_PROPERTY(bool realtime READ realtime WRITE set_realtime NOTIFY realtime_changed FINAL)
+
+    /// @brief Indicates whether the turtle is blocked by the lines it has drawn.
+    Q_PROPERTY(bool self_collision READ self_collision WRITE set_self_collision NOTIFY self_collision_changed FINAL)
+
+    /// @brief Indicates whether there is a command to undo.
+    Q_PROPERTY(bool can_undo READ can_undo NOTIFY history_changed FINAL)
+
+    /// @brief Indicates whether there is an undone command to redo.
+    Q_PROPERTY(bool can_redo READ can_redo NOTIFY history_changed FINAL)
+
 public:
+    /**
+     * @brief The state of the turtle at a checkpoint.
+     */
+    struct Snapshot
+    {
+        QPointF position_; ///< Position of the turtle.
+        float rotation_;   ///< Rotation of the turtle.
+        float speed_;      ///< Speed of the turtle.
+        float pen_radius_; ///< Radius of the pen.
+        QRgb pen_color_;   ///< Color of the pen.
+        bool b_pen_down_;  ///< Indicates if the pen is down.
+        int line_count_;   ///< Number of lines drawn before the checkpoint.
+        std::vector<std::pair<QPointF, float>> saved_states_; ///< Positions and rotations saved by push_state.
+    };
+
     /**
      * @brief Constructs a TurtleControl object.
      * 
@@ -94,6 +138,9 @@ public:
      */
     explicit TurtleControl(QObject *parent = nullptr);
 
+    /// @brief Destroys the turtle and its line index.
+    ~TurtleControl() override;
+
     /// @brief Gets the current position of the turtle.
     /// @return The current position as a QPointF.
     QPointF position() const { return position_; }
@@ -132,6 +179,30 @@ public:
     /// @return The number of lines.
     int line_count() const { return lines_.size(); }
 
+    /// @brief Checks if the simulation clock is paced to the wall clock.
+    /// @return True if movements are animated in real time, false if they complete instantly.
+    bool realtime() const { return b_realtime_; }
+
+    /// @brief Checks if the turtle is blocked by the lines it has drawn.
+    /// @return True if drawing across an earlier line is a collision.
+    bool self_collision() const { return b_self_collision_; }
+
+    /// @brief Checks if there is a command to undo.
+    /// @return True if a checkpoint was marked since the history was last cleared.
+    bool can_undo() const { return history_position_ > 0; }
+
+    /// @brief Checks if there is an undone command to redo.
+    /// @return True if a command was undone and no new command was started since.
+    bool can_redo() const { return history_position_ + 1 < static_cast<int>(history_.size()); }
+
+    /// @brief Gets the fixed simulation time step.
+    /// @return The duration of one clock step in milliseconds.
+    float get_time_step() const { return time_step_; }
+
+    /// @brief Gets the number of clock steps simulated since the turtle was created.
+    /// @return The step counter of the simulation clock.
+    quint64 get_simulation_steps() const { return simulation_steps_; }
+
     /// @brief Calculates the forward vector based on the turtle's current rotation.
     /// @return The forward vector as a QPointF.
     QPointF get_forward_vector() const;
@@ -152,9 +223,9 @@ public:
     /**
      * @brief Indicates if the turtle is currently moving.
      * 
-     * @return True if the turtle movement animation exists and is being played, false otherwise.
+     * @return True if a movement is being simulated, false otherwise.
      */
-    bool is_moving() const;
+    bool is_moving() const { return b_moving_; }
 
     /**
      * @brief Sets the pen color.
@@ -171,15 +242,105 @@ public:
      */
     Q_INVOKABLE Line get_line(int index) const;
 
+    /**
+     * @brief Finds the line closest to a point, e.g. to inspect the line under the mouse.
+     *
+     * @param point The point.
+     * @param max_distance The maximum distance of the line from the point.
+     * @return The index of the line, or -1 if no line is within max_distance.
+     */
+    Q_INVOKABLE int line_at(const QPointF &point, qreal max_distance) const;
+
+    /**
+     * @brief Removes the lines intersecting a rectangle and notifies listeners.
+     *
+     * @param rect The rectangle to erase.
+     * @return The number of removed lines.
+     */
+    Q_INVOKABLE int erase_lines(const QRectF &rect);
+
+    /**
+     * @brief Marks the start of a command that can be undone.
+     *
+     * Records the number of lines and the turtle state, and discards the undone commands.
+     */
+    Q_INVOKABLE void mark_checkpoint();
+
+    /**
+     * @brief Reverts the lines and the turtle state to the last checkpoint.
+     *
+     * Costs time in the number of lines drawn by the undone command only.
+     *
+     * @return True if a command was undone, false if there is none, the turtle is moving
+     *         or the history is locked.
+     */
+    Q_INVOKABLE bool undo();
+
+    /**
+     * @brief Applies the last undone command again.
+     *
+     * @return True if a command was redone, false if there is none, the turtle is moving
+     *         or the history is locked.
+     */
+    Q_INVOKABLE bool redo();
+
+    /**
+     * @brief Refuses undo and redo until a matching unlock_history().
+     *
+     * Held by the driver of the turtle while a command or script runs: it processes events
+     * while waiting for movements, which may deliver an undo that would revert the lines
+     * the running command is drawing. Locks nest.
+     */
+    void lock_history();
+
+    /// @brief Releases a lock taken by lock_history().
+    void unlock_history();
+
+    /// @brief Checks if undo and redo are refused.
+    /// @return True while lock_history() was called more often than unlock_history().
+    bool history_locked() const { return history_locks_ > 0; }
+
+    /**
+     * @brief Forgets all checkpoints and undone commands.
+     *
+     * Called when the lines are replaced or erased, as the checkpoints refer to line counts.
+     */
+    Q_INVOKABLE void clear_history();
+
+    /// @brief Returns the current state of the turtle.
+    Snapshot snapshot() const;
+
+    /**
+     * @brief Returns the turtle to a state taken earlier, discarding the lines drawn since.
+     *
+     * Unlike undo(), the discarded lines cannot be redone. If lines are discarded, the
+     * history is cleared. The turtle must not be moving.
+     *
+     * @param snapshot The state to return to, taken by snapshot() with at most line_count() lines.
+     */
+    void rewind(const Snapshot &snapshot);
+
+    /**
+     * @brief Counts the times lines were removed or replaced.
+     *
+     * Appending lines keeps the count, so while it is unchanged, the lines start with the
+     * lines seen at an earlier snapshot.
+     */
+    quint64 lines_generation() const { return lines_generation_; }
+
+    /// @brief Gets the spatial index over the lines.
+    /// @return The index, always up to date with the lines.
+    const LineIndex &get_line_index() const { return *line_index_; }
+
     /**
      * @brief Sets the canvas.
      *
+     * The moving obstacles of the canvas are advanced by the clock of the turtle, unless
+     * another turtle sharing the canvas claimed the canvas clock first.
+     *
      * @param canvas The pointer to the canvas.
      */
-    Q_INVOKABLE void set_canvas(Canvas *canvas)
-    {
-        canvas_ = canvas;
-    }
+    Q_INVOKABLE void set_canvas(Canvas *canvas);
    
 
 public slots:
@@ -195,6 +356,36 @@ public slots:
     /// @param position The new position for the turtle.
     void set_position(QPointF position);
 
+    /**
+     * @brief Sets whether the simulation clock is paced to the wall clock.
+     *
+     * Switching realtime off finishes the current movement immediately.
+     *
+     * @param b_realtime True to animate movements, false to complete them instantly.
+     */
+    void set_realtime(bool b_realtime);
+
+    /**
+     * @brief Sets whether the turtle is blocked by the lines it has drawn.
+     *
+     * While the pen is down, a movement crossing or running along an earlier line is
+     * then stopped like a collision with an obstacle.
+     *
+     * @param b_self_collision True to block the turtle at its own lines.
+     */
+    void set_self_collision(bool b_self_collision);
+
+    /**
+     * @brief Advances the simulation clock by one fixed time step.
+     *
+     * Moves the moving obstacles of the canvas first if the turtle owns the canvas clock,
+     * then the turtle if it is moving.
+     */
+    void step();
+
+    /// @brief Advances the simulation clock until the current movement has completed.
+    void run_until_idle();
+
     /// @brief Sets the turtle's rotation.
     /// @param rotation The new rotation angle in degrees.
     void set_rotation(float rotation);
@@ -237,6 +428,37 @@ public slots:
      * @return The duration of the arc movement.
      */
     float arc(float radius, float degrees = 360.f);
+
+    /// @brief Saves the position and rotation, to be returned to by pop_state.
+    void push_state();
+
+    /**
+     * @brief Returns to the position and rotation last saved by push_state, without drawing.
+     *
+     * Does nothing if no state is saved.
+     */
+    void pop_state();
+
+    /// @brief Gets the positions and rotations saved by push_state, the last one on top.
+    const std::vector<std::pair<QPointF, float>> &saved_states() const { return saved_states_; }
+
+    /**
+     * @brief Replaces the positions and rotations saved by push_state, e.g. with those a cached script left.
+     * @param saved_states The states, the last one on top.
+     */
+    void set_saved_states(const std::vector<std::pair<QPointF, float>> &saved_states) { saved_states_ = saved_states; }
+
+    /**
+     * @brief Runs a sequence of movements as if they were called one by one.
+     *
+     * In instant mode without self collision, a batch whose path keeps clear of the canvas
+     * borders and the obstacles is expanded at once, long paths on several threads.
+     * Otherwise its movements are simulated one after another. The completion of the
+     * whole batch is reported once, as blocked if any of its movements was blocked.
+     *
+     * @param batch The movements in order.
+     */
+    void run_motion_batch(const MotionBatch &batch);
     
     /**
    * @brief Replaces the current set of lines and notifies listeners.
@@ -244,6 +466,15 @@ public slots:
    */
    
     void set_lines(const QVector<Line> &lines);
+
+    /**
+     * @brief Appends lines as if the turtle had drawn them, and notifies listeners.
+     *
+     * Unlike set_lines, only the appended lines are indexed and the undo history is kept.
+     *
+     * @param lines The lines to append.
+     */
+    void append_lines(const QVector<Line> &lines);
     
       /**
      * @brief Public function to get lines.
@@ -287,18 +518,57 @@ signals:
 
     /// @brief Emitted when the lines vector changes.
     void lines_changed();
+
+    /**
+     * @brief Emitted before lines_changed when only the last lines were removed, e.g. on undo.
+     *
+     * Listeners may drop the removed lines instead of reloading all lines.
+     *
+     * @param count The number of remaining lines.
+     */
+    void lines_truncated(int count);
+
+    /// @brief Emitted when commands can be undone or redone.
+    void history_changed();
+
+    /// @brief Emitted when the realtime mode changes.
+    void realtime_changed();
+
+    /// @brief Emitted when self collision is switched on or off.
+    void self_collision_changed();
     
     /// @brief Emitted when a movement operation is completed.
     /// @param movement_result The result of the movement operation.
     void on_movement_completed(MovementResult movement_result);
 
     /// @brief Emitted when on collision event.
-    /// Emitted when a collision with obstacle or the canvas borders occurs.
+    /// Emitted when a collision with obstacle, the canvas borders or, with self collision,
+    /// an earlier line occurs. For lines the turtle itself is the hit object.
     /// @param hit_object The object collided with.
     /// @param hit_polygon The shape of the collided object.
     void on_collision(QObject *hit_object, const QPolygonF &hit_polygon);
 
 private:
+    /**
+     * @brief A movement simulated by the clock.
+     *
+     * A movement lasts a whole number of clock steps and is split into segments.
+     * Every segment is tested for collisions and produces at most one line.
+     */
+    struct Motion
+    {
+        QPointF start_position_; ///< Position at the start of the movement.
+        QPointF end_position_;   ///< Position at the end of the movement.
+        float start_rotation_;   ///< Rotation at the start of the movement.
+        float degrees_;          ///< Angle swept by an arc, 0 for straight movements.
+        float radius_;           ///< Radius of an arc, 0 for straight movements.
+        float duration_;         ///< Duration of the movement in milliseconds.
+        int steps_;              ///< Number of clock steps the movement lasts.
+        int segments_;           ///< Number of segments the movement is split into.
+        int step_;               ///< Clock steps simulated so far.
+        int segment_;            ///< Segments simulated so far.
+    };
+
     QPointF position_;                 ///< Current position of the turtle.
     float rotation_;                   ///< Current rotation of the turtle.
     float speed_;                      ///< Speed at which the turtle moves.
@@ -307,35 +577,139 @@ private:
     float pen_radius_;                 ///< Radius of the pen.
     QColor pen_color_;                 ///< Color of the pen.
     QVector<Line> lines_;              ///< Collection of lines drawn by the turtle.
-    QParallelAnimationGroup *current_anim_; ///< Animation that is currently being played.
+    std::unique_ptr<LineIndex> line_index_; ///< Spatial index over lines_.
+    bool b_self_collision_;            ///< Indicates if the turtle is blocked by its own lines.
+    std::vector<Snapshot> history_;    ///< Checkpoints before each command, then the state after the last undone one.
+    int history_position_;             ///< Number of commands currently applied, the index of the current state.
+    QVector<Line> redo_lines_;         ///< Lines of the undone commands, the next one to redo last.
+    int history_locks_;                ///< Number of locks refusing undo and redo.
+    quint64 lines_generation_;         ///< Number of times lines were removed or replaced.
+    Motion motion_;                    ///< Movement that is currently being simulated.
+    bool b_moving_;                    ///< Indicates if a movement is being simulated.
+    bool b_realtime_;                  ///< Indicates if the clock is paced to the wall clock.
+    float time_step_;                  ///< Duration of one clock step in milliseconds.
+    quint64 simulation_steps_;         ///< Number of clock steps simulated so far.
+    QTimer *clock_;                    ///< Timer pacing the clock in realtime mode or while obstacles move.
+    QElapsedTimer clock_time_;         ///< Wall time since the clock was started.
+    qint64 clock_steps_;               ///< Number of clock steps run since the clock was started.
     Canvas *canvas_; ///< Canvas module used to retrieve canvas properties and the list of obstacles.
-    QPointF previous_position_; ///< Position of the turtle before the animation was updated.
-    float previous_rotation_;   ///< Rotation of the turtle before the animation was updated.
+    QPointF previous_position_; ///< Position of the turtle before the last simulated segment.
+    float previous_rotation_;   ///< Rotation of the turtle before the last simulated segment.
     QPolygonF shape_;           ///< Shape of the turtle cursor.
+    std::vector<std::pair<QPointF, float>> saved_states_; ///< Positions and rotations saved by push_state, the last one on top.
+    MotionBatch batch_;         ///< Batch whose movements are simulated one after another.
+    size_t batch_position_;     ///< Index of the next movement of batch_ to simulate.
+    bool b_batch_running_;      ///< Indicates if the movements of batch_ are being simulated.
+    bool b_batch_starting_;     ///< Indicates if run_batch_motions is starting the next movement.
+    bool b_batch_blocked_;      ///< Indicates if a movement of batch_ was blocked.
+
+    /// @brief Gets the forward direction of a rotation.
+    static QPointF forward_vector(float rotation);
+
+    /// @brief Gets the right direction of a rotation.
+    static QPointF right_vector(float rotation);
+
+    /// @brief Brings a rotation into the range set_rotation keeps rotations in.
+    static float normalized_rotation(float rotation);
 
-    /// @brief Handles changes in animation values.
-    void anim_value_changed();
     /**
-     * @brief Handles changes in animation state.
-     * 
-     * @param new_state The new state of the animation.
-     * @param old_state The previous state of the animation.
+     * @brief Gets the position at the end of a segment of a movement.
+     *
+     * @param motion The movement.
+     * @param segment The index of the segment end, between 1 and the segment count.
      */
-    void anim_state_changed(QAbstractAnimation::State new_state,
-                            QAbstractAnimation::State old_state);
+    static QPointF segment_position(const Motion &motion, int segment);
 
-    /// @brief Handles the completion of an animation.
-    void anim_finished();
+    /**
+     * @brief Gets the rotation an arc sets at the end of a segment, before normalization.
+     *
+     * @param motion The arc.
+     * @param segment The index of the segment end, between 1 and the segment count.
+     */
+    static float segment_rotation(const Motion &motion, int segment);
 
     /**
-     * @brief Updates the current animation pointer.
-     * 
-     * Stops playing the current animation and replaces it with a new one.
-     * The old animation object will be automatically deleted.
-     * 
-     * @param anim The animation that will replace the current animation.  
+     * @brief Builds a forward movement.
+     *
+     * @param position The position at the start of the movement.
+     * @param rotation The rotation of the turtle.
+     * @param distance The distance to move.
+     */
+    Motion forward_motion(const QPointF &position, float rotation, float distance) const;
+
+    /**
+     * @brief Builds an arc movement.
+     *
+     * @param position The position at the start of the movement.
+     * @param rotation The rotation at the start of the movement.
+     * @param radius The radius of the arc, not below the minimum arc radius.
+     * @param degrees The angle the arc sweeps.
+     */
+    Motion arc_motion(const QPointF &position, float rotation, float radius, float degrees) const;
+
+    /// @brief Rotates the turtle at once, as turn does without reporting the completion.
+    void apply_turn(float degrees);
+
+    /**
+     * @brief Expands a whole batch at once, if that gives the same result as simulating it.
+     *
+     * The poses at the start of each movement are chained in order, then the segment
+     * positions and lines of all movements are computed in parallel and appended in one go.
+     *
+     * @param batch The movements in order.
+     * @return False if the batch has to be simulated, e.g. as it may collide.
+     */
+    bool expand_motions(const MotionBatch &batch);
+
+    /// @brief Simulates the remaining movements of batch_ until one of them is animated.
+    void run_batch_motions();
+
+    /**
+     * @brief Reports the completion of a movement, or continues the running batch.
+     *
+     * @param result The result of the movement.
+     */
+    void complete_motion(MovementResult result);
+
+    /**
+     * @brief Starts simulating a movement.
+     *
+     * In realtime mode the clock timer is started, otherwise the movement is
+     * simulated to completion before returning.
+     *
+     * @param motion The movement to simulate.
      */
-    void set_current_anim(QParallelAnimationGroup *anim);
+    void start_motion(const Motion &motion);
+
+    /// @brief Moves the turtle to the given segment of the current movement.
+    /// @param segment The index of the segment end, between 1 and the segment count.
+    void apply_motion_segment(int segment);
+
+    /// @brief Stops the current movement without notifying listeners.
+    void stop_motion();
+
+    /// @brief Starts the realtime clock, counting its steps from now.
+    void start_clock();
+
+    /**
+     * @brief Starts or stops the clock timer as needed.
+     *
+     * The timer runs while the turtle moves in realtime mode, and in any mode while
+     * obstacles move and the turtle owns the canvas clock, so they keep moving while the
+     * turtle is idle.
+     */
+    void update_clock();
+
+    /**
+     * @brief Runs the clock steps due since the clock was started.
+     *
+     * The timer only paces the clock and may fire late, so as many fixed steps are run as
+     * the elapsed wall time calls for.
+     */
+    void tick();
+
+    /// @brief Handles the completion of a movement.
+    void finish_motion();
 
     /// @brief Handles collisions with obstacles and canvas borders.
     /// @return Boolean indicating test result. True if collides.
@@ -343,6 +717,20 @@ private:
 
     /// @brief Adds a new line and emits the lines_changed signal.
     void update_lines();
+
+    /**
+     * @brief Restores a state of the turtle, moving lines to or from the redo stack.
+     *
+     * @param snapshot The state to restore.
+     */
+    void restore(const Snapshot &snapshot);
+
+    /**
+     * @brief Restores the position, rotation, speed and pen of a state.
+     *
+     * @param snapshot The state to restore.
+     */
+    void restore_pose(const Snapshot &snapshot);
 };
 
 #endif // TURTLECONTROL_H
@@ -1,6 +1,7 @@
 #include <QtTest>
 #include "canvas.hpp"
 #include "obstacle.hpp"
+#include "obstaclemap.hpp"
 
 class TestCanvas : public QObject
 {
@@ -14,6 +15,10 @@ private slots:
     void test_generate_obstacles(); // Test obstacle generation
     void test_clear_obstacles(); // Test obstacle clearing
     void test_obstacle_properties(); // Test obstacle color and points
+    void test_collision_world(); // Test the published collision snapshots
+    void test_decompose(); // Test the convex decomposition of obstacle polygons
+    void test_load_obstacles(); // Test loading obstacle maps in all formats
+    void test_moving_obstacles(); // Test advancing moving obstacles and their snapshots
 
 private:
     Canvas* m_canvas; // Pointer to Canvas for testing
@@ -97,5 +102,234 @@ void TestCanvas::test_obstacle_properties()
     QVERIFY(parsedColor.isValid());
 }
 
+void TestCanvas::test_collision_world()
+{
+    m_canvas->clear_obstacles();
+    m_canvas->generate_obstacles(200, QPointF(400.0, 300.0));
+
+    std::shared_ptr<const CollisionWorld> world = m_canvas->collision_world();
+    QCOMPARE(world->obstacle_count(), m_canvas->obstacle_count());
+    QCOMPARE(world->bounds(), QRectF(0.0, 0.0, m_canvas->width(), m_canvas->height()));
+    QCOMPARE(world->bounded(), m_canvas->bounded());
+
+    // Every obstacle is found through the grid, the first in canvas order winning
+    for (int i = 0; i < world->obstacle_count(); ++i) {
+        const QPolygonF polygon = m_canvas->get_obstacles()[i]->get_points();
+        QCOMPARE(world->body(i).polygon_, polygon);
+        const int hit = world->first_hit(polygon);
+        QVERIFY(hit >= 0 && hit <= i);
+        QVERIFY(world->body(hit).polygon_.intersects(polygon));
+        QVERIFY(world->intersects(polygon.boundingRect()));
+    }
+    QCOMPARE(world->first_hit(QPolygonF(QRectF(-100.0, -100.0, 10.0, 10.0))), -1);
+    QVERIFY(!world->intersects(QRectF(-100.0, -100.0, 10.0, 10.0)));
+
+    // Moving an obstacle publishes a new snapshot and leaves the held one unchanged
+    const QPolygonF before = world->body(0).polygon_;
+    m_canvas->get_obstacles()[0]->set_position(QPointF(-500.0, -500.0));
+    QCOMPARE(world->body(0).polygon_, before);
+    std::shared_ptr<const CollisionWorld> moved = m_canvas->collision_world();
+    QVERIFY(moved != world);
+    QVERIFY(moved->first_hit(m_canvas->get_obstacles()[0]->get_points()) == 0);
+
+    // Resizing and clearing publish new snapshots as well
+    m_canvas->set_width(1000.0);
+    QCOMPARE(m_canvas->collision_world()->bounds().width(), 1000.0);
+    m_canvas->clear_obstacles();
+    QCOMPARE(m_canvas->collision_world()->obstacle_count(), 0);
+    QCOMPARE(moved->obstacle_count(), world->obstacle_count());
+    QCOMPARE(m_canvas->collision_world()->first_hit(before), -1);
+}
+
+void TestCanvas::test_decompose()
+{
+    const auto area = [](const QPolygonF &polygon) {
+        qreal sum = 0.0;
+        for (int i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+            sum += polygon[j].x() * polygon[i].y() - polygon[i].x() * polygon[j].y();
+        }
+        return std::abs(sum) * 0.5;
+    };
+    const auto is_convex = [](const QPolygonF &polygon) {
+        for (int i = 0; i < polygon.size(); ++i) {
+            const QPointF a = polygon[(i + polygon.size() - 1) % polygon.size()];
+            const QPointF b = polygon[i];
+            const QPointF c = polygon[(i + 1) % polygon.size()];
+            if ((b.x() - a.x()) * (c.y() - b.y()) - (b.y() - a.y()) * (c.x() - b.x()) < -1e-9) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // A convex polygon is kept whole, repeated and collinear points dropped
+    const QVector<QPolygonF> square = ObstacleMap::decompose(
+        QPolygonF({QPointF(0, 0), QPointF(10, 0), QPointF(10, 0), QPointF(10, 10), QPointF(5, 10),
+                   QPointF(0, 10), QPointF(0, 0)}));
+    QCOMPARE(square.size(), qsizetype(1));
+    QCOMPARE(square[0].size(), qsizetype(4));
+
+    // An L shape in either orientation takes two pieces
+    const QPolygonF l_shape({QPointF(0, 0), QPointF(20, 0), QPointF(20, 10), QPointF(10, 10),
+                             QPointF(10, 20), QPointF(0, 20)});
+    QPolygonF reversed(l_shape.rbegin(), l_shape.rend());
+    for (const QPolygonF &polygon : {l_shape, reversed}) {
+        const QVector<QPolygonF> pieces = ObstacleMap::decompose(polygon);
+        QCOMPARE(pieces.size(), qsizetype(2));
+        QCOMPARE(area(pieces[0]) + area(pieces[1]), 300.0);
+    }
+
+    // A comb: every tooth needs its own piece, merged from the triangles of the ear clipping
+    QPolygonF comb;
+    comb << QPointF(0, 0);
+    for (int tooth = 0; tooth < 50; ++tooth) {
+        comb << QPointF(tooth * 4 + 1, 0) << QPointF(tooth * 4 + 2, 30) << QPointF(tooth * 4 + 3, 0);
+    }
+    comb << QPointF(200, 0) << QPointF(200, -10) << QPointF(0, -10);
+    const QVector<QPolygonF> pieces = ObstacleMap::decompose(comb);
+    QCOMPARE(pieces.size(), qsizetype(51));
+    qreal total = 0.0;
+    for (const QPolygonF &piece : pieces) {
+        QVERIFY(is_convex(piece));
+        total += area(piece);
+    }
+    QCOMPARE(total, area(comb));
+
+    QVERIFY(ObstacleMap::decompose(QPolygonF({QPointF(0, 0), QPointF(10, 0), QPointF(20, 0)})).isEmpty());
+}
+
+void TestCanvas::test_load_obstacles()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const auto write = [&dir](const QString &name, const QByteArray &contents) {
+        QFile file(dir.filePath(name));
+        file.open(QIODevice::WriteOnly);
+        file.write(contents);
+        return file.fileName();
+    };
+
+    const QString text = write("map.txt",
+                               "# a square and an L shape\n"
+                               "0 0, 10 0, 10 10, 0 10\n"
+                               "\n"
+                               "#00ff00 100 100 120 100 120 110 110 110 110 120 100 120 # green\n");
+    const QString json = write("map.json",
+                               R"({"obstacles": [{"points": [[0, 0], [10, 0], [10, 10], [0, 10]], "color": "blue"},
+                                                 {"points": [100, 100, 120, 100, 120, 110, 110, 110, 110, 120, 100, 120]}]})");
+    const QString svg = write("map.svg",
+                              R"(<svg xmlns="http://www.w3.org/2000/svg"><g fill="#0000ff">)"
+                              R"(<rect x="0" y="0" width="10" height="10"/>)"
+                              R"(<path d="M100 100 h20 v10 h-10 v10 H100 z" style="fill: red"/>)"
+                              R"(</g></svg>)");
+
+    for (const QString &path : {text, json, svg}) {
+        m_canvas->clear_obstacles();
+        QSignalSpy spy(m_canvas, &Canvas::obstacles_changed);
+        QVERIFY(m_canvas->load_obstacles(path));
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(m_canvas->obstacle_count(), 3); // the L shape is split in two
+        QCOMPARE(m_canvas->collision_world()->obstacle_count(), 3);
+        QCOMPARE(m_canvas->get_obstacles()[0]->get_bounds(), QRectF(0, 0, 10, 10));
+    }
+    QCOMPARE(m_canvas->get_obstacle_color(1), m_canvas->get_obstacle_color(2));
+
+    // Invalid maps leave the obstacles unchanged and report why
+    QSignalSpy spy(m_canvas, &Canvas::obstacles_changed);
+    QSignalSpy failed_spy(m_canvas, &Canvas::obstacles_load_failed);
+    QVERIFY(!m_canvas->load_obstacles(write("bad.txt", "0 0 10 0 10\n")));
+    QVERIFY(!m_canvas->load_obstacles(write("bad.json", "{")));
+    QVERIFY(!m_canvas->load_obstacles(write("bad.svg", R"(<svg><path d="M0 0 C 1 1 2 2 3 3"/></svg>)")));
+    const QString missing = dir.filePath("missing.txt");
+    QVERIFY(!m_canvas->load_obstacles(missing));
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(failed_spy.count(), 4);
+    QCOMPARE(failed_spy.last().at(0).toString(), missing);
+    QVERIFY(!failed_spy.last().at(1).toString().isEmpty());
+    QCOMPARE(m_canvas->obstacle_count(), 3);
+    m_canvas->clear_obstacles();
+}
+
+void TestCanvas::test_moving_obstacles()
+{
+    Canvas canvas;
+    canvas.set_width(1000.0);
+    canvas.set_height(1000.0);
+    canvas.add_obstacles({new Obstacle(QPolygonF(QRectF(100, 100, 20, 20)), Qt::red),
+                          new Obstacle(QPolygonF(QRectF(970, 500, 20, 20)), Qt::blue)});
+    Obstacle *sliding = canvas.get_obstacles()[0];
+    Obstacle *bouncing = canvas.get_obstacles()[1];
+    QCOMPARE(canvas.collision_world()->moving_count(), 0);
+
+    QSignalSpy moving_spy(&canvas, &Canvas::moving_changed);
+    sliding->set_velocity(QPointF(100, 0));
+    bouncing->set_velocity(QPointF(50, 0));
+    bouncing->set_angular_velocity(90);
+    const std::shared_ptr<const CollisionWorld> before = canvas.collision_world();
+    QCOMPARE(before->moving_count(), 2);
+    QCOMPARE(moving_spy.count(), 1);
+    QVERIFY(canvas.has_moving_obstacles());
+
+    // One step moves all obstacles with a single notification
+    QSignalSpy moved_spy(&canvas, &Canvas::obstacles_moved);
+    QSignalSpy changed_spy(&canvas, &Canvas::obstacles_changed);
+    canvas.advance_obstacles(0.5);
+    QCOMPARE(moved_spy.count(), 1);
+    QCOMPARE(changed_spy.count(), 0);
+    QCOMPARE(sliding->get_bounds(), QRectF(150, 100, 20, 20));
+    QVERIFY(bouncing->get_velocity().x() < 0.0); // crossed the right edge
+    QVERIFY(bouncing->get_bounds().width() > 20.0); // rotated by 45 degrees
+
+    const std::shared_ptr<const CollisionWorld> after = canvas.collision_world();
+    QVERIFY(after != before);
+    QCOMPARE(before->body(0).bounds_, QRectF(100, 100, 20, 20));
+    QCOMPARE(after->body(0).bounds_, sliding->get_bounds());
+    QCOMPARE(after->first_hit(QPolygonF(QRectF(155, 105, 5, 5))), 0);
+    QCOMPARE(after->first_hit(QPolygonF(QRectF(105, 105, 5, 5))), -1);
+
+    // Stopping the obstacles takes them out of the sweep and prune list, in a single snapshot
+    QSignalSpy motion_spy(sliding, &Obstacle::motion_changed);
+    canvas.randomize_motion(0.0, 0.0);
+    QCOMPARE(motion_spy.count(), 0);
+    QCOMPARE(canvas.collision_world()->moving_count(), 0);
+    QCOMPARE(moving_spy.count(), 2);
+    QVERIFY(!canvas.has_moving_obstacles());
+
+    // Without a speed, the obstacles still rotate in place
+    canvas.randomize_motion(0.0, 90.0);
+    QVERIFY(canvas.has_moving_obstacles());
+    QCOMPARE(sliding->get_velocity(), QPointF());
+    QVERIFY(sliding->get_angular_velocity() != 0.0 || bouncing->get_angular_velocity() != 0.0);
+    canvas.randomize_motion(0.0, 0.0);
+    QCOMPARE(moving_spy.count(), 4);
+    canvas.advance_obstacles(0.5);
+    QCOMPARE(moved_spy.count(), 1);
+
+    // Many moving and static obstacles: the broad phase finds what a test of all of them finds
+    canvas.clear_obstacles();
+    canvas.generate_obstacles(300, QPointF(-100, -100));
+    canvas.randomize_motion(200.0, 90.0);
+    for (int i = 0; i < 300; i += 3) {
+        canvas.get_obstacles()[i]->set_velocity(QPointF());
+        canvas.get_obstacles()[i]->set_angular_velocity(0.0);
+    }
+    for (int step = 0; step < 20; ++step) {
+        canvas.advance_obstacles(0.1);
+        const std::shared_ptr<const CollisionWorld> world = canvas.collision_world();
+        for (int y = 0; y < 1000; y += 50) {
+            for (int x = 0; x < 1000; x += 50) {
+                const QPolygonF probe(QRectF(x, y, 10, 10));
+                int expected = -1;
+                for (int i = 0; i < canvas.obstacle_count() && expected < 0; ++i) {
+                    if (canvas.get_obstacles()[i]->get_points().intersects(probe)) {
+                        expected = i;
+                    }
+                }
+                QCOMPARE(world->first_hit(probe), expected);
+            }
+        }
+    }
+}
+
 QTEST_MAIN(TestCanvas)
 #include "tst_testcanvas.moc"
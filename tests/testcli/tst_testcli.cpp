@@ -0,0 +1,380 @@
+#include <QtTest>
+#include <QLocalSocket>
+#include "CLI.hpp"
+#include "OutputLogModel.hpp"
+#include "RingBuffer.hpp"
+#include "ScriptCache.hpp"
+#include "ScriptSession.hpp"
+#include "canvas.hpp"
+#include "obstacle.hpp"
+#include "parser.hpp"
+#include "turtlecontrol.h"
+
+class TestCLI : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void test_ring_buffer();      // Test eviction order of the ring buffer
+    void test_output_model();     // Test that the output model only inserts and removes single rows
+    void test_history_spill();    // Test that commands dropped from the history are written to the spill file
+    void test_command_server();   // Test that pipelined batches sent over a local socket are run and answered in order
+    void test_undo_commands();    // Test that command lines request checkpoints and undo/redo is requested by command
+    void test_script_cache();     // Test that cached script results round-trip, are keyed by context and evicted by age
+    void test_script_rerun();     // Test that an edited script is rerun from a checkpoint with the same result as a full run
+
+private:
+    void connectTurtle(Parser &parser, TurtleControl &turtleControl);
+    void writeScript(const QString &filePath, const QByteArray &content);
+};
+
+void TestCLI::connectTurtle(Parser &parser, TurtleControl &turtleControl)
+{
+    // Connections from Parser to Turtle, as in Main.qml
+    turtleControl.set_realtime(false);
+    connect(&parser, &Parser::setspeed, &turtleControl, &TurtleControl::set_speed);
+    connect(&parser, &Parser::setsize, &turtleControl, &TurtleControl::set_pen_radius);
+    connect(&parser, &Parser::setcolor, &turtleControl, &TurtleControl::set_pen_color);
+    connect(&parser, &Parser::forward, &turtleControl, &TurtleControl::forward);
+    connect(&parser, &Parser::turn, &turtleControl, &TurtleControl::turn);
+    connect(&parser, &Parser::arc, &turtleControl, &TurtleControl::arc);
+    connect(&parser, &Parser::setpos, &turtleControl, &TurtleControl::set_position);
+    connect(&parser, &Parser::setrot, &turtleControl, &TurtleControl::set_rotation);
+    connect(&parser, &Parser::up, &turtleControl, [&turtleControl]() { turtleControl.set_pen_down(false); });
+    connect(&parser, &Parser::down, &turtleControl, [&turtleControl]() { turtleControl.set_pen_down(true); });
+    connect(&parser, &Parser::push_state, &turtleControl, &TurtleControl::push_state);
+    connect(&parser, &Parser::pop_state, &turtleControl, &TurtleControl::pop_state);
+    connect(&turtleControl, &TurtleControl::on_movement_completed, &parser, &Parser::animation_done);
+}
+
+void TestCLI::writeScript(const QString &filePath, const QByteArray &content)
+{
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(content);
+}
+
+void TestCLI::test_ring_buffer()
+{
+    RingBuffer<int> buffer(3);
+    int evicted = -1;
+
+    QVERIFY(buffer.empty());
+    QVERIFY(!buffer.push_back(1, &evicted));
+    QVERIFY(!buffer.push_back(2, &evicted));
+    QVERIFY(!buffer.push_back(3, &evicted));
+    QVERIFY(buffer.full());
+
+    QVERIFY(buffer.push_back(4, &evicted));
+    QCOMPARE(evicted, 1);
+    QCOMPARE(buffer.size(), size_t(3));
+    QCOMPARE(buffer[0], 2);
+    QCOMPARE(buffer[2], 4);
+    QCOMPARE(buffer.back(), 4);
+
+    QCOMPARE(buffer.pop_front(), 2);
+    QCOMPARE(buffer.size(), size_t(2));
+    QCOMPARE(buffer[0], 3);
+
+    buffer.clear();
+    QVERIFY(buffer.empty());
+}
+
+void TestCLI::test_output_model()
+{
+    OutputLogModel model(2);
+    QSignalSpy insertedSpy(&model, &QAbstractItemModel::rowsInserted);
+    QSignalSpy removedSpy(&model, &QAbstractItemModel::rowsRemoved);
+
+    model.append("first");
+    model.append("second");
+    model.append("third");
+
+    QCOMPARE(model.rowCount(), 2);
+    QCOMPARE(insertedSpy.count(), 3);
+    QCOMPARE(removedSpy.count(), 1);
+    QCOMPARE(model.data(model.index(0), OutputLogModel::MessageRole).toString(), QString("second"));
+    QCOMPARE(model.data(model.index(1), OutputLogModel::MessageRole).toString(), QString("third"));
+    QCOMPARE(model.join("\n"), QString("second\nthird"));
+}
+
+void TestCLI::test_history_spill()
+{
+    const QString filePath = "test_history_spill.txt";
+    QFile::remove(filePath);
+
+    {
+        CLI cli;
+        cli.setHistorySpillFile(filePath);
+        // Without a parser the commands are only added to the history
+        for (size_t i = 0; i < CLI::HISTORY_CAPACITY + 2; ++i) {
+            cli.processCommand(QString("command%1").arg(i));
+        }
+
+        const QStringList history = cli.getCommandHistory();
+        QCOMPARE(size_t(history.size()), CLI::HISTORY_CAPACITY);
+        QCOMPARE(history.first(), QString("command2"));
+        QCOMPARE(cli.outputModel()->rowCount(), int(CLI::OUTPUT_LOG_CAPACITY));
+    }
+
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly | QIODevice::Text));
+    QCOMPARE(QString::fromUtf8(file.readAll()), QString("command0\ncommand1\n"));
+    file.close();
+    QFile::remove(filePath);
+}
+
+void TestCLI::test_command_server()
+{
+    Parser parser;
+    // No turtle is animating the movements, complete them right away
+    connect(&parser, &Parser::forward, &parser, &Parser::animation_done);
+    connect(&parser, &Parser::arc, &parser, &Parser::animation_done);
+    QSignalSpy forwardSpy(&parser, &Parser::forward);
+
+    CLI cli;
+    cli.setParser(&parser);
+    const QString serverName = "turtle-test-command-server";
+    QVERIFY(cli.startServer(serverName));
+    QVERIFY(cli.isServerListening());
+
+    QLocalSocket client;
+    client.connectToServer(serverName);
+    QVERIFY(client.waitForConnected(1000));
+
+    // Three batches in one write, the second one with a block spanning several lines
+    client.write("forward(10)\nturn(90)\n\n"
+                 "LOOP 3 {\n  forward(5)\n}\n\n"
+                 "DEF f(n) {\nIF n > 0 {\nf(n - 1)\n}\n}\nf(2000)\n\n");
+    client.flush();
+
+    QByteArray replies;
+    QTRY_VERIFY_WITH_TIMEOUT((replies += client.readAll()).count('\n') >= 3, 5000);
+    const QList<QByteArray> lines = replies.split('\n');
+    QCOMPARE(lines.size(), 4);
+    QCOMPARE(lines[0], QByteArray("OK 2"));
+    QCOMPARE(lines[1], QByteArray("OK 3"));
+    QVERIFY(lines[2].startsWith("ERROR Maximum call depth"));
+    QCOMPARE(forwardSpy.count(), 4);
+    QVERIFY(cli.getCommandHistory().contains("turn(90)"));
+
+    // An unterminated batch still runs when the client disconnects
+    client.write("forward(1)");
+    client.disconnectFromServer();
+    QTRY_COMPARE(forwardSpy.count(), 5);
+
+    cli.stopServer();
+    QVERIFY(!cli.isServerListening());
+}
+
+void TestCLI::test_undo_commands()
+{
+    Parser parser;
+    connect(&parser, &Parser::forward, &parser, &Parser::animation_done);
+    CLI cli;
+    cli.setParser(&parser);
+    QSignalSpy checkpointSpy(&cli, &CLI::checkpointRequested);
+    QSignalSpy undoSpy(&cli, &CLI::undoRequested);
+    QSignalSpy redoSpy(&cli, &CLI::redoRequested);
+
+    cli.processCommand("forward(10)");
+    cli.processCommand("forward(20)");
+    QCOMPARE(checkpointSpy.count(), 2);
+
+    // Undo and redo are not steps themselves
+    cli.processCommand("undo");
+    cli.processCommand(" redo ");
+    QCOMPARE(undoSpy.count(), 1);
+    QCOMPARE(redoSpy.count(), 1);
+    QCOMPARE(checkpointSpy.count(), 2);
+
+    // Special commands do not run anything to undo
+    cli.processCommand("stats");
+    QCOMPARE(checkpointSpy.count(), 2);
+
+    // The history is locked while a command runs, so an undo typed meanwhile is refused
+    TurtleControl turtleControl;
+    cli.setTurtleControl(&turtleControl);
+    bool b_locked = false;
+    connect(&parser, &Parser::forward, &turtleControl, [&turtleControl, &b_locked]() {
+        b_locked = turtleControl.history_locked();
+    });
+    cli.processCommand("forward(5)");
+    QVERIFY(b_locked);
+    QVERIFY(!turtleControl.history_locked());
+
+    turtleControl.lock_history();
+    cli.processCommand("undo");
+    QCOMPARE(undoSpy.count(), 1);
+    turtleControl.unlock_history();
+
+    // Without a checkpoint, there is nothing to undo or redo, which is reported as an error
+    QSignalSpy outputSpy(&cli, &CLI::commandProcessed);
+    cli.processCommand("undo");
+    cli.processCommand("redo");
+    QCOMPARE(undoSpy.count(), 1);
+    QCOMPARE(redoSpy.count(), 1);
+    QCOMPARE(outputSpy.count(), 2);
+    QCOMPARE(outputSpy.at(0).at(0).toString(), QString("Error: Nothing to undo."));
+    QCOMPARE(outputSpy.at(1).at(0).toString(), QString("Error: Nothing to redo."));
+
+    // With one, the undo is requested
+    connect(&cli, &CLI::checkpointRequested, &turtleControl, &TurtleControl::mark_checkpoint);
+    cli.processCommand("forward(5)");
+    cli.processCommand("undo");
+    QCOMPARE(undoSpy.count(), 2);
+}
+
+void TestCLI::test_script_cache()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QBuffer script;
+    script.setData("forward(10)\nright(90)\n");
+    QVERIFY(script.open(QIODevice::ReadOnly));
+    const QByteArray key = ScriptCache::key(script, "context");
+    QVERIFY(!key.isEmpty());
+
+    // The same script from another state is another entry
+    script.seek(0);
+    QCOMPARE(ScriptCache::key(script, "context"), key);
+    script.seek(0);
+    QVERIFY(ScriptCache::key(script, "other context") != key);
+
+    ScriptCache::Entry entry;
+    entry.lines_.append(Line(QPointF(0, 0), QPointF(0.1, -10), QColor(255, 0, 0), 2.5f));
+    entry.lines_.append(Line(QPointF(0.1, -10), QPointF(10, -10), QColor(0, 0, 255, 128), 1.0f));
+    entry.position_ = QPointF(10, -10);
+    entry.rotation_ = 90.f;
+    entry.speed_ = 300.f;
+    entry.penRadius_ = 2.5f;
+    entry.penColor_ = QColor(0, 0, 255, 128);
+    entry.b_penDown_ = false;
+    entry.savedStates_ = {{QPointF(3, 4), 45.f}, {QPointF(-1, 2.5), 180.f}};
+    entry.globals_ = {{"a", 1.5}, {"b", -2.0}};
+
+    ScriptCache cache(dir.filePath("scripts"));
+    ScriptCache::Entry loaded;
+    QVERIFY(!cache.load(key, loaded));
+    QVERIFY(cache.store(key, entry));
+    QVERIFY(cache.size() > 0);
+    QVERIFY(cache.load(key, loaded));
+
+    QCOMPARE(loaded.lines_.size(), 2);
+    QCOMPARE(loaded.lines_[0].start_, entry.lines_[0].start_);
+    QCOMPARE(loaded.lines_[0].end_, entry.lines_[0].end_);
+    QCOMPARE(loaded.lines_[1].color_, entry.lines_[1].color_);
+    QCOMPARE(loaded.lines_[0].width_, entry.lines_[0].width_);
+    QCOMPARE(loaded.position_, entry.position_);
+    QCOMPARE(loaded.rotation_, entry.rotation_);
+    QCOMPARE(loaded.speed_, entry.speed_);
+    QCOMPARE(loaded.penRadius_, entry.penRadius_);
+    QCOMPARE(loaded.penColor_, entry.penColor_);
+    QCOMPARE(loaded.b_penDown_, entry.b_penDown_);
+    QVERIFY(loaded.savedStates_ == entry.savedStates_);
+    QVERIFY(loaded.globals_ == entry.globals_);
+
+    // Entries above the size limit are removed, the least recently used first
+    const qint64 entrySize = cache.size();
+    ScriptCache smallCache(dir.filePath("small"), entrySize * 2 + entrySize / 2);
+    QVERIFY(smallCache.store("first", entry));
+    QVERIFY(smallCache.store("second", entry));
+    QFile first(dir.filePath("small/first.tsc"));
+    QVERIFY(first.open(QIODevice::ReadWrite));
+    QVERIFY(first.setFileTime(QDateTime::currentDateTime().addSecs(-20), QFileDevice::FileModificationTime));
+    first.close();
+    QFile second(dir.filePath("small/second.tsc"));
+    QVERIFY(second.open(QIODevice::ReadWrite));
+    QVERIFY(second.setFileTime(QDateTime::currentDateTime().addSecs(-10), QFileDevice::FileModificationTime));
+    second.close();
+
+    QVERIFY(smallCache.load("first", loaded)); // now the most recently used
+    QVERIFY(smallCache.store("third", entry));
+    QVERIFY(smallCache.load("first", loaded));
+    QVERIFY(!smallCache.load("second", loaded));
+    QVERIFY(smallCache.load("third", loaded));
+
+    smallCache.clear();
+    QCOMPARE(smallCache.size(), qint64(0));
+}
+
+void TestCLI::test_script_rerun()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.filePath("rerun.txt");
+
+    // Two commands per call, so there is a checkpoint every CHECKPOINT_COMMANDS / 2 lines
+    QByteArray script = "DEF step(n) {\n  forward(n)\n  turn(7)\n}\nsize = 2\n";
+    for (int i = 0; i < 1000; ++i) {
+        script += "step(size)\n";
+    }
+    writeScript(filePath, script);
+
+    Parser parser;
+    TurtleControl turtleControl;
+    connectTurtle(parser, turtleControl);
+    CLI cli;
+    cli.setParser(&parser);
+    cli.setTurtleControl(&turtleControl);
+    cli.loadScript(QUrl::fromLocalFile(filePath).toString());
+    QVERIFY(turtleControl.line_count() >= 1000);
+
+    // Edit a line near the end, only the commands after the last checkpoint before it run again
+    const QByteArray edited = script.replace(script.size() - 3 * 11, 11, "step(size + 1)\nsize = 5\n");
+    writeScript(filePath, edited);
+    QSignalSpy forwardSpy(&parser, &Parser::forward);
+    cli.rerunScript();
+    QVERIFY(forwardSpy.count() > 0);
+    QVERIFY(forwardSpy.count() <= ScriptSession::CHECKPOINT_COMMANDS / 2 + 3);
+
+    // The result is the same as running the edited script from the start
+    Parser referenceParser;
+    TurtleControl reference;
+    connectTurtle(referenceParser, reference);
+    QBuffer buffer;
+    buffer.setData(edited);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    referenceParser.parse_script(buffer, [](const script::ExecutedCommand &) {});
+
+    const QVector<Line> lines = turtleControl.get_lines();
+    const QVector<Line> referenceLines = reference.get_lines();
+    QCOMPARE(lines.size(), referenceLines.size());
+    for (int i = 0; i < lines.size(); ++i) {
+        QCOMPARE(lines[i].start_, referenceLines[i].start_);
+        QCOMPARE(lines[i].end_, referenceLines[i].end_);
+    }
+    QCOMPARE(turtleControl.position(), reference.position());
+    QCOMPARE(turtleControl.rotation(), reference.rotation());
+    QVERIFY(parser.globals() == referenceParser.globals());
+
+    // An unchanged script is rerun from its last checkpoint, with the same result
+    forwardSpy.clear();
+    cli.processCommand("rerun");
+    QVERIFY(forwardSpy.count() <= ScriptSession::CHECKPOINT_COMMANDS / 2 + 3);
+    QCOMPARE(turtleControl.line_count(), referenceLines.size());
+
+    // Once lines were replaced, the script is loaded as a whole
+    turtleControl.set_lines(referenceLines.mid(0, 10));
+    forwardSpy.clear();
+    cli.rerunScript();
+    QCOMPARE(forwardSpy.count(), 1000);
+    QCOMPARE(turtleControl.line_count(), 10 + referenceLines.size());
+
+    // While obstacles move, they are not where the checkpoint saw them, so the script is loaded as a whole
+    Canvas canvas;
+    canvas.set_bounded(false);
+    canvas.add_obstacles({new Obstacle(QPolygonF(QRectF(50000, 50000, 10, 10)), Qt::red)});
+    canvas.get_obstacles()[0]->set_velocity(QPointF(10, 0));
+    turtleControl.set_canvas(&canvas);
+    cli.setCanvas(&canvas);
+    const QRectF obstacleBounds = canvas.get_obstacles()[0]->get_bounds();
+    forwardSpy.clear();
+    cli.rerunScript();
+    QCOMPARE(forwardSpy.count(), 1000);
+    QVERIFY(canvas.get_obstacles()[0]->get_bounds() != obstacleBounds);
+}
+
+QTEST_MAIN(TestCLI)
+#include "tst_testcli.moc"
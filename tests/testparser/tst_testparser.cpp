@@ -0,0 +1,364 @@
+#include <QtTest>
+#include <algorithm>
+#include <fstream>
+#include "lsystem.hpp"
+#include "parser.hpp"
+
+class TestParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();                   // Set up a fresh parser for each test
+    void cleanup();                // Delete the parser
+    void test_single_command();    // Test a single built-in command
+    void test_nested_loops();      // Test loops nested on a single line
+    void test_nested_blocks();     // Test nested blocks spanning multiple lines in a script
+    void test_invalid_lines();     // Test that erroneous lines are skipped
+    void test_expressions();       // Test arithmetic expressions and built-in functions
+    void test_undefined_operands(); // Test that undefined variables reject statements in any operator
+    void test_recursion();         // Test recursive functions with several parameters
+    void test_local_scopes();      // Test that locals of a call do not clobber other variables
+    void test_call_depth_limit();  // Test that runaway recursion is aborted
+    void test_reentrant_input();   // Test input parsed while a call waits for the turtle
+    void test_streamed_script();   // Test executing a script read from a device in chunks
+    void test_definitions_only();  // Test loading the functions of a script without running it
+    void test_lsystem();           // Test drawing L-systems, rewritten in parallel and streamed
+
+private:
+    Parser *m_parser; // Pointer to the Parser under test
+
+    void writeScript(const QString &filePath, const std::string &content);
+};
+
+void TestParser::init()
+{
+    m_parser = new Parser();
+    // There is no turtle to animate movements, report them as done immediately
+    connect(m_parser, &Parser::forward, m_parser, &Parser::animation_done);
+    connect(m_parser, &Parser::arc, m_parser, &Parser::animation_done);
+}
+
+void TestParser::cleanup()
+{
+    delete m_parser;
+}
+
+void TestParser::writeScript(const QString &filePath, const std::string &content)
+{
+    std::ofstream file(filePath.toStdString());
+    file << content;
+}
+
+void TestParser::test_single_command()
+{
+    QSignalSpy spy(m_parser, &Parser::forward);
+
+    std::vector<script::ExecutedCommand> commands = m_parser->parse_line("forward(42.5)");
+
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toFloat(), 42.5f);
+    QCOMPARE(commands.size(), size_t(1));
+    QCOMPARE(commands.front().to_string(), std::string("forward(42.5)"));
+}
+
+void TestParser::test_nested_loops()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    QSignalSpy turnSpy(m_parser, &Parser::turn);
+
+    m_parser->parse_line("LOOP3{ LOOP4{ forward(1) }; turn(120) }");
+
+    QCOMPARE(forwardSpy.count(), 12);
+    QCOMPARE(turnSpy.count(), 3);
+}
+
+void TestParser::test_nested_blocks()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    QSignalSpy turnSpy(m_parser, &Parser::turn);
+
+    const QString filePath = "test_nested_blocks.txt";
+    writeScript(filePath,
+                "DEF square(size) {\n"
+                "  LOOP 4 {\n"
+                "    forward(size)\n"
+                "    turn(90)\n"
+                "  }\n"
+                "}\n"
+                "LOOP 2 {\n"
+                "  LOOP 3 { square(10) }\n"
+                "  turn(45) # comments are ignored\n"
+                "}\n");
+
+    std::ifstream file(filePath.toStdString());
+    m_parser->parse_script(file);
+    file.close();
+    QFile::remove(filePath);
+
+    QCOMPARE(forwardSpy.count(), 2 * 3 * 4);
+    QCOMPARE(turnSpy.count(), 2 * 3 * 4 + 2);
+    QCOMPARE(forwardSpy.at(0).at(0).toFloat(), 10.f);
+}
+
+void TestParser::test_invalid_lines()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    std::vector<script::ExecutedCommand> commands = m_parser->parse_line("fasg; forward(5); }; forward(x)");
+
+    QCOMPARE(forwardSpy.count(), 1);
+    QCOMPARE(commands.size(), size_t(1));
+}
+
+void TestParser::test_expressions()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    QSignalSpy turnSpy(m_parser, &Parser::turn);
+
+    m_parser->parse_line("size=10; forward(size*2+1); forward(-(2+3)^2); forward(100*cos(60))");
+    m_parser->parse_line("r=add(size,2); r=mul(r,0.5); forward(r); turn(atan2(1,1)); turn(size>5 && size<=10)");
+    m_parser->parse_line("LOOP size/5 { forward(sqrt(16) % 3) }; forward(1/0)");
+
+    QCOMPARE(forwardSpy.count(), 6);
+    QCOMPARE(forwardSpy.at(0).at(0).toFloat(), 21.f);
+    QCOMPARE(forwardSpy.at(1).at(0).toFloat(), -25.f);
+    QCOMPARE(forwardSpy.at(2).at(0).toFloat(), 50.f);
+    QCOMPARE(forwardSpy.at(3).at(0).toFloat(), 6.f);
+    QCOMPARE(forwardSpy.at(4).at(0).toFloat(), 1.f);
+    QCOMPARE(turnSpy.count(), 2);
+    QCOMPARE(turnSpy.at(0).at(0).toFloat(), 45.f);
+    QCOMPARE(turnSpy.at(1).at(0).toFloat(), 1.f);
+}
+
+void TestParser::test_undefined_operands()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    QSignalSpy turnSpy(m_parser, &Parser::turn);
+
+    // x is never assigned: comparisons, logic, pow and min/max must not turn it into 0 or 1
+    m_parser->parse_line("turn(x < 5); turn(!x); turn(x == x); turn(x && 1); turn(x || 1); turn(0 || x)");
+    m_parser->parse_line("turn(x ^ 0); turn(min(x, 5)); turn(max(5, x))");
+    m_parser->parse_line("IF !x { forward(1) }; IF x < 5 { forward(2) }; LOOP x > 1 { forward(3) }");
+    QCOMPARE(turnSpy.count(), 0);
+    QCOMPARE(forwardSpy.count(), 0);
+
+    // Short-circuiting skips the undefined operand
+    m_parser->parse_line("turn(0 && x); turn(1 || x)");
+    QCOMPARE(turnSpy.count(), 2);
+    QCOMPARE(turnSpy.at(0).at(0).toFloat(), 0.f);
+    QCOMPARE(turnSpy.at(1).at(0).toFloat(), 1.f);
+}
+
+void TestParser::test_recursion()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    const QString filePath = "test_recursion.txt";
+    writeScript(filePath,
+                "DEF koch(len, depth) {\n"
+                "  IF depth == 0 { forward(len) }\n"
+                "  IF depth > 0 {\n"
+                "    koch(len / 3, depth - 1); turn(-60)\n"
+                "    koch(len / 3, depth - 1); turn(120)\n"
+                "    koch(len / 3, depth - 1); turn(-60)\n"
+                "    koch(len / 3, depth - 1)\n"
+                "  }\n"
+                "}\n"
+                "koch(81, 3)\n");
+
+    std::ifstream file(filePath.toStdString());
+    m_parser->parse_script(file);
+    file.close();
+    QFile::remove(filePath);
+
+    QCOMPARE(forwardSpy.count(), 4 * 4 * 4);
+    QCOMPARE(forwardSpy.at(0).at(0).toFloat(), 3.f);
+}
+
+void TestParser::test_local_scopes()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    m_parser->parse_line("n=100; DEF down_up(n) { t = n * 10; IF n > 0 { down_up(n - 1) }; forward(t) }");
+    m_parser->parse_line("down_up(2); forward(n)");
+
+    QCOMPARE(forwardSpy.count(), 4);
+    QCOMPARE(forwardSpy.at(0).at(0).toFloat(), 0.f);
+    QCOMPARE(forwardSpy.at(1).at(0).toFloat(), 10.f);
+    QCOMPARE(forwardSpy.at(2).at(0).toFloat(), 20.f);
+    QCOMPARE(forwardSpy.at(3).at(0).toFloat(), 100.f);
+}
+
+void TestParser::test_call_depth_limit()
+{
+    m_parser->parse_line("DEF forever(n) { forever(n + 1) }");
+
+    bool b_thrown = false;
+    try {
+        m_parser->parse_line("forever(0)");
+    } catch (const std::runtime_error &) {
+        b_thrown = true;
+    }
+    QVERIFY(b_thrown);
+
+    // The parser keeps working after the aborted call
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    m_parser->parse_line("forward(1)");
+    QCOMPARE(forwardSpy.count(), 1);
+}
+
+void TestParser::test_reentrant_input()
+{
+    disconnect(m_parser, &Parser::forward, m_parser, &Parser::animation_done);
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    // Complete the movements from the event loop, as the turtle does, and deliver
+    // more input there while the call waits for its first movement
+    QObject turtle;
+    bool b_nested = false;
+    connect(m_parser, &Parser::forward, &turtle, [this, &turtle, &b_nested]() {
+        QTimer::singleShot(0, &turtle, [this, &b_nested]() {
+            m_parser->animation_done();
+            if (!b_nested) {
+                b_nested = true;
+                m_parser->parse_line("DEF g(a) { b = a }; g(3); y = 4");
+            }
+        });
+    });
+
+    m_parser->parse_line("DEF f(x) { forward(x); forward(x); forward(x + 1) }; f(5)");
+
+    QVERIFY(b_nested);
+    QCOMPARE(forwardSpy.count(), 3);
+    QCOMPARE(forwardSpy.at(2).at(0).toFloat(), 6.f);
+    const auto globals = m_parser->globals();
+    QVERIFY(std::find(globals.begin(), globals.end(), std::make_pair(std::string("y"), 4.0)) != globals.end());
+}
+
+void TestParser::test_streamed_script()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    // Lines longer than a read chunk, and a last line without a line break
+    const QString filePath = "test_streamed_script.txt";
+    const std::string longComment(300 * 1024, '#');
+    writeScript(filePath, "LOOP 2 {\n" + longComment + "\n  forward(1)\n}\nforward(2) " + longComment + "\nforward(3)");
+
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    std::vector<script::ExecutedCommand> commands;
+    const qint64 bytesRead = m_parser->parse_script(file, [&commands](const script::ExecutedCommand &command) {
+        commands.push_back(command);
+    });
+    file.close();
+    QFile::remove(filePath);
+
+    QCOMPARE(bytesRead, qint64(2 * longComment.size() + 47));
+    QCOMPARE(forwardSpy.count(), 4);
+    QCOMPARE(forwardSpy.at(3).at(0).toFloat(), 3.f);
+    QCOMPARE(commands.size(), size_t(4));
+    QCOMPARE(commands.front().to_string(), std::string("forward(1)"));
+
+    // An empty device reads no bytes and runs nothing
+    QFile emptyFile(filePath);
+    QVERIFY(emptyFile.open(QIODevice::WriteOnly));
+    emptyFile.close();
+    QVERIFY(emptyFile.open(QIODevice::ReadOnly));
+    QCOMPARE(m_parser->parse_script(emptyFile, [](const script::ExecutedCommand &) {}), qint64(0));
+    emptyFile.close();
+    QFile::remove(filePath);
+}
+
+void TestParser::test_definitions_only()
+{
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+
+    const QString filePath = "test_definitions_only.txt";
+    writeScript(filePath, "DEF step(n) {\n  forward(n)\n}\nstep(4)\nsize = 3\n");
+    const std::string before = m_parser->fingerprint();
+
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QVERIFY(m_parser->load_definitions(file) > 0);
+    file.close();
+    QFile::remove(filePath);
+
+    // The function is defined, but nothing ran
+    QCOMPARE(forwardSpy.count(), 0);
+    QVERIFY(m_parser->globals().empty());
+    QVERIFY(m_parser->fingerprint() != before);
+
+    m_parser->set_global("size", 3);
+    m_parser->parse_line("step(size)");
+    QCOMPARE(forwardSpy.count(), 1);
+    QCOMPARE(forwardSpy.at(0).at(0).toFloat(), 3.f);
+    QCOMPARE(m_parser->globals().size(), size_t(1));
+    QCOMPARE(m_parser->globals().front().first, std::string("size"));
+
+    // The fingerprint follows the values of the variables
+    const std::string defined = m_parser->fingerprint();
+    m_parser->set_global("size", 4);
+    QVERIFY(m_parser->fingerprint() != defined);
+}
+
+void TestParser::test_lsystem()
+{
+    LSystem koch;
+    QVERIFY(koch.set_rules("F=F+F-F-F+F"));
+    QVERIFY(!koch.set_rules("F=F+F FF"));
+    QVERIFY(!koch.set_rules("F=F F=FF"));
+
+    // Rewriting a long generation on several threads equals rewriting it symbol by symbol
+    std::string generation = "F";
+    for (int i = 0; i < 7; ++i) {
+        std::string expected;
+        for (char symbol : generation) { expected += symbol == 'F' ? std::string("F+F-F-F+F") : std::string(1, symbol); }
+        QVERIFY(koch.rewrite(generation, expected.size(), generation));
+        QCOMPARE(generation, expected);
+    }
+    std::string unchanged = generation;
+    QVERIFY(!koch.rewrite(generation, generation.size(), unchanged));
+    QCOMPARE(unchanged, generation);
+
+    // Generations too large to be stored are streamed depth first, in the same order
+    std::string stored = generation;
+    for (int i = 7; i < 9; ++i) { QVERIFY(koch.rewrite(stored, std::string::npos, stored)); }
+    QVERIFY(stored.size() > LSystem::MAX_STORED_SYMBOLS);
+    std::string streamed;
+    koch.generate("F", 9, [&streamed](char symbol) { streamed += symbol; });
+    QVERIFY(streamed == stored);
+
+    // Drawn by the parser, symbols become turtle commands
+    QSignalSpy forwardSpy(m_parser, &Parser::forward);
+    QSignalSpy turnSpy(m_parser, &Parser::turn);
+    QSignalSpy pushSpy(m_parser, &Parser::push_state);
+    QSignalSpy popSpy(m_parser, &Parser::pop_state);
+    std::vector<script::ExecutedCommand> commands = m_parser->parse_line("lsystem(\"F\", \"F=F+F-F-F+F\", 2, 90, 5)");
+    QCOMPARE(forwardSpy.count(), 25);
+    QCOMPARE(turnSpy.count(), 24);
+    QCOMPARE(forwardSpy.first().at(0).toFloat(), 5.f);
+    QCOMPARE(turnSpy.first().at(0).toFloat(), 90.f);
+    QCOMPARE(turnSpy.at(1).at(0).toFloat(), -90.f);
+    QCOMPARE(commands.size(), size_t(1));
+
+    // Separators and whitespace in the quoted rules are part of them
+    forwardSpy.clear();
+    commands = m_parser->parse_line("n = 2; lsystem(\"X\", \"X=F[+X]F[-X]+X;# F=FF{}\", n, 20, 1); forward(1)");
+    QCOMPARE(forwardSpy.count(), 11);
+    QCOMPARE(pushSpy.count(), 8);
+    QCOMPARE(popSpy.count(), 8);
+    QCOMPARE(commands.size(), size_t(3));
+    QCOMPARE(commands[0].to_string(), std::string("n=2"));
+    QCOMPARE(commands[1].to_string(), std::string("lsystem(\"X\",\"X=F[+X]F[-X]+X;# F=FF{}\",2,20,1)"));
+
+    // Invalid rules and iteration counts draw nothing
+    forwardSpy.clear();
+    m_parser->parse_line("lsystem(\"F\", \"FF=F\", 2, 90, 5)");
+    m_parser->parse_line("lsystem(\"F\", \"F=FF\", -1, 90, 5)");
+    m_parser->parse_line("lsystem(F, \"F=FF\", 2, 90, 5)");
+    QCOMPARE(forwardSpy.count(), 0);
+}
+
+QTEST_MAIN(TestParser)
+#include "tst_testparser.moc"
@@ -0,0 +1,130 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <thread>
+#include <vector>
+#include "perf.hpp"
+#include "trace.hpp"
+
+class TestProfiling : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();                  // Start every test with an empty, disabled trace
+    void test_disabled();         // Test that nothing is recorded while tracing is disabled
+    void test_threads();          // Test that spans of several threads are exported as complete events
+    void test_clear();            // Test that cleared spans are not exported
+    void test_histogram();        // Test the statistics of a performance histogram
+};
+
+void TestProfiling::init()
+{
+    trace::set_enabled(false);
+    trace::clear();
+}
+
+void TestProfiling::test_disabled()
+{
+    {
+        TRACE_SCOPE("disabled");
+    }
+    QCOMPARE(trace::event_count(), size_t(0));
+
+    // A span started while disabled is not recorded when it ends while enabled
+    {
+        TRACE_SCOPE("started_disabled");
+        trace::set_enabled(true);
+    }
+    QCOMPARE(trace::event_count(), size_t(0));
+}
+
+void TestProfiling::test_threads()
+{
+    const int threadCount = 4;
+    const int spansPerThread = 10000; // more than one chunk per thread
+    trace::set_enabled(true);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < spansPerThread; ++i) {
+                TRACE_SCOPE("worker");
+            }
+        });
+    }
+    {
+        TRACE_SCOPE("main");
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    QCOMPARE(trace::event_count(), size_t(threadCount * spansPerThread + 1));
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(trace::to_chrome_json(), &error);
+    QCOMPARE(error.error, QJsonParseError::NoError);
+
+    int workerSpans = 0;
+    int mainSpans = 0;
+    QSet<int> threadIds;
+    const QJsonArray events = document.object()["traceEvents"].toArray();
+    for (const QJsonValue &value : events) {
+        const QJsonObject event = value.toObject();
+        if (event["ph"].toString() != "X") {
+            continue; // thread name metadata
+        }
+        QVERIFY(event["dur"].toDouble() >= 0.0);
+        threadIds.insert(event["tid"].toInt());
+        workerSpans += event["name"].toString() == "worker";
+        mainSpans += event["name"].toString() == "main";
+    }
+    QCOMPARE(workerSpans, threadCount * spansPerThread);
+    QCOMPARE(mainSpans, 1);
+    QCOMPARE(threadIds.size(), threadCount + 1);
+}
+
+void TestProfiling::test_clear()
+{
+    trace::set_enabled(true);
+    {
+        TRACE_SCOPE("before_clear");
+    }
+    trace::clear();
+    QCOMPARE(trace::event_count(), size_t(0));
+
+    {
+        TRACE_SCOPE("after_clear");
+    }
+    QCOMPARE(trace::event_count(), size_t(1));
+    const QByteArray json = trace::to_chrome_json();
+    QVERIFY(!json.contains("before_clear"));
+    QVERIFY(json.contains("after_clear"));
+}
+
+void TestProfiling::test_histogram()
+{
+    perf::reset();
+    for (std::uint64_t value = 1; value <= 100; ++value) {
+        perf::record(perf::Histogram::kPaintTime, value);
+    }
+    perf::add(perf::Counter::kMovesExecuted, 3);
+
+    const perf::HistogramSnapshot paint = perf::snapshot(perf::Histogram::kPaintTime);
+    QCOMPARE(paint.count, std::uint64_t(100));
+    QCOMPARE(paint.max, std::uint64_t(100));
+    QCOMPARE(paint.mean(), 50.5);
+    // Percentiles are the upper bounds of power of two buckets
+    QCOMPARE(paint.percentile(0.5), std::uint64_t(63));
+    QCOMPARE(paint.percentile(0.99), std::uint64_t(100));
+    QCOMPARE(perf::value(perf::Counter::kMovesExecuted), std::uint64_t(3));
+    QVERIFY(perf::report().contains("Moves executed: 3"));
+
+    perf::reset();
+    QCOMPARE(perf::snapshot(perf::Histogram::kPaintTime).count, std::uint64_t(0));
+    QCOMPARE(perf::value(perf::Counter::kMovesExecuted), std::uint64_t(0));
+}
+
+QTEST_MAIN(TestProfiling)
+#include "tst_testprofiling.moc"
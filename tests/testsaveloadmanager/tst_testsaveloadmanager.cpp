@@ -1,4 +1,9 @@
 #include <QtTest>
+#include <QBuffer>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include "LineCodec.hpp"
 #include "SaveLoadManager.hpp"
 #include "turtlecontrol.h"
 
@@ -12,6 +17,10 @@ public:
 
 private slots:
     void test_saveLoadState();
+    void test_saveLoadLines();
+    void test_loadRegion();
+    void test_corruptLines();
+    void test_loadTextState();
 
 private:
     void createDummyFile(const QString &filePath, const QString &content);
@@ -62,7 +71,7 @@ void test_SaveLoadManager::test_saveLoadState()
     turtleControl.set_pen_color(Qt::black);
 
     // Loading the state
-    manager.loadState(dir.filePath(stateFileName + ".txt"));
+    manager.loadState(dir.filePath(stateFileName + ".tgs"));
 
     // Verifying the loaded state
     QCOMPARE(turtleControl.position(), position);
@@ -72,10 +81,183 @@ void test_SaveLoadManager::test_saveLoadState()
     QCOMPARE(turtleControl.pen_color(), penColor);
 
     // Clean up the saved state file
-    QFile::remove(dir.filePath(stateFileName + ".txt"));
+    QFile::remove(dir.filePath(stateFileName + ".tgs"));
     dir.rmdir(folderPath);
 }
 
+void test_SaveLoadManager::test_saveLoadLines()
+{
+    SaveLoadManager manager;
+    TurtleControl turtleControl;
+    manager.setTurtleControl(&turtleControl);
+    QString folderPath = "test_build_folder";
+    QDir dir(folderPath);
+    dir.mkpath(".");
+    manager.setBuildFolder(folderPath);
+
+    // Polylines in several colors and widths, with jumps, spanning more than one block
+    QVector<Line> lines;
+    QPointF position(10.25, -3.5);
+    for (int i = 0; i < LineCodec::LINES_PER_BLOCK + 1000; ++i) {
+        if (i % 500 == 0) {
+            position = QPointF(i % 977, -(i % 613)); // a jump with the pen up
+        }
+        const QPointF end = position + QPointF(std::cos(i * 0.01) * 3.3, std::sin(i * 0.01) * 3.3);
+        const QColor color = QColor::fromRgba(qRgba(i / 2000, 128, 255 - i / 1000 % 256, 255));
+        lines.append(Line(position, end, color, i / 3000 % 2 ? 2.5f : 1.f));
+        position = end;
+    }
+    turtleControl.set_lines(lines);
+
+    QString stateFileName = "test_lines";
+    manager.saveState(stateFileName);
+    turtleControl.set_lines(QVector<Line>());
+    manager.loadState(dir.filePath(stateFileName + ".tgs"));
+
+    // Coordinates are rounded to the fixed-point grid, styles are kept exactly
+    const qreal tolerance = 1.0 / LineCodec::POSITION_SCALE;
+    const QVector<Line> loaded = turtleControl.get_lines();
+    QCOMPARE(loaded.size(), lines.size());
+    for (int i = 0; i < lines.size(); ++i) {
+        QVERIFY(qAbs(loaded[i].start_.x() - lines[i].start_.x()) <= tolerance);
+        QVERIFY(qAbs(loaded[i].start_.y() - lines[i].start_.y()) <= tolerance);
+        QVERIFY(qAbs(loaded[i].end_.x() - lines[i].end_.x()) <= tolerance);
+        QVERIFY(qAbs(loaded[i].end_.y() - lines[i].end_.y()) <= tolerance);
+        QCOMPARE(loaded[i].color_, lines[i].color_);
+        QCOMPARE(loaded[i].width_, lines[i].width_);
+    }
+
+    // A few bytes per line, where the text format took about 60
+    QVERIFY(QFileInfo(dir.filePath(stateFileName + ".tgs")).size() < lines.size() * 6);
+
+    QFile::remove(dir.filePath(stateFileName + ".tgs"));
+    dir.rmdir(folderPath);
+}
+
+void test_SaveLoadManager::test_loadRegion()
+{
+    SaveLoadManager manager;
+    TurtleControl turtleControl;
+    manager.setTurtleControl(&turtleControl);
+    QString folderPath = "test_build_folder";
+    QDir dir(folderPath);
+    dir.mkpath(".");
+    manager.setBuildFolder(folderPath);
+
+    // A spiral over a large area, in many blocks
+    QVector<Line> lines;
+    QPointF position(0, 0);
+    for (int i = 0; i < 8 * LineCodec::LINES_PER_BLOCK; ++i) {
+        const qreal angle = i * 0.05;
+        const QPointF end(std::cos(angle) * i * 0.01, std::sin(angle) * i * 0.01);
+        lines.append(Line(position, end, Qt::black, 1.f));
+        position = end;
+    }
+    turtleControl.set_lines(lines);
+
+    QString stateFileName = "test_region";
+    manager.saveState(stateFileName);
+    manager.loadState(dir.filePath(stateFileName + ".tgs"));
+    const QVector<Line> all = turtleControl.get_lines();
+    turtleControl.set_lines(QVector<Line>());
+
+    // The lines crossing a small window, in drawing order
+    const QRectF region(500, -20, 40, 40);
+    manager.loadRegion(dir.filePath(stateFileName + ".tgs"), region);
+    QVector<Line> expected;
+    for (const Line &line : all) {
+        if (LineCodec::intersects(line, region)) {
+            expected.append(line);
+        }
+    }
+    const QVector<Line> loaded = turtleControl.get_lines();
+    QVERIFY(!expected.isEmpty());
+    QCOMPARE(loaded.size(), expected.size());
+    for (int i = 0; i < loaded.size(); ++i) {
+        QCOMPARE(loaded[i].start_, expected[i].start_);
+        QCOMPARE(loaded[i].end_, expected[i].end_);
+    }
+
+    QFile::remove(dir.filePath(stateFileName + ".tgs"));
+    dir.rmdir(folderPath);
+}
+
+void test_SaveLoadManager::test_corruptLines()
+{
+    QVector<Line> lines;
+    QPointF position(0, 0);
+    for (int i = 0; i < 2 * LineCodec::LINES_PER_BLOCK + 10; ++i) {
+        const QPointF end = position + QPointF(std::cos(i * 0.1), std::sin(i * 0.1));
+        lines.append(Line(position, end, Qt::black, 1.f));
+        position = end;
+    }
+    QBuffer buffer;
+    QVERIFY(buffer.open(QIODevice::WriteOnly));
+    QVERIFY(LineCodec::write(buffer, lines));
+    const QByteArray data = buffer.data();
+
+    const auto accepted = [](const QByteArray &bytes) {
+        QVector<Line> loaded;
+        const uchar *begin = reinterpret_cast<const uchar *>(bytes.constData());
+        return LineCodec::read(begin, bytes.size(), loaded)
+               || LineCodec::readRegion(begin, bytes.size(), QRectF(-1e6, -1e6, 2e6, 2e6), loaded);
+    };
+    const auto patched = [&data](qsizetype position, auto value) {
+        QByteArray bytes = data;
+        const auto little = qToLittleEndian(value);
+        std::memcpy(bytes.data() + position, &little, sizeof(little));
+        return bytes;
+    };
+    QVERIFY(accepted(data));
+
+    // Truncated files, e.g. by an interrupted copy
+    const qsizetype sizes[] = {0, 1, 19, 20, data.size() / 2, data.size() - 20, data.size() - 1};
+    for (const qsizetype size : sizes) {
+        QVERIFY(!accepted(data.left(size)));
+    }
+
+    // Trailer and index fields whose sums with other fields would wrap around
+    const qsizetype trailer = data.size() - 20;
+    const quint64 indexOffset = qFromLittleEndian<quint64>(data.constData() + trailer + 8);
+    QVERIFY(!accepted(patched(trailer + 8, ~quint64(0) - 7)));       // index offset
+    QVERIFY(!accepted(patched(trailer + 4, ~quint32(0))));           // block count
+    QVERIFY(!accepted(patched(qsizetype(indexOffset), ~quint64(0) - 9))); // offset of the first block
+}
+
+void test_SaveLoadManager::test_loadTextState()
+{
+    // States saved by older versions are text
+    SaveLoadManager manager;
+    TurtleControl turtleControl;
+    manager.setTurtleControl(&turtleControl);
+    const QString filePath = "test_text_state.txt";
+    createDummyFile(filePath, "12.5;-4;90;0;3;#00ff00;\n"
+                              "0;0;10;0;#ff0000;2\n"
+                              "10;0;10;10;#0000ff;1\n");
+
+    manager.loadState(filePath);
+
+    QCOMPARE(turtleControl.position(), QPointF(12.5, -4));
+    QCOMPARE(turtleControl.rotation(), 90.f);
+    QCOMPARE(turtleControl.pen_down(), false);
+    QCOMPARE(turtleControl.pen_radius(), 3.f);
+    QCOMPARE(turtleControl.pen_color(), QColor("#00ff00"));
+    const QVector<Line> lines = turtleControl.get_lines();
+    QCOMPARE(lines.size(), qsizetype(2));
+    QCOMPARE(lines[1].end_, QPointF(10, 10));
+    QCOMPARE(lines[1].color_, QColor("#0000ff"));
+    QCOMPARE(lines[0].width_, 2.f);
+
+    QFile::remove(filePath);
+}
+
+void test_SaveLoadManager::createDummyFile(const QString &filePath, const QString &content)
+{
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write(content.toUtf8());
+}
+
 QTEST_APPLESS_MAIN(test_SaveLoadManager)
 
 #include "tst_testsaveloadmanager.moc"
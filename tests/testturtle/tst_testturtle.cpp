@@ -1,5 +1,9 @@
 #include <QtTest>
 #include "canvas.hpp"
+#include "lineindex.h"
+#include "linelayer.h"
+#include "lodpyramid.h"
+#include "linepainter.h"
 #include "obstacle.hpp"
 #include "turtlecontrol.h"
 
@@ -20,6 +24,17 @@ private slots:
     void test_circle();
     void test_arc();
     void test_collision();
+    void test_determinism();
+    void test_line_painter();
+    void test_unbounded_canvas();
+    void test_lod_pyramid();
+    void test_line_layer();
+    void test_line_index();
+    void test_self_collision();
+    void test_undo_redo();
+    void test_lod_pyramid_truncate();
+    void test_motion_batch();
+    void test_moving_obstacles();
 
 private:
     Canvas *canvas_;
@@ -39,6 +54,8 @@ void TestTurtle::initTestCase()
     turtle_ = new TurtleControl();
     initial_turtle_position_ = turtle_->position();
     turtle_->set_canvas(canvas_);
+    // Movements are simulated to completion without waiting for the wall clock
+    turtle_->set_realtime(false);
 }
 
 void TestTurtle::cleanupTestCase()
@@ -65,8 +82,7 @@ void TestTurtle::test_forward()
     // Set up a spy and call the command
     QSignalSpy spy(turtle_, &TurtleControl::on_movement_completed);
     QVERIFY(spy.isValid());
-    const float duration = turtle_->forward(distance);
-    spy.wait(duration * 1.1f);
+    turtle_->forward(distance);
 
     QCOMPARE(spy.count(), 1); // making sure the signal was emitted exactly one time
     QList<QVariant> arguments = spy.takeFirst(); // take the first signal
@@ -87,8 +103,7 @@ void TestTurtle::test_turn()
     // Set up a spy and call the command
     QSignalSpy spy(turtle_, &TurtleControl::on_movement_completed);
     QVERIFY(spy.isValid());
-    const float duration = turtle_->turn(degrees);
-    spy.wait(duration * 1.1f);
+    turtle_->turn(degrees);
 
     QCOMPARE(spy.count(), 1); // making sure the signal was emitted exactly one time
     QList<QVariant> arguments = spy.takeFirst(); // take the first signal
@@ -111,8 +126,7 @@ void TestTurtle::test_circle()
     // Set up a spy and call the command
     QSignalSpy spy(turtle_, &TurtleControl::on_movement_completed);
     QVERIFY(spy.isValid());
-    const float duration = turtle_->arc(radius);
-    spy.wait(duration * 1.1f);
+    turtle_->arc(radius);
 
     QCOMPARE(spy.count(), 1); // making sure the signal was emitted exactly one time
     QList<QVariant> arguments = spy.takeFirst(); // take the first signal
@@ -144,8 +158,7 @@ void TestTurtle::test_arc()
     // Set up a spy and call the command
     QSignalSpy spy(turtle_, &TurtleControl::on_movement_completed);
     QVERIFY(spy.isValid());
-    const float duration = turtle_->arc(radius, degrees);
-    spy.wait(duration * 1.1f);
+    turtle_->arc(radius, degrees);
 
     QCOMPARE(spy.count(), 1); // making sure the signal was emitted exactly one time
     QList<QVariant> arguments = spy.takeFirst(); // take the first signal
@@ -180,8 +193,7 @@ void TestTurtle::test_collision()
     // Set up a spy and call the command
     QSignalSpy spy(turtle_, &TurtleControl::on_movement_completed);
     QVERIFY(spy.isValid());
-    const float duration = turtle_->forward(distance);
-    spy.wait(duration * 1.1f);
+    turtle_->forward(distance);
 
     QCOMPARE(spy.count(), 1); // making sure the signal was emitted exactly one time
     QList<QVariant> arguments = spy.takeFirst(); // take the first signal
@@ -194,6 +206,523 @@ void TestTurtle::test_collision()
     QCOMPARE_LE(distance_to_obstacle, test_tolerance);
 }
 
+void TestTurtle::test_determinism()
+{
+    // Two turtles given the same commands must produce bit for bit identical lines
+    TurtleControl first;
+    TurtleControl second;
+    first.set_realtime(false);
+    second.set_realtime(false);
+
+    for (TurtleControl *turtle : {&first, &second}) {
+        turtle->set_speed(777.f);
+        for (int i = 0; i < 12; ++i) {
+            turtle->forward(37.5f + i);
+            turtle->turn(29.f);
+            turtle->arc(20.f + i, 75.f);
+        }
+    }
+
+    QVERIFY(first.line_count() > 0);
+    QCOMPARE(first.line_count(), second.line_count());
+    for (int i = 0; i < first.line_count(); ++i) {
+        const Line a = first.get_line(i);
+        const Line b = second.get_line(i);
+        // QPointF comparison is fuzzy, compare the coordinates exactly instead
+        QVERIFY(a.start_.x() == b.start_.x() && a.start_.y() == b.start_.y());
+        QVERIFY(a.end_.x() == b.end_.x() && a.end_.y() == b.end_.y());
+    }
+    QVERIFY(first.position().x() == second.position().x());
+    QVERIFY(first.position().y() == second.position().y());
+    QVERIFY(first.rotation() == second.rotation());
+    QCOMPARE(first.get_simulation_steps(), second.get_simulation_steps());
+}
+
+void TestTurtle::test_line_painter()
+{
+    const QVector<Line> lines = {Line(QPointF(10, 50), QPointF(90, 50), QColor(Qt::red), 4.f),
+                                 Line(QPointF(50, 10), QPointF(50, 30), QColor(Qt::blue), 2.f)};
+
+    const QImage image = render_lines(lines, QSize(100, 100));
+    QCOMPARE(image.size(), QSize(100, 100));
+    QCOMPARE(image.pixelColor(50, 50), QColor(Qt::red));
+    QCOMPARE(image.pixelColor(50, 20), QColor(Qt::blue));
+    QCOMPARE(image.pixelColor(20, 80), QColor(Qt::white));
+
+    const QString svg = lines_to_svg(lines, QSize(100, 100));
+    QVERIFY(svg.startsWith("<?xml"));
+    QCOMPARE(svg.count("<line "), 2);
+    QVERIFY(svg.contains("x1=\"10\" y1=\"50\" x2=\"90\" y2=\"50\" stroke=\"#ff0000\" stroke-width=\"4\""));
+}
+
+void TestTurtle::test_unbounded_canvas()
+{
+    Canvas canvas;
+    canvas.set_width(100.0);
+    canvas.set_height(100.0);
+    TurtleControl turtle;
+    turtle.set_realtime(false);
+    turtle.set_canvas(&canvas);
+    turtle.set_speed(1000.f);
+
+    // The turtle starts outside the small canvas, so it is blocked at once
+    QSignalSpy spy(&turtle, &TurtleControl::on_movement_completed);
+    turtle.forward(50.f);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).value<MovementResult>(), MovementResult::kBlocked);
+
+    canvas.set_bounded(false);
+    turtle.forward(50.f);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).value<MovementResult>(), MovementResult::kSuccess);
+}
+
+void TestTurtle::test_lod_pyramid()
+{
+    // A circle drawn in fine steps, as arcs are
+    const QPointF center(450, 450);
+    const int steps = 1000;
+    QVector<Line> lines;
+    for (int i = 0; i < steps; ++i) {
+        const qreal a1 = 2 * M_PI * i / steps;
+        const qreal a2 = 2 * M_PI * (i + 1) / steps;
+        lines.append(Line(center + 200 * QPointF(std::cos(a1), std::sin(a1)),
+                          center + 200 * QPointF(std::cos(a2), std::sin(a2)), QColor(Qt::red), 2.f));
+    }
+
+    // Lines added one at a time end up like lines added together
+    LodPyramid pyramid;
+    LodPyramid incremental;
+    pyramid.append(lines, 0);
+    for (int i = 1; i <= lines.size(); ++i) {
+        incremental.append(lines.mid(0, i), i - 1);
+    }
+
+    QCOMPARE(pyramid.segment_count(0), steps);
+    for (int level = 1; level < LodPyramid::LEVEL_COUNT; ++level) {
+        QVERIFY(pyramid.segment_count(level) <= pyramid.segment_count(level - 1));
+        QCOMPARE(incremental.segment_count(level), pyramid.segment_count(level));
+    }
+    QVERIFY(pyramid.segment_count(4) < 100);
+
+    // The simplified polyline still starts and ends where the lines do, up to float precision
+    QVERIFY((pyramid.segment(4, 0).start() - lines.first().start_).manhattanLength() < 0.01);
+    QVERIFY((pyramid.segment(4, pyramid.segment_count(4) - 1).end() - lines.last().end_).manhattanLength() < 0.01);
+    QCOMPARE(pyramid.color(pyramid.segment(4, 0).style_), QColor(Qt::red));
+
+    // The rightmost point (650, 450) is in cell (2, 1) of level 0, the center is empty
+    const std::vector<int> *cell = pyramid.cell(0, 2, 1);
+    QVERIFY(cell != nullptr);
+    QVERIFY(!cell->empty());
+    QVERIFY(std::is_sorted(cell->begin(), cell->end()));
+    QVERIFY(pyramid.cell(0, 10, 10) == nullptr);
+
+    // A polyline doubling back is not reduced to its end points
+    std::vector<QPointF> simplified;
+    LodPyramid::simplify({QPointF(0, 0), QPointF(100, 0), QPointF(50, 0)}, 1.0, simplified);
+    QCOMPARE(simplified.size(), size_t(3));
+    LodPyramid::simplify({QPointF(0, 0), QPointF(50, 0.5), QPointF(100, 0)}, 1.0, simplified);
+    QCOMPARE(simplified.size(), size_t(2));
+}
+
+void TestTurtle::test_line_layer()
+{
+    TurtleControl turtle;
+    LineLayer layer;
+    layer.setSize(QSizeF(800, 600));
+    layer.set_turtle_control(&turtle);
+
+    QImage image(800, 600, QImage::Format_ARGB32_Premultiplied);
+    const auto paint = [&layer, &image]() {
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        layer.paint(&painter);
+    };
+    paint();
+    QCOMPARE(layer.tile_count(), 0);
+
+    // Tiles are only created where there are lines
+    turtle.set_lines({Line(QPointF(10, 50), QPointF(100, 50), QColor(Qt::red), 4.f)});
+    QCOMPARE(layer.rasterized_count(), 1);
+    paint();
+    QCOMPARE(layer.tile_count(), 1);
+    QCOMPARE(image.pixelColor(50, 50), QColor(Qt::red));
+
+    // Appended lines are painted into the cached tiles and create the tiles they reach
+    QVector<Line> lines = turtle.get_lines();
+    lines.append(Line(QPointF(100, 50), QPointF(300, 50), QColor(Qt::blue), 4.f));
+    turtle.set_lines(lines);
+    QCOMPARE(layer.rasterized_count(), 2);
+    paint();
+    QCOMPARE(layer.tile_count(), 2);
+    QCOMPARE(image.pixelColor(200, 50), QColor(Qt::blue));
+
+    // Zooming out shows a coarser level from tiles of its own
+    layer.zoom_at(QPointF(0, 0), 0.25);
+    QCOMPARE(layer.zoom(), 0.25);
+    QCOMPARE(layer.level(), 2);
+    paint();
+    QCOMPARE(layer.tile_count(), 3);
+    QVERIFY(image.pixelColor(50, 12).blue() > 0);
+    QCOMPARE(image.pixelColor(50, 100).alpha(), 0);
+
+    // Zooming keeps the point under the mouse in place
+    layer.zoom_at(QPointF(400, 300), 2.0);
+    QCOMPARE(layer.map_from_drawing(layer.map_to_drawing(QPointF(400, 300))), QPointF(400, 300));
+    layer.reset_view();
+    QCOMPARE(layer.level(), 0);
+    QCOMPARE(layer.pan(), QPointF());
+
+    // Replacing the lines rebuilds the tiles
+    turtle.set_lines({Line(QPointF(600, 600), QPointF(610, 610), QColor(Qt::red), 2.f)});
+    QCOMPARE(layer.rasterized_count(), 1);
+    QCOMPARE(layer.tile_count(), 0);
+
+    turtle.reset_state();
+    QCOMPARE(layer.rasterized_count(), 0);
+    QCOMPARE(layer.pyramid().segment_count(0), 0);
+}
+
+void TestTurtle::test_line_index()
+{
+    // A grid of horizontal lines 10 pixels apart and a diagonal across them
+    QVector<Line> lines;
+    for (int i = 0; i < 10; ++i) {
+        lines.append(Line(QPointF(0, i * 10), QPointF(100, i * 10), QColor(Qt::black), 1.f));
+    }
+    lines.append(Line(QPointF(0, 0), QPointF(100, 100), QColor(Qt::red), 1.f));
+    LineIndex index(lines);
+    index.update();
+    QCOMPARE(index.size(), 11);
+
+    // Of equally close lines the last one drawn is found
+    QCOMPARE(index.nearest(QPointF(20, 52), 5.0), 5);
+    QCOMPARE(index.nearest(QPointF(50, 50), 5.0), 10);
+    QCOMPARE(index.nearest(QPointF(500, 500), 5.0), -1);
+
+    // Lines passing by the cells of the rectangle are filtered out
+    QCOMPARE(index.query(QRectF(70, 15, 10, 10)), std::vector<int>({2}));
+    QCOMPARE(index.query(QRectF(15, 15, 10, 10)), std::vector<int>({2, 10}));
+
+    // Touching a line at the end points is not crossing it
+    QCOMPARE(index.first_crossing(QPointF(5, -5), QPointF(5, 15)), 0);
+    QCOMPARE(index.first_crossing(QPointF(50, 41), QPointF(50, 49)), -1);
+    QCOMPARE(index.first_crossing(QPointF(100, 90), QPointF(120, 90)), -1);
+
+    // Removed lines are no longer found
+    index.truncate(10);
+    lines.removeLast();
+    QCOMPARE(index.nearest(QPointF(50, 50), 5.0), 5);
+    QCOMPARE(index.query(QRectF(-1, -1, 102, 102)).size(), size_t(10));
+}
+
+void TestTurtle::test_self_collision()
+{
+    TurtleControl turtle;
+    turtle.set_realtime(false);
+    turtle.set_speed(1000.f);
+    QSignalSpy spy(&turtle, &TurtleControl::on_movement_completed);
+
+    // Three sides of a rectangle, the fourth side runs across the first one
+    const auto draw = [&turtle, &spy]() {
+        turtle.forward(100.f);
+        turtle.turn(90.f);
+        turtle.forward(50.f);
+        turtle.turn(90.f);
+        turtle.forward(50.f);
+        turtle.turn(90.f);
+        spy.clear();
+        turtle.forward(100.f);
+        QCOMPARE(spy.count(), 1);
+        return spy.takeFirst().at(0).value<MovementResult>();
+    };
+
+    QCOMPARE(draw(), MovementResult::kSuccess);
+    QCOMPARE(turtle.position().toPoint(), QPoint(400, 400));
+
+    turtle.reset_state();
+    turtle.set_self_collision(true);
+    QCOMPARE(draw(), MovementResult::kBlocked);
+    QVERIFY(turtle.position().x() > 450);
+
+    // The line under the point and the lines in a rectangle
+    const int line_count = turtle.line_count();
+    QVERIFY(turtle.line_at(QPointF(452, 380), 4.0) >= 0);
+    QCOMPARE(turtle.line_at(QPointF(475, 380), 4.0), -1);
+    QSignalSpy lines_spy(&turtle, &TurtleControl::lines_changed);
+    QVERIFY(turtle.erase_lines(QRectF(440, 340, 20, 20)) > 0);
+    QCOMPARE(lines_spy.count(), 1);
+    QVERIFY(turtle.line_count() < line_count);
+    QCOMPARE(turtle.get_line_index().size(), turtle.line_count());
+    QCOMPARE(turtle.erase_lines(QRectF(0, 0, 10, 10)), 0);
+}
+
+void TestTurtle::test_undo_redo()
+{
+    TurtleControl turtle;
+    turtle.set_realtime(false);
+    turtle.set_speed(1000.f);
+    LineLayer layer;
+    layer.set_turtle_control(&turtle);
+    QVERIFY(!turtle.can_undo());
+    QVERIFY(!turtle.undo());
+
+    turtle.mark_checkpoint();
+    turtle.forward(100.f);
+    const int first_count = turtle.line_count();
+    const QPointF first_position = turtle.position();
+    turtle.mark_checkpoint();
+    turtle.set_pen_color(Qt::red);
+    turtle.push_state();
+    turtle.turn(90.f);
+    turtle.arc(50.f, 180.f);
+    const int second_count = turtle.line_count();
+    const QPointF second_position = turtle.position();
+    QVERIFY(second_count > first_count);
+
+    // Undo drops the lines of the last command only and restores the turtle
+    QSignalSpy truncated_spy(&turtle, &TurtleControl::lines_truncated);
+    QVERIFY(turtle.undo());
+    QCOMPARE(truncated_spy.count(), 1);
+    QCOMPARE(truncated_spy.takeFirst().at(0).toInt(), first_count);
+    QCOMPARE(turtle.line_count(), first_count);
+    QCOMPARE(turtle.position(), first_position);
+    QCOMPARE(turtle.rotation(), 0.f);
+    QCOMPARE(turtle.pen_color(), QColor(Qt::black));
+    QVERIFY(turtle.saved_states().empty());
+    QCOMPARE(turtle.get_line_index().size(), first_count);
+    QCOMPARE(layer.rasterized_count(), first_count);
+    QCOMPARE(layer.pyramid().segment_count(0), first_count);
+    QVERIFY(turtle.can_redo());
+
+    QVERIFY(turtle.undo());
+    QCOMPARE(turtle.line_count(), 0);
+    QCOMPARE(turtle.position(), QPointF(450, 450));
+    QVERIFY(!turtle.can_undo());
+
+    // Redo brings the lines back in their order
+    QVERIFY(turtle.redo());
+    QVERIFY(turtle.redo());
+    QVERIFY(!turtle.redo());
+    QCOMPARE(turtle.line_count(), second_count);
+    QCOMPARE(turtle.position(), second_position);
+    QCOMPARE(turtle.pen_color(), QColor(Qt::red));
+    QCOMPARE(turtle.saved_states().size(), size_t(1));
+    QCOMPARE(turtle.get_line(first_count).color_, QColor(Qt::red));
+    QCOMPARE(layer.rasterized_count(), second_count);
+
+    // Undo and redo are refused while a command holds the history
+    turtle.lock_history();
+    turtle.lock_history();
+    QVERIFY(!turtle.undo());
+    turtle.unlock_history();
+    QVERIFY(!turtle.undo());
+    QCOMPARE(turtle.line_count(), second_count);
+    turtle.unlock_history();
+    QVERIFY(!turtle.history_locked());
+
+    // A new command discards the undone ones
+    QVERIFY(turtle.undo());
+    turtle.mark_checkpoint();
+    turtle.forward(10.f);
+    QVERIFY(!turtle.can_redo());
+    QVERIFY(turtle.undo());
+    QCOMPARE(turtle.line_count(), first_count);
+
+    turtle.reset_state();
+    QVERIFY(!turtle.can_undo());
+}
+
+void TestTurtle::test_lod_pyramid_truncate()
+{
+    QVector<Line> lines;
+    QPointF position(0, 0);
+    for (int i = 0; i < 600; ++i) {
+        const QPointF next = position + QPointF(std::cos(i * 0.1), std::sin(i * 0.13)) * 10.0;
+        lines.append(Line(position, next, i < 400 ? QColor(Qt::black) : QColor(Qt::blue), 1.f));
+        position = next;
+    }
+
+    // Removing lines leaves the levels as if the remaining lines were added alone
+    for (int count : {500, 300, 256, 1, 0}) {
+        LodPyramid truncated;
+        truncated.append(lines, 0);
+        const LodPyramid::Changes changes = truncated.truncate(lines, count);
+        QVERIFY(changes.b_removed_);
+
+        LodPyramid expected;
+        expected.append(lines.mid(0, count), 0);
+        for (int level = 0; level < LodPyramid::LEVEL_COUNT; ++level) {
+            QCOMPARE(truncated.segment_count(level), expected.segment_count(level));
+        }
+
+        // Appending again continues where the lines were cut off
+        truncated.append(lines, count);
+        for (int level = 0; level < LodPyramid::LEVEL_COUNT; ++level) {
+            QVERIFY(truncated.segment_count(level) > 0);
+        }
+        QCOMPARE(truncated.segment_count(0), int(lines.size()));
+    }
+}
+
+// Runs the movements of a batch on a turtle one by one
+static void run_one_by_one(TurtleControl &turtle, const MotionBatch &batch)
+{
+    for (size_t i = 0; i < batch.size(); ++i) {
+        switch (batch.kinds_[i]) {
+        case MotionBatch::kForward: turtle.forward(batch.lengths_[i]); break;
+        case MotionBatch::kTurn: turtle.turn(batch.degrees_[i]); break;
+        case MotionBatch::kArc: turtle.arc(batch.lengths_[i], batch.degrees_[i]); break;
+        case MotionBatch::kPush: turtle.push_state(); break;
+        case MotionBatch::kPop: turtle.pop_state(); break;
+        }
+    }
+}
+
+// Checks that two turtles drew bit for bit identical lines and stopped in the same pose
+static void compare_turtles(const TurtleControl &first, const TurtleControl &second)
+{
+    QCOMPARE(first.line_count(), second.line_count());
+    for (int i = 0; i < first.line_count(); ++i) {
+        const Line a = first.get_line(i);
+        const Line b = second.get_line(i);
+        QVERIFY(a.start_.x() == b.start_.x() && a.start_.y() == b.start_.y());
+        QVERIFY(a.end_.x() == b.end_.x() && a.end_.y() == b.end_.y());
+        QCOMPARE(a.color_, b.color_);
+        QCOMPARE(a.width_, b.width_);
+    }
+    QVERIFY(first.position().x() == second.position().x());
+    QVERIFY(first.position().y() == second.position().y());
+    QVERIFY(first.rotation() == second.rotation());
+    QCOMPARE(first.get_simulation_steps(), second.get_simulation_steps());
+}
+
+void TestTurtle::test_motion_batch()
+{
+    // Long enough to be expanded on several threads
+    MotionBatch batch;
+    batch.add_pop(); // nothing saved yet
+    for (int i = 0; i < 400; ++i) {
+        if (i % 3 == 0) {
+            batch.add_push();
+        }
+        batch.add_forward(20.f + i % 7);
+        batch.add_turn(i % 3 ? 29.f : -410.f);
+        batch.add_arc(15.f + i % 5, i % 2 ? 75.f : -140.f);
+        batch.add_arc(0.f, 90.f); // does not move
+        if (i % 3 == 2) {
+            batch.add_pop(); // branches back without drawing
+        }
+    }
+
+    {
+        TurtleControl batched;
+        TurtleControl reference;
+        for (TurtleControl *turtle : {&batched, &reference}) {
+            turtle->set_realtime(false);
+            turtle->set_speed(50.f);
+            turtle->set_position(QPointF(100, 100)); // the first line starts at the old position
+        }
+
+        QSignalSpy spy(&batched, &TurtleControl::on_movement_completed);
+        batched.run_motion_batch(batch);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.takeFirst().at(0).value<MovementResult>(), MovementResult::kSuccess);
+        QVERIFY(batched.line_count() > 16384);
+
+        run_one_by_one(reference, batch);
+        compare_turtles(batched, reference);
+    }
+
+    {
+        // An obstacle on the path: the movements are simulated and some are blocked
+        Canvas canvas;
+        canvas.set_width(2000.0);
+        canvas.set_height(2000.0);
+        canvas.generate_obstacles(1, QPointF(1000, 1000));
+        canvas.get_obstacles()[0]->set_position(QPointF(450, 380));
+
+        MotionBatch short_batch;
+        short_batch.add_forward(150.f);
+        short_batch.add_turn(90.f);
+        short_batch.add_forward(60.f);
+        short_batch.add_arc(40.f, 180.f);
+
+        TurtleControl batched;
+        TurtleControl reference;
+        for (TurtleControl *turtle : {&batched, &reference}) {
+            turtle->set_realtime(false);
+            turtle->set_speed(1000.f);
+            turtle->set_canvas(&canvas);
+        }
+
+        QSignalSpy spy(&batched, &TurtleControl::on_movement_completed);
+        QSignalSpy reference_spy(&reference, &TurtleControl::on_movement_completed);
+        batched.run_motion_batch(short_batch);
+        run_one_by_one(reference, short_batch);
+        QCOMPARE(spy.count(), 1);
+        QCOMPARE(spy.takeFirst().at(0).value<MovementResult>(), MovementResult::kBlocked);
+        QCOMPARE(reference_spy.first().at(0).value<MovementResult>(), MovementResult::kBlocked);
+        compare_turtles(batched, reference);
+        QVERIFY(!batched.is_moving());
+    }
+}
+
+void TestTurtle::test_moving_obstacles()
+{
+    Canvas canvas;
+    canvas.set_width(1000.0);
+    canvas.set_height(1000.0);
+    canvas.add_obstacles({new Obstacle(QPolygonF(QRectF(500, 100, 20, 20)), Qt::red)});
+    Obstacle *obstacle = canvas.get_obstacles()[0];
+    TurtleControl turtle;
+    turtle.set_realtime(false);
+    turtle.set_canvas(&canvas);
+    turtle.set_speed(1000.f);
+    turtle.set_position(QPointF(100, 500));
+    obstacle->set_velocity(QPointF(60, 0));
+
+    // Every step of the turtle advances the obstacles by the same time step
+    QSignalSpy spy(&turtle, &TurtleControl::on_movement_completed);
+    const quint64 steps_before = turtle.get_simulation_steps();
+    turtle.forward(100.f);
+    QCOMPARE(spy.count(), 1);
+    quint64 steps = turtle.get_simulation_steps() - steps_before;
+    QVERIFY(steps > 0);
+    QVERIFY(qAbs(obstacle->get_bounds().left() - (500.0 + steps * turtle.get_time_step() * 0.06)) < 1e-3);
+
+    // Batches are not expanded at once while obstacles move
+    MotionBatch batch;
+    batch.add_turn(90.f);
+    batch.add_forward(100.f);
+    batch.add_turn(-90.f);
+    batch.add_forward(100.f);
+    turtle.run_motion_batch(batch);
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(spy.last().at(0).value<MovementResult>(), MovementResult::kSuccess);
+    steps = turtle.get_simulation_steps() - steps_before;
+    QVERIFY(qAbs(obstacle->get_bounds().left() - (500.0 + steps * turtle.get_time_step() * 0.06)) < 1e-3);
+
+    // A second turtle on the canvas leaves the obstacles to the clock of the first
+    TurtleControl other;
+    other.set_realtime(false);
+    other.set_canvas(&canvas);
+    other.set_speed(1000.f);
+    other.set_position(QPointF(100, 800));
+    const QRectF moving = obstacle->get_bounds();
+    other.forward(100.f);
+    QVERIFY(other.get_simulation_steps() > 0);
+    QCOMPARE(obstacle->get_bounds(), moving);
+    QVERIFY(canvas.owns_clock(&turtle));
+    QVERIFY(!canvas.owns_clock(&other));
+
+    // The obstacles stop with the turtle when they stop moving
+    obstacle->set_velocity(QPointF());
+    const QRectF stopped = obstacle->get_bounds();
+    turtle.forward(100.f);
+    QCOMPARE(obstacle->get_bounds(), stopped);
+}
+
 QTEST_MAIN(TestTurtle)
 
 #include "tst_testturtle.moc"